@@ -50,7 +50,7 @@ extern "C"
 // #define AES_128     /* define if AES with 128 bit keys is needed    */
 // #define AES_192     /* define if AES with 192 bit keys is needed    */
 #define AES_256     /* define if AES with 256 bit keys is needed    */
-// #define AES_VAR     /* define if a variable key size is needed      */
+#define AES_VAR     /* define if a variable key size is needed      */
 // #define AES_MODES   /* define if support is needed for modes        */
 
 /* The following must also be set in assembler files if being used  */
@@ -81,12 +81,23 @@ extern "C"
 #define AES_RETURN     VOID_RETURN
 #endif
 
+/* the character array 'inf' in the following structures is used    */
+/* to hold AES context information. This AES code uses cx->inf.b[0]  */
+/* to hold the number of rounds multiplied by 16.                    */
+
+typedef union
+{   uint_32t l;
+    uint_8t b[4];
+} aes_inf;
+
 typedef struct
 {   uint_32t ks[KS_LENGTH];
+    aes_inf inf;
 } aes_encrypt_ctx;
 
 typedef struct 
 {   uint_32t ks[KS_LENGTH];
+    aes_inf inf;
 } aes_decrypt_ctx;
 
 /* This routine must be called before first use if non-static       */
@@ -15,6 +15,8 @@
 #include "cpu.h"
 #include "misc.h"
 #include "Aes_Botan_aesni.h"
+#include "Aes_gcm_clmul.h"
+#include "Aes_lanes.h"
 
 #if BYTE_ORDER == BIG_ENDIAN
 
@@ -34,6 +36,16 @@
 
 #endif
 
+/*
+* inf.b[1] of a decryption context whose ks still holds the encryption
+* schedule, see aes_botan_aesni_set_decrypt_key
+*/
+#define AES_DK_PENDING 1
+
+#define AES_DK_PREPARE(ctx) \
+	if ((ctx)->inf.b[1] == AES_DK_PENDING) \
+		aes_botan_aesni_prepare_decrypt_key (ctx)
+
 static __m128i aes_128_key_expansion(__m128i key, __m128i key_with_rcon)
    {
    key_with_rcon = _mm_shuffle_epi32(key_with_rcon, _MM_SHUFFLE(3,3,3,3));
@@ -43,6 +55,35 @@ static __m128i aes_128_key_expansion(__m128i key, __m128i key_with_rcon)
    return _mm_xor_si128(key, key_with_rcon);
    }
 
+/*
+* AES-192 key expansion step: produces 6 words of key schedule in "out"
+*/
+static void aes_192_key_expansion(__m128i* K1, __m128i* K2, __m128i key2_with_rcon,
+                                  uint_32t out[], int last)
+   {
+   __m128i key1 = *K1;
+   __m128i key2 = *K2;
+
+   key2_with_rcon  = _mm_shuffle_epi32(key2_with_rcon, _MM_SHUFFLE(1,1,1,1));
+   key1 = _mm_xor_si128(key1, _mm_slli_si128(key1, 4));
+   key1 = _mm_xor_si128(key1, _mm_slli_si128(key1, 4));
+   key1 = _mm_xor_si128(key1, _mm_slli_si128(key1, 4));
+   key1 = _mm_xor_si128(key1, key2_with_rcon);
+
+   *K1 = key1;
+   _mm_storeu_si128((__m128i*)(out), key1);
+
+   if(last)
+      return;
+
+   key2 = _mm_xor_si128(key2, _mm_slli_si128(key2, 4));
+   key2 = _mm_xor_si128(key2, _mm_shuffle_epi32(key1, _MM_SHUFFLE(3,3,3,3)));
+
+   *K2 = key2;
+   out[4] = _mm_cvtsi128_si32(key2);
+   out[5] = _mm_cvtsi128_si32(_mm_srli_si128(key2, 4));
+   }
+
 /*
 * The second half of the AES-256 key expansion (other half same as AES-128)
 */
@@ -59,539 +100,152 @@ static __m128i aes_256_key_expansion(__m128i key, __m128i key2)
 
 
 
-#define AES_ENC_15_ROUNDS(i)                     \
-   do                                           \
-      {  \
-		K  = _mm_loadu_si128(key_mm + i); \
-		B0 = _mm_aesenc_si128(B0, K); \
-		B1 = _mm_aesenc_si128(B1, K); \
-		B2 = _mm_aesenc_si128(B2, K); \
-		B3 = _mm_aesenc_si128(B3, K); \
-		B4 = _mm_aesenc_si128(B4, K); \
-		B5 = _mm_aesenc_si128(B5, K); \
-		B6 = _mm_aesenc_si128(B6, K); \
-		B7 = _mm_aesenc_si128(B7, K); \
-		B8 = _mm_aesenc_si128(B8, K); \
-		B9 = _mm_aesenc_si128(B9, K); \
-		B10 = _mm_aesenc_si128(B10, K); \
-		B11 = _mm_aesenc_si128(B11, K); \
-		B12 = _mm_aesenc_si128(B12, K); \
-		B13 = _mm_aesenc_si128(B13, K); \
-		B14 = _mm_aesenc_si128(B14, K); \
-      } while(0)
-
-#define AES_ENC_15_LAST_ROUNDS            \
-   do                                           \
-      { \
-		K  = _mm_loadu_si128(key_mm + 14); \
-		B0 = _mm_aesenclast_si128(B0, K); \
-		B1 = _mm_aesenclast_si128(B1, K); \
-		B2 = _mm_aesenclast_si128(B2, K); \
-		B3 = _mm_aesenclast_si128(B3, K); \
-		B4 = _mm_aesenclast_si128(B4, K); \
-		B5 = _mm_aesenclast_si128(B5, K); \
-		B6 = _mm_aesenclast_si128(B6, K); \
-		B7 = _mm_aesenclast_si128(B7, K); \
-		B8 = _mm_aesenclast_si128(B8, K); \
-		B9 = _mm_aesenclast_si128(B9, K); \
-		B10 = _mm_aesenclast_si128(B10, K); \
-		B11 = _mm_aesenclast_si128(B11, K); \
-		B12 = _mm_aesenclast_si128(B12, K); \
-		B13 = _mm_aesenclast_si128(B13, K); \
-		B14 = _mm_aesenclast_si128(B14, K); \
-      } while(0)
-
-#define AES_ENC_7_ROUNDS(i)                     \
-   do                                           \
-      {  \
-		K  = _mm_loadu_si128(key_mm + i); \
-		B0 = _mm_aesenc_si128(B0, K); \
-		B1 = _mm_aesenc_si128(B1, K); \
-		B2 = _mm_aesenc_si128(B2, K); \
-		B3 = _mm_aesenc_si128(B3, K); \
-		B4 = _mm_aesenc_si128(B4, K); \
-		B5 = _mm_aesenc_si128(B5, K); \
-		B6 = _mm_aesenc_si128(B6, K); \
-      } while(0)
-
-#define AES_ENC_7_LAST_ROUNDS            \
-   do                                           \
-      { \
-		K  = _mm_loadu_si128(key_mm + 14); \
-		B0 = _mm_aesenclast_si128(B0, K); \
-		B1 = _mm_aesenclast_si128(B1, K); \
-		B2 = _mm_aesenclast_si128(B2, K); \
-		B3 = _mm_aesenclast_si128(B3, K); \
-		B4 = _mm_aesenclast_si128(B4, K); \
-		B5 = _mm_aesenclast_si128(B5, K); \
-		B6 = _mm_aesenclast_si128(B6, K); \
-      } while(0)
-
-#define AES_ENC_4_ROUNDS(i)                     \
-   do                                           \
-      {  \
-		K  = _mm_loadu_si128(key_mm + i); \
-		B0 = _mm_aesenc_si128(B0, K); \
-		B1 = _mm_aesenc_si128(B1, K); \
-		B2 = _mm_aesenc_si128(B2, K); \
-		B3 = _mm_aesenc_si128(B3, K); \
-      } while(0)
-
-#define AES_ENC_4_LAST_ROUNDS                \
-   do                                           \
-      {                                         \
-	  K  = _mm_loadu_si128(key_mm + 14); \
-      B0 = _mm_aesenclast_si128(B0, K);         \
-      B1 = _mm_aesenclast_si128(B1, K);         \
-      B2 = _mm_aesenclast_si128(B2, K);         \
-      B3 = _mm_aesenclast_si128(B3, K);         \
-      } while(0)
-
-#define AES_ENC_3_ROUNDS(i)                     \
-   do                                           \
-      {  \
-		K  = _mm_loadu_si128(key_mm + i); \
-		B0 = _mm_aesenc_si128(B0, K); \
-		B1 = _mm_aesenc_si128(B1, K); \
-		B2 = _mm_aesenc_si128(B2, K); \
-      } while(0)
-
-#define AES_ENC_3_LAST_ROUNDS                \
-   do                                           \
-      {                                         \
-	  K  = _mm_loadu_si128(key_mm + 14); \
-      B0 = _mm_aesenclast_si128(B0, K);         \
-      B1 = _mm_aesenclast_si128(B1, K);         \
-      B2 = _mm_aesenclast_si128(B2, K);         \
-      } while(0)
-
-#define AES_ENC_2_ROUNDS(i)                     \
-   do                                           \
-      {  \
-		K  = _mm_loadu_si128(key_mm + i); \
-		B0 = _mm_aesenc_si128(B0, K); \
-		B1 = _mm_aesenc_si128(B1, K); \
-      } while(0)
+#define AES_LANE_LOAD(j)		__m128i B##j = _mm_loadu_si128((const __m128i*)(in) + j);
+#define AES_LANE_STORE(j)		_mm_storeu_si128((__m128i*)(out) + j, B##j);
+#define AES_LANE_STREAM(j)		_mm_stream_si128((__m128i*)(out) + j, B##j);
+#define AES_LANE_XOR(j)			B##j = _mm_xor_si128(B##j, K);
+#define AES_LANE_ENC(j)			B##j = _mm_aesenc_si128(B##j, K);
+#define AES_LANE_ENCLAST(j)		B##j = _mm_aesenclast_si128(B##j, K);
+#define AES_LANE_DEC(j)			B##j = _mm_aesdec_si128(B##j, K);
+#define AES_LANE_DECLAST(j)		B##j = _mm_aesdeclast_si128(B##j, K);
 
-#define AES_ENC_2_LAST_ROUNDS                \
-   do                                           \
-      {                                         \
-	  K  = _mm_loadu_si128(key_mm + 14); \
-      B0 = _mm_aesenclast_si128(B0, K);         \
-      B1 = _mm_aesenclast_si128(B1, K);         \
-      } while(0)
+/* round key i of the schedule at key_mm */
+#define AES_ROUND_KEY(i)		_mm_loadu_si128(key_mm + (i))
 
-#define AES_DEC_15_ROUNDS(i)                     \
-   do                                           \
-      {  \
-		K  = _mm_loadu_si128(key_mm + i); \
-		B0 = _mm_aesdec_si128(B0, K); \
-		B1 = _mm_aesdec_si128(B1, K); \
-		B2 = _mm_aesdec_si128(B2, K); \
-		B3 = _mm_aesdec_si128(B3, K); \
-		B4 = _mm_aesdec_si128(B4, K); \
-		B5 = _mm_aesdec_si128(B5, K); \
-		B6 = _mm_aesdec_si128(B6, K); \
-		B7 = _mm_aesdec_si128(B7, K); \
-		B8 = _mm_aesdec_si128(B8, K); \
-		B9 = _mm_aesdec_si128(B9, K); \
-		B10 = _mm_aesdec_si128(B10, K); \
-		B11 = _mm_aesdec_si128(B11, K); \
-		B12 = _mm_aesdec_si128(B12, K); \
-		B13 = _mm_aesdec_si128(B13, K); \
-		B14 = _mm_aesdec_si128(B14, K); \
-      } while(0)
+/* round i, or the last round, of lanes B0 .. Bn-1 */
+#define AES_N_ROUND(n, i, OP)	AES_N_ROUND_K(n, AES_ROUND_KEY(i), OP)
 
-#define AES_DEC_15_LAST_ROUNDS            \
-   do                                           \
-      { \
-		K  = _mm_loadu_si128(key_mm + 14); \
-		B0 = _mm_aesdeclast_si128(B0, K); \
-		B1 = _mm_aesdeclast_si128(B1, K); \
-		B2 = _mm_aesdeclast_si128(B2, K); \
-		B3 = _mm_aesdeclast_si128(B3, K); \
-		B4 = _mm_aesdeclast_si128(B4, K); \
-		B5 = _mm_aesdeclast_si128(B5, K); \
-		B6 = _mm_aesdeclast_si128(B6, K); \
-		B7 = _mm_aesdeclast_si128(B7, K); \
-		B8 = _mm_aesdeclast_si128(B8, K); \
-		B9 = _mm_aesdeclast_si128(B9, K); \
-		B10 = _mm_aesdeclast_si128(B10, K); \
-		B11 = _mm_aesdeclast_si128(B11, K); \
-		B12 = _mm_aesdeclast_si128(B12, K); \
-		B13 = _mm_aesdeclast_si128(B13, K); \
-		B14 = _mm_aesdeclast_si128(B14, K); \
-      } while(0)
+/* all the rounds of lanes B0 .. Bn-1, round key 0 included */
+#define AES_N_ALL_ROUNDS(n, OP, LASTOP) \
+	AES_N_ALL_ROUNDS_K(n, AES_ROUND_KEY, AES_ROUND_KEY(rounds), AES_LANE_XOR, OP, LASTOP)
 
-#define AES_DEC_7_ROUNDS(i)                     \
-   do                                           \
-      {  \
-		K  = _mm_loadu_si128(key_mm + i); \
-		B0 = _mm_aesdec_si128(B0, K); \
-		B1 = _mm_aesdec_si128(B1, K); \
-		B2 = _mm_aesdec_si128(B2, K); \
-		B3 = _mm_aesdec_si128(B3, K); \
-		B4 = _mm_aesdec_si128(B4, K); \
-		B5 = _mm_aesdec_si128(B5, K); \
-		B6 = _mm_aesdec_si128(B6, K); \
-      } while(0)
+/*
+* n blocks from in to out, fully unrolled: aes_botan_aesni_encrypt_<n>way and
+* aes_botan_aesni_decrypt_<n>way
+*/
+#define AES_N_WAY_KERNELS(n) \
+VC_INLINE void aes_botan_aesni_encrypt_##n##way(const __m128i* key_mm, const byte* in, byte* out, const int rounds) \
+{ \
+	AES_LANES_##n(AES_LANE_LOAD) \
+	__m128i K; \
+	AES_N_ALL_ROUNDS(n, AES_LANE_ENC, AES_LANE_ENCLAST); \
+	AES_LANES_##n(AES_LANE_STORE) \
+} \
+VC_INLINE void aes_botan_aesni_decrypt_##n##way(const __m128i* key_mm, const byte* in, byte* out, const int rounds) \
+{ \
+	AES_LANES_##n(AES_LANE_LOAD) \
+	__m128i K; \
+	AES_N_ALL_ROUNDS(n, AES_LANE_DEC, AES_LANE_DECLAST); \
+	AES_LANES_##n(AES_LANE_STORE) \
+}
 
-#define AES_DEC_7_LAST_ROUNDS            \
-   do                                           \
-      { \
-		K  = _mm_loadu_si128(key_mm + 14); \
-		B0 = _mm_aesdeclast_si128(B0, K); \
-		B1 = _mm_aesdeclast_si128(B1, K); \
-		B2 = _mm_aesdeclast_si128(B2, K); \
-		B3 = _mm_aesdeclast_si128(B3, K); \
-		B4 = _mm_aesdeclast_si128(B4, K); \
-		B5 = _mm_aesdeclast_si128(B5, K); \
-		B6 = _mm_aesdeclast_si128(B6, K); \
-      } while(0)
+AES_WIDTHS(AES_N_WAY_KERNELS)
 
-#define AES_DEC_4_ROUNDS(i)                     \
-   do                                           \
-      {  \
-		K  = _mm_loadu_si128(key_mm + i); \
-		B0 = _mm_aesdec_si128(B0, K); \
-		B1 = _mm_aesdec_si128(B1, K); \
-		B2 = _mm_aesdec_si128(B2, K); \
-		B3 = _mm_aesdec_si128(B3, K); \
-      } while(0)
+/*
+* AES Encryption: 4 blocks at a time, the 1 to 3 left in a single pass of
+* the kernel of their width
+*/
+VC_INLINE void aes_botan_aesni_encrypt_4x_nr(const __m128i* key_mm, const byte* in, byte* out, uint_32t blocks, const int rounds)
+{
+	while (blocks >= 4)
+	{
+		aes_botan_aesni_encrypt_4way (key_mm, in, out, rounds);
+		blocks -= 4;
+		in += 4 * 16;
+		out += 4 * 16;
+	}
 
-#define AES_DEC_4_LAST_ROUNDS            \
-   do                                           \
-      { \
-		K  = _mm_loadu_si128(key_mm + 14); \
-		B0 = _mm_aesdeclast_si128(B0, K); \
-		B1 = _mm_aesdeclast_si128(B1, K); \
-		B2 = _mm_aesdeclast_si128(B2, K); \
-		B3 = _mm_aesdeclast_si128(B3, K); \
-      } while(0)
+	switch (blocks)
+	{
+	case 3: aes_botan_aesni_encrypt_3way (key_mm, in, out, rounds); break;
+	case 2: aes_botan_aesni_encrypt_2way (key_mm, in, out, rounds); break;
+	case 1: aes_botan_aesni_encrypt_1way (key_mm, in, out, rounds); break;
+	}
+}
 
-#define AES_DEC_3_ROUNDS(i)                     \
-   do                                           \
-      {  \
-		K  = _mm_loadu_si128(key_mm + i); \
-		B0 = _mm_aesdec_si128(B0, K); \
-		B1 = _mm_aesdec_si128(B1, K); \
-		B2 = _mm_aesdec_si128(B2, K); \
-      } while(0)
+VC_INLINE void aes_botan_aesni_encrypt_15x_nr(const __m128i* key_mm, const byte* in, byte* out, uint_32t blocks, const int rounds)
+{
+#if CRYPTOPP_BOOL_X64
+	while (blocks >= 15)
+	{
+		aes_botan_aesni_encrypt_15way (key_mm, in, out, rounds);
+		blocks -= 15;
+		in += 15 * 16;
+		out += 15 * 16;
+	}
+#endif
+	while (blocks >= 7)
+	{
+		aes_botan_aesni_encrypt_7way (key_mm, in, out, rounds);
+		blocks -= 7;
+		in += 7 * 16;
+		out += 7 * 16;
+	}
 
-#define AES_DEC_3_LAST_ROUNDS            \
-   do                                           \
-      { \
-		K  = _mm_loadu_si128(key_mm + 14); \
-		B0 = _mm_aesdeclast_si128(B0, K); \
-		B1 = _mm_aesdeclast_si128(B1, K); \
-		B2 = _mm_aesdeclast_si128(B2, K); \
-      } while(0)
+	aes_botan_aesni_encrypt_4x_nr (key_mm, in, out, blocks, rounds);
+}
 
-#define AES_DEC_2_ROUNDS(i)                     \
-   do                                           \
-      {  \
-		K  = _mm_loadu_si128(key_mm + i); \
-		B0 = _mm_aesdec_si128(B0, K); \
-		B1 = _mm_aesdec_si128(B1, K); \
-      } while(0)
+VC_INLINE void aes_botan_aesni_encrypt_7x_nr(const __m128i* key_mm, const byte* in, byte* out, uint_32t blocks, const int rounds)
+{
+	while (blocks >= 7)
+	{
+		aes_botan_aesni_encrypt_7way (key_mm, in, out, rounds);
+		blocks -= 7;
+		in += 7 * 16;
+		out += 7 * 16;
+	}
 
-#define AES_DEC_2_LAST_ROUNDS            \
-   do                                           \
-      { \
-		K  = _mm_loadu_si128(key_mm + 14); \
-		B0 = _mm_aesdeclast_si128(B0, K); \
-		B1 = _mm_aesdeclast_si128(B1, K); \
-      } while(0)
+	aes_botan_aesni_encrypt_4x_nr (key_mm, in, out, blocks, rounds);
+}
 
-/*
-* AES-256 Encryption
-*/
 void aes_botan_aesni_encrypt_4x(aes_encrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks)
-   {
-   const __m128i* in_mm = (const __m128i*)(in);
-   __m128i* out_mm = (__m128i*)(out);
-
-   const __m128i* key_mm = (const __m128i*)(ctx->ks);
-
-   while(blocks >= 4)
-      {
-    __m128i B0 = _mm_loadu_si128(in_mm + 0);
-    __m128i B1 = _mm_loadu_si128(in_mm + 1);
-    __m128i B2 = _mm_loadu_si128(in_mm + 2);
-    __m128i B3 = _mm_loadu_si128(in_mm + 3);
-
-	// round-0
-	__m128i K  = _mm_loadu_si128(key_mm);
-
-	B0 = _mm_xor_si128(B0, K);
-	B1 = _mm_xor_si128(B1, K);
-	B2 = _mm_xor_si128(B2, K);
-	B3 = _mm_xor_si128(B3, K);
-
-	// round
-	AES_ENC_4_ROUNDS (1);
-	AES_ENC_4_ROUNDS (2);
-	AES_ENC_4_ROUNDS (3);
-	AES_ENC_4_ROUNDS (4);
-	AES_ENC_4_ROUNDS (5);
-	AES_ENC_4_ROUNDS (6);
-	AES_ENC_4_ROUNDS (7);
-	AES_ENC_4_ROUNDS (8);
-	AES_ENC_4_ROUNDS (9);
-	AES_ENC_4_ROUNDS (10);
-	AES_ENC_4_ROUNDS (11);
-	AES_ENC_4_ROUNDS (12);
-	AES_ENC_4_ROUNDS (13);
-
-	AES_ENC_4_LAST_ROUNDS;
-
-	_mm_storeu_si128(out_mm + 0, B0);
-	_mm_storeu_si128(out_mm + 1, B1);
-	_mm_storeu_si128(out_mm + 2, B2);
-	_mm_storeu_si128(out_mm + 3, B3);
-
-      blocks -= 4;
-      in_mm += 4;
-      out_mm += 4;
-      }
+{
+	const __m128i* key_mm = (const __m128i*)(ctx->ks);
 
-   if (blocks == 3)
-      {
-    __m128i B0 = _mm_loadu_si128(in_mm + 0);
-    __m128i B1 = _mm_loadu_si128(in_mm + 1);
-    __m128i B2 = _mm_loadu_si128(in_mm + 2);
+	AES_NR_DISPATCH (ctx, aes_botan_aesni_encrypt_4x_nr (key_mm, in, out, blocks, rounds));
+}
 
-	// round-0
-	__m128i K  = _mm_loadu_si128(key_mm);
-
-	B0 = _mm_xor_si128(B0, K);
-	B1 = _mm_xor_si128(B1, K);
-	B2 = _mm_xor_si128(B2, K);
-
-	// round
-	AES_ENC_3_ROUNDS (1);
-	AES_ENC_3_ROUNDS (2);
-	AES_ENC_3_ROUNDS (3);
-	AES_ENC_3_ROUNDS (4);
-	AES_ENC_3_ROUNDS (5);
-	AES_ENC_3_ROUNDS (6);
-	AES_ENC_3_ROUNDS (7);
-	AES_ENC_3_ROUNDS (8);
-	AES_ENC_3_ROUNDS (9);
-	AES_ENC_3_ROUNDS (10);
-	AES_ENC_3_ROUNDS (11);
-	AES_ENC_3_ROUNDS (12);
-	AES_ENC_3_ROUNDS (13);
-
-	AES_ENC_3_LAST_ROUNDS;
-
-	_mm_storeu_si128(out_mm + 0, B0);
-	_mm_storeu_si128(out_mm + 1, B1);
-	_mm_storeu_si128(out_mm + 2, B2);
-	}
-   else if (blocks == 2)
-      {
-    __m128i B0 = _mm_loadu_si128(in_mm + 0);
-    __m128i B1 = _mm_loadu_si128(in_mm + 1);
+void aes_botan_aesni_encrypt_7x(aes_encrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks)
+{
+	const __m128i* key_mm = (const __m128i*)(ctx->ks);
 
-	// round-0
-	__m128i K  = _mm_loadu_si128(key_mm);
-
-	B0 = _mm_xor_si128(B0, K);
-	B1 = _mm_xor_si128(B1, K);
-
-	// round
-	AES_ENC_2_ROUNDS (1);
-	AES_ENC_2_ROUNDS (2);
-	AES_ENC_2_ROUNDS (3);
-	AES_ENC_2_ROUNDS (4);
-	AES_ENC_2_ROUNDS (5);
-	AES_ENC_2_ROUNDS (6);
-	AES_ENC_2_ROUNDS (7);
-	AES_ENC_2_ROUNDS (8);
-	AES_ENC_2_ROUNDS (9);
-	AES_ENC_2_ROUNDS (10);
-	AES_ENC_2_ROUNDS (11);
-	AES_ENC_2_ROUNDS (12);
-	AES_ENC_2_ROUNDS (13);
-
-	AES_ENC_2_LAST_ROUNDS;
-
-	_mm_storeu_si128(out_mm + 0, B0);
-	_mm_storeu_si128(out_mm + 1, B1);
-	}
-   else if (blocks == 1)
-      {
-      __m128i B = _mm_loadu_si128(in_mm);
-	  __m128i K  = _mm_loadu_si128(key_mm);
-
-      B = _mm_xor_si128(B, K);
-
-	  K  = _mm_loadu_si128(key_mm + 1);
-      B = _mm_aesenc_si128(B, K);
-	  K  = _mm_loadu_si128(key_mm + 2);
-      B = _mm_aesenc_si128(B, K);
-	  K  = _mm_loadu_si128(key_mm + 3);
-      B = _mm_aesenc_si128(B, K);
-	  K  = _mm_loadu_si128(key_mm + 4);
-      B = _mm_aesenc_si128(B, K);
-	  K  = _mm_loadu_si128(key_mm + 5);
-      B = _mm_aesenc_si128(B, K);
-	  K  = _mm_loadu_si128(key_mm + 6);
-      B = _mm_aesenc_si128(B, K);
-	  K  = _mm_loadu_si128(key_mm + 7);
-      B = _mm_aesenc_si128(B, K);
-	  K  = _mm_loadu_si128(key_mm + 8);
-      B = _mm_aesenc_si128(B, K);
-	  K  = _mm_loadu_si128(key_mm + 9);
-      B = _mm_aesenc_si128(B, K);
-	  K  = _mm_loadu_si128(key_mm + 10);
-      B = _mm_aesenc_si128(B, K);
-	  K  = _mm_loadu_si128(key_mm + 11);
-      B = _mm_aesenc_si128(B, K);
-	  K  = _mm_loadu_si128(key_mm + 12);
-      B = _mm_aesenc_si128(B, K);
-	  K  = _mm_loadu_si128(key_mm + 13);
-      B = _mm_aesenc_si128(B, K);
-	  K  = _mm_loadu_si128(key_mm + 14);
-      B = _mm_aesenclast_si128(B, K);
-
-      _mm_storeu_si128(out_mm, B);
-      }
-   }
+	AES_NR_DISPATCH (ctx, aes_botan_aesni_encrypt_7x_nr (key_mm, in, out, blocks, rounds));
+}
 
-#if CRYPTOPP_BOOL_X64
-void aes_botan_aesni_encrypt_15way(aes_encrypt_ctx *ctx, const byte* in, byte* out)
-{
-	const __m128i* in_mm = (const __m128i*)(in);
-	const __m128i* key_mm = (const __m128i*)(ctx->ks);	
-
-    __m128i B0 = _mm_loadu_si128(in_mm + 0);
-    __m128i B1 = _mm_loadu_si128(in_mm + 1);
-    __m128i B2 = _mm_loadu_si128(in_mm + 2);
-    __m128i B3 = _mm_loadu_si128(in_mm + 3);
-    __m128i B4 = _mm_loadu_si128(in_mm + 4);
-    __m128i B5 = _mm_loadu_si128(in_mm + 5);
-    __m128i B6 = _mm_loadu_si128(in_mm + 6);
-    __m128i B7 = _mm_loadu_si128(in_mm + 7);
-    __m128i B8 = _mm_loadu_si128(in_mm + 8);
-    __m128i B9 = _mm_loadu_si128(in_mm + 9);
-    __m128i B10 = _mm_loadu_si128(in_mm + 10);
-    __m128i B11 = _mm_loadu_si128(in_mm + 11);
-    __m128i B12 = _mm_loadu_si128(in_mm + 12);
-    __m128i B13 = _mm_loadu_si128(in_mm + 13);
-    __m128i B14 = _mm_loadu_si128(in_mm + 14);
+void aes_botan_aesni_encrypt_15x(aes_encrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks)
+{
+	const __m128i* key_mm = (const __m128i*)(ctx->ks);
 
-	// round-0
-	__m128i K  = _mm_loadu_si128(key_mm);
-
-	B0 = _mm_xor_si128(B0, K);
-	B1 = _mm_xor_si128(B1, K);
-	B2 = _mm_xor_si128(B2, K);
-	B3 = _mm_xor_si128(B3, K);
-	B4 = _mm_xor_si128(B4, K);
-	B5 = _mm_xor_si128(B5, K);
-	B6 = _mm_xor_si128(B6, K);
-	B7 = _mm_xor_si128(B7, K);
-	B8 = _mm_xor_si128(B8, K);
-	B9 = _mm_xor_si128(B9, K);
-	B10 = _mm_xor_si128(B10, K);
-	B11 = _mm_xor_si128(B11, K);
-	B12 = _mm_xor_si128(B12, K);
-	B13 = _mm_xor_si128(B13, K);
-	B14 = _mm_xor_si128(B14, K);
-
-	// round
-	AES_ENC_15_ROUNDS (1);
-	AES_ENC_15_ROUNDS (2);
-	AES_ENC_15_ROUNDS (3);
-	AES_ENC_15_ROUNDS (4);
-	AES_ENC_15_ROUNDS (5);
-	AES_ENC_15_ROUNDS (6);
-	AES_ENC_15_ROUNDS (7);
-	AES_ENC_15_ROUNDS (8);
-	AES_ENC_15_ROUNDS (9);
-	AES_ENC_15_ROUNDS (10);
-	AES_ENC_15_ROUNDS (11);
-	AES_ENC_15_ROUNDS (12);
-	AES_ENC_15_ROUNDS (13);
-
-	AES_ENC_15_LAST_ROUNDS;
-
-	_mm_storeu_si128((__m128i*)(out) + 0, B0);
-	_mm_storeu_si128((__m128i*)(out) + 1, B1);
-	_mm_storeu_si128((__m128i*)(out) + 2, B2);
-	_mm_storeu_si128((__m128i*)(out) + 3, B3);
-	_mm_storeu_si128((__m128i*)(out) + 4, B4);
-	_mm_storeu_si128((__m128i*)(out) + 5, B5);
-	_mm_storeu_si128((__m128i*)(out) + 6, B6);
-	_mm_storeu_si128((__m128i*)(out) + 7, B7);
-	_mm_storeu_si128((__m128i*)(out) + 8, B8);
-	_mm_storeu_si128((__m128i*)(out) + 9, B9);
-	_mm_storeu_si128((__m128i*)(out) + 10, B10);
-	_mm_storeu_si128((__m128i*)(out) + 11, B11);
-	_mm_storeu_si128((__m128i*)(out) + 12, B12);
-	_mm_storeu_si128((__m128i*)(out) + 13, B13);
-	_mm_storeu_si128((__m128i*)(out) + 14, B14);
+	AES_NR_DISPATCH (ctx, aes_botan_aesni_encrypt_15x_nr (key_mm, in, out, blocks, rounds));
 }
-#endif
 
-void aes_botan_aesni_encrypt_7way(aes_encrypt_ctx *ctx, const byte* in, byte* out)
+/*
+* AES Decryption
+*/
+VC_INLINE void aes_botan_aesni_decrypt_4x_nr(const __m128i* key_mm, const byte* in, byte* out, uint_32t blocks, const int rounds)
 {
-	const __m128i* in_mm = (const __m128i*)(in);
-	const __m128i* key_mm = (const __m128i*)(ctx->ks);	
-
-    __m128i B0 = _mm_loadu_si128(in_mm + 0);
-    __m128i B1 = _mm_loadu_si128(in_mm + 1);
-    __m128i B2 = _mm_loadu_si128(in_mm + 2);
-    __m128i B3 = _mm_loadu_si128(in_mm + 3);
-    __m128i B4 = _mm_loadu_si128(in_mm + 4);
-    __m128i B5 = _mm_loadu_si128(in_mm + 5);
-    __m128i B6 = _mm_loadu_si128(in_mm + 6);
+	while (blocks >= 4)
+	{
+		aes_botan_aesni_decrypt_4way (key_mm, in, out, rounds);
+		blocks -= 4;
+		in += 4 * 16;
+		out += 4 * 16;
+	}
 
-	// round-0
-	__m128i K  = _mm_loadu_si128(key_mm);
-
-	B0 = _mm_xor_si128(B0, K);
-	B1 = _mm_xor_si128(B1, K);
-	B2 = _mm_xor_si128(B2, K);
-	B3 = _mm_xor_si128(B3, K);
-	B4 = _mm_xor_si128(B4, K);
-	B5 = _mm_xor_si128(B5, K);
-	B6 = _mm_xor_si128(B6, K);
-
-	// round
-	AES_ENC_7_ROUNDS (1);
-	AES_ENC_7_ROUNDS (2);
-	AES_ENC_7_ROUNDS (3);
-	AES_ENC_7_ROUNDS (4);
-	AES_ENC_7_ROUNDS (5);
-	AES_ENC_7_ROUNDS (6);
-	AES_ENC_7_ROUNDS (7);
-	AES_ENC_7_ROUNDS (8);
-	AES_ENC_7_ROUNDS (9);
-	AES_ENC_7_ROUNDS (10);
-	AES_ENC_7_ROUNDS (11);
-	AES_ENC_7_ROUNDS (12);
-	AES_ENC_7_ROUNDS (13);
-
-	AES_ENC_7_LAST_ROUNDS;
-
-	_mm_storeu_si128((__m128i*)(out) + 0, B0);
-	_mm_storeu_si128((__m128i*)(out) + 1, B1);
-	_mm_storeu_si128((__m128i*)(out) + 2, B2);
-	_mm_storeu_si128((__m128i*)(out) + 3, B3);
-	_mm_storeu_si128((__m128i*)(out) + 4, B4);
-	_mm_storeu_si128((__m128i*)(out) + 5, B5);
-	_mm_storeu_si128((__m128i*)(out) + 6, B6);
+	switch (blocks)
+	{
+	case 3: aes_botan_aesni_decrypt_3way (key_mm, in, out, rounds); break;
+	case 2: aes_botan_aesni_decrypt_2way (key_mm, in, out, rounds); break;
+	case 1: aes_botan_aesni_decrypt_1way (key_mm, in, out, rounds); break;
+	}
 }
 
-void aes_botan_aesni_encrypt_15x(aes_encrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks)
+VC_INLINE void aes_botan_aesni_decrypt_15x_nr(const __m128i* key_mm, const byte* in, byte* out, uint_32t blocks, const int rounds)
 {
 #if CRYPTOPP_BOOL_X64
 	while (blocks >= 15)
 	{
-		aes_botan_aesni_encrypt_15way (ctx, in, out);
+		aes_botan_aesni_decrypt_15way (key_mm, in, out, rounds);
 		blocks -= 15;
 		in += 15 * 16;
 		out += 15 * 16;
@@ -599,414 +253,2188 @@ void aes_botan_aesni_encrypt_15x(aes_encrypt_ctx *ctx, const byte* in, byte* out
 #endif
 	while (blocks >= 7)
 	{
-		aes_botan_aesni_encrypt_7way (ctx, in, out);
+		aes_botan_aesni_decrypt_7way (key_mm, in, out, rounds);
 		blocks -= 7;
 		in += 7 * 16;
 		out += 7 * 16;
 	}
 
-	aes_botan_aesni_encrypt_4x (ctx, in, out, blocks);
+	aes_botan_aesni_decrypt_4x_nr (key_mm, in, out, blocks, rounds);
 }
 
-void aes_botan_aesni_encrypt_7x(aes_encrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks)
+VC_INLINE void aes_botan_aesni_decrypt_7x_nr(const __m128i* key_mm, const byte* in, byte* out, uint_32t blocks, const int rounds)
 {
 	while (blocks >= 7)
 	{
-		aes_botan_aesni_encrypt_7way (ctx, in, out);
+		aes_botan_aesni_decrypt_7way (key_mm, in, out, rounds);
 		blocks -= 7;
 		in += 7 * 16;
 		out += 7 * 16;
 	}
 
-	aes_botan_aesni_encrypt_4x (ctx, in, out, blocks);
+	aes_botan_aesni_decrypt_4x_nr (key_mm, in, out, blocks, rounds);
 }
 
-/*
-* AES-256 Decryption
-*/
 void aes_botan_aesni_decrypt_4x(aes_decrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks)
-   {
-   const __m128i* in_mm = (const __m128i*)(in);
-   __m128i* out_mm = (__m128i*)(out);
+{
+	const __m128i* key_mm = (const __m128i*)(ctx->ks);
 
-   const __m128i* key_mm = (const __m128i*)(ctx->ks);
+	AES_DK_PREPARE (ctx);
+	AES_NR_DISPATCH (ctx, aes_botan_aesni_decrypt_4x_nr (key_mm, in, out, blocks, rounds));
+}
 
-   while(blocks >= 4)
-      {
-    __m128i B0 = _mm_loadu_si128(in_mm + 0);
-    __m128i B1 = _mm_loadu_si128(in_mm + 1);
-    __m128i B2 = _mm_loadu_si128(in_mm + 2);
-    __m128i B3 = _mm_loadu_si128(in_mm + 3);
+void aes_botan_aesni_decrypt_7x(aes_decrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks)
+{
+	const __m128i* key_mm = (const __m128i*)(ctx->ks);
 
-	// round-0
-	__m128i K  = _mm_loadu_si128(key_mm);
-
-	B0 = _mm_xor_si128(B0, K);
-	B1 = _mm_xor_si128(B1, K);
-	B2 = _mm_xor_si128(B2, K);
-	B3 = _mm_xor_si128(B3, K);
-
-	// round
-	AES_DEC_4_ROUNDS (1);
-	AES_DEC_4_ROUNDS (2);
-	AES_DEC_4_ROUNDS (3);
-	AES_DEC_4_ROUNDS (4);
-	AES_DEC_4_ROUNDS (5);
-	AES_DEC_4_ROUNDS (6);
-	AES_DEC_4_ROUNDS (7);
-	AES_DEC_4_ROUNDS (8);
-	AES_DEC_4_ROUNDS (9);
-	AES_DEC_4_ROUNDS (10);
-	AES_DEC_4_ROUNDS (11);
-	AES_DEC_4_ROUNDS (12);
-	AES_DEC_4_ROUNDS (13);
-
-	AES_DEC_4_LAST_ROUNDS;
-
-	_mm_storeu_si128(out_mm + 0, B0);
-	_mm_storeu_si128(out_mm + 1, B1);
-	_mm_storeu_si128(out_mm + 2, B2);
-	_mm_storeu_si128(out_mm + 3, B3);
-
-      blocks -= 4;
-      in_mm += 4;
-      out_mm += 4;
-      }
+	AES_DK_PREPARE (ctx);
+	AES_NR_DISPATCH (ctx, aes_botan_aesni_decrypt_7x_nr (key_mm, in, out, blocks, rounds));
+}
 
-   if (blocks == 3)
-      {
-    __m128i B0 = _mm_loadu_si128(in_mm + 0);
-    __m128i B1 = _mm_loadu_si128(in_mm + 1);
-    __m128i B2 = _mm_loadu_si128(in_mm + 2);
+void aes_botan_aesni_decrypt_15x(aes_decrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks)
+{
+	const __m128i* key_mm = (const __m128i*)(ctx->ks);
 
-	// round-0
-	__m128i K  = _mm_loadu_si128(key_mm);
-
-	B0 = _mm_xor_si128(B0, K);
-	B1 = _mm_xor_si128(B1, K);
-	B2 = _mm_xor_si128(B2, K);
-
-	// round
-	AES_DEC_3_ROUNDS (1);
-	AES_DEC_3_ROUNDS (2);
-	AES_DEC_3_ROUNDS (3);
-	AES_DEC_3_ROUNDS (4);
-	AES_DEC_3_ROUNDS (5);
-	AES_DEC_3_ROUNDS (6);
-	AES_DEC_3_ROUNDS (7);
-	AES_DEC_3_ROUNDS (8);
-	AES_DEC_3_ROUNDS (9);
-	AES_DEC_3_ROUNDS (10);
-	AES_DEC_3_ROUNDS (11);
-	AES_DEC_3_ROUNDS (12);
-	AES_DEC_3_ROUNDS (13);
-
-	AES_DEC_3_LAST_ROUNDS;
-
-	_mm_storeu_si128(out_mm + 0, B0);
-	_mm_storeu_si128(out_mm + 1, B1);
-	_mm_storeu_si128(out_mm + 2, B2);
-	}
-   else if (blocks == 2)
-      {
-    __m128i B0 = _mm_loadu_si128(in_mm + 0);
-    __m128i B1 = _mm_loadu_si128(in_mm + 1);
+	AES_DK_PREPARE (ctx);
+	AES_NR_DISPATCH (ctx, aes_botan_aesni_decrypt_15x_nr (key_mm, in, out, blocks, rounds));
+}
 
-	// round-0
-	__m128i K  = _mm_loadu_si128(key_mm);
-
-	B0 = _mm_xor_si128(B0, K);
-	B1 = _mm_xor_si128(B1, K);
-
-	// round
-	AES_DEC_2_ROUNDS (1);
-	AES_DEC_2_ROUNDS (2);
-	AES_DEC_2_ROUNDS (3);
-	AES_DEC_2_ROUNDS (4);
-	AES_DEC_2_ROUNDS (5);
-	AES_DEC_2_ROUNDS (6);
-	AES_DEC_2_ROUNDS (7);
-	AES_DEC_2_ROUNDS (8);
-	AES_DEC_2_ROUNDS (9);
-	AES_DEC_2_ROUNDS (10);
-	AES_DEC_2_ROUNDS (11);
-	AES_DEC_2_ROUNDS (12);
-	AES_DEC_2_ROUNDS (13);
-
-	AES_DEC_2_LAST_ROUNDS;
-
-	_mm_storeu_si128(out_mm + 0, B0);
-	_mm_storeu_si128(out_mm + 1, B1);
-	}
-   else if (blocks == 1)
-      {
-      __m128i B = _mm_loadu_si128(in_mm);
-	  __m128i K  = _mm_loadu_si128(key_mm);
-
-      B = _mm_xor_si128(B, K);
-
-	  K  = _mm_loadu_si128(key_mm + 1);
-      B = _mm_aesdec_si128(B, K);
-	  K  = _mm_loadu_si128(key_mm + 2);
-      B = _mm_aesdec_si128(B, K);
-	  K  = _mm_loadu_si128(key_mm + 3);
-      B = _mm_aesdec_si128(B, K);
-	  K  = _mm_loadu_si128(key_mm + 4);
-      B = _mm_aesdec_si128(B, K);
-	  K  = _mm_loadu_si128(key_mm + 5);
-      B = _mm_aesdec_si128(B, K);
-	  K  = _mm_loadu_si128(key_mm + 6);
-      B = _mm_aesdec_si128(B, K);
-	  K  = _mm_loadu_si128(key_mm + 7);
-      B = _mm_aesdec_si128(B, K);
-	  K  = _mm_loadu_si128(key_mm + 8);
-      B = _mm_aesdec_si128(B, K);
-	  K  = _mm_loadu_si128(key_mm + 9);
-      B = _mm_aesdec_si128(B, K);
-	  K  = _mm_loadu_si128(key_mm + 10);
-      B = _mm_aesdec_si128(B, K);
-	  K  = _mm_loadu_si128(key_mm + 11);
-      B = _mm_aesdec_si128(B, K);
-	  K  = _mm_loadu_si128(key_mm + 12);
-      B = _mm_aesdec_si128(B, K);
-	  K  = _mm_loadu_si128(key_mm + 13);
-      B = _mm_aesdec_si128(B, K);
-	  K  = _mm_loadu_si128(key_mm + 14);
-      B = _mm_aesdeclast_si128(B, K);
-
-      _mm_storeu_si128(out_mm, B);
-      }
-   }
+/*
+* Streaming stores: the n-way kernels with the results written by movntdq,
+* which skips the read for ownership of the destination lines and leaves the
+* cache alone. Only the wide loops stream; the tail of 1 to 6 blocks is
+* stored as usual, and a single sfence orders the lot before returning, so
+* that another thread told the output is ready sees all of it. movntdq
+* needs out 16-byte aligned: otherwise the plain kernels run.
+*/
+#define AES_N_WAY_STREAM_KERNELS(n) \
+VC_INLINE void aes_botan_aesni_encrypt_##n##way_nt(const __m128i* key_mm, const byte* in, byte* out, const int rounds) \
+{ \
+	AES_LANES_##n(AES_LANE_LOAD) \
+	__m128i K; \
+	AES_N_ALL_ROUNDS(n, AES_LANE_ENC, AES_LANE_ENCLAST); \
+	AES_LANES_##n(AES_LANE_STREAM) \
+} \
+VC_INLINE void aes_botan_aesni_decrypt_##n##way_nt(const __m128i* key_mm, const byte* in, byte* out, const int rounds) \
+{ \
+	AES_LANES_##n(AES_LANE_LOAD) \
+	__m128i K; \
+	AES_N_ALL_ROUNDS(n, AES_LANE_DEC, AES_LANE_DECLAST); \
+	AES_LANES_##n(AES_LANE_STREAM) \
+}
 
 #if CRYPTOPP_BOOL_X64
-void aes_botan_aesni_decrypt_15way(aes_decrypt_ctx *ctx, const byte* in, byte* out)
-{
-	const __m128i* in_mm = (const __m128i*)(in);
-	const __m128i* key_mm = (const __m128i*)(ctx->ks);	
-
-    __m128i B0 = _mm_loadu_si128(in_mm + 0);
-    __m128i B1 = _mm_loadu_si128(in_mm + 1);
-    __m128i B2 = _mm_loadu_si128(in_mm + 2);
-    __m128i B3 = _mm_loadu_si128(in_mm + 3);
-    __m128i B4 = _mm_loadu_si128(in_mm + 4);
-    __m128i B5 = _mm_loadu_si128(in_mm + 5);
-    __m128i B6 = _mm_loadu_si128(in_mm + 6);
-    __m128i B7 = _mm_loadu_si128(in_mm + 7);
-    __m128i B8 = _mm_loadu_si128(in_mm + 8);
-    __m128i B9 = _mm_loadu_si128(in_mm + 9);
-    __m128i B10 = _mm_loadu_si128(in_mm + 10);
-    __m128i B11 = _mm_loadu_si128(in_mm + 11);
-    __m128i B12 = _mm_loadu_si128(in_mm + 12);
-    __m128i B13 = _mm_loadu_si128(in_mm + 13);
-    __m128i B14 = _mm_loadu_si128(in_mm + 14);
+AES_N_WAY_STREAM_KERNELS(15)
+#endif
+AES_N_WAY_STREAM_KERNELS(7)
+
+#define AES_STREAM_LOOP(dir, n) \
+	while (blocks >= n) \
+	{ \
+		aes_botan_aesni_##dir##_##n##way_nt (key_mm, in, out, rounds); \
+		blocks -= n; \
+		in += n * 16; \
+		out += n * 16; \
+	}
 
-	// round-0
-	__m128i K  = _mm_loadu_si128(key_mm);
-
-	B0 = _mm_xor_si128(B0, K);
-	B1 = _mm_xor_si128(B1, K);
-	B2 = _mm_xor_si128(B2, K);
-	B3 = _mm_xor_si128(B3, K);
-	B4 = _mm_xor_si128(B4, K);
-	B5 = _mm_xor_si128(B5, K);
-	B6 = _mm_xor_si128(B6, K);
-	B7 = _mm_xor_si128(B7, K);
-	B8 = _mm_xor_si128(B8, K);
-	B9 = _mm_xor_si128(B9, K);
-	B10 = _mm_xor_si128(B10, K);
-	B11 = _mm_xor_si128(B11, K);
-	B12 = _mm_xor_si128(B12, K);
-	B13 = _mm_xor_si128(B13, K);
-	B14 = _mm_xor_si128(B14, K);
-
-	// round
-	AES_DEC_15_ROUNDS (1);
-	AES_DEC_15_ROUNDS (2);
-	AES_DEC_15_ROUNDS (3);
-	AES_DEC_15_ROUNDS (4);
-	AES_DEC_15_ROUNDS (5);
-	AES_DEC_15_ROUNDS (6);
-	AES_DEC_15_ROUNDS (7);
-	AES_DEC_15_ROUNDS (8);
-	AES_DEC_15_ROUNDS (9);
-	AES_DEC_15_ROUNDS (10);
-	AES_DEC_15_ROUNDS (11);
-	AES_DEC_15_ROUNDS (12);
-	AES_DEC_15_ROUNDS (13);
-
-	AES_DEC_15_LAST_ROUNDS;
-
-	_mm_storeu_si128((__m128i*)(out) + 0, B0);
-	_mm_storeu_si128((__m128i*)(out) + 1, B1);
-	_mm_storeu_si128((__m128i*)(out) + 2, B2);
-	_mm_storeu_si128((__m128i*)(out) + 3, B3);
-	_mm_storeu_si128((__m128i*)(out) + 4, B4);
-	_mm_storeu_si128((__m128i*)(out) + 5, B5);
-	_mm_storeu_si128((__m128i*)(out) + 6, B6);
-	_mm_storeu_si128((__m128i*)(out) + 7, B7);
-	_mm_storeu_si128((__m128i*)(out) + 8, B8);
-	_mm_storeu_si128((__m128i*)(out) + 9, B9);
-	_mm_storeu_si128((__m128i*)(out) + 10, B10);
-	_mm_storeu_si128((__m128i*)(out) + 11, B11);
-	_mm_storeu_si128((__m128i*)(out) + 12, B12);
-	_mm_storeu_si128((__m128i*)(out) + 13, B13);
-	_mm_storeu_si128((__m128i*)(out) + 14, B14);
+VC_INLINE void aes_botan_aesni_encrypt_15x_nt_nr(const __m128i* key_mm, const byte* in, byte* out, uint_32t blocks, const int rounds)
+{
+#if CRYPTOPP_BOOL_X64
+	AES_STREAM_LOOP (encrypt, 15);
+#endif
+	AES_STREAM_LOOP (encrypt, 7);
+	aes_botan_aesni_encrypt_4x_nr (key_mm, in, out, blocks, rounds);
+	_mm_sfence ();
+}
+
+VC_INLINE void aes_botan_aesni_encrypt_7x_nt_nr(const __m128i* key_mm, const byte* in, byte* out, uint_32t blocks, const int rounds)
+{
+	AES_STREAM_LOOP (encrypt, 7);
+	aes_botan_aesni_encrypt_4x_nr (key_mm, in, out, blocks, rounds);
+	_mm_sfence ();
 }
+
+VC_INLINE void aes_botan_aesni_decrypt_15x_nt_nr(const __m128i* key_mm, const byte* in, byte* out, uint_32t blocks, const int rounds)
+{
+#if CRYPTOPP_BOOL_X64
+	AES_STREAM_LOOP (decrypt, 15);
 #endif
+	AES_STREAM_LOOP (decrypt, 7);
+	aes_botan_aesni_decrypt_4x_nr (key_mm, in, out, blocks, rounds);
+	_mm_sfence ();
+}
 
-void aes_botan_aesni_decrypt_7way(aes_decrypt_ctx *ctx, const byte* in, byte* out)
+VC_INLINE void aes_botan_aesni_decrypt_7x_nt_nr(const __m128i* key_mm, const byte* in, byte* out, uint_32t blocks, const int rounds)
 {
-	const __m128i* in_mm = (const __m128i*)(in);
-	const __m128i* key_mm = (const __m128i*)(ctx->ks);	
+	AES_STREAM_LOOP (decrypt, 7);
+	aes_botan_aesni_decrypt_4x_nr (key_mm, in, out, blocks, rounds);
+	_mm_sfence ();
+}
 
-    __m128i B0 = _mm_loadu_si128(in_mm + 0);
-    __m128i B1 = _mm_loadu_si128(in_mm + 1);
-    __m128i B2 = _mm_loadu_si128(in_mm + 2);
-    __m128i B3 = _mm_loadu_si128(in_mm + 3);
-    __m128i B4 = _mm_loadu_si128(in_mm + 4);
-    __m128i B5 = _mm_loadu_si128(in_mm + 5);
-    __m128i B6 = _mm_loadu_si128(in_mm + 6);
+void aes_botan_aesni_encrypt_7x_nt(aes_encrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks)
+{
+	const __m128i* key_mm = (const __m128i*)(ctx->ks);
 
-	// round-0
-	__m128i K  = _mm_loadu_si128(key_mm);
-
-	B0 = _mm_xor_si128(B0, K);
-	B1 = _mm_xor_si128(B1, K);
-	B2 = _mm_xor_si128(B2, K);
-	B3 = _mm_xor_si128(B3, K);
-	B4 = _mm_xor_si128(B4, K);
-	B5 = _mm_xor_si128(B5, K);
-	B6 = _mm_xor_si128(B6, K);
-
-	// round
-	AES_DEC_7_ROUNDS (1);
-	AES_DEC_7_ROUNDS (2);
-	AES_DEC_7_ROUNDS (3);
-	AES_DEC_7_ROUNDS (4);
-	AES_DEC_7_ROUNDS (5);
-	AES_DEC_7_ROUNDS (6);
-	AES_DEC_7_ROUNDS (7);
-	AES_DEC_7_ROUNDS (8);
-	AES_DEC_7_ROUNDS (9);
-	AES_DEC_7_ROUNDS (10);
-	AES_DEC_7_ROUNDS (11);
-	AES_DEC_7_ROUNDS (12);
-	AES_DEC_7_ROUNDS (13);
-
-	AES_DEC_7_LAST_ROUNDS;
-
-	_mm_storeu_si128((__m128i*)(out) + 0, B0);
-	_mm_storeu_si128((__m128i*)(out) + 1, B1);
-	_mm_storeu_si128((__m128i*)(out) + 2, B2);
-	_mm_storeu_si128((__m128i*)(out) + 3, B3);
-	_mm_storeu_si128((__m128i*)(out) + 4, B4);
-	_mm_storeu_si128((__m128i*)(out) + 5, B5);
-	_mm_storeu_si128((__m128i*)(out) + 6, B6);
+	if ((size_t) out & 15)
+		aes_botan_aesni_encrypt_7x (ctx, in, out, blocks);
+	else
+		AES_NR_DISPATCH (ctx, aes_botan_aesni_encrypt_7x_nt_nr (key_mm, in, out, blocks, rounds));
 }
 
-void aes_botan_aesni_decrypt_15x(aes_decrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks)
+void aes_botan_aesni_decrypt_7x_nt(aes_decrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks)
 {
+	const __m128i* key_mm = (const __m128i*)(ctx->ks);
+
+	AES_DK_PREPARE (ctx);
+	if ((size_t) out & 15)
+		aes_botan_aesni_decrypt_7x (ctx, in, out, blocks);
+	else
+		AES_NR_DISPATCH (ctx, aes_botan_aesni_decrypt_7x_nt_nr (key_mm, in, out, blocks, rounds));
+}
+
 #if CRYPTOPP_BOOL_X64
-	while (blocks >= 15)
-	{
-		aes_botan_aesni_decrypt_15way (ctx, in, out);
-		blocks -= 15;
-		in += 15 * 16;
-		out += 15 * 16;
-	}
+void aes_botan_aesni_encrypt_15x_nt(aes_encrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks)
+{
+	const __m128i* key_mm = (const __m128i*)(ctx->ks);
+
+	if ((size_t) out & 15)
+		aes_botan_aesni_encrypt_15x (ctx, in, out, blocks);
+	else
+		AES_NR_DISPATCH (ctx, aes_botan_aesni_encrypt_15x_nt_nr (key_mm, in, out, blocks, rounds));
+}
+
+void aes_botan_aesni_decrypt_15x_nt(aes_decrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks)
+{
+	const __m128i* key_mm = (const __m128i*)(ctx->ks);
+
+	AES_DK_PREPARE (ctx);
+	if ((size_t) out & 15)
+		aes_botan_aesni_decrypt_15x (ctx, in, out, blocks);
+	else
+		AES_NR_DISPATCH (ctx, aes_botan_aesni_decrypt_15x_nt_nr (key_mm, in, out, blocks, rounds));
+}
+#endif
+
+/*
+* Size-adaptive ECB: a request shorter than the wide loop is done in a single
+* pass of the kernel of its exact width, with no loop and no tail branches.
+* 1 to 3 blocks, the most common requests, are tested first and with plain
+* branches, as the jump table of the other widths costs an indirect branch.
+* Longer requests go through the wide loop, and their remainder the same way
+*/
+#if CRYPTOPP_BOOL_X64
+#define AES_SIZED_WAYS 15
+#define AES_SIZED_TAILS(M) M(1) M(2) M(3) M(4) M(5) M(6) M(7) M(8) M(9) M(10) M(11) M(12) M(13) M(14)
+#else
+#define AES_SIZED_WAYS 7
+#define AES_SIZED_TAILS(M) M(1) M(2) M(3) M(4) M(5) M(6)
 #endif
-	while (blocks >= 7)
-	{
-		aes_botan_aesni_decrypt_7way (ctx, in, out);
-		blocks -= 7;
-		in += 7 * 16;
-		out += 7 * 16;
-	}
 
-	aes_botan_aesni_decrypt_4x (ctx, in, out, blocks);
+#define AES_SIZED_KERNEL(dir, n) AES_SIZED_KERNEL_(dir, n)
+#define AES_SIZED_KERNEL_(dir, n) aes_botan_aesni_##dir##_##n##way (key_mm, in, out, rounds)
+#define AES_SIZED_ENC_CASE(n) case n: AES_SIZED_KERNEL (encrypt, n); break;
+#define AES_SIZED_DEC_CASE(n) case n: AES_SIZED_KERNEL (decrypt, n); break;
+
+#define AES_SIZED_DRIVER(dir, CASE) \
+VC_INLINE void aes_botan_aesni_##dir##_sized_nr(const __m128i* key_mm, const byte* in, byte* out, uint_32t blocks, const int rounds) \
+{ \
+	if (blocks < 4) \
+	{ \
+		if (blocks == 1) \
+			AES_SIZED_KERNEL (dir, 1); \
+		else if (blocks == 2) \
+			AES_SIZED_KERNEL (dir, 2); \
+		else if (blocks == 3) \
+			AES_SIZED_KERNEL (dir, 3); \
+		return; \
+	} \
+ \
+	while (blocks >= AES_SIZED_WAYS) \
+	{ \
+		AES_SIZED_KERNEL (dir, AES_SIZED_WAYS); \
+		blocks -= AES_SIZED_WAYS; \
+		in += AES_SIZED_WAYS * 16; \
+		out += AES_SIZED_WAYS * 16; \
+	} \
+ \
+	switch (blocks) \
+	{ \
+	AES_SIZED_TAILS(CASE) \
+	} \
 }
 
-void aes_botan_aesni_decrypt_7x(aes_decrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks)
+AES_SIZED_DRIVER(encrypt, AES_SIZED_ENC_CASE)
+AES_SIZED_DRIVER(decrypt, AES_SIZED_DEC_CASE)
+
+void aes_botan_aesni_encrypt_sized(aes_encrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks)
 {
-	while (blocks >= 7)
-	{
-		aes_botan_aesni_decrypt_7way (ctx, in, out);
-		blocks -= 7;
-		in += 7 * 16;
-		out += 7 * 16;
-	}
+	const __m128i* key_mm = (const __m128i*)(ctx->ks);
+
+	AES_NR_DISPATCH (ctx, aes_botan_aesni_encrypt_sized_nr (key_mm, in, out, blocks, rounds));
+}
+
+void aes_botan_aesni_decrypt_sized(aes_decrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks)
+{
+	const __m128i* key_mm = (const __m128i*)(ctx->ks);
 
-	aes_botan_aesni_decrypt_4x (ctx, in, out, blocks);
+	AES_DK_PREPARE (ctx);
+	AES_NR_DISPATCH (ctx, aes_botan_aesni_decrypt_sized_nr (key_mm, in, out, blocks, rounds));
 }
 
+#undef AES_SIZED_DRIVER
+#undef AES_SIZED_KERNEL
+#undef AES_SIZED_KERNEL_
+#undef AES_SIZED_ENC_CASE
+#undef AES_SIZED_DEC_CASE
+#undef AES_SIZED_TAILS
+#undef AES_SIZED_WAYS
+
 /*
-* AES-256 Key Schedule
+* ECB with any width from 1 to AES_BOTAN_MAX_WAYS, to find the best one for a
+* given CPU. As for the 4, 7 and 15-way kernels, the drivers are specialized
+* for 10, 12 and 14 rounds through AES_NR_DISPATCH, so that a width picked by
+* the autotuner runs the same code as the sweep measured
 */
-void aes_botan_aesni_set_key(aes_encrypt_ctx *ctxe, aes_decrypt_ctx *ctxd, const byte* key)
-   {
+#define AES_N_WAY_DRIVERS(n) \
+VC_INLINE void aes_botan_aesni_encrypt_##n##way_nr(const __m128i* key_mm, const byte* in, byte* out, uint_32t blocks, const int rounds) \
+{ \
+	while (blocks >= n) \
+	{ \
+		aes_botan_aesni_encrypt_##n##way (key_mm, in, out, rounds); \
+		blocks -= n; \
+		in += n * 16; \
+		out += n * 16; \
+	} \
+	aes_botan_aesni_encrypt_4x_nr (key_mm, in, out, blocks, rounds); \
+} \
+VC_INLINE void aes_botan_aesni_decrypt_##n##way_nr(const __m128i* key_mm, const byte* in, byte* out, uint_32t blocks, const int rounds) \
+{ \
+	while (blocks >= n) \
+	{ \
+		aes_botan_aesni_decrypt_##n##way (key_mm, in, out, rounds); \
+		blocks -= n; \
+		in += n * 16; \
+		out += n * 16; \
+	} \
+	aes_botan_aesni_decrypt_4x_nr (key_mm, in, out, blocks, rounds); \
+} \
+static void aes_botan_aesni_encrypt_##n##way_blocks(aes_encrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks) \
+{ \
+	const __m128i* key_mm = (const __m128i*)(ctx->ks); \
+ \
+	AES_NR_DISPATCH (ctx, aes_botan_aesni_encrypt_##n##way_nr (key_mm, in, out, blocks, rounds)); \
+} \
+static void aes_botan_aesni_decrypt_##n##way_blocks(aes_decrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks) \
+{ \
+	const __m128i* key_mm = (const __m128i*)(ctx->ks); \
+ \
+	AES_DK_PREPARE (ctx); \
+	AES_NR_DISPATCH (ctx, aes_botan_aesni_decrypt_##n##way_nr (key_mm, in, out, blocks, rounds)); \
+}
 
-   __m128i K0 = _mm_loadu_si128((const __m128i*)(key));
-   __m128i K1 = _mm_loadu_si128((const __m128i*)(key + 16));
+AES_WIDTHS(AES_N_WAY_DRIVERS)
 
-   __m128i K2 = aes_128_key_expansion(K0, _mm_aeskeygenassist_si128(K1, 0x01));
-   __m128i K3 = aes_256_key_expansion(K1, K2);
+#define AES_ENCRYPT_WIDTH_FN(n) aes_botan_aesni_encrypt_##n##way_blocks,
+#define AES_DECRYPT_WIDTH_FN(n) aes_botan_aesni_decrypt_##n##way_blocks,
 
-   __m128i K4 = aes_128_key_expansion(K2, _mm_aeskeygenassist_si128(K3, 0x02));
-   __m128i K5 = aes_256_key_expansion(K3, K4);
+static const aes_ecb_encrypt_width_fn aes_encrypt_width_fns[AES_BOTAN_MAX_WAYS] = { AES_WIDTHS(AES_ENCRYPT_WIDTH_FN) };
+static const aes_ecb_decrypt_width_fn aes_decrypt_width_fns[AES_BOTAN_MAX_WAYS] = { AES_WIDTHS(AES_DECRYPT_WIDTH_FN) };
 
-   __m128i K6 = aes_128_key_expansion(K4, _mm_aeskeygenassist_si128(K5, 0x04));
-   __m128i K7 = aes_256_key_expansion(K5, K6);
+#undef AES_ENCRYPT_WIDTH_FN
+#undef AES_DECRYPT_WIDTH_FN
+#undef AES_N_WAY_DRIVERS
 
-   __m128i K8 = aes_128_key_expansion(K6, _mm_aeskeygenassist_si128(K7, 0x08));
-   __m128i K9 = aes_256_key_expansion(K7, K8);
+AES_RETURN aes_botan_aesni_encrypt_width(aes_encrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks, uint_32t ways)
+{
+	if (ways < 1 || ways > AES_BOTAN_MAX_WAYS)
+		return EXIT_FAILURE;
 
-   __m128i K10 = aes_128_key_expansion(K8, _mm_aeskeygenassist_si128(K9, 0x10));
-   __m128i K11 = aes_256_key_expansion(K9, K10);
+	aes_encrypt_width_fns[ways - 1] (ctx, in, out, blocks);
+	return EXIT_SUCCESS;
+}
 
-   __m128i K12 = aes_128_key_expansion(K10, _mm_aeskeygenassist_si128(K11, 0x20));
-   __m128i K13 = aes_256_key_expansion(K11, K12);
+AES_RETURN aes_botan_aesni_decrypt_width(aes_decrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks, uint_32t ways)
+{
+	if (ways < 1 || ways > AES_BOTAN_MAX_WAYS)
+		return EXIT_FAILURE;
 
-   __m128i K14 = aes_128_key_expansion(K12, _mm_aeskeygenassist_si128(K13, 0x40));
+	aes_decrypt_width_fns[ways - 1] (ctx, in, out, blocks);
+	return EXIT_SUCCESS;
+}
 
-   __m128i* EK_mm = (__m128i*)(ctxe->ks);
-   __m128i* DK_mm = (__m128i*)(ctxd->ks);
+aes_ecb_encrypt_width_fn aes_botan_aesni_encrypt_width_kernel(uint_32t ways)
+{
+	return (ways < 1 || ways > AES_BOTAN_MAX_WAYS)? NULL : aes_encrypt_width_fns[ways - 1];
+}
 
-   _mm_storeu_si128(EK_mm     , K0);
-   _mm_storeu_si128(EK_mm +  1, K1);
-   _mm_storeu_si128(EK_mm +  2, K2);
-   _mm_storeu_si128(EK_mm +  3, K3);
-   _mm_storeu_si128(EK_mm +  4, K4);
-   _mm_storeu_si128(EK_mm +  5, K5);
-   _mm_storeu_si128(EK_mm +  6, K6);
-   _mm_storeu_si128(EK_mm +  7, K7);
-   _mm_storeu_si128(EK_mm +  8, K8);
-   _mm_storeu_si128(EK_mm +  9, K9);
-   _mm_storeu_si128(EK_mm + 10, K10);
-   _mm_storeu_si128(EK_mm + 11, K11);
-   _mm_storeu_si128(EK_mm + 12, K12);
-   _mm_storeu_si128(EK_mm + 13, K13);
-   _mm_storeu_si128(EK_mm + 14, K14);
+aes_ecb_decrypt_width_fn aes_botan_aesni_decrypt_width_kernel(uint_32t ways)
+{
+	return (ways < 1 || ways > AES_BOTAN_MAX_WAYS)? NULL : aes_decrypt_width_fns[ways - 1];
+}
+
+/*
+* Single block, for the tails of the modes below
+*/
+VC_INLINE __m128i aes_botan_aesni_encrypt_block(const __m128i* key_mm, __m128i B, const int rounds)
+{
+	int i;
+
+	B = _mm_xor_si128(B, _mm_loadu_si128(key_mm));
+	for (i = 1; i < rounds; ++i)
+		B = _mm_aesenc_si128(B, _mm_loadu_si128(key_mm + i));
+	return _mm_aesenclast_si128(B, _mm_loadu_si128(key_mm + rounds));
+}
+
+VC_INLINE __m128i aes_botan_aesni_decrypt_block(const __m128i* key_mm, __m128i B, const int rounds)
+{
+	int i;
+
+	B = _mm_xor_si128(B, _mm_loadu_si128(key_mm));
+	for (i = 1; i < rounds; ++i)
+		B = _mm_aesdec_si128(B, _mm_loadu_si128(key_mm + i));
+	return _mm_aesdeclast_si128(B, _mm_loadu_si128(key_mm + rounds));
+}
+
+/*
+* AES CTR mode: the counter is kept byte-swapped (little-endian 128-bit) in
+* a register so that consecutive blocks are one _mm_add_epi64 and one pshufb
+* away. Batches that would carry out of the low 64 bits or wrap a 32-bit
+* counter are done one block at a time with the carry handled in C.
+*/
+
+#define AES_CTR_BSWAP_MASK _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15)
+
+/* lane j starts from counter C + j and xors its keystream block into block j of in */
+#define AES_CTR_LANE_INIT(j)	__m128i B##j = _mm_shuffle_epi8(_mm_add_epi64(C, _mm_set_epi32(0, 0, 0, j)), BSWAP);
+#define AES_CTR_LANE_STORE(j)	_mm_storeu_si128((__m128i*)(out) + j, _mm_xor_si128(B##j, _mm_loadu_si128((const __m128i*)(in) + j)));
+
+/* n counter blocks from C: aes_botan_aesni_ctr_<n>way */
+#define AES_N_WAY_CTR_KERNEL(n) \
+VC_INLINE void aes_botan_aesni_ctr_##n##way(const __m128i* key_mm, __m128i C, const byte* in, byte* out, const int rounds) \
+{ \
+	const __m128i BSWAP = AES_CTR_BSWAP_MASK; \
+	AES_LANES_##n(AES_CTR_LANE_INIT) \
+	__m128i K; \
+	AES_N_ALL_ROUNDS(n, AES_LANE_ENC, AES_LANE_ENCLAST); \
+	AES_LANES_##n(AES_CTR_LANE_STORE) \
+}
+
+#if CRYPTOPP_BOOL_X64
+AES_N_WAY_CTR_KERNEL(15)
+#endif
+AES_N_WAY_CTR_KERNEL(7)
+AES_N_WAY_CTR_KERNEL(4)
+
+VC_INLINE __m128i aes_botan_aesni_ctr_1way(const __m128i* key_mm, __m128i C, const int rounds)
+{
+	return aes_botan_aesni_encrypt_block (key_mm, _mm_shuffle_epi8(C, AES_CTR_BSWAP_MASK), rounds);
+}
+
+/* true if the counters lo .. lo + n - 1 stay inside the counter lane */
+VC_INLINE int aes_ctr_fits(uint64 lo, uint_32t n, int width)
+{
+	if (width == 32)
+		return (uint32) lo <= (uint32) (0xFFFFFFFF - (n - 1));
+	else
+		return lo <= (uint64) (0 - (uint64) n);
+}
+
+VC_INLINE void aes_ctr_advance(uint64* hi, uint64* lo, uint_32t n, int width)
+{
+	if (width == 32)
+		*lo = (*lo & 0xFFFFFFFF00000000ULL) | (uint32) (*lo + n);
+	else
+	{
+		*lo += n;
+		if (width == 128 && *lo < n)
+			++*hi;
+	}
+}
+
+VC_INLINE void aes_botan_aesni_ctr_crypt_nr(const __m128i* key_mm, aes_ctr_state* state, const byte* in, byte* out, uint_32t len, const int rounds, const int ways)
+{
+	const int width = state->width;
+	uint64 hi, lo;
+	uint_32t blocks, n;
+
+	/* use up the keystream left over from the previous call */
+	while (len && state->used < 16)
+	{
+		*out++ = *in++ ^ state->buf[state->used++];
+		--len;
+	}
+
+	if (!len)
+		return;
+
+	memcpy (&hi, state->ctr, 8);
+	memcpy (&lo, state->ctr + 8, 8);
+	hi = BE64 (hi);
+	lo = BE64 (lo);
+
+	for (blocks = len / 16; blocks; blocks -= n)
+	{
+		const __m128i C = _mm_set_epi64x(hi, lo);
+#if CRYPTOPP_BOOL_X64
+		if (ways == 15 && blocks >= 15 && aes_ctr_fits (lo, 15, width))
+		{
+			aes_botan_aesni_ctr_15way (key_mm, C, in, out, rounds);
+			n = 15;
+		}
+		else
+#endif
+		if (blocks >= 7 && aes_ctr_fits (lo, 7, width))
+		{
+			aes_botan_aesni_ctr_7way (key_mm, C, in, out, rounds);
+			n = 7;
+		}
+		else if (blocks >= 4 && aes_ctr_fits (lo, 4, width))
+		{
+			aes_botan_aesni_ctr_4way (key_mm, C, in, out, rounds);
+			n = 4;
+		}
+		else
+		{
+			_mm_storeu_si128((__m128i*)(out), _mm_xor_si128(aes_botan_aesni_ctr_1way (key_mm, C, rounds), _mm_loadu_si128((const __m128i*)(in))));
+			n = 1;
+		}
+
+		aes_ctr_advance (&hi, &lo, n, width);
+		in += n * 16;
+		out += n * 16;
+	}
+
+	/* final partial block: keep the rest of its keystream for the next call */
+	len %= 16;
+	if (len)
+	{
+		_mm_storeu_si128((__m128i*)(state->buf), aes_botan_aesni_ctr_1way (key_mm, _mm_set_epi64x(hi, lo), rounds));
+		aes_ctr_advance (&hi, &lo, 1, width);
+		for (state->used = 0; state->used < len; ++state->used)
+			out[state->used] = in[state->used] ^ state->buf[state->used];
+	}
+
+	hi = BE64 (hi);
+	lo = BE64 (lo);
+	memcpy (state->ctr, &hi, 8);
+	memcpy (state->ctr + 8, &lo, 8);
+}
+
+AES_RETURN aes_botan_aesni_ctr_init(aes_ctr_state* state, const byte* iv, int ctr_bits)
+{
+	if (ctr_bits != 32 && ctr_bits != 64 && ctr_bits != 128)
+		return EXIT_FAILURE;
+
+	memcpy (state->ctr, iv, 16);
+	state->used = 16;
+	state->width = ctr_bits;
+	return EXIT_SUCCESS;
+}
+
+void aes_botan_aesni_ctr_crypt_7x(aes_encrypt_ctx *ctx, aes_ctr_state* state, const byte* in, byte* out, uint_32t len)
+{
+	const __m128i* key_mm = (const __m128i*)(ctx->ks);
+
+	AES_NR_DISPATCH (ctx, aes_botan_aesni_ctr_crypt_nr (key_mm, state, in, out, len, rounds, 7));
+}
+
+#if CRYPTOPP_BOOL_X64
+void aes_botan_aesni_ctr_crypt_15x(aes_encrypt_ctx *ctx, aes_ctr_state* state, const byte* in, byte* out, uint_32t len)
+{
+	const __m128i* key_mm = (const __m128i*)(ctx->ks);
+
+	AES_NR_DISPATCH (ctx, aes_botan_aesni_ctr_crypt_nr (key_mm, state, in, out, len, rounds, 15));
+}
+#endif
+
+#undef AES_CTR_BSWAP_MASK
+
+/*
+* AES-GCM stitched with GHASH: while the 8 counter blocks of a group go
+* through the AES rounds, the PCLMULQDQ products of the ciphertext of the
+* previous group (encryption) or of the current group (decryption) are
+* issued between the rounds, so the AES and CLMUL units work in parallel.
+* The 8 products use H^8 .. H^1 and are reduced once, as in the GHASH of
+* Aes_gcm.c. 8 blocks, the round key, the GHASH accumulators and the input
+* block being hashed fit in the 16 xmm registers of x64; 15 blocks would
+* not, the wider version is the VAES one below.
+*/
+
+#define GCM_8_GHASH_STEP(j) \
+	if (hash) gcm_mul_acc (_mm_shuffle_epi8(_mm_loadu_si128(hash_mm + j), BSWAP), gctx->H[7 - j], gctx->Hk[7 - j], &lo, &mid, &hi)
+
+/* lane j of the stitched kernel: counter C + j, only the low 32 bits counting */
+#define GCM_8_LANE_INIT(j) \
+	__m128i B##j = _mm_shuffle_epi8(_mm_add_epi32(C, _mm_set_epi32(0, 0, 0, j)), BSWAP);
+
+VC_INLINE void aes_botan_aesni_gcm_8way(const __m128i* key_mm, const aes_gcm_ctx* gctx, __m128i C, const byte* in, byte* out,
+										const byte* hash_in, __m128i* Y, const int rounds, const int hash)
+{
+	const __m128i BSWAP = GCM_BSWAP_MASK;
+	const __m128i* hash_mm = (const __m128i*)(hash_in);
+	__m128i lo = _mm_setzero_si128(), mid = _mm_setzero_si128(), hi = _mm_setzero_si128();
+
+	// GCM increments only the low 32 bits of the counter block
+	AES_LANES_8(GCM_8_LANE_INIT)
+
+	// round-0
+	__m128i K  = AES_ROUND_KEY(0);
+	AES_LANES_8(AES_LANE_XOR)
+
+	// round, interleaved with (Y + X0) * H^8 + X1 * H^7 + ... + X7 * H
+	AES_N_ROUND (8, 1, AES_LANE_ENC);
+	if (hash) gcm_mul_acc (_mm_xor_si128(*Y, _mm_shuffle_epi8(_mm_loadu_si128(hash_mm), BSWAP)), gctx->H[7], gctx->Hk[7], &lo, &mid, &hi);
+	AES_N_ROUND (8, 2, AES_LANE_ENC);
+	GCM_8_GHASH_STEP (1);
+	AES_N_ROUND (8, 3, AES_LANE_ENC);
+	GCM_8_GHASH_STEP (2);
+	AES_N_ROUND (8, 4, AES_LANE_ENC);
+	GCM_8_GHASH_STEP (3);
+	AES_N_ROUND (8, 5, AES_LANE_ENC);
+	GCM_8_GHASH_STEP (4);
+	AES_N_ROUND (8, 6, AES_LANE_ENC);
+	GCM_8_GHASH_STEP (5);
+	AES_N_ROUND (8, 7, AES_LANE_ENC);
+	GCM_8_GHASH_STEP (6);
+	AES_N_ROUND (8, 8, AES_LANE_ENC);
+	GCM_8_GHASH_STEP (7);
+	AES_N_ROUND (8, 9, AES_LANE_ENC);
+	if (hash) *Y = gcm_reduce (lo, mid, hi);
+	if (rounds > 10)
+	{
+		AES_N_ROUND (8, 10, AES_LANE_ENC);
+		AES_N_ROUND (8, 11, AES_LANE_ENC);
+	}
+	if (rounds > 12)
+	{
+		AES_N_ROUND (8, 12, AES_LANE_ENC);
+		AES_N_ROUND (8, 13, AES_LANE_ENC);
+	}
+
+	AES_N_ROUND (8, rounds, AES_LANE_ENCLAST);
+
+	AES_LANES_8(AES_CTR_LANE_STORE)
+}
+
+VC_INLINE uint_32t aes_botan_aesni_gcm_crypt_8x_nr(const __m128i* key_mm, const aes_gcm_ctx* gctx, byte* ctr, byte* ghash,
+												   const byte* in, byte* out, uint_32t blocks, const int rounds, const int encrypt)
+{
+	const __m128i BSWAP = GCM_BSWAP_MASK;
+	const __m128i EIGHT = _mm_set_epi32(0, 0, 0, 8);
+	__m128i C = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(ctr)), BSWAP);
+	__m128i Y = _mm_loadu_si128((const __m128i*)(ghash));
+	uint_32t groups = blocks / 8, g;
+
+	if (!groups)
+		return 0;
+
+	if (encrypt)
+	{
+		// the ciphertext of a group is hashed while the next group is encrypted
+		aes_botan_aesni_gcm_8way (key_mm, gctx, C, in, out, NULL, &Y, rounds, 0);
+		for (g = 1; g < groups; g++)
+		{
+			C = _mm_add_epi32(C, EIGHT);
+			in += 8 * 16;
+			out += 8 * 16;
+			aes_botan_aesni_gcm_8way (key_mm, gctx, C, in, out, out - 8 * 16, &Y, rounds, 1);
+		}
+		C = _mm_add_epi32(C, EIGHT);
+
+		// last group on its own
+		{
+			const __m128i* hash_mm = (const __m128i*)(out);
+			const int hash = 1;
+			__m128i lo = _mm_setzero_si128(), mid = _mm_setzero_si128(), hi = _mm_setzero_si128();
+
+			gcm_mul_acc (_mm_xor_si128(Y, _mm_shuffle_epi8(_mm_loadu_si128(hash_mm), BSWAP)), gctx->H[7], gctx->Hk[7], &lo, &mid, &hi);
+			GCM_8_GHASH_STEP (1);
+			GCM_8_GHASH_STEP (2);
+			GCM_8_GHASH_STEP (3);
+			GCM_8_GHASH_STEP (4);
+			GCM_8_GHASH_STEP (5);
+			GCM_8_GHASH_STEP (6);
+			GCM_8_GHASH_STEP (7);
+			Y = gcm_reduce (lo, mid, hi);
+		}
+	}
+	else
+	{
+		for (g = 0; g < groups; g++)
+		{
+			aes_botan_aesni_gcm_8way (key_mm, gctx, C, in, out, in, &Y, rounds, 1);
+			C = _mm_add_epi32(C, EIGHT);
+			in += 8 * 16;
+			out += 8 * 16;
+		}
+	}
+
+	_mm_storeu_si128((__m128i*)(ctr), _mm_shuffle_epi8(C, BSWAP));
+	_mm_storeu_si128((__m128i*)(ghash), Y);
+	return groups * 8;
+}
+
+uint_32t aes_botan_aesni_gcm_encrypt_8x(const aes_gcm_ctx* gctx, byte* ctr, byte* ghash, const byte* in, byte* out, uint_32t blocks)
+{
+	const __m128i* key_mm = (const __m128i*)(gctx->ek.ks);
+	uint_32t done = 0;
+
+	AES_NR_DISPATCH (&gctx->ek, done = aes_botan_aesni_gcm_crypt_8x_nr (key_mm, gctx, ctr, ghash, in, out, blocks, rounds, 1));
+	return done;
+}
+
+uint_32t aes_botan_aesni_gcm_decrypt_8x(const aes_gcm_ctx* gctx, byte* ctr, byte* ghash, const byte* in, byte* out, uint_32t blocks)
+{
+	const __m128i* key_mm = (const __m128i*)(gctx->ek.ks);
+	uint_32t done = 0;
+
+	AES_NR_DISPATCH (&gctx->ek, done = aes_botan_aesni_gcm_crypt_8x_nr (key_mm, gctx, ctr, ghash, in, out, blocks, rounds, 0));
+	return done;
+}
+
+#undef GCM_8_GHASH_STEP
+#undef GCM_8_LANE_INIT
+
+/*
+* XTS-AES (IEEE 1619). The tweaks of a group of blocks are all derived from
+* the tweak of its first block, each lane multiplying it by x^j with two
+* 64-bit shifts and a fold of the bits shifted out (x^128 = x^7 + x^2 + x + 1),
+* so they are independent of each other instead of a chain of doublings.
+*/
+
+/* T * x^k in GF(2^128), XTS (little-endian) bit order, 0 <= k < 57 */
+VC_INLINE __m128i aes_xts_mul_xk(__m128i T, const int k)
+{
+	const __m128i carry = _mm_srl_epi64(T, _mm_cvtsi32_si128(64 - k));
+	const __m128i top = _mm_srli_si128(carry, 8);
+	__m128i R = _mm_xor_si128(_mm_sll_epi64(T, _mm_cvtsi32_si128(k)), _mm_slli_si128(carry, 8));
+
+	R = _mm_xor_si128(R, top);
+	R = _mm_xor_si128(R, _mm_slli_epi64(top, 1));
+	R = _mm_xor_si128(R, _mm_slli_epi64(top, 2));
+	return _mm_xor_si128(R, _mm_slli_epi64(top, 7));
+}
+
+/* lane j is block j of in between two xors with the tweak T * x^j */
+#define AES_XTS_LANE_LOAD(j)	__m128i B##j = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(in) + j), tw[j]);
+#define AES_XTS_LANE_STORE(j)	_mm_storeu_si128((__m128i*)(out) + j, _mm_xor_si128(B##j, tw[j]));
+
+/*
+* n blocks from the tweak *T, which is advanced past them:
+* aes_botan_aesni_xts_encrypt_<n>way and aes_botan_aesni_xts_decrypt_<n>way
+*/
+#define AES_N_WAY_XTS_KERNEL(dir, n, OP, LASTOP) \
+VC_INLINE void aes_botan_aesni_xts_##dir##_##n##way(const __m128i* key_mm, __m128i* T, const byte* in, byte* out, const int rounds) \
+{ \
+	__m128i tw[n]; \
+	int j; \
+	for (j = 0; j < n; j++) \
+		tw[j] = aes_xts_mul_xk (*T, j); \
+	*T = aes_xts_mul_xk (*T, n); \
+	{ \
+	AES_LANES_##n(AES_XTS_LANE_LOAD) \
+	__m128i K; \
+	AES_N_ALL_ROUNDS(n, OP, LASTOP); \
+	AES_LANES_##n(AES_XTS_LANE_STORE) \
+	} \
+}
+
+#define AES_N_WAY_XTS_KERNELS(n) \
+	AES_N_WAY_XTS_KERNEL(encrypt, n, AES_LANE_ENC, AES_LANE_ENCLAST) \
+	AES_N_WAY_XTS_KERNEL(decrypt, n, AES_LANE_DEC, AES_LANE_DECLAST)
+
+#if CRYPTOPP_BOOL_X64
+AES_N_WAY_XTS_KERNELS(15)
+#endif
+AES_N_WAY_XTS_KERNELS(7)
+AES_N_WAY_XTS_KERNELS(4)
+
+VC_INLINE void aes_botan_aesni_xts_encrypt_sector(const __m128i* key_mm, const __m128i* tkey_mm, uint64 sector, const byte* in, byte* out, uint_32t size, const int rounds, const int ways)
+{
+	__m128i T = aes_botan_aesni_encrypt_block (tkey_mm, _mm_set_epi64x(0, sector), rounds);
+	uint_32t blocks = size / 16, rem = size % 16;
+
+	// with ciphertext stealing the last full block is done apart
+	if (rem)
+		--blocks;
+
+#if CRYPTOPP_BOOL_X64
+	while (ways == 15 && blocks >= 15)
+	{
+		aes_botan_aesni_xts_encrypt_15way (key_mm, &T, in, out, rounds);
+		blocks -= 15;
+		in += 15 * 16;
+		out += 15 * 16;
+	}
+#endif
+	while (blocks >= 7)
+	{
+		aes_botan_aesni_xts_encrypt_7way (key_mm, &T, in, out, rounds);
+		blocks -= 7;
+		in += 7 * 16;
+		out += 7 * 16;
+	}
+	if (blocks >= 4)
+	{
+		aes_botan_aesni_xts_encrypt_4way (key_mm, &T, in, out, rounds);
+		blocks -= 4;
+		in += 4 * 16;
+		out += 4 * 16;
+	}
+	while (blocks--)
+	{
+		_mm_storeu_si128((__m128i*)(out), _mm_xor_si128(aes_botan_aesni_encrypt_block (key_mm, _mm_xor_si128(_mm_loadu_si128((const __m128i*)(in)), T), rounds), T));
+		T = aes_xts_mul_xk (T, 1);
+		in += 16;
+		out += 16;
+	}
+
+	if (rem)
+	{
+		byte CC[16], PP[16];
+
+		_mm_storeu_si128((__m128i*)(CC), _mm_xor_si128(aes_botan_aesni_encrypt_block (key_mm, _mm_xor_si128(_mm_loadu_si128((const __m128i*)(in)), T), rounds), T));
+		T = aes_xts_mul_xk (T, 1);
+
+		memcpy (PP, in + 16, rem);
+		memcpy (PP + rem, CC + rem, 16 - rem);
+		memcpy (out + 16, CC, rem);
+		_mm_storeu_si128((__m128i*)(out), _mm_xor_si128(aes_botan_aesni_encrypt_block (key_mm, _mm_xor_si128(_mm_loadu_si128((const __m128i*)(PP)), T), rounds), T));
+	}
+}
+
+VC_INLINE void aes_botan_aesni_xts_decrypt_sector(const __m128i* key_mm, const __m128i* tkey_mm, uint64 sector, const byte* in, byte* out, uint_32t size, const int rounds, const int ways)
+{
+	__m128i T = aes_botan_aesni_encrypt_block (tkey_mm, _mm_set_epi64x(0, sector), rounds);
+	uint_32t blocks = size / 16, rem = size % 16;
+
+	// with ciphertext stealing the last full block is done apart
+	if (rem)
+		--blocks;
+
+#if CRYPTOPP_BOOL_X64
+	while (ways == 15 && blocks >= 15)
+	{
+		aes_botan_aesni_xts_decrypt_15way (key_mm, &T, in, out, rounds);
+		blocks -= 15;
+		in += 15 * 16;
+		out += 15 * 16;
+	}
+#endif
+	while (blocks >= 7)
+	{
+		aes_botan_aesni_xts_decrypt_7way (key_mm, &T, in, out, rounds);
+		blocks -= 7;
+		in += 7 * 16;
+		out += 7 * 16;
+	}
+	if (blocks >= 4)
+	{
+		aes_botan_aesni_xts_decrypt_4way (key_mm, &T, in, out, rounds);
+		blocks -= 4;
+		in += 4 * 16;
+		out += 4 * 16;
+	}
+	while (blocks--)
+	{
+		_mm_storeu_si128((__m128i*)(out), _mm_xor_si128(aes_botan_aesni_decrypt_block (key_mm, _mm_xor_si128(_mm_loadu_si128((const __m128i*)(in)), T), rounds), T));
+		T = aes_xts_mul_xk (T, 1);
+		in += 16;
+		out += 16;
+	}
+
+	if (rem)
+	{
+		// the last full block was encrypted with the next tweak
+		const __m128i T2 = aes_xts_mul_xk (T, 1);
+		byte CC[16], PP[16];
+
+		_mm_storeu_si128((__m128i*)(PP), _mm_xor_si128(aes_botan_aesni_decrypt_block (key_mm, _mm_xor_si128(_mm_loadu_si128((const __m128i*)(in)), T2), rounds), T2));
+
+		memcpy (CC, in + 16, rem);
+		memcpy (CC + rem, PP + rem, 16 - rem);
+		memcpy (out + 16, PP, rem);
+		_mm_storeu_si128((__m128i*)(out), _mm_xor_si128(aes_botan_aesni_decrypt_block (key_mm, _mm_xor_si128(_mm_loadu_si128((const __m128i*)(CC)), T), rounds), T));
+	}
+}
+
+VC_INLINE void aes_botan_aesni_xts_crypt_nr(const aes_xts_ctx* ctx, const byte* in, byte* out, uint64 startSector, uint_32t sectorCount,
+											uint_32t sectorSize, const int rounds, const int ways, const int encrypt)
+{
+	const __m128i* tkey_mm = (const __m128i*)(ctx->tk.ks);
+
+	// no whole block to steal from
+	if (sectorSize < 16)
+		return;
+
+	for (; sectorCount; --sectorCount, ++startSector, in += sectorSize, out += sectorSize)
+	{
+		if (encrypt)
+			aes_botan_aesni_xts_encrypt_sector ((const __m128i*)(ctx->ek.ks), tkey_mm, startSector, in, out, sectorSize, rounds, ways);
+		else
+			aes_botan_aesni_xts_decrypt_sector ((const __m128i*)(ctx->dk.ks), tkey_mm, startSector, in, out, sectorSize, rounds, ways);
+	}
+}
+
+AES_RETURN aes_botan_aesni_xts_set_key(aes_xts_ctx* ctx, const byte* key1, const byte* key2, int key_len)
+{
+	aes_decrypt_ctx tdk;
+
+	if (aes_botan_aesni_set_key_var (&ctx->ek, &ctx->dk, key1, key_len) != EXIT_SUCCESS
+		|| aes_botan_aesni_set_key_var (&ctx->tk, &tdk, key2, key_len) != EXIT_SUCCESS)
+		return EXIT_FAILURE;
+
+	burn (&tdk, sizeof (tdk));
+	return EXIT_SUCCESS;
+}
+
+#if CRYPTOPP_BOOL_X64
+void aes_botan_aesni_xts_encrypt_15x(const aes_xts_ctx* ctx, const byte* in, byte* out, uint64 startSector, uint_32t sectorCount, uint_32t sectorSize)
+{
+	AES_NR_DISPATCH (&ctx->ek, aes_botan_aesni_xts_crypt_nr (ctx, in, out, startSector, sectorCount, sectorSize, rounds, 15, 1));
+}
+
+void aes_botan_aesni_xts_decrypt_15x(const aes_xts_ctx* ctx, const byte* in, byte* out, uint64 startSector, uint_32t sectorCount, uint_32t sectorSize)
+{
+	AES_NR_DISPATCH (&ctx->ek, aes_botan_aesni_xts_crypt_nr (ctx, in, out, startSector, sectorCount, sectorSize, rounds, 15, 0));
+}
+#endif
+
+void aes_botan_aesni_xts_encrypt_7x(const aes_xts_ctx* ctx, const byte* in, byte* out, uint64 startSector, uint_32t sectorCount, uint_32t sectorSize)
+{
+	AES_NR_DISPATCH (&ctx->ek, aes_botan_aesni_xts_crypt_nr (ctx, in, out, startSector, sectorCount, sectorSize, rounds, 7, 1));
+}
+
+void aes_botan_aesni_xts_decrypt_7x(const aes_xts_ctx* ctx, const byte* in, byte* out, uint64 startSector, uint_32t sectorCount, uint_32t sectorSize)
+{
+	AES_NR_DISPATCH (&ctx->ek, aes_botan_aesni_xts_crypt_nr (ctx, in, out, startSector, sectorCount, sectorSize, rounds, 7, 0));
+}
+
+/*
+* AES CBC mode. Decryption is parallel: a group of ciphertext blocks goes
+* through the rounds together and each result is xored with the preceding
+* ciphertext block, the last one of the group being carried in a register to
+* the next group. Encryption is serial inside a stream, so the multi-stream
+* entry point runs one block of each of up to 15 (or 7) independent streams
+* per lane; a lane whose stream ends takes the next pending stream.
+*/
+
+/*
+* lane j of the decryption is xored with ciphertext block j - 1, lane 0 with
+* *V; all ciphertext blocks are read before any store, for in-place calls
+*/
+#define AES_CBC_LANE_CHAIN(j)	B##j = _mm_xor_si128(B##j, j ? _mm_loadu_si128((const __m128i*)(in) + j - 1) : *V);
+
+/* n blocks, *V being the ciphertext block before them: aes_botan_aesni_cbc_decrypt_<n>way */
+#define AES_N_WAY_CBC_DECRYPT_KERNEL(n) \
+VC_INLINE void aes_botan_aesni_cbc_decrypt_##n##way(const __m128i* key_mm, __m128i* V, const byte* in, byte* out, const int rounds) \
+{ \
+	AES_LANES_##n(AES_LANE_LOAD) \
+	__m128i K; \
+	AES_N_ALL_ROUNDS(n, AES_LANE_DEC, AES_LANE_DECLAST); \
+	AES_LANES_##n(AES_CBC_LANE_CHAIN) \
+	*V = _mm_loadu_si128((const __m128i*)(in) + n - 1); \
+	AES_LANES_##n(AES_LANE_STORE) \
+}
+
+#if CRYPTOPP_BOOL_X64
+AES_N_WAY_CBC_DECRYPT_KERNEL(15)
+#endif
+AES_N_WAY_CBC_DECRYPT_KERNEL(7)
+AES_N_WAY_CBC_DECRYPT_KERNEL(4)
+
+VC_INLINE void aes_botan_aesni_cbc_decrypt_nr(const __m128i* key_mm, byte* iv, const byte* in, byte* out, uint_32t blocks, const int rounds, const int ways)
+{
+	__m128i V = _mm_loadu_si128((const __m128i*)(iv));
+
+#if CRYPTOPP_BOOL_X64
+	while (ways == 15 && blocks >= 15)
+	{
+		aes_botan_aesni_cbc_decrypt_15way (key_mm, &V, in, out, rounds);
+		blocks -= 15;
+		in += 15 * 16;
+		out += 15 * 16;
+	}
+#endif
+	while (blocks >= 7)
+	{
+		aes_botan_aesni_cbc_decrypt_7way (key_mm, &V, in, out, rounds);
+		blocks -= 7;
+		in += 7 * 16;
+		out += 7 * 16;
+	}
+	if (blocks >= 4)
+	{
+		aes_botan_aesni_cbc_decrypt_4way (key_mm, &V, in, out, rounds);
+		blocks -= 4;
+		in += 4 * 16;
+		out += 4 * 16;
+	}
+	while (blocks--)
+	{
+		const __m128i C = _mm_loadu_si128((const __m128i*)(in));
+
+		_mm_storeu_si128((__m128i*)(out), _mm_xor_si128(aes_botan_aesni_decrypt_block (key_mm, C, rounds), V));
+		V = C;
+		in += 16;
+		out += 16;
+	}
+
+	_mm_storeu_si128((__m128i*)(iv), V);
+}
+
+VC_INLINE void aes_botan_aesni_cbc_encrypt_nr(const __m128i* key_mm, byte* iv, const byte* in, byte* out, uint_32t blocks, const int rounds)
+{
+	__m128i V = _mm_loadu_si128((const __m128i*)(iv));
+
+	while (blocks--)
+	{
+		V = aes_botan_aesni_encrypt_block (key_mm, _mm_xor_si128(V, _mm_loadu_si128((const __m128i*)(in))), rounds);
+		_mm_storeu_si128((__m128i*)(out), V);
+		in += 16;
+		out += 16;
+	}
+
+	_mm_storeu_si128((__m128i*)(iv), V);
+}
+
+/* lane j encrypts the next block of stream j, chained to the previous one in V[j] */
+#define AES_CBC_LANE_LOAD(j)	__m128i B##j = _mm_xor_si128(V[j], _mm_loadu_si128((const __m128i*)(in[j])));
+#define AES_CBC_LANE_STORE(j)	V[j] = B##j; _mm_storeu_si128((__m128i*)(out[j]), B##j); in[j] += 16; out[j] += 16;
+
+/* one block of each of n streams: aes_botan_aesni_cbc_encrypt_<n>lanes */
+#define AES_N_LANE_CBC_ENCRYPT_KERNEL(n) \
+VC_INLINE void aes_botan_aesni_cbc_encrypt_##n##lanes(const __m128i* key_mm, __m128i* V, const byte** in, byte** out, const int rounds) \
+{ \
+	AES_LANES_##n(AES_CBC_LANE_LOAD) \
+	__m128i K; \
+	AES_N_ALL_ROUNDS(n, AES_LANE_ENC, AES_LANE_ENCLAST); \
+	AES_LANES_##n(AES_CBC_LANE_STORE) \
+}
+
+#if CRYPTOPP_BOOL_X64
+AES_N_LANE_CBC_ENCRYPT_KERNEL(15)
+#endif
+AES_N_LANE_CBC_ENCRYPT_KERNEL(7)
+AES_N_LANE_CBC_ENCRYPT_KERNEL(4)
+AES_N_LANE_CBC_ENCRYPT_KERNEL(3)
+AES_N_LANE_CBC_ENCRYPT_KERNEL(2)
+AES_N_LANE_CBC_ENCRYPT_KERNEL(1)
+
+VC_INLINE void aes_botan_aesni_cbc_encrypt_streams_nr(const __m128i* key_mm, aes_cbc_stream* streams, uint_32t count, const int rounds, const int ways)
+{
+	__m128i V[15];
+	const byte* in[15];
+	byte* out[15];
+	uint_32t left[15], lane[15];
+	uint_32t active = 0, next = 0, steps, i;
+
+	for (;;)
+	{
+		// give the free lanes to the next streams
+		while (active < (uint_32t) ways && next < count)
+		{
+			if (streams[next].blocks)
+			{
+				V[active] = _mm_loadu_si128((const __m128i*)(streams[next].iv));
+				in[active] = streams[next].in;
+				out[active] = streams[next].out;
+				left[active] = streams[next].blocks;
+				lane[active++] = next;
+			}
+			next++;
+		}
+
+		if (!active)
+			break;
+
+		// run all lanes until the shortest stream ends
+		for (steps = left[0], i = 1; i < active; i++)
+		{
+			if (left[i] < steps)
+				steps = left[i];
+		}
+
+		for (i = 0; i < steps; i++)
+		{
+			uint_32t j = 0;
+#if CRYPTOPP_BOOL_X64
+			if (active == 15)
+			{
+				aes_botan_aesni_cbc_encrypt_15lanes (key_mm, V, in, out, rounds);
+				continue;
+			}
+#endif
+			for (; active - j >= 7; j += 7)
+				aes_botan_aesni_cbc_encrypt_7lanes (key_mm, V + j, in + j, out + j, rounds);
+			if (active - j >= 4)
+			{
+				aes_botan_aesni_cbc_encrypt_4lanes (key_mm, V + j, in + j, out + j, rounds);
+				j += 4;
+			}
+			switch (active - j)
+			{
+			case 3: aes_botan_aesni_cbc_encrypt_3lanes (key_mm, V + j, in + j, out + j, rounds); break;
+			case 2: aes_botan_aesni_cbc_encrypt_2lanes (key_mm, V + j, in + j, out + j, rounds); break;
+			case 1: aes_botan_aesni_cbc_encrypt_1lanes (key_mm, V + j, in + j, out + j, rounds); break;
+			}
+		}
+
+		// retire the streams that are done, the last lane fills the hole
+		for (i = 0; i < active; )
+		{
+			left[i] -= steps;
+			if (left[i])
+			{
+				i++;
+				continue;
+			}
+
+			_mm_storeu_si128((__m128i*)(streams[lane[i]].iv), V[i]);
+			if (i != --active)
+			{
+				V[i] = V[active];
+				in[i] = in[active];
+				out[i] = out[active];
+				left[i] = left[active];
+				lane[i] = lane[active];
+			}
+		}
+	}
+}
+
+void aes_botan_aesni_cbc_encrypt(aes_encrypt_ctx *ctx, byte* iv, const byte* in, byte* out, uint_32t blocks)
+{
+	const __m128i* key_mm = (const __m128i*)(ctx->ks);
+	AES_NR_DISPATCH (ctx, aes_botan_aesni_cbc_encrypt_nr (key_mm, iv, in, out, blocks, rounds));
+}
+
+#if CRYPTOPP_BOOL_X64
+void aes_botan_aesni_cbc_encrypt_streams_15x(aes_encrypt_ctx *ctx, aes_cbc_stream* streams, uint_32t count)
+{
+	const __m128i* key_mm = (const __m128i*)(ctx->ks);
+	AES_NR_DISPATCH (ctx, aes_botan_aesni_cbc_encrypt_streams_nr (key_mm, streams, count, rounds, 15));
+}
+
+void aes_botan_aesni_cbc_decrypt_15x(aes_decrypt_ctx *ctx, byte* iv, const byte* in, byte* out, uint_32t blocks)
+{
+	const __m128i* key_mm = (const __m128i*)(ctx->ks);
+
+	AES_DK_PREPARE (ctx);
+	AES_NR_DISPATCH (ctx, aes_botan_aesni_cbc_decrypt_nr (key_mm, iv, in, out, blocks, rounds, 15));
+}
+#endif
+
+void aes_botan_aesni_cbc_encrypt_streams_7x(aes_encrypt_ctx *ctx, aes_cbc_stream* streams, uint_32t count)
+{
+	const __m128i* key_mm = (const __m128i*)(ctx->ks);
+	AES_NR_DISPATCH (ctx, aes_botan_aesni_cbc_encrypt_streams_nr (key_mm, streams, count, rounds, 7));
+}
+
+void aes_botan_aesni_cbc_decrypt_7x(aes_decrypt_ctx *ctx, byte* iv, const byte* in, byte* out, uint_32t blocks)
+{
+	const __m128i* key_mm = (const __m128i*)(ctx->ks);
+
+	AES_DK_PREPARE (ctx);
+	AES_NR_DISPATCH (ctx, aes_botan_aesni_cbc_decrypt_nr (key_mm, iv, in, out, blocks, rounds, 7));
+}
+
+#if CRYPTOPP_BOOL_X64 && CRYPTOPP_BOOL_VAES_INTRINSICS_AVAILABLE
+
+/*
+* AES-128, AES-192 and AES-256 using VAES: every ymm register carries two
+* blocks, so the 16-way and 32-way kernels use 8 and 16 registers. The round key is broadcast to both
+* 128-bit lanes directly from the key schedule.
+*/
+#define VAES256_FUNCTION CRYPTOPP_TARGET("aes,avx2,vaes")
+
+#define AES_VAES256_ROUND_KEY(i)		_mm256_broadcastsi128_si256(_mm_loadu_si128(key_mm + (i)))
+#define AES_VAES256_LANE_LOAD(j)		__m256i B##j = _mm256_loadu_si256((const __m256i*)(in) + j);
+#define AES_VAES256_LANE_STORE(j)		_mm256_storeu_si256((__m256i*)(out) + j, B##j);
+#define AES_VAES256_LANE_STREAM(j)		_mm256_stream_si256((__m256i*)(out) + j, B##j);
+#define AES_VAES256_LANE_XOR(j)			B##j = _mm256_xor_si256(B##j, K);
+#define AES_VAES256_LANE_ENC(j)			B##j = _mm256_aesenc_epi128(B##j, K);
+#define AES_VAES256_LANE_ENCLAST(j)		B##j = _mm256_aesenclast_epi128(B##j, K);
+#define AES_VAES256_LANE_DEC(j)			B##j = _mm256_aesdec_epi128(B##j, K);
+#define AES_VAES256_LANE_DECLAST(j)		B##j = _mm256_aesdeclast_epi128(B##j, K);
+
+/* 2n blocks in n ymm registers, written back by STORE */
+#define AES_VAES256_KERNEL(name, n, OP, LASTOP, STORE) \
+VAES256_FUNCTION VC_INLINE void name(const __m128i* key_mm, const byte* in, byte* out, const int rounds) \
+{ \
+	AES_LANES_##n(AES_VAES256_LANE_LOAD) \
+	__m256i K; \
+	AES_N_ALL_ROUNDS_K(n, AES_VAES256_ROUND_KEY, AES_VAES256_ROUND_KEY(rounds), AES_VAES256_LANE_XOR, OP, LASTOP); \
+	AES_LANES_##n(STORE) \
+}
+
+/*
+* 32 (32x only) then 16 blocks at a time. The remaining blocks, and requests
+* under 16 blocks, go through the size-adaptive SSE kernels in a single pass
+* of their exact width: the upper halves are cleared first to avoid the AVX to
+* SSE transition penalty. The _nt drivers stream the 16 or 32-block groups
+* with vmovntdq, the first block being done apart when out is not 32-byte
+* aligned
+*/
+#define AES_VAES256_DRIVERS(dir, OP, LASTOP) \
+AES_VAES256_KERNEL(aes_botan_aesni_##dir##_vaes256_16way, 8, OP, LASTOP, AES_VAES256_LANE_STORE) \
+AES_VAES256_KERNEL(aes_botan_aesni_##dir##_vaes256_32way, 16, OP, LASTOP, AES_VAES256_LANE_STORE) \
+AES_VAES256_KERNEL(aes_botan_aesni_##dir##_vaes256_16way_nt, 8, OP, LASTOP, AES_VAES256_LANE_STREAM) \
+AES_VAES256_KERNEL(aes_botan_aesni_##dir##_vaes256_32way_nt, 16, OP, LASTOP, AES_VAES256_LANE_STREAM) \
+VAES256_FUNCTION VC_INLINE void aes_botan_aesni_##dir##_vaes256_16x_nr(const __m128i* key_mm, const byte* in, byte* out, uint_32t blocks, const int rounds) \
+{ \
+	while (blocks >= 16) \
+	{ \
+		aes_botan_aesni_##dir##_vaes256_16way (key_mm, in, out, rounds); \
+		blocks -= 16; \
+		in += 16 * 16; \
+		out += 16 * 16; \
+	} \
+	_mm256_zeroupper (); \
+	aes_botan_aesni_##dir##_sized_nr (key_mm, in, out, blocks, rounds); \
+} \
+VAES256_FUNCTION VC_INLINE void aes_botan_aesni_##dir##_vaes256_32x_nr(const __m128i* key_mm, const byte* in, byte* out, uint_32t blocks, const int rounds) \
+{ \
+	while (blocks >= 32) \
+	{ \
+		aes_botan_aesni_##dir##_vaes256_32way (key_mm, in, out, rounds); \
+		blocks -= 32; \
+		in += 32 * 16; \
+		out += 32 * 16; \
+	} \
+	aes_botan_aesni_##dir##_vaes256_16x_nr (key_mm, in, out, blocks, rounds); \
+} \
+VAES256_FUNCTION VC_INLINE void aes_botan_aesni_##dir##_vaes256_16x_nt_nr(const __m128i* key_mm, const byte* in, byte* out, uint_32t blocks, uint_32t head, const int rounds) \
+{ \
+	aes_botan_aesni_##dir##_vaes256_16x_nr (key_mm, in, out, head, rounds); \
+	blocks -= head; \
+	in += head * 16; \
+	out += head * 16; \
+	while (blocks >= 16) \
+	{ \
+		aes_botan_aesni_##dir##_vaes256_16way_nt (key_mm, in, out, rounds); \
+		blocks -= 16; \
+		in += 16 * 16; \
+		out += 16 * 16; \
+	} \
+	aes_botan_aesni_##dir##_vaes256_16x_nr (key_mm, in, out, blocks, rounds); \
+	_mm_sfence (); \
+} \
+VAES256_FUNCTION VC_INLINE void aes_botan_aesni_##dir##_vaes256_32x_nt_nr(const __m128i* key_mm, const byte* in, byte* out, uint_32t blocks, uint_32t head, const int rounds) \
+{ \
+	aes_botan_aesni_##dir##_vaes256_16x_nr (key_mm, in, out, head, rounds); \
+	blocks -= head; \
+	in += head * 16; \
+	out += head * 16; \
+	while (blocks >= 32) \
+	{ \
+		aes_botan_aesni_##dir##_vaes256_32way_nt (key_mm, in, out, rounds); \
+		blocks -= 32; \
+		in += 32 * 16; \
+		out += 32 * 16; \
+	} \
+	aes_botan_aesni_##dir##_vaes256_16x_nr (key_mm, in, out, blocks, rounds); \
+	_mm_sfence (); \
+}
+
+AES_VAES256_DRIVERS(encrypt, AES_VAES256_LANE_ENC, AES_VAES256_LANE_ENCLAST)
+AES_VAES256_DRIVERS(decrypt, AES_VAES256_LANE_DEC, AES_VAES256_LANE_DECLAST)
+
+VAES256_FUNCTION void aes_botan_aesni_encrypt_vaes256_16x(aes_encrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks)
+{
+	const __m128i* key_mm = (const __m128i*)(ctx->ks);
+
+	AES_NR_DISPATCH (ctx, aes_botan_aesni_encrypt_vaes256_16x_nr (key_mm, in, out, blocks, rounds));
+}
+
+VAES256_FUNCTION void aes_botan_aesni_encrypt_vaes256_32x(aes_encrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks)
+{
+	const __m128i* key_mm = (const __m128i*)(ctx->ks);
+
+	AES_NR_DISPATCH (ctx, aes_botan_aesni_encrypt_vaes256_32x_nr (key_mm, in, out, blocks, rounds));
+}
+
+VAES256_FUNCTION void aes_botan_aesni_decrypt_vaes256_16x(aes_decrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks)
+{
+	const __m128i* key_mm = (const __m128i*)(ctx->ks);
+
+	AES_DK_PREPARE (ctx);
+	AES_NR_DISPATCH (ctx, aes_botan_aesni_decrypt_vaes256_16x_nr (key_mm, in, out, blocks, rounds));
+}
+
+VAES256_FUNCTION void aes_botan_aesni_decrypt_vaes256_32x(aes_decrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks)
+{
+	const __m128i* key_mm = (const __m128i*)(ctx->ks);
+
+	AES_DK_PREPARE (ctx);
+	AES_NR_DISPATCH (ctx, aes_botan_aesni_decrypt_vaes256_32x_nr (key_mm, in, out, blocks, rounds));
+}
+
+VAES256_FUNCTION void aes_botan_aesni_encrypt_vaes256_16x_nt(aes_encrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks)
+{
+	const __m128i* key_mm = (const __m128i*)(ctx->ks);
+	const uint_32t head = (uint_32t) (((size_t) 0 - (size_t) out) & 31) / 16;
+
+	if (((size_t) out & 15) || blocks <= head)
+		aes_botan_aesni_encrypt_vaes256_16x (ctx, in, out, blocks);
+	else
+		AES_NR_DISPATCH (ctx, aes_botan_aesni_encrypt_vaes256_16x_nt_nr (key_mm, in, out, blocks, head, rounds));
+}
+
+VAES256_FUNCTION void aes_botan_aesni_decrypt_vaes256_16x_nt(aes_decrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks)
+{
+	const __m128i* key_mm = (const __m128i*)(ctx->ks);
+	const uint_32t head = (uint_32t) (((size_t) 0 - (size_t) out) & 31) / 16;
+
+	AES_DK_PREPARE (ctx);
+	if (((size_t) out & 15) || blocks <= head)
+		aes_botan_aesni_decrypt_vaes256_16x (ctx, in, out, blocks);
+	else
+		AES_NR_DISPATCH (ctx, aes_botan_aesni_decrypt_vaes256_16x_nt_nr (key_mm, in, out, blocks, head, rounds));
+}
+
+VAES256_FUNCTION void aes_botan_aesni_encrypt_vaes256_32x_nt(aes_encrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks)
+{
+	const __m128i* key_mm = (const __m128i*)(ctx->ks);
+	const uint_32t head = (uint_32t) (((size_t) 0 - (size_t) out) & 31) / 16;
+
+	if (((size_t) out & 15) || blocks <= head)
+		aes_botan_aesni_encrypt_vaes256_32x (ctx, in, out, blocks);
+	else
+		AES_NR_DISPATCH (ctx, aes_botan_aesni_encrypt_vaes256_32x_nt_nr (key_mm, in, out, blocks, head, rounds));
+}
+
+VAES256_FUNCTION void aes_botan_aesni_decrypt_vaes256_32x_nt(aes_decrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks)
+{
+	const __m128i* key_mm = (const __m128i*)(ctx->ks);
+	const uint_32t head = (uint_32t) (((size_t) 0 - (size_t) out) & 31) / 16;
+
+	AES_DK_PREPARE (ctx);
+	if (((size_t) out & 15) || blocks <= head)
+		aes_botan_aesni_decrypt_vaes256_32x (ctx, in, out, blocks);
+	else
+		AES_NR_DISPATCH (ctx, aes_botan_aesni_decrypt_vaes256_32x_nt_nr (key_mm, in, out, blocks, head, rounds));
+}
+
+#undef AES_VAES256_DRIVERS
+#undef AES_VAES256_KERNEL
+#undef AES_VAES256_ROUND_KEY
+#undef AES_VAES256_LANE_LOAD
+#undef AES_VAES256_LANE_STORE
+#undef AES_VAES256_LANE_STREAM
+#undef AES_VAES256_LANE_XOR
+#undef AES_VAES256_LANE_ENC
+#undef AES_VAES256_LANE_ENCLAST
+#undef AES_VAES256_LANE_DEC
+#undef AES_VAES256_LANE_DECLAST
+#undef VAES256_FUNCTION
+
+/*
+* AES-128, AES-192 and AES-256 using AVX-512 VAES: each zmm register carries
+* four blocks. With 32 vector registers the 11, 13 or 15 round keys are
+* loaded once per call and kept in registers next to 16 data registers (64
+* blocks per iteration). Whatever is left is finished 16 blocks at a time and
+* then with masked loads and stores in 1 to 4 registers, so short tails never
+* drop back to the SSE kernels. Requests under 4 blocks do: broadcasting the
+* round keys would take longer than their rounds.
+*/
+#define VAES512_FUNCTION CRYPTOPP_TARGET("aes,avx2,avx512f,vaes")
+
+/*
+* The lane operations above on zmm registers. The round keys are the
+* registers K0 .. K13 and KN, broadcast from the schedule once per call.
+* In the tail, one mask bit per 64-bit lane, two lanes per block: masked-off
+* lanes are neither read nor written, so nothing past the buffer end is touched
+*/
+#define AES_VAES512_KEY_LOAD(i)			const __m512i K##i = _mm512_broadcast_i32x4(_mm_loadu_si128(key_mm + i));
+#define AES_VAES512_ROUND_KEY(i)		K##i
+#define AES_VAES512_LANE_LOAD(j)		__m512i B##j = _mm512_loadu_si512(in + j * 64);
+#define AES_VAES512_LANE_STORE(j)		_mm512_storeu_si512(out + j * 64, B##j);
+#define AES_VAES512_LANE_STREAM(j)		_mm512_stream_si512((__m512i*)(out + j * 64), B##j);
+#define AES_VAES512_LANE_MASK(j)		const __mmask8 M##j = (__mmask8) (lanes >> (8 * j));
+#define AES_VAES512_LANE_MASK_LOAD(j)	__m512i B##j = _mm512_maskz_loadu_epi64(M##j, in + j * 64);
+#define AES_VAES512_LANE_MASK_STORE(j)	_mm512_mask_storeu_epi64(out + j * 64, M##j, B##j);
+#define AES_VAES512_LANE_XOR(j)			B##j = _mm512_xor_si512(B##j, K);
+#define AES_VAES512_LANE_ENC(j)			B##j = _mm512_aesenc_epi128(B##j, K);
+#define AES_VAES512_LANE_ENCLAST(j)		B##j = _mm512_aesenclast_epi128(B##j, K);
+#define AES_VAES512_LANE_DEC(j)			B##j = _mm512_aesdec_epi128(B##j, K);
+#define AES_VAES512_LANE_DECLAST(j)		B##j = _mm512_aesdeclast_epi128(B##j, K);
+
+#define AES_VAES512_ALL_ROUNDS(n, OP, LASTOP) \
+	AES_N_ALL_ROUNDS_K(n, AES_VAES512_ROUND_KEY, KN, AES_VAES512_LANE_XOR, OP, LASTOP)
+
+/* the masked tail of 1 to 15 blocks in its n registers */
+#define AES_VAES512_TAIL(n, OP, LASTOP) \
+	{ \
+		AES_LANES_##n(AES_VAES512_LANE_MASK) \
+		AES_LANES_##n(AES_VAES512_LANE_MASK_LOAD) \
+		AES_VAES512_ALL_ROUNDS(n, OP, LASTOP); \
+		AES_LANES_##n(AES_VAES512_LANE_MASK_STORE) \
+	}
+
+/* Requests of 1 to 3 blocks go to SMALL, the xmm kernel of their exact width,
+   before any round key is broadcast. Then 64 blocks at a time in 16
+   registers and 16 in 4, all written back by STORE, and the masked tail in
+   as many registers as it fills */
+#define AES_VAES512_DRIVER(name, SMALL, OP, LASTOP, STORE) \
+VAES512_FUNCTION VC_INLINE void name(const __m128i* key_mm, const byte* in, byte* out, uint_32t blocks, const int rounds) \
+{ \
+	if (blocks < 4) \
+	{ \
+		SMALL (key_mm, in, out, blocks, rounds); \
+		return; \
+	} \
+ \
+	AES_LANES_14(AES_VAES512_KEY_LOAD) \
+	const __m512i KN = _mm512_broadcast_i32x4(_mm_loadu_si128(key_mm + rounds)); \
+	__m512i K; \
+	while (blocks >= 64) \
+	{ \
+		AES_LANES_16(AES_VAES512_LANE_LOAD) \
+		AES_VAES512_ALL_ROUNDS(16, OP, LASTOP); \
+		AES_LANES_16(STORE) \
+		blocks -= 64; \
+		in += 64 * 16; \
+		out += 64 * 16; \
+	} \
+	while (blocks >= 16) \
+	{ \
+		AES_LANES_4(AES_VAES512_LANE_LOAD) \
+		AES_VAES512_ALL_ROUNDS(4, OP, LASTOP); \
+		AES_LANES_4(STORE) \
+		blocks -= 16; \
+		in += 16 * 16; \
+		out += 16 * 16; \
+	} \
+	if (blocks) \
+	{ \
+		const uint_32t lanes = (1u << (2 * blocks)) - 1; \
+		switch ((blocks + 3) / 4) \
+		{ \
+		case 1: AES_VAES512_TAIL(1, OP, LASTOP) break; \
+		case 2: AES_VAES512_TAIL(2, OP, LASTOP) break; \
+		case 3: AES_VAES512_TAIL(3, OP, LASTOP) break; \
+		default: AES_VAES512_TAIL(4, OP, LASTOP) break; \
+		} \
+	} \
+}
+
+AES_VAES512_DRIVER(aes_botan_aesni_encrypt_vaes512_nr, aes_botan_aesni_encrypt_sized_nr, AES_VAES512_LANE_ENC, AES_VAES512_LANE_ENCLAST, AES_VAES512_LANE_STORE)
+AES_VAES512_DRIVER(aes_botan_aesni_decrypt_vaes512_nr, aes_botan_aesni_decrypt_sized_nr, AES_VAES512_LANE_DEC, AES_VAES512_LANE_DECLAST, AES_VAES512_LANE_STORE)
+AES_VAES512_DRIVER(aes_botan_aesni_encrypt_vaes512_stream_nr, aes_botan_aesni_encrypt_sized_nr, AES_VAES512_LANE_ENC, AES_VAES512_LANE_ENCLAST, AES_VAES512_LANE_STREAM)
+AES_VAES512_DRIVER(aes_botan_aesni_decrypt_vaes512_stream_nr, aes_botan_aesni_decrypt_sized_nr, AES_VAES512_LANE_DEC, AES_VAES512_LANE_DECLAST, AES_VAES512_LANE_STREAM)
+
+/*
+* With streaming stores: vmovntdq needs out 64-byte aligned, so the first 1 to
+* 3 blocks are stored as usual when it is only 16-byte aligned, and the plain
+* kernel runs when it is not even that
+*/
+#define AES_VAES512_STREAM_DRIVER(dir) \
+VAES512_FUNCTION VC_INLINE void aes_botan_aesni_##dir##_vaes512_nt_nr(const __m128i* key_mm, const byte* in, byte* out, uint_32t blocks, uint_32t head, const int rounds) \
+{ \
+	aes_botan_aesni_##dir##_vaes512_nr (key_mm, in, out, head, rounds); \
+	aes_botan_aesni_##dir##_vaes512_stream_nr (key_mm, in + head * 16, out + head * 16, blocks - head, rounds); \
+	_mm_sfence (); \
+}
+
+AES_VAES512_STREAM_DRIVER(encrypt)
+AES_VAES512_STREAM_DRIVER(decrypt)
+
+VAES512_FUNCTION void aes_botan_aesni_encrypt_vaes512(aes_encrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks)
+{
+	const __m128i* key_mm = (const __m128i*)(ctx->ks);
+
+	AES_NR_DISPATCH (ctx, aes_botan_aesni_encrypt_vaes512_nr (key_mm, in, out, blocks, rounds));
+}
+
+VAES512_FUNCTION void aes_botan_aesni_decrypt_vaes512(aes_decrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks)
+{
+	const __m128i* key_mm = (const __m128i*)(ctx->ks);
+
+	AES_DK_PREPARE (ctx);
+	AES_NR_DISPATCH (ctx, aes_botan_aesni_decrypt_vaes512_nr (key_mm, in, out, blocks, rounds));
+}
+
+VAES512_FUNCTION void aes_botan_aesni_encrypt_vaes512_nt(aes_encrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks)
+{
+	const __m128i* key_mm = (const __m128i*)(ctx->ks);
+	const uint_32t head = (uint_32t) (((size_t) 0 - (size_t) out) & 63) / 16;
+
+	if (((size_t) out & 15) || blocks <= head)
+		aes_botan_aesni_encrypt_vaes512 (ctx, in, out, blocks);
+	else
+		AES_NR_DISPATCH (ctx, aes_botan_aesni_encrypt_vaes512_nt_nr (key_mm, in, out, blocks, head, rounds));
+}
+
+VAES512_FUNCTION void aes_botan_aesni_decrypt_vaes512_nt(aes_decrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks)
+{
+	const __m128i* key_mm = (const __m128i*)(ctx->ks);
+	const uint_32t head = (uint_32t) (((size_t) 0 - (size_t) out) & 63) / 16;
+
+	AES_DK_PREPARE (ctx);
+	if (((size_t) out & 15) || blocks <= head)
+		aes_botan_aesni_decrypt_vaes512 (ctx, in, out, blocks);
+	else
+		AES_NR_DISPATCH (ctx, aes_botan_aesni_decrypt_vaes512_nt_nr (key_mm, in, out, blocks, head, rounds));
+}
+
+/*
+* AES-GCM stitched with GHASH on zmm registers: 16 counter blocks in 4
+* registers go through the rounds while VPCLMULQDQ multiplies the 16 blocks
+* of the previous group (encryption) or of the current one (decryption) by
+* H^16 .. H^1, four per instruction, reduced once. The round keys and the
+* powers of H stay in registers for the whole call
+*/
+#define VAES512_GCM_FUNCTION CRYPTOPP_TARGET("aes,pclmul,avx2,avx512f,avx512bw,vaes,vpclmulqdq")
+
+/* H^(16 - 4q) .. H^(13 - 4q) in the lanes of register q, the order of the blocks it multiplies */
+#define GCM_VAES512_H_LOAD(q) \
+	const __m512i H##q = _mm512_shuffle_i64x2(_mm512_loadu_si512(gctx->H[12 - 4 * q]), _mm512_loadu_si512(gctx->H[12 - 4 * q]), _MM_SHUFFLE(0, 1, 2, 3)); \
+	const __m512i Hk##q = _mm512_shuffle_i64x2(_mm512_loadu_si512(gctx->Hk[12 - 4 * q]), _mm512_loadu_si512(gctx->Hk[12 - 4 * q]), _MM_SHUFFLE(0, 1, 2, 3));
+
+/* register q of the group: counters C + 4q .. C + 4q + 3, only the low 32 bits counting */
+#define GCM_VAES512_LANE_INIT(q) \
+	__m512i B##q = _mm512_shuffle_epi8(_mm512_add_epi32(C, _mm512_broadcast_i32x4(_mm_set_epi32(0, 0, 0, 4 * q))), BSWAP);
+#define GCM_VAES512_LANE_STORE(q) \
+	_mm512_storeu_si512(out + q * 64, _mm512_xor_si512(B##q, _mm512_loadu_si512(in + q * 64)));
+
+/* Karatsuba products of the blocks 4q .. 4q + 3 at hash_in, Y added to block 0 */
+#define GCM_VAES512_GHASH_STEP(q) \
+	{ \
+		__m512i X = _mm512_shuffle_epi8(_mm512_loadu_si512(hash_in + q * 64), BSWAP); \
+		if (q == 0) X = _mm512_xor_si512(X, _mm512_inserti32x4(_mm512_setzero_si512(), Y, 0)); \
+		lo = _mm512_xor_si512(lo, _mm512_clmulepi64_epi128(X, H##q, 0x00)); \
+		hi = _mm512_xor_si512(hi, _mm512_clmulepi64_epi128(X, H##q, 0x11)); \
+		mid = _mm512_xor_si512(mid, _mm512_clmulepi64_epi128(_mm512_xor_si512(X, _mm512_shuffle_epi32(X, _MM_PERM_BADC)), Hk##q, 0x00)); \
+	}
+
+/* one group of 16 blocks, hashing the 16 blocks at hash_in when HASH */
+#define GCM_VAES512_GROUP(HASH) \
+	{ \
+		__m512i lo = _mm512_setzero_si512(), mid = _mm512_setzero_si512(), hi = _mm512_setzero_si512(); \
+		AES_LANES_4(GCM_VAES512_LANE_INIT) \
+		K = K0; \
+		AES_LANES_4(AES_VAES512_LANE_XOR) \
+		AES_N_ROUND_K(4, K1, AES_VAES512_LANE_ENC); \
+		if (HASH) GCM_VAES512_GHASH_STEP(0) \
+		AES_N_ROUND_K(4, K2, AES_VAES512_LANE_ENC); \
+		if (HASH) GCM_VAES512_GHASH_STEP(1) \
+		AES_N_ROUND_K(4, K3, AES_VAES512_LANE_ENC); \
+		if (HASH) GCM_VAES512_GHASH_STEP(2) \
+		AES_N_ROUND_K(4, K4, AES_VAES512_LANE_ENC); \
+		if (HASH) GCM_VAES512_GHASH_STEP(3) \
+		AES_N_ROUND_K(4, K5, AES_VAES512_LANE_ENC); \
+		if (HASH) Y = gcm_reduce (gcm_vaes512_fold (lo), gcm_vaes512_fold (mid), gcm_vaes512_fold (hi)); \
+		AES_N_ROUND_K(4, K6, AES_VAES512_LANE_ENC); \
+		AES_N_ROUND_K(4, K7, AES_VAES512_LANE_ENC); \
+		AES_N_ROUND_K(4, K8, AES_VAES512_LANE_ENC); \
+		AES_N_ROUND_K(4, K9, AES_VAES512_LANE_ENC); \
+		if (rounds > 10) \
+		{ \
+			AES_N_ROUND_K(4, K10, AES_VAES512_LANE_ENC); \
+			AES_N_ROUND_K(4, K11, AES_VAES512_LANE_ENC); \
+		} \
+		if (rounds > 12) \
+		{ \
+			AES_N_ROUND_K(4, K12, AES_VAES512_LANE_ENC); \
+			AES_N_ROUND_K(4, K13, AES_VAES512_LANE_ENC); \
+		} \
+		AES_N_ROUND_K(4, KN, AES_VAES512_LANE_ENCLAST); \
+		AES_LANES_4(GCM_VAES512_LANE_STORE) \
+	}
+
+/* XOR of the four 128-bit lanes of x */
+VAES512_GCM_FUNCTION VC_INLINE __m128i gcm_vaes512_fold(__m512i x)
+{
+	const __m256i t = _mm256_xor_si256(_mm512_castsi512_si256(x), _mm512_extracti64x4_epi64(x, 1));
+
+	return _mm_xor_si128(_mm256_castsi256_si128(t), _mm256_extracti128_si256(t, 1));
+}
+
+VAES512_GCM_FUNCTION VC_INLINE uint_32t aes_botan_aesni_gcm_crypt_vaes512_nr(const __m128i* key_mm, const aes_gcm_ctx* gctx, byte* ctr, byte* ghash,
+																			 const byte* in, byte* out, uint_32t blocks, const int rounds, const int encrypt)
+{
+	const __m512i BSWAP = _mm512_broadcast_i32x4(GCM_BSWAP_MASK);
+	const __m512i SIXTEEN = _mm512_broadcast_i32x4(_mm_set_epi32(0, 0, 0, 16));
+	AES_LANES_14(AES_VAES512_KEY_LOAD)
+	const __m512i KN = _mm512_broadcast_i32x4(_mm_loadu_si128(key_mm + rounds));
+	AES_LANES_4(GCM_VAES512_H_LOAD)
+	// the counter of block j of the group in lane j % 4, so that register q adds 4q
+	__m512i C = _mm512_add_epi32(_mm512_broadcast_i32x4(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(ctr)), GCM_BSWAP_MASK)),
+								 _mm512_set_epi32(0, 0, 0, 3, 0, 0, 0, 2, 0, 0, 0, 1, 0, 0, 0, 0));
+	__m128i Y = _mm_loadu_si128((const __m128i*)(ghash));
+	const byte* hash_in = in;
+	uint_32t groups = blocks / 16, g;
+	__m512i K;
+
+	if (!groups)
+		return 0;
+
+	if (encrypt)
+	{
+		// the ciphertext of a group is hashed while the next group is encrypted
+		GCM_VAES512_GROUP(0)
+		for (g = 1; g < groups; g++)
+		{
+			C = _mm512_add_epi32(C, SIXTEEN);
+			in += 16 * 16;
+			out += 16 * 16;
+			hash_in = out - 16 * 16;
+			GCM_VAES512_GROUP(1)
+		}
+		C = _mm512_add_epi32(C, SIXTEEN);
+
+		// last group on its own
+		{
+			__m512i lo = _mm512_setzero_si512(), mid = _mm512_setzero_si512(), hi = _mm512_setzero_si512();
+
+			hash_in = out;
+			AES_LANES_4(GCM_VAES512_GHASH_STEP)
+			Y = gcm_reduce (gcm_vaes512_fold (lo), gcm_vaes512_fold (mid), gcm_vaes512_fold (hi));
+		}
+	}
+	else
+	{
+		for (g = 0; g < groups; g++)
+		{
+			hash_in = in;
+			GCM_VAES512_GROUP(1)
+			C = _mm512_add_epi32(C, SIXTEEN);
+			in += 16 * 16;
+			out += 16 * 16;
+		}
+	}
+
+	_mm_storeu_si128((__m128i*)(ctr), _mm_shuffle_epi8(_mm512_castsi512_si128(C), GCM_BSWAP_MASK));
+	_mm_storeu_si128((__m128i*)(ghash), Y);
+	return groups * 16;
+}
+
+VAES512_GCM_FUNCTION uint_32t aes_botan_aesni_gcm_encrypt_vaes512(const aes_gcm_ctx* gctx, byte* ctr, byte* ghash, const byte* in, byte* out, uint_32t blocks)
+{
+	const __m128i* key_mm = (const __m128i*)(gctx->ek.ks);
+	uint_32t done = 0;
+
+	AES_NR_DISPATCH (&gctx->ek, done = aes_botan_aesni_gcm_crypt_vaes512_nr (key_mm, gctx, ctr, ghash, in, out, blocks, rounds, 1));
+	return done;
+}
+
+VAES512_GCM_FUNCTION uint_32t aes_botan_aesni_gcm_decrypt_vaes512(const aes_gcm_ctx* gctx, byte* ctr, byte* ghash, const byte* in, byte* out, uint_32t blocks)
+{
+	const __m128i* key_mm = (const __m128i*)(gctx->ek.ks);
+	uint_32t done = 0;
+
+	AES_NR_DISPATCH (&gctx->ek, done = aes_botan_aesni_gcm_crypt_vaes512_nr (key_mm, gctx, ctr, ghash, in, out, blocks, rounds, 0));
+	return done;
+}
+
+#undef GCM_VAES512_GROUP
+#undef GCM_VAES512_GHASH_STEP
+#undef GCM_VAES512_LANE_STORE
+#undef GCM_VAES512_LANE_INIT
+#undef GCM_VAES512_H_LOAD
+#undef VAES512_GCM_FUNCTION
+
+#undef AES_VAES512_DRIVER
+#undef AES_VAES512_TAIL
+#undef AES_VAES512_STREAM_DRIVER
+#undef AES_VAES512_ALL_ROUNDS
+#undef AES_VAES512_KEY_LOAD
+#undef AES_VAES512_ROUND_KEY
+#undef AES_VAES512_LANE_LOAD
+#undef AES_VAES512_LANE_STORE
+#undef AES_VAES512_LANE_STREAM
+#undef AES_VAES512_LANE_MASK
+#undef AES_VAES512_LANE_MASK_LOAD
+#undef AES_VAES512_LANE_MASK_STORE
+#undef AES_VAES512_LANE_XOR
+#undef AES_VAES512_LANE_ENC
+#undef AES_VAES512_LANE_ENCLAST
+#undef AES_VAES512_LANE_DEC
+#undef AES_VAES512_LANE_DECLAST
+#undef VAES512_FUNCTION
+
+#endif
+
+/*
+* AES-256 key expansion, encryption schedule only
+*/
+static void aes_256_expand(const byte* key, __m128i* EK_mm)
+   {
+   __m128i K0 = _mm_loadu_si128((const __m128i*)(key));
+   __m128i K1 = _mm_loadu_si128((const __m128i*)(key + 16));
+
+   __m128i K2 = aes_128_key_expansion(K0, _mm_aeskeygenassist_si128(K1, 0x01));
+   __m128i K3 = aes_256_key_expansion(K1, K2);
+
+   __m128i K4 = aes_128_key_expansion(K2, _mm_aeskeygenassist_si128(K3, 0x02));
+   __m128i K5 = aes_256_key_expansion(K3, K4);
+
+   __m128i K6 = aes_128_key_expansion(K4, _mm_aeskeygenassist_si128(K5, 0x04));
+   __m128i K7 = aes_256_key_expansion(K5, K6);
+
+   __m128i K8 = aes_128_key_expansion(K6, _mm_aeskeygenassist_si128(K7, 0x08));
+   __m128i K9 = aes_256_key_expansion(K7, K8);
+
+   __m128i K10 = aes_128_key_expansion(K8, _mm_aeskeygenassist_si128(K9, 0x10));
+   __m128i K11 = aes_256_key_expansion(K9, K10);
+
+   __m128i K12 = aes_128_key_expansion(K10, _mm_aeskeygenassist_si128(K11, 0x20));
+   __m128i K13 = aes_256_key_expansion(K11, K12);
+
+   __m128i K14 = aes_128_key_expansion(K12, _mm_aeskeygenassist_si128(K13, 0x40));
+
+   _mm_storeu_si128(EK_mm     , K0);
+   _mm_storeu_si128(EK_mm +  1, K1);
+   _mm_storeu_si128(EK_mm +  2, K2);
+   _mm_storeu_si128(EK_mm +  3, K3);
+   _mm_storeu_si128(EK_mm +  4, K4);
+   _mm_storeu_si128(EK_mm +  5, K5);
+   _mm_storeu_si128(EK_mm +  6, K6);
+   _mm_storeu_si128(EK_mm +  7, K7);
+   _mm_storeu_si128(EK_mm +  8, K8);
+   _mm_storeu_si128(EK_mm +  9, K9);
+   _mm_storeu_si128(EK_mm + 10, K10);
+   _mm_storeu_si128(EK_mm + 11, K11);
+   _mm_storeu_si128(EK_mm + 12, K12);
+   _mm_storeu_si128(EK_mm + 13, K13);
+   _mm_storeu_si128(EK_mm + 14, K14);
+   }
+
+#define AES_128_key_exp(K, RCON) \
+   aes_128_key_expansion(K, _mm_aeskeygenassist_si128(K, RCON))
+
+/*
+* AES-128 key expansion, encryption schedule only
+*/
+static void aes_128_expand(const byte* key, __m128i* EK_mm)
+   {
+   const __m128i K0  = _mm_loadu_si128((const __m128i*)(key));
+   const __m128i K1  = AES_128_key_exp(K0, 0x01);
+   const __m128i K2  = AES_128_key_exp(K1, 0x02);
+   const __m128i K3  = AES_128_key_exp(K2, 0x04);
+   const __m128i K4  = AES_128_key_exp(K3, 0x08);
+   const __m128i K5  = AES_128_key_exp(K4, 0x10);
+   const __m128i K6  = AES_128_key_exp(K5, 0x20);
+   const __m128i K7  = AES_128_key_exp(K6, 0x40);
+   const __m128i K8  = AES_128_key_exp(K7, 0x80);
+   const __m128i K9  = AES_128_key_exp(K8, 0x1B);
+   const __m128i K10 = AES_128_key_exp(K9, 0x36);
+
+   _mm_storeu_si128(EK_mm     , K0);
+   _mm_storeu_si128(EK_mm +  1, K1);
+   _mm_storeu_si128(EK_mm +  2, K2);
+   _mm_storeu_si128(EK_mm +  3, K3);
+   _mm_storeu_si128(EK_mm +  4, K4);
+   _mm_storeu_si128(EK_mm +  5, K5);
+   _mm_storeu_si128(EK_mm +  6, K6);
+   _mm_storeu_si128(EK_mm +  7, K7);
+   _mm_storeu_si128(EK_mm +  8, K8);
+   _mm_storeu_si128(EK_mm +  9, K9);
+   _mm_storeu_si128(EK_mm + 10, K10);
+   }
+
+#undef AES_128_key_exp
+
+/*
+* AES-192 key expansion, encryption schedule only
+*/
+static void aes_192_expand(const byte* key, uint_32t* ks)
+   {
+   __m128i K0 = _mm_loadu_si128((const __m128i*)(key));
+   __m128i K1 = _mm_loadu_si128((const __m128i*)(key + 8));
+
+   K1 = _mm_srli_si128(K1, 8);
+
+   memcpy (ks, key, 24);
+
+#define AES_192_key_exp(RCON, EK_OFF) \
+   aes_192_key_expansion(&K0, &K1, \
+                         _mm_aeskeygenassist_si128(K1, RCON), \
+                         &ks[EK_OFF], EK_OFF == 48)
+
+   AES_192_key_exp(0x01, 6);
+   AES_192_key_exp(0x02, 12);
+   AES_192_key_exp(0x04, 18);
+   AES_192_key_exp(0x08, 24);
+   AES_192_key_exp(0x10, 30);
+   AES_192_key_exp(0x20, 36);
+   AES_192_key_exp(0x40, 42);
+   AES_192_key_exp(0x80, 48);
+
+#undef AES_192_key_exp
+   }
+
+/*
+* Decryption schedule from the encryption one: round keys in reverse order,
+* InvMixColumns applied to all but the first and last. EK_mm == DK_mm is fine
+*/
+static void aes_invert_schedule(const __m128i* EK_mm, __m128i* DK_mm, int rounds)
+   {
+   int i, j;
+
+   for(i = 0, j = rounds; i < j; ++i, --j)
+      {
+      const __m128i A = _mm_loadu_si128(EK_mm + i);
+      const __m128i B = _mm_loadu_si128(EK_mm + j);
+
+      _mm_storeu_si128(DK_mm + i, i? _mm_aesimc_si128(B) : B);
+      _mm_storeu_si128(DK_mm + j, i? _mm_aesimc_si128(A) : A);
+      }
+   if(i == j)
+      _mm_storeu_si128(DK_mm + i, _mm_aesimc_si128(_mm_loadu_si128(EK_mm + i)));
+   }
+
+/*
+* AES-256 Key Schedule
+*/
+void aes_botan_aesni_set_key(aes_encrypt_ctx *ctxe, aes_decrypt_ctx *ctxd, const byte* key)
+   {
+   aes_256_expand(key, (__m128i*)(ctxe->ks));
+   aes_invert_schedule((const __m128i*)(ctxe->ks), (__m128i*)(ctxd->ks), 14);
+
+   ctxe->inf.b[0] = ctxd->inf.b[0] = 14 * 16;
+   ctxd->inf.b[1] = 0;
+   }
+
+/*
+* AES-128 Key Schedule
+*/
+void aes_botan_aesni_set_key128(aes_encrypt_ctx *ctxe, aes_decrypt_ctx *ctxd, const byte* key)
+   {
+   aes_128_expand(key, (__m128i*)(ctxe->ks));
+   aes_invert_schedule((const __m128i*)(ctxe->ks), (__m128i*)(ctxd->ks), 10);
+
+   ctxe->inf.b[0] = ctxd->inf.b[0] = 10 * 16;
+   ctxd->inf.b[1] = 0;
+   }
+
+/*
+* AES-192 Key Schedule
+*/
+void aes_botan_aesni_set_key192(aes_encrypt_ctx *ctxe, aes_decrypt_ctx *ctxd, const byte* key)
+   {
+   aes_192_expand(key, ctxe->ks);
+   aes_invert_schedule((const __m128i*)(ctxe->ks), (__m128i*)(ctxd->ks), 12);
+
+   ctxe->inf.b[0] = ctxd->inf.b[0] = 12 * 16;
+   ctxd->inf.b[1] = 0;
+   }
+
+/*
+* Key schedule for a 128, 192 or 256-bit key. As in aes_encrypt_key, the
+* key length may be given either in bytes (16, 24, 32) or in bits
+*/
+AES_RETURN aes_botan_aesni_set_key_var(aes_encrypt_ctx *ctxe, aes_decrypt_ctx *ctxd, const byte* key, int key_len)
+   {
+   switch (key_len)
+   {
+   case 16: case 128: aes_botan_aesni_set_key128 (ctxe, ctxd, key); return EXIT_SUCCESS;
+   case 24: case 192: aes_botan_aesni_set_key192 (ctxe, ctxd, key); return EXIT_SUCCESS;
+   case 32: case 256: aes_botan_aesni_set_key (ctxe, ctxd, key); return EXIT_SUCCESS;
+   default: return EXIT_FAILURE;
+   }
+   }
+
+/*
+* Encryption schedule into ks, returns the number of rounds or 0 for a bad key_len
+*/
+static int aes_expand_key(const byte* key, int key_len, uint_32t* ks)
+   {
+   switch (key_len)
+   {
+   case 16: case 128: aes_128_expand(key, (__m128i*)(ks)); return 10;
+   case 24: case 192: aes_192_expand(key, ks); return 12;
+   case 32: case 256: aes_256_expand(key, (__m128i*)(ks)); return 14;
+   default: return 0;
+   }
+   }
+
+AES_RETURN aes_botan_aesni_set_encrypt_key(aes_encrypt_ctx *ctx, const byte* key, int key_len)
+   {
+   const int rounds = aes_expand_key(key, key_len, ctx->ks);
+
+   if(!rounds)
+      return EXIT_FAILURE;
+   ctx->inf.b[0] = (uint_8t) (rounds * 16);
+   return EXIT_SUCCESS;
+   }
+
+/*
+* Only the encryption schedule is built here; it is turned into the
+* decryption schedule, in place, by the first call that decrypts with ctx
+*/
+AES_RETURN aes_botan_aesni_set_decrypt_key(aes_decrypt_ctx *ctx, const byte* key, int key_len)
+   {
+   const int rounds = aes_expand_key(key, key_len, ctx->ks);
+
+   if(!rounds)
+      return EXIT_FAILURE;
+   ctx->inf.b[0] = (uint_8t) (rounds * 16);
+   ctx->inf.b[1] = AES_DK_PENDING;
+   return EXIT_SUCCESS;
+   }
+
+void aes_botan_aesni_prepare_decrypt_key(aes_decrypt_ctx *ctx)
+   {
+   if(ctx->inf.b[1] == AES_DK_PENDING)
+      {
+      aes_invert_schedule((const __m128i*)(ctx->ks), (__m128i*)(ctx->ks), AES_NR(ctx));
+      ctx->inf.b[1] = 0;
+      }
+   }
+
+/*
+* Batched key expansion. AESKEYGENASSIST has a long latency and each round
+* key depends on the previous one, so a single schedule is one serial chain;
+* several schedules expanded side by side overlap their chains. AESKEYGENASSIST
+* has no VAES form, so the expansion uses AESENCLAST instead: on a block whose
+* four columns hold the same word, ShiftRows does nothing and AESENCLAST is
+* SubWord followed by a xor with the round key, here the round constant.
+*/
+
+static const uint_32t aes_keyexp_rcon[10] = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1B, 0x36};
+
+/* RotWord of the last word, in all four columns */
+#define AES_KEYEXP_ROTWORD_MASK _mm_set_epi8(12, 15, 14, 13, 12, 15, 14, 13, 12, 15, 14, 13, 12, 15, 14, 13)
+
+/* K xored with its words shifted by 1, 2 and 3 positions, then with T */
+VC_INLINE __m128i aes_keyexp_step(__m128i K, __m128i T)
+   {
+   K = _mm_xor_si128(K, _mm_slli_si128(K, 4));
+   K = _mm_xor_si128(K, _mm_slli_si128(K, 8));
+   return _mm_xor_si128(K, T);
+   }
+
+#define AES_KEYEXP_4_STORE(r) \
+   do \
+      { \
+      _mm_storeu_si128((__m128i*)(ks + 0 * stride) + r, K0); \
+      _mm_storeu_si128((__m128i*)(ks + 1 * stride) + r, K1); \
+      _mm_storeu_si128((__m128i*)(ks + 2 * stride) + r, K2); \
+      _mm_storeu_si128((__m128i*)(ks + 3 * stride) + r, K3); \
+      } while(0)
+
+/* 4 consecutive AES-128 keys into the schedules at ks, ks + stride, ... */
+static void aes_128_expand_4x(const byte* keys, byte* ks, size_t stride)
+   {
+   const __m128i ROT = AES_KEYEXP_ROTWORD_MASK;
+   __m128i K0 = _mm_loadu_si128((const __m128i*)(keys) + 0);
+   __m128i K1 = _mm_loadu_si128((const __m128i*)(keys) + 1);
+   __m128i K2 = _mm_loadu_si128((const __m128i*)(keys) + 2);
+   __m128i K3 = _mm_loadu_si128((const __m128i*)(keys) + 3);
+   int r;
+
+   AES_KEYEXP_4_STORE(0);
+   for(r = 1; r <= 10; ++r)
+      {
+      const __m128i RC = _mm_set1_epi32(aes_keyexp_rcon[r - 1]);
+
+      K0 = aes_keyexp_step(K0, _mm_aesenclast_si128(_mm_shuffle_epi8(K0, ROT), RC));
+      K1 = aes_keyexp_step(K1, _mm_aesenclast_si128(_mm_shuffle_epi8(K1, ROT), RC));
+      K2 = aes_keyexp_step(K2, _mm_aesenclast_si128(_mm_shuffle_epi8(K2, ROT), RC));
+      K3 = aes_keyexp_step(K3, _mm_aesenclast_si128(_mm_shuffle_epi8(K3, ROT), RC));
+      AES_KEYEXP_4_STORE(r);
+      }
+   }
+
+/* 4 consecutive AES-256 keys; K is the first half of each key, L the second */
+static void aes_256_expand_4x(const byte* keys, byte* ks, size_t stride)
+   {
+   const __m128i ROT = AES_KEYEXP_ROTWORD_MASK;
+   const __m128i ZERO = _mm_setzero_si128();
+   __m128i K0 = _mm_loadu_si128((const __m128i*)(keys) + 0), L0 = _mm_loadu_si128((const __m128i*)(keys) + 1);
+   __m128i K1 = _mm_loadu_si128((const __m128i*)(keys) + 2), L1 = _mm_loadu_si128((const __m128i*)(keys) + 3);
+   __m128i K2 = _mm_loadu_si128((const __m128i*)(keys) + 4), L2 = _mm_loadu_si128((const __m128i*)(keys) + 5);
+   __m128i K3 = _mm_loadu_si128((const __m128i*)(keys) + 6), L3 = _mm_loadu_si128((const __m128i*)(keys) + 7);
+   int r;
+
+   AES_KEYEXP_4_STORE(0);
+   {
+   __m128i T;
+   T = K0; K0 = L0; L0 = T;
+   T = K1; K1 = L1; L1 = T;
+   T = K2; K2 = L2; L2 = T;
+   T = K3; K3 = L3; L3 = T;
+   }
+   AES_KEYEXP_4_STORE(1);
+
+   // K holds the last round key stored and L the one before it
+   for(r = 2; r <= 14; ++r)
+      {
+      const __m128i RC = (r & 1)? ZERO : _mm_set1_epi32(aes_keyexp_rcon[r / 2 - 1]);
+      __m128i T0, T1, T2, T3;
+
+      if(r & 1)
+         {
+         T0 = _mm_aesenclast_si128(_mm_shuffle_epi32(K0, 0xFF), RC);
+         T1 = _mm_aesenclast_si128(_mm_shuffle_epi32(K1, 0xFF), RC);
+         T2 = _mm_aesenclast_si128(_mm_shuffle_epi32(K2, 0xFF), RC);
+         T3 = _mm_aesenclast_si128(_mm_shuffle_epi32(K3, 0xFF), RC);
+         }
+      else
+         {
+         T0 = _mm_aesenclast_si128(_mm_shuffle_epi8(K0, ROT), RC);
+         T1 = _mm_aesenclast_si128(_mm_shuffle_epi8(K1, ROT), RC);
+         T2 = _mm_aesenclast_si128(_mm_shuffle_epi8(K2, ROT), RC);
+         T3 = _mm_aesenclast_si128(_mm_shuffle_epi8(K3, ROT), RC);
+         }
+
+      T0 = aes_keyexp_step(L0, T0); L0 = K0; K0 = T0;
+      T1 = aes_keyexp_step(L1, T1); L1 = K1; K1 = T1;
+      T2 = aes_keyexp_step(L2, T2); L2 = K2; K2 = T2;
+      T3 = aes_keyexp_step(L3, T3); L3 = K3; K3 = T3;
+      AES_KEYEXP_4_STORE(r);
+      }
+   }
+
+#undef AES_KEYEXP_4_STORE
+#undef AES_KEYEXP_ROTWORD_MASK
+
+/*
+* Schedules of count consecutive keys, 4 at a time, then one at a time.
+* AES-192 keys are expanded one at a time
+*/
+static size_t aes_expand_keys_4x(const byte* keys, size_t count, int key_len, byte* ks, size_t stride)
+   {
+   size_t i;
+   const size_t klen = (size_t) (key_len > 32? key_len / 8 : key_len);
+
+   for(i = 0; i + 4 <= count; i += 4)
+      {
+      if(klen == 16)
+         aes_128_expand_4x(keys + i * klen, ks + i * stride, stride);
+      else if(klen == 32)
+         aes_256_expand_4x(keys + i * klen, ks + i * stride, stride);
+      else
+         break;
+      }
+   return i;
+   }
+
+#if CRYPTOPP_BOOL_X64 && CRYPTOPP_BOOL_VAES_INTRINSICS_AVAILABLE
+
+#define VAES512_KEYEXP_FUNCTION CRYPTOPP_TARGET("aes,avx2,avx512f,vaes")
+
+/* K xored with its words shifted by 1, 2 and 3 positions in each lane, then with T */
+VAES512_KEYEXP_FUNCTION VC_INLINE __m512i aes_keyexp_step_512(__m512i K, __m512i T)
+   {
+   K = _mm512_xor_si512(K, _mm512_maskz_shuffle_epi32(0xEEEE, K, _MM_PERM_CBAA));
+   K = _mm512_xor_si512(K, _mm512_maskz_shuffle_epi32(0xCCCC, K, _MM_PERM_BAAA));
+   return _mm512_xor_si512(K, T);
+   }
+
+#define AES_KEYEXP_16_STORE_LANE(K, k, r) \
+   do \
+      { \
+      _mm_storeu_si128((__m128i*)(ks + (k + 0) * stride) + r, _mm512_extracti32x4_epi32(K, 0)); \
+      _mm_storeu_si128((__m128i*)(ks + (k + 1) * stride) + r, _mm512_extracti32x4_epi32(K, 1)); \
+      _mm_storeu_si128((__m128i*)(ks + (k + 2) * stride) + r, _mm512_extracti32x4_epi32(K, 2)); \
+      _mm_storeu_si128((__m128i*)(ks + (k + 3) * stride) + r, _mm512_extracti32x4_epi32(K, 3)); \
+      } while(0)
+
+#define AES_KEYEXP_16_STORE(r) \
+   do \
+      { \
+      AES_KEYEXP_16_STORE_LANE(K0,  0, r); \
+      AES_KEYEXP_16_STORE_LANE(K1,  4, r); \
+      AES_KEYEXP_16_STORE_LANE(K2,  8, r); \
+      AES_KEYEXP_16_STORE_LANE(K3, 12, r); \
+      } while(0)
+
+/* RotWord of the last word, in all four columns of each lane */
+#define AES_KEYEXP_ROTWORD_512(K) _mm512_ror_epi32(_mm512_shuffle_epi32(K, _MM_PERM_DDDD), 8)
+
+/* 16 consecutive AES-128 keys, four to a register */
+VAES512_KEYEXP_FUNCTION static void aes_128_expand_16x_vaes512(const byte* keys, byte* ks, size_t stride)
+   {
+   __m512i K0 = _mm512_loadu_si512((const void*)(keys +   0));
+   __m512i K1 = _mm512_loadu_si512((const void*)(keys +  64));
+   __m512i K2 = _mm512_loadu_si512((const void*)(keys + 128));
+   __m512i K3 = _mm512_loadu_si512((const void*)(keys + 192));
+   int r;
+
+   AES_KEYEXP_16_STORE(0);
+   for(r = 1; r <= 10; ++r)
+      {
+      const __m512i RC = _mm512_set1_epi32(aes_keyexp_rcon[r - 1]);
+
+      K0 = aes_keyexp_step_512(K0, _mm512_aesenclast_epi128(AES_KEYEXP_ROTWORD_512(K0), RC));
+      K1 = aes_keyexp_step_512(K1, _mm512_aesenclast_epi128(AES_KEYEXP_ROTWORD_512(K1), RC));
+      K2 = aes_keyexp_step_512(K2, _mm512_aesenclast_epi128(AES_KEYEXP_ROTWORD_512(K2), RC));
+      K3 = aes_keyexp_step_512(K3, _mm512_aesenclast_epi128(AES_KEYEXP_ROTWORD_512(K3), RC));
+      AES_KEYEXP_16_STORE(r);
+      }
+   }
+
+/* 16 consecutive AES-256 keys; the first and second halves of four keys are gathered in K and L */
+VAES512_KEYEXP_FUNCTION static void aes_256_expand_16x_vaes512(const byte* keys, byte* ks, size_t stride)
+   {
+   const __m512i LO = _mm512_set_epi64(13, 12, 9, 8, 5, 4, 1, 0);
+   const __m512i HI = _mm512_set_epi64(15, 14, 11, 10, 7, 6, 3, 2);
+   const __m512i ZERO = _mm512_setzero_si512();
+   __m512i K0, K1, K2, K3, L0, L1, L2, L3;
+   int r;
+
+#define AES_KEYEXP_LOAD_256(K, L, off) \
+   do \
+      { \
+      const __m512i A = _mm512_loadu_si512((const void*)(keys + off)); \
+      const __m512i B = _mm512_loadu_si512((const void*)(keys + off + 64)); \
+      K = _mm512_permutex2var_epi64(A, LO, B); \
+      L = _mm512_permutex2var_epi64(A, HI, B); \
+      } while(0)
+
+   AES_KEYEXP_LOAD_256(K0, L0,   0);
+   AES_KEYEXP_LOAD_256(K1, L1, 128);
+   AES_KEYEXP_LOAD_256(K2, L2, 256);
+   AES_KEYEXP_LOAD_256(K3, L3, 384);
+
+#undef AES_KEYEXP_LOAD_256
+
+   AES_KEYEXP_16_STORE(0);
+   {
+   __m512i T;
+   T = K0; K0 = L0; L0 = T;
+   T = K1; K1 = L1; L1 = T;
+   T = K2; K2 = L2; L2 = T;
+   T = K3; K3 = L3; L3 = T;
+   }
+   AES_KEYEXP_16_STORE(1);
+
+   // K holds the last round key stored and L the one before it
+   for(r = 2; r <= 14; ++r)
+      {
+      __m512i T0, T1, T2, T3;
+
+      if(r & 1)
+         {
+         T0 = _mm512_aesenclast_epi128(_mm512_shuffle_epi32(K0, _MM_PERM_DDDD), ZERO);
+         T1 = _mm512_aesenclast_epi128(_mm512_shuffle_epi32(K1, _MM_PERM_DDDD), ZERO);
+         T2 = _mm512_aesenclast_epi128(_mm512_shuffle_epi32(K2, _MM_PERM_DDDD), ZERO);
+         T3 = _mm512_aesenclast_epi128(_mm512_shuffle_epi32(K3, _MM_PERM_DDDD), ZERO);
+         }
+      else
+         {
+         const __m512i RC = _mm512_set1_epi32(aes_keyexp_rcon[r / 2 - 1]);
+
+         T0 = _mm512_aesenclast_epi128(AES_KEYEXP_ROTWORD_512(K0), RC);
+         T1 = _mm512_aesenclast_epi128(AES_KEYEXP_ROTWORD_512(K1), RC);
+         T2 = _mm512_aesenclast_epi128(AES_KEYEXP_ROTWORD_512(K2), RC);
+         T3 = _mm512_aesenclast_epi128(AES_KEYEXP_ROTWORD_512(K3), RC);
+         }
+
+      T0 = aes_keyexp_step_512(L0, T0); L0 = K0; K0 = T0;
+      T1 = aes_keyexp_step_512(L1, T1); L1 = K1; K1 = T1;
+      T2 = aes_keyexp_step_512(L2, T2); L2 = K2; K2 = T2;
+      T3 = aes_keyexp_step_512(L3, T3); L3 = K3; K3 = T3;
+      AES_KEYEXP_16_STORE(r);
+      }
+   }
+
+#undef AES_KEYEXP_ROTWORD_512
+#undef AES_KEYEXP_16_STORE
+#undef AES_KEYEXP_16_STORE_LANE
+
+static size_t aes_expand_keys_16x_vaes512(const byte* keys, size_t count, int key_len, byte* ks, size_t stride)
+   {
+   size_t i;
+   const size_t klen = (size_t) (key_len > 32? key_len / 8 : key_len);
+
+   for(i = 0; i + 16 <= count; i += 16)
+      {
+      if(klen == 16)
+         aes_128_expand_16x_vaes512(keys + i * klen, ks + i * stride, stride);
+      else if(klen == 32)
+         aes_256_expand_16x_vaes512(keys + i * klen, ks + i * stride, stride);
+      else
+         break;
+      }
+   return i;
+   }
+
+#undef VAES512_KEYEXP_FUNCTION
+
+#endif
+
+/*
+* Encryption schedules of count keys stored back to back in keys, the
+* schedule of key i going to ks + i * stride. Returns the number of rounds,
+* 0 for a bad key_len. level 0 expands one key at a time, 1 four at a time
+* with SSE, 2 sixteen at a time with VAES-512 when available
+*/
+static int aes_expand_keys(const byte* keys, size_t count, int key_len, byte* ks, size_t stride, int level)
+   {
+   const size_t klen = (size_t) (key_len > 32? key_len / 8 : key_len);
+   int rounds = 0;
+   size_t i = 0;
+
+#if CRYPTOPP_BOOL_X64 && CRYPTOPP_BOOL_VAES_INTRINSICS_AVAILABLE
+   if(level >= 2 && g_hasVAES && g_hasAVX512F)
+      i = aes_expand_keys_16x_vaes512(keys, count, key_len, ks, stride);
+#endif
+   if(level >= 1)
+      i += aes_expand_keys_4x(keys + i * klen, count - i, key_len, ks + i * stride, stride);
+
+   for(; i < count; ++i)
+      rounds = aes_expand_key(keys + i * klen, key_len, (uint_32t*)(ks + i * stride));
+   if(!rounds)
+      rounds = (klen == 16)? 10 : (klen == 24)? 12 : (klen == 32)? 14 : 0;
+   return rounds;
+   }
+
+#define AES_KEYS_STRIDE	sizeof(aes_encrypt_ctx)
+
+static AES_RETURN aes_set_encrypt_keys(aes_encrypt_ctx *ctx, const byte* keys, size_t count, int key_len, int level)
+   {
+   size_t i;
+   const int rounds = aes_expand_keys(keys, count, key_len, (byte*)(ctx->ks), AES_KEYS_STRIDE, level);
+
+   if(!rounds)
+      return EXIT_FAILURE;
+   for(i = 0; i < count; ++i)
+      ctx[i].inf.b[0] = (uint_8t) (rounds * 16);
+   return EXIT_SUCCESS;
+   }
+
+static AES_RETURN aes_set_decrypt_keys(aes_decrypt_ctx *ctx, const byte* keys, size_t count, int key_len, int level)
+   {
+   size_t i;
+   const int rounds = aes_expand_keys(keys, count, key_len, (byte*)(ctx->ks), AES_KEYS_STRIDE, level);
+
+   if(!rounds)
+      return EXIT_FAILURE;
+   for(i = 0; i < count; ++i)
+      {
+      ctx[i].inf.b[0] = (uint_8t) (rounds * 16);
+      ctx[i].inf.b[1] = AES_DK_PENDING;
+      }
+   return EXIT_SUCCESS;
+   }
+
+AES_RETURN aes_botan_aesni_set_encrypt_keys(aes_encrypt_ctx *ctx, const byte* keys, size_t count, int key_len)
+   {
+   return aes_set_encrypt_keys(ctx, keys, count, key_len, 2);
+   }
+
+AES_RETURN aes_botan_aesni_set_decrypt_keys(aes_decrypt_ctx *ctx, const byte* keys, size_t count, int key_len)
+   {
+   return aes_set_decrypt_keys(ctx, keys, count, key_len, 2);
+   }
+
+AES_RETURN aes_botan_aesni_set_encrypt_keys_4x(aes_encrypt_ctx *ctx, const byte* keys, size_t count, int key_len)
+   {
+   return aes_set_encrypt_keys(ctx, keys, count, key_len, 1);
+   }
+
+AES_RETURN aes_botan_aesni_set_encrypt_keys_1x(aes_encrypt_ctx *ctx, const byte* keys, size_t count, int key_len)
+   {
+   return aes_set_encrypt_keys(ctx, keys, count, key_len, 0);
+   }
+
+#undef AES_KEYS_STRIDE
 
-   // Now generate decryption keys
-   
-   _mm_storeu_si128(DK_mm     , K14);
-   _mm_storeu_si128(DK_mm +  1, _mm_aesimc_si128(K13));
-   _mm_storeu_si128(DK_mm +  2, _mm_aesimc_si128(K12));
-   _mm_storeu_si128(DK_mm +  3, _mm_aesimc_si128(K11));
-   _mm_storeu_si128(DK_mm +  4, _mm_aesimc_si128(K10));
-   _mm_storeu_si128(DK_mm +  5, _mm_aesimc_si128(K9));
-   _mm_storeu_si128(DK_mm +  6, _mm_aesimc_si128(K8));
-   _mm_storeu_si128(DK_mm +  7, _mm_aesimc_si128(K7));
-   _mm_storeu_si128(DK_mm +  8, _mm_aesimc_si128(K6));
-   _mm_storeu_si128(DK_mm +  9, _mm_aesimc_si128(K5));
-   _mm_storeu_si128(DK_mm + 10, _mm_aesimc_si128(K4));
-   _mm_storeu_si128(DK_mm + 11, _mm_aesimc_si128(K3));
-   _mm_storeu_si128(DK_mm + 12, _mm_aesimc_si128(K2));
-   _mm_storeu_si128(DK_mm + 13, _mm_aesimc_si128(K1));
-   _mm_storeu_si128(DK_mm + 14, K0);
-   }
-
-#undef AES_ENC_4_ROUNDS
-#undef AES_ENC_4_LAST_ROUNDS
-#undef AES_DEC_4_ROUNDS
-#undef AES_DEC_4_LAST_ROUNDS
+#undef AES_N_WAY_KERNELS
+#undef AES_N_ALL_ROUNDS
+#undef AES_N_ROUND
+#undef AES_ROUND_KEY
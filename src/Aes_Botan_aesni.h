@@ -7,6 +7,7 @@ and released into public domain.
 #include "Tcdefs.h"
 #include "config.h"
 #include "Aes.h"
+#include "Aes_gcm.h"
 
 #pragma once
 
@@ -16,6 +17,28 @@ extern "C"
 #endif
 
 void aes_botan_aesni_set_key(aes_encrypt_ctx *ctxe, aes_decrypt_ctx *ctxd, const byte* in_key);
+void aes_botan_aesni_set_key128(aes_encrypt_ctx *ctxe, aes_decrypt_ctx *ctxd, const byte* in_key);
+void aes_botan_aesni_set_key192(aes_encrypt_ctx *ctxe, aes_decrypt_ctx *ctxd, const byte* in_key);
+/* key_len in bytes (16, 24, 32) or bits (128, 192, 256) */
+AES_RETURN aes_botan_aesni_set_key_var(aes_encrypt_ctx *ctxe, aes_decrypt_ctx *ctxd, const byte* in_key, int key_len);
+
+/* Separate encryption and decryption schedules, key_len as above. The
+   decryption schedule is only derived from the encryption one when ctx is
+   first used to decrypt, so set_decrypt_key costs no more than set_encrypt_key.
+   That first use writes to ctx: it must not run concurrently with another use
+   of the same ctx, unless aes_botan_aesni_prepare_decrypt_key was called before. */
+AES_RETURN aes_botan_aesni_set_encrypt_key(aes_encrypt_ctx *ctx, const byte* in_key, int key_len);
+AES_RETURN aes_botan_aesni_set_decrypt_key(aes_decrypt_ctx *ctx, const byte* in_key, int key_len);
+void aes_botan_aesni_prepare_decrypt_key(aes_decrypt_ctx *ctx);
+
+/* Schedules of count keys of the same size stored back to back in keys, into
+   ctx[0] .. ctx[count - 1]. Several keys are expanded side by side: 16 at a time
+   with VAES-512 when available, then 4 at a time; AES-192 keys one at a time */
+AES_RETURN aes_botan_aesni_set_encrypt_keys(aes_encrypt_ctx *ctx, const byte* keys, size_t count, int key_len);
+AES_RETURN aes_botan_aesni_set_decrypt_keys(aes_decrypt_ctx *ctx, const byte* keys, size_t count, int key_len);
+/* for comparison: 4 keys at a time without VAES, and one key at a time */
+AES_RETURN aes_botan_aesni_set_encrypt_keys_4x(aes_encrypt_ctx *ctx, const byte* keys, size_t count, int key_len);
+AES_RETURN aes_botan_aesni_set_encrypt_keys_1x(aes_encrypt_ctx *ctx, const byte* keys, size_t count, int key_len);
 
 #if CRYPTOPP_BOOL_X64
 void aes_botan_aesni_encrypt_15x(aes_encrypt_ctx *instance, const byte* in_blk, byte* out_blk, uint_32t blocks);
@@ -29,6 +52,130 @@ void aes_botan_aesni_decrypt_15x(aes_decrypt_ctx *instance, const byte* in_blk,
 void aes_botan_aesni_decrypt_7x(aes_decrypt_ctx *instance, const byte* in_blk, byte* out_blk, uint_32t blocks);
 void aes_botan_aesni_decrypt_4x(aes_decrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks);
 
+/* The 15-way and 7-way kernels with streaming stores, for out-of-place
+   requests larger than the last level cache: the output is not read for
+   ownership first and does not evict the working set. Slower when out is
+   read again soon, and nothing gained in place. Unless out is 16-byte
+   aligned, the plain kernels run. */
+#if CRYPTOPP_BOOL_X64
+void aes_botan_aesni_encrypt_15x_nt(aes_encrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks);
+void aes_botan_aesni_decrypt_15x_nt(aes_decrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks);
+#endif
+void aes_botan_aesni_encrypt_7x_nt(aes_encrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks);
+void aes_botan_aesni_decrypt_7x_nt(aes_decrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks);
+
+/* ECB routed by size: requests shorter than the wide loop in one pass of the
+   kernel of their exact width, so that 1 to 3 blocks pay no loop overhead */
+void aes_botan_aesni_encrypt_sized(aes_encrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks);
+void aes_botan_aesni_decrypt_sized(aes_decrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks);
+
+/* ECB with ways blocks in flight, 1 to AES_BOTAN_MAX_WAYS; beyond the register
+   count of the CPU, blocks spill to the stack. EXIT_FAILURE for other widths */
+#define AES_BOTAN_MAX_WAYS	32
+AES_RETURN aes_botan_aesni_encrypt_width(aes_encrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks, uint_32t ways);
+AES_RETURN aes_botan_aesni_decrypt_width(aes_decrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks, uint_32t ways);
+
+/* the kernels of width ways as plain functions, to bind them without the
+   width argument; NULL for other widths */
+typedef void (*aes_ecb_encrypt_width_fn) (aes_encrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks);
+typedef void (*aes_ecb_decrypt_width_fn) (aes_decrypt_ctx *ctx, const byte* in, byte* out, uint_32t blocks);
+aes_ecb_encrypt_width_fn aes_botan_aesni_encrypt_width_kernel(uint_32t ways);
+aes_ecb_decrypt_width_fn aes_botan_aesni_decrypt_width_kernel(uint_32t ways);
+
+/* CTR mode state. Calls may pass any number of bytes: the unused part of the
+   last keystream block is kept and consumed first by the next call. */
+typedef struct
+{
+	byte ctr[16];		/* next counter block (big-endian) */
+	byte buf[16];		/* keystream of the last partial block */
+	uint_32t used;		/* bytes of buf already consumed */
+	int width;			/* counter width in bits: 32, 64 or 128 */
+} aes_ctr_state;
+
+AES_RETURN aes_botan_aesni_ctr_init(aes_ctr_state* state, const byte* iv, int ctr_bits);
+
+#if CRYPTOPP_BOOL_X64
+void aes_botan_aesni_ctr_crypt_15x(aes_encrypt_ctx *instance, aes_ctr_state* state, const byte* in_blk, byte* out_blk, uint_32t len);
+#endif
+void aes_botan_aesni_ctr_crypt_7x(aes_encrypt_ctx *instance, aes_ctr_state* state, const byte* in_blk, byte* out_blk, uint_32t len);
+
+/* GCM with GHASH stitched into the AES rounds, require HasCLMUL(). Process whole
+   groups of 8 blocks and return how many blocks were done. ctr is the next
+   counter block, ghash the byte-reflected GHASH state; both are updated. */
+uint_32t aes_botan_aesni_gcm_encrypt_8x(const aes_gcm_ctx* gctx, byte* ctr, byte* ghash, const byte* in_blk, byte* out_blk, uint_32t blocks);
+uint_32t aes_botan_aesni_gcm_decrypt_8x(const aes_gcm_ctx* gctx, byte* ctr, byte* ghash, const byte* in_blk, byte* out_blk, uint_32t blocks);
+
+/* CBC mode, iv is updated to the last ciphertext block so that calls can be chained */
+void aes_botan_aesni_cbc_encrypt(aes_encrypt_ctx *instance, byte* iv, const byte* in_blk, byte* out_blk, uint_32t blocks);
+#if CRYPTOPP_BOOL_X64
+void aes_botan_aesni_cbc_decrypt_15x(aes_decrypt_ctx *instance, byte* iv, const byte* in_blk, byte* out_blk, uint_32t blocks);
+#endif
+void aes_botan_aesni_cbc_decrypt_7x(aes_decrypt_ctx *instance, byte* iv, const byte* in_blk, byte* out_blk, uint_32t blocks);
+
+/* one independent stream of the multi-stream CBC encryption */
+typedef struct
+{
+	const byte* in;
+	byte* out;
+	uint_32t blocks;
+	byte iv[16];		/* updated to the last ciphertext block */
+} aes_cbc_stream;
+
+/* encrypt count streams, one block of several streams per AES pipeline pass */
+#if CRYPTOPP_BOOL_X64
+void aes_botan_aesni_cbc_encrypt_streams_15x(aes_encrypt_ctx *instance, aes_cbc_stream* streams, uint_32t count);
+#endif
+void aes_botan_aesni_cbc_encrypt_streams_7x(aes_encrypt_ctx *instance, aes_cbc_stream* streams, uint_32t count);
+
+/* XTS-AES (IEEE 1619): data key and tweak key */
+typedef struct
+{
+	aes_encrypt_ctx ek;
+	aes_decrypt_ctx dk;
+	aes_encrypt_ctx tk;
+} aes_xts_ctx;
+
+/* key1 is the data key, key2 the tweak key, both of key_len bytes (16, 24, 32) or bits */
+AES_RETURN aes_botan_aesni_xts_set_key(aes_xts_ctx* ctx, const byte* key1, const byte* key2, int key_len);
+
+/* sectorCount consecutive data units of sectorSize bytes (at least 16, ciphertext
+   stealing is used when it is not a multiple of 16), numbered from startSector.
+   XTS has no encryption of shorter units: with sectorSize under 16, out is left
+   as it is. */
+#if CRYPTOPP_BOOL_X64
+void aes_botan_aesni_xts_encrypt_15x(const aes_xts_ctx* ctx, const byte* in_blk, byte* out_blk, uint64 startSector, uint_32t sectorCount, uint_32t sectorSize);
+void aes_botan_aesni_xts_decrypt_15x(const aes_xts_ctx* ctx, const byte* in_blk, byte* out_blk, uint64 startSector, uint_32t sectorCount, uint_32t sectorSize);
+#endif
+void aes_botan_aesni_xts_encrypt_7x(const aes_xts_ctx* ctx, const byte* in_blk, byte* out_blk, uint64 startSector, uint_32t sectorCount, uint_32t sectorSize);
+void aes_botan_aesni_xts_decrypt_7x(const aes_xts_ctx* ctx, const byte* in_blk, byte* out_blk, uint64 startSector, uint_32t sectorCount, uint_32t sectorSize);
+
+#if CRYPTOPP_BOOL_X64 && CRYPTOPP_BOOL_VAES_INTRINSICS_AVAILABLE
+/* require HasVAES() */
+void aes_botan_aesni_encrypt_vaes256_32x(aes_encrypt_ctx *instance, const byte* in_blk, byte* out_blk, uint_32t blocks);
+void aes_botan_aesni_encrypt_vaes256_16x(aes_encrypt_ctx *instance, const byte* in_blk, byte* out_blk, uint_32t blocks);
+
+void aes_botan_aesni_decrypt_vaes256_32x(aes_decrypt_ctx *instance, const byte* in_blk, byte* out_blk, uint_32t blocks);
+void aes_botan_aesni_decrypt_vaes256_16x(aes_decrypt_ctx *instance, const byte* in_blk, byte* out_blk, uint_32t blocks);
+
+/* require HasVAES() && HasAVX512F() */
+void aes_botan_aesni_encrypt_vaes512(aes_encrypt_ctx *instance, const byte* in_blk, byte* out_blk, uint_32t blocks);
+void aes_botan_aesni_decrypt_vaes512(aes_decrypt_ctx *instance, const byte* in_blk, byte* out_blk, uint_32t blocks);
+
+/* the VAES and VAES-512 kernels with streaming stores, as the 15-way and
+   7-way ones above; same requirements as the plain kernels */
+void aes_botan_aesni_encrypt_vaes256_16x_nt(aes_encrypt_ctx *instance, const byte* in_blk, byte* out_blk, uint_32t blocks);
+void aes_botan_aesni_decrypt_vaes256_16x_nt(aes_decrypt_ctx *instance, const byte* in_blk, byte* out_blk, uint_32t blocks);
+void aes_botan_aesni_encrypt_vaes256_32x_nt(aes_encrypt_ctx *instance, const byte* in_blk, byte* out_blk, uint_32t blocks);
+void aes_botan_aesni_decrypt_vaes256_32x_nt(aes_decrypt_ctx *instance, const byte* in_blk, byte* out_blk, uint_32t blocks);
+void aes_botan_aesni_encrypt_vaes512_nt(aes_encrypt_ctx *instance, const byte* in_blk, byte* out_blk, uint_32t blocks);
+void aes_botan_aesni_decrypt_vaes512_nt(aes_decrypt_ctx *instance, const byte* in_blk, byte* out_blk, uint_32t blocks);
+
+/* the stitched GCM kernels above on groups of 16 blocks, with the 16 powers
+   of H; require HasVAES() && HasAVX512F() && HasAVX512BW() && HasVPCLMULQDQ() */
+uint_32t aes_botan_aesni_gcm_encrypt_vaes512(const aes_gcm_ctx* gctx, byte* ctr, byte* ghash, const byte* in_blk, byte* out_blk, uint_32t blocks);
+uint_32t aes_botan_aesni_gcm_decrypt_vaes512(const aes_gcm_ctx* gctx, byte* ctr, byte* ghash, const byte* in_blk, byte* out_blk, uint_32t blocks);
+#endif
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,503 @@
+/*
+ * Runtime selection of the AES-NI kernels.
+ *
+ * Without a profile, the entry points are bound to the widest kernel the CPU
+ * supports. With one, they go through a table indexed by direction, key size
+ * and request size class, filled by aes_dispatch_autotune from measurements.
+ */
+
+#ifdef _MSC_VER
+#define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cpu.h"
+#include "Aes_Botan_aesni.h"
+#include "Aes_lanes.h"
+#include "Aes_dispatch.h"
+#include "utils.h"
+
+typedef struct
+{
+	const char* name;
+	aes_encrypt_blocks_fn encrypt;
+	aes_decrypt_blocks_fn decrypt;
+	int (*isSupported) (void);	/* NULL when AES-NI is enough */
+	aes_encrypt_blocks_fn streamEncrypt;	/* the same family with streaming stores, */
+	aes_decrypt_blocks_fn streamDecrypt;	/* for out-of-place requests past the cache */
+	uint_32t ways;	/* for aes_botan_aesni_encrypt_width, 0 for the others */
+} AES_KERNEL;
+
+#if CRYPTOPP_BOOL_X64 && CRYPTOPP_BOOL_VAES_INTRINSICS_AVAILABLE
+static int IsVAES512Supported (void) { return HasVAES() && HasAVX512F(); }
+static int IsVAESSupported (void) { return HasVAES(); }
+#endif
+
+#if CRYPTOPP_BOOL_X64
+#define AES_STREAM_ENCRYPT	aes_botan_aesni_encrypt_15x_nt
+#define AES_STREAM_DECRYPT	aes_botan_aesni_decrypt_15x_nt
+#else
+#define AES_STREAM_ENCRYPT	aes_botan_aesni_encrypt_7x_nt
+#define AES_STREAM_DECRYPT	aes_botan_aesni_decrypt_7x_nt
+#endif
+
+/* Ordered from the most to the least demanding, the first supported one wins.
+   The VAES kernels start with the size-adaptive path, under 4 blocks for
+   VAES-512 and 16 for the others, so that the default binding keeps the wide
+   loops for large requests. */
+static const AES_KERNEL g_aesKernels[] = {
+#if CRYPTOPP_BOOL_X64 && CRYPTOPP_BOOL_VAES_INTRINSICS_AVAILABLE
+	{ "VAES-512 64-way", aes_botan_aesni_encrypt_vaes512, aes_botan_aesni_decrypt_vaes512, IsVAES512Supported,
+		aes_botan_aesni_encrypt_vaes512_nt, aes_botan_aesni_decrypt_vaes512_nt, 0 },
+	{ "VAES 32-way", aes_botan_aesni_encrypt_vaes256_32x, aes_botan_aesni_decrypt_vaes256_32x, IsVAESSupported,
+		aes_botan_aesni_encrypt_vaes256_32x_nt, aes_botan_aesni_decrypt_vaes256_32x_nt, 0 },
+	{ "VAES 16-way", aes_botan_aesni_encrypt_vaes256_16x, aes_botan_aesni_decrypt_vaes256_16x, IsVAESSupported,
+		aes_botan_aesni_encrypt_vaes256_16x_nt, aes_botan_aesni_decrypt_vaes256_16x_nt, 0 },
+#endif
+	{ "AES-NI size-adaptive", aes_botan_aesni_encrypt_sized, aes_botan_aesni_decrypt_sized, NULL, AES_STREAM_ENCRYPT, AES_STREAM_DECRYPT, 0 },
+#if CRYPTOPP_BOOL_X64
+	{ "AES-NI 15-way", aes_botan_aesni_encrypt_15x, aes_botan_aesni_decrypt_15x, NULL, AES_STREAM_ENCRYPT, AES_STREAM_DECRYPT, 0 },
+#endif
+	{ "AES-NI 7-way", aes_botan_aesni_encrypt_7x, aes_botan_aesni_decrypt_7x, NULL, AES_STREAM_ENCRYPT, AES_STREAM_DECRYPT, 0 },
+	{ "AES-NI 4-way", aes_botan_aesni_encrypt_4x, aes_botan_aesni_decrypt_4x, NULL, AES_STREAM_ENCRYPT, AES_STREAM_DECRYPT, 0 },
+};
+
+#define AES_KERNEL_COUNT (sizeof (g_aesKernels) / sizeof (g_aesKernels[0]))
+
+/* The AES-NI kernels of every width, which only the autotuner picks: the
+   profile records them by name, and so by width */
+#define AES_WIDTH_KERNEL_NAME "AES-NI width %u"
+
+static AES_KERNEL g_aesWidthKernels[AES_BOTAN_MAX_WAYS];
+static char g_aesWidthKernelNames[AES_BOTAN_MAX_WAYS][24];
+
+static void aes_init_width_kernels (void)
+{
+	uint_32t w;
+
+	for (w = 1; w <= AES_BOTAN_MAX_WAYS && !g_aesWidthKernels[w - 1].ways; w++)
+	{
+		sprintf (g_aesWidthKernelNames[w - 1], AES_WIDTH_KERNEL_NAME, w);
+		g_aesWidthKernels[w - 1].name = g_aesWidthKernelNames[w - 1];
+		g_aesWidthKernels[w - 1].encrypt = aes_botan_aesni_encrypt_width_kernel (w);
+		g_aesWidthKernels[w - 1].decrypt = aes_botan_aesni_decrypt_width_kernel (w);
+		g_aesWidthKernels[w - 1].streamEncrypt = AES_STREAM_ENCRYPT;
+		g_aesWidthKernels[w - 1].streamDecrypt = AES_STREAM_DECRYPT;
+		g_aesWidthKernels[w - 1].ways = w;
+	}
+}
+
+/* the VAES 32-way and AES-NI 4-way kernels are only picked by the autotuner */
+static int IsDefaultCandidate (const AES_KERNEL* kernel)
+{
+	return kernel->encrypt != aes_botan_aesni_encrypt_4x
+#if CRYPTOPP_BOOL_X64 && CRYPTOPP_BOOL_VAES_INTRINSICS_AVAILABLE
+		&& kernel->encrypt != aes_botan_aesni_encrypt_vaes256_32x
+#endif
+		;
+}
+
+static int IsKernelSupported (const AES_KERNEL* kernel)
+{
+	return !kernel->isSupported || kernel->isSupported ();
+}
+
+static const AES_KERNEL* g_aesSelectedKernel = NULL;
+
+/* largest request of each size class, in blocks */
+static const uint_32t g_aesSizeClasses[AES_DISPATCH_SIZE_CLASSES] = {1, 4, 16, 64, 256, 1024, 4096, 0xFFFFFFFF};
+
+/* [decrypt][(rounds - 10) / 2][size class], all set when g_aesTuned is */
+static const AES_KERNEL* g_aesProfile[2][3][AES_DISPATCH_SIZE_CLASSES];
+static int g_aesTuned = 0;
+
+/* the kernel functions of g_aesProfile, so that a tuned call is a single
+   lookup and call */
+static aes_encrypt_blocks_fn g_aesTunedEncrypt[3][AES_DISPATCH_SIZE_CLASSES];
+static aes_decrypt_blocks_fn g_aesTunedDecrypt[3][AES_DISPATCH_SIZE_CLASSES];
+
+/* index in g_aesSizeClasses of the class of blocks, without a loop: the
+   bounds are those of g_aesSizeClasses */
+#define AES_DISPATCH_SIZE_CLASS(blocks) \
+	(((blocks) > 1) + ((blocks) > 4) + ((blocks) > 16) + ((blocks) > 64) + ((blocks) > 256) + ((blocks) > 1024) + ((blocks) > 4096))
+
+/* (rounds - 10) / 2, with any round count but 10 and 12 taken as 14, as
+   AES_ROUNDS_DISPATCH does in the kernels: an unset context cannot index
+   past the tables */
+#define AES_DISPATCH_KEY_INDEX(ctx) (AES_NR (ctx) == 10? 0 : AES_NR (ctx) == 12? 1 : 2)
+
+/* requests to aes_*_blocks_oop of more than this many blocks, the last level
+   cache, go to the streaming kernels, 0 for none */
+static uint_32t g_aesStreamBlocks = 0;
+/* [decrypt][(rounds - 10) / 2], the kernel bound to the largest requests,
+   whose streaming variant takes those past the cache */
+static const AES_KERNEL* g_aesStreamKernels[2][3];
+
+static void aes_encrypt_blocks_resolve (aes_encrypt_ctx *ctx, const byte* in_blk, byte* out_blk, uint_32t blocks)
+{
+	aes_dispatch_init ();
+	aes_encrypt_blocks (ctx, in_blk, out_blk, blocks);
+}
+
+static void aes_decrypt_blocks_resolve (aes_decrypt_ctx *ctx, const byte* in_blk, byte* out_blk, uint_32t blocks)
+{
+	aes_dispatch_init ();
+	aes_decrypt_blocks (ctx, in_blk, out_blk, blocks);
+}
+
+static void aes_encrypt_blocks_tuned (aes_encrypt_ctx *ctx, const byte* in_blk, byte* out_blk, uint_32t blocks)
+{
+	g_aesTunedEncrypt[AES_DISPATCH_KEY_INDEX (ctx)][AES_DISPATCH_SIZE_CLASS (blocks)] (ctx, in_blk, out_blk, blocks);
+}
+
+static void aes_decrypt_blocks_tuned (aes_decrypt_ctx *ctx, const byte* in_blk, byte* out_blk, uint_32t blocks)
+{
+	g_aesTunedDecrypt[AES_DISPATCH_KEY_INDEX (ctx)][AES_DISPATCH_SIZE_CLASS (blocks)] (ctx, in_blk, out_blk, blocks);
+}
+
+aes_encrypt_blocks_fn aes_encrypt_blocks = aes_encrypt_blocks_resolve;
+aes_decrypt_blocks_fn aes_decrypt_blocks = aes_decrypt_blocks_resolve;
+
+/* The streaming variants of g_aesStreamKernels are of the same family as the
+   kernels bound to large requests: VAES bindings stream with VAES kernels */
+void aes_encrypt_blocks_oop (aes_encrypt_ctx *ctx, const byte* in_blk, byte* out_blk, uint_32t blocks)
+{
+	if (g_aesStreamBlocks && blocks > g_aesStreamBlocks && in_blk != out_blk)
+		g_aesStreamKernels[0][AES_DISPATCH_KEY_INDEX (ctx)]->streamEncrypt (ctx, in_blk, out_blk, blocks);
+	else
+		aes_encrypt_blocks (ctx, in_blk, out_blk, blocks);
+}
+
+void aes_decrypt_blocks_oop (aes_decrypt_ctx *ctx, const byte* in_blk, byte* out_blk, uint_32t blocks)
+{
+	if (g_aesStreamBlocks && blocks > g_aesStreamBlocks && in_blk != out_blk)
+		g_aesStreamKernels[1][AES_DISPATCH_KEY_INDEX (ctx)]->streamDecrypt (ctx, in_blk, out_blk, blocks);
+	else
+		aes_decrypt_blocks (ctx, in_blk, out_blk, blocks);
+}
+
+/* points the entry points straight at encrypt and decrypt */
+static void aes_bind (aes_encrypt_blocks_fn encrypt, aes_decrypt_blocks_fn decrypt)
+{
+	aes_encrypt_blocks = encrypt;
+	aes_decrypt_blocks = decrypt;
+}
+
+void aes_dispatch_init (void)
+{
+	size_t i, llc;
+	int d, k;
+
+	if (!g_x86DetectionDone)
+		DetectX86Features ();
+
+	/* past the last level cache, the output would only evict the input */
+	GetCpuTopology ();
+	llc = GetL3CacheSize ()? GetL3CacheSize () : GetL2CacheSize ();
+	g_aesStreamBlocks = (llc > (size_t) 0xFFFFFFFF * 16)? 0 : (uint_32t) (llc / 16);
+
+	g_aesSelectedKernel = &g_aesKernels[AES_KERNEL_COUNT - 1];
+	for (i = 0; i < AES_KERNEL_COUNT; i++)
+	{
+		if (IsDefaultCandidate (&g_aesKernels[i]) && IsKernelSupported (&g_aesKernels[i]))
+		{
+			g_aesSelectedKernel = &g_aesKernels[i];
+			break;
+		}
+	}
+
+	for (d = 0; d < 2; d++)
+		for (k = 0; k < 3; k++)
+			g_aesStreamKernels[d][k] = g_aesSelectedKernel;
+	aes_bind (g_aesSelectedKernel->encrypt, g_aesSelectedKernel->decrypt);
+	g_aesTuned = 0;
+
+	aes_dispatch_load_profile (AES_DISPATCH_PROFILE_FILE);
+}
+
+const char* aes_dispatch_kernel_name (void)
+{
+	if (!g_aesSelectedKernel)
+		aes_dispatch_init ();
+
+	return g_aesTuned? "autotuned" : g_aesSelectedKernel->name;
+}
+
+size_t aes_dispatch_kernel_count (void)
+{
+	return AES_KERNEL_COUNT;
+}
+
+AES_RETURN aes_dispatch_get_kernel (size_t index, const char** name, aes_encrypt_blocks_fn* encrypt, aes_decrypt_blocks_fn* decrypt)
+{
+	if (!g_x86DetectionDone)
+		DetectX86Features ();
+
+	if (index >= AES_KERNEL_COUNT || !IsKernelSupported (&g_aesKernels[index]))
+		return EXIT_FAILURE;
+
+	*name = g_aesKernels[index].name;
+	*encrypt = g_aesKernels[index].encrypt;
+	*decrypt = g_aesKernels[index].decrypt;
+	return EXIT_SUCCESS;
+}
+
+size_t aes_dispatch_stream_bytes (void)
+{
+	if (!g_aesSelectedKernel)
+		aes_dispatch_init ();
+
+	return (size_t) g_aesStreamBlocks * 16;
+}
+
+const char* aes_dispatch_kernel_for (int encrypt, int key_len, uint_32t blocks)
+{
+	const int keyIndex = (key_len > 32? key_len / 8 : key_len) / 8 - 2;
+
+	if (!g_aesSelectedKernel)
+		aes_dispatch_init ();
+
+	if (!g_aesTuned || keyIndex < 0 || keyIndex > 2)
+		return g_aesSelectedKernel->name;
+	return g_aesProfile[encrypt? 0 : 1][keyIndex][AES_DISPATCH_SIZE_CLASS (blocks)]->name;
+}
+
+/*
+* Profile file: one line per direction, key size and size class, prefixed by
+* the CPU signature, e.g. "06-8c-01 enc 256 4096 AES-NI 15-way", or
+* "06-8c-01 enc 256 65536 AES-NI width 11" for the kernels of any width
+*/
+
+static void aes_cpu_signature (char* signature)
+{
+	uint32 cpuid[4] = {0, 0, 0, 0};
+	uint32 family, model;
+
+	CpuId (1, cpuid);
+	family = (cpuid[0] >> 8) & 0xF;
+	model = (cpuid[0] >> 4) & 0xF;
+	if (family == 0xF)
+		family += (cpuid[0] >> 20) & 0xFF;
+	if (family == 0x6 || family >= 0xF)
+		model += ((cpuid[0] >> 16) & 0xF) << 4;
+
+	sprintf (signature, "%02x-%02x-%02x", family, model, cpuid[0] & 0xF);
+}
+
+static void aes_bind_profile (void)
+{
+	int d, k, c;
+
+	for (d = 0; d < 2; d++)
+		for (k = 0; k < 3; k++)
+			g_aesStreamKernels[d][k] = g_aesProfile[d][k][AES_DISPATCH_SIZE_CLASSES - 1];
+
+	for (k = 0; k < 3; k++)
+	{
+		for (c = 0; c < AES_DISPATCH_SIZE_CLASSES; c++)
+		{
+			g_aesTunedEncrypt[k][c] = g_aesProfile[0][k][c]->encrypt;
+			g_aesTunedDecrypt[k][c] = g_aesProfile[1][k][c]->decrypt;
+		}
+	}
+
+	g_aesTuned = 1;
+	aes_bind (aes_encrypt_blocks_tuned, aes_decrypt_blocks_tuned);
+}
+
+AES_RETURN aes_dispatch_load_profile (const char* path)
+{
+	static const AES_KERNEL* profile[2][3][AES_DISPATCH_SIZE_CLASSES];
+	char signature[16], line[128], lineSignature[16], dir[4], name[64];
+	unsigned int keyBits, maxBytes, c, ways, found = 0;
+	const AES_KERNEL* kernel;
+	size_t i;
+	FILE* f;
+
+	if (!g_x86DetectionDone)
+		DetectX86Features ();
+	if (!g_hasAESNI || (f = fopen (path, "r")) == NULL)
+		return EXIT_FAILURE;
+
+	aes_init_width_kernels ();
+
+	aes_cpu_signature (signature);
+	memset (profile, 0, sizeof (profile));
+	while (fgets (line, sizeof (line), f))
+	{
+		if (sscanf (line, "%15s %3s %u %u %63[^\r\n]", lineSignature, dir, &keyBits, &maxBytes, name) != 5
+			|| strcmp (lineSignature, signature)
+			|| (keyBits != 128 && keyBits != 192 && keyBits != 256))
+			continue;
+
+		for (c = 0; c < AES_DISPATCH_SIZE_CLASSES - 1 && maxBytes / 16 > g_aesSizeClasses[c]; c++)
+			;
+		kernel = NULL;
+		if (sscanf (name, AES_WIDTH_KERNEL_NAME, &ways) == 1 && ways >= 1 && ways <= AES_BOTAN_MAX_WAYS)
+			kernel = &g_aesWidthKernels[ways - 1];
+		for (i = 0; i < AES_KERNEL_COUNT && !kernel; i++)
+		{
+			if (!strcmp (name, g_aesKernels[i].name) && IsKernelSupported (&g_aesKernels[i]))
+				kernel = &g_aesKernels[i];
+		}
+		if (kernel)
+		{
+			const AES_KERNEL** entry = &profile[strcmp (dir, "enc")? 1 : 0][(keyBits - 128) / 64][c];
+
+			if (!*entry)
+				found++;
+			*entry = kernel;
+		}
+	}
+	fclose (f);
+
+	if (found != sizeof (profile) / sizeof (profile[0][0][0]))
+		return EXIT_FAILURE;
+
+	memcpy (g_aesProfile, profile, sizeof (profile));
+	aes_bind_profile ();
+	return EXIT_SUCCESS;
+}
+
+/* rewrites path with the lines of other CPUs and the current profile */
+static AES_RETURN aes_save_profile (const char* path)
+{
+	char signature[16], line[128], *others = NULL;
+	size_t othersLen = 0;
+	int d, k, c;
+	FILE* f;
+
+	aes_cpu_signature (signature);
+	if ((f = fopen (path, "r")) != NULL)
+	{
+		while (fgets (line, sizeof (line), f))
+		{
+			size_t len = strlen (line);
+			char* grown;
+
+			if (line[0] == '#' || !strncmp (line, signature, strlen (signature)))
+				continue;
+			if ((grown = (char*) realloc (others, othersLen + len + 1)) == NULL)
+				break;
+			others = grown;
+			memcpy (others + othersLen, line, len + 1);
+			othersLen += len;
+		}
+		fclose (f);
+	}
+
+	if ((f = fopen (path, "w")) == NULL)
+	{
+		free (others);
+		return EXIT_FAILURE;
+	}
+
+	fprintf (f, "# AES kernel profile: CPU family-model-stepping, direction, key bits, largest request in bytes, kernel\n");
+	if (others)
+		fputs (others, f);
+	for (d = 0; d < 2; d++)
+	{
+		for (k = 0; k < 3; k++)
+		{
+			for (c = 0; c < AES_DISPATCH_SIZE_CLASSES; c++)
+			{
+				fprintf (f, "%s %s %d %u %s\n", signature, d? "dec" : "enc", 128 + 64 * k,
+					(c < AES_DISPATCH_SIZE_CLASSES - 1)? 16 * g_aesSizeClasses[c] : 0xFFFFFFFF, g_aesProfile[d][k][c]->name);
+			}
+		}
+	}
+
+	free (others);
+	return fclose (f)? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* Best of AES_TUNE_RUNS timings of AES_TUNE_BYTES worth of requests of the
+   given size, in counter ticks: the minimum filters out interrupts */
+#define AES_TUNE_RUNS	5
+#define AES_TUNE_BYTES	65536
+#define AES_TUNE_LARGEST	(256 * 1024)
+
+static long long aes_time_kernel (const AES_KERNEL* kernel, int decrypt, aes_encrypt_ctx* kse, aes_decrypt_ctx* ksd,
+								  byte* buf, uint_32t blocks)
+{
+	const uint_32t calls = (blocks * 16 < AES_TUNE_BYTES)? AES_TUNE_BYTES / (blocks * 16) : 1;
+	long long best = 0;
+	LARGE_INTEGER start, end;
+	uint_32t run, i;
+
+	for (run = 0; run < AES_TUNE_RUNS; run++)
+	{
+		QueryPerformanceCounter (&start);
+		for (i = 0; i < calls; i++)
+		{
+			/* requests over the buffer, as a stream of messages would be */
+			byte* msg = buf + ((i * blocks * 16) % AES_TUNE_LARGEST);
+
+			if (decrypt)
+				kernel->decrypt (ksd, msg, msg, blocks);
+			else
+				kernel->encrypt (kse, msg, msg, blocks);
+		}
+		QueryPerformanceCounter (&end);
+		if (run == 0 || end.QuadPart - start.QuadPart < best)
+			best = end.QuadPart - start.QuadPart;
+	}
+	return best;
+}
+
+AES_RETURN aes_dispatch_autotune (const char* path)
+{
+	byte key[32];
+	byte* buf;
+	aes_encrypt_ctx kse;
+	aes_decrypt_ctx ksd;
+	int d, k, c;
+	size_t i;
+
+	if (!g_aesSelectedKernel)
+		aes_dispatch_init ();
+	if (!g_hasAESNI || (buf = (byte*) _aligned_malloc (AES_TUNE_LARGEST, 64)) == NULL)
+		return EXIT_FAILURE;
+
+	memset (buf, 0x5A, AES_TUNE_LARGEST);
+	aes_init_width_kernels ();
+	for (i = 0; i < sizeof (key); i++)
+		key[i] = (byte) (i * 13 + 7);
+
+	for (k = 0; k < 3; k++)
+	{
+		aes_botan_aesni_set_key_var (&kse, &ksd, key, 16 + 8 * k);
+		for (d = 0; d < 2; d++)
+		{
+			for (c = 0; c < AES_DISPATCH_SIZE_CLASSES; c++)
+			{
+				const uint_32t blocks = (c < AES_DISPATCH_SIZE_CLASSES - 1)? g_aesSizeClasses[c] : AES_TUNE_LARGEST / 16;
+				long long best = 0;
+
+				for (i = 0; i < AES_KERNEL_COUNT + AES_BOTAN_MAX_WAYS; i++)
+				{
+					const AES_KERNEL* kernel = (i < AES_KERNEL_COUNT)? &g_aesKernels[i] : &g_aesWidthKernels[i - AES_KERNEL_COUNT];
+					long long t;
+
+					if (!IsKernelSupported (kernel))
+						continue;
+					t = aes_time_kernel (kernel, d, &kse, &ksd, buf, blocks);
+					if (!best || t < best)
+					{
+						best = t;
+						g_aesProfile[d][k][c] = kernel;
+					}
+				}
+			}
+		}
+	}
+
+	burn (&kse, sizeof (kse));
+	burn (&ksd, sizeof (ksd));
+	_aligned_free (buf);
+
+	aes_bind_profile ();
+	return path? aes_save_profile (path) : EXIT_SUCCESS;
+}
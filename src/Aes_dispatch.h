@@ -0,0 +1,76 @@
+/*
+ * Runtime selection of the AES-NI kernels.
+ *
+ * aes_encrypt_blocks and aes_decrypt_blocks are bound once, at startup, to the
+ * fastest kernel of Aes_Botan_aesni.c that the CPU supports. Calling through
+ * them is a single indirect call, which is what calling a kernel through a
+ * CipherFunction style pointer already costs. aes_encrypt_blocks_oop and
+ * aes_decrypt_blocks_oop are for large out-of-place requests: past the size
+ * of the last level cache, they send them to the streaming-store variant of
+ * the kernel bound to large requests, AES-NI or VAES.
+ */
+
+#include "Tcdefs.h"
+#include "config.h"
+#include "Aes.h"
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef void (*aes_encrypt_blocks_fn) (aes_encrypt_ctx *ctx, const byte* in_blk, byte* out_blk, uint_32t blocks);
+typedef void (*aes_decrypt_blocks_fn) (aes_decrypt_ctx *ctx, const byte* in_blk, byte* out_blk, uint_32t blocks);
+
+/* Until aes_dispatch_init has run, both point to stubs that run it on first use */
+extern aes_encrypt_blocks_fn aes_encrypt_blocks;
+extern aes_decrypt_blocks_fn aes_decrypt_blocks;
+
+/* As aes_encrypt_blocks and aes_decrypt_blocks, plus a compare: requests of
+   more than aes_dispatch_stream_bytes () with in_blk != out_blk go to the
+   kernels with streaming stores, which leave the cache to the rest */
+void aes_encrypt_blocks_oop (aes_encrypt_ctx *ctx, const byte* in_blk, byte* out_blk, uint_32t blocks);
+void aes_decrypt_blocks_oop (aes_decrypt_ctx *ctx, const byte* in_blk, byte* out_blk, uint_32t blocks);
+
+/* Runs DetectX86Features if needed and binds the entry points. Call it once at startup. */
+void aes_dispatch_init (void);
+
+/* Name of the kernel the entry points are bound to, for reporting */
+const char* aes_dispatch_kernel_name (void);
+
+/* Out-of-place requests to aes_*_blocks_oop larger than this, the size of the
+   last level cache, go to the kernels with streaming stores; 0 when the cache
+   size is unknown */
+size_t aes_dispatch_stream_bytes (void);
+
+/* Kernels the dispatcher chooses from, for benchmarks: index runs from 0 to
+   aes_dispatch_kernel_count () - 1. EXIT_FAILURE if the CPU does not support it. */
+size_t aes_dispatch_kernel_count (void);
+AES_RETURN aes_dispatch_get_kernel (size_t index, const char** name, aes_encrypt_blocks_fn* encrypt, aes_decrypt_blocks_fn* decrypt);
+
+/* Profile of the fastest kernel for each direction, key size and request size,
+   per CPU (CPUID family, model and stepping); aes_dispatch_init loads it */
+#define AES_DISPATCH_PROFILE_FILE	"AesNiBenchmark.profile"
+
+/* request size classes of the profile, up to 16, 64, ... 64KB and beyond */
+#define AES_DISPATCH_SIZE_CLASSES	8
+
+/* Times every supported kernel, and the AES-NI kernels of every width from 1
+   to AES_BOTAN_MAX_WAYS, for each direction, key size and size class, binds
+   the entry points to the fastest ones and, unless path is NULL, records them,
+   widths included, in path next to the entries of other CPUs. Takes a few
+   hundred ms. */
+AES_RETURN aes_dispatch_autotune (const char* path);
+
+/* Binds the entry points to the kernels path records for this CPU.
+   EXIT_FAILURE, leaving the binding as it was, if it has no complete entry. */
+AES_RETURN aes_dispatch_load_profile (const char* path);
+
+/* Kernel used for requests of blocks blocks under key_len-byte keys, for reporting */
+const char* aes_dispatch_kernel_for (int encrypt, int key_len, uint_32t blocks);
+
+#ifdef __cplusplus
+}
+#endif
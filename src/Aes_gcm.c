@@ -0,0 +1,285 @@
+/*
+ * AES-GCM (NIST SP 800-38D) using AES-NI and PCLMULQDQ.
+ *
+ * GHASH follows the Intel white paper "Intel Carry-Less Multiplication
+ * Instruction and its Usage for Computing the GCM Mode": blocks and H are
+ * kept byte-reflected, each 256-bit product is shifted left by one bit and
+ * then reduced with shifts and XORs. Both steps are linear, so the products
+ * of eight blocks by H^8 .. H^1 are summed first and reduced only once.
+ *
+ * The stitched seal and open run 16 blocks at a time with VAES and VPCLMULQDQ
+ * where the CPU has them, then 8 at a time, then CTR and GHASH on the rest.
+ */
+
+#include <string.h>
+#include "cpu.h"
+#include "Aes_Botan_aesni.h"
+#include "Aes_gcm.h"
+#include "Aes_gcm_clmul.h"
+
+#if CRYPTOPP_BOOL_X64
+#define GCM_CTR_CRYPT aes_botan_aesni_ctr_crypt_15x
+#else
+#define GCM_CTR_CRYPT aes_botan_aesni_ctr_crypt_7x
+#endif
+
+/* blocks multiplied by H^8 .. H^1 and reduced together by gcm_ghash */
+#define GCM_GHASH_BLOCKS 8
+
+/* Y * H^1, Y byte-reflected */
+VC_INLINE __m128i gcm_mul_h(const aes_gcm_ctx* ctx, __m128i Y)
+{
+	__m128i lo = _mm_setzero_si128(), mid = _mm_setzero_si128(), hi = _mm_setzero_si128();
+
+	gcm_mul_acc (Y, ctx->H[0], ctx->Hk[0], &lo, &mid, &hi);
+	return gcm_reduce (lo, mid, hi);
+}
+
+/* absorb data into the byte-reflected GHASH state Y, zero-padding the last block */
+static __m128i gcm_ghash(const aes_gcm_ctx* ctx, __m128i Y, const byte* data, uint_32t len)
+{
+	const __m128i BSWAP = GCM_BSWAP_MASK;
+	const __m128i* data_mm = (const __m128i*)(data);
+
+	while (len >= GCM_GHASH_BLOCKS * 16)
+	{
+		__m128i lo = _mm_setzero_si128(), mid = _mm_setzero_si128(), hi = _mm_setzero_si128();
+
+		// Y' = (Y + X0) * H^8 + X1 * H^7 + ... + X7 * H
+		gcm_mul_acc (_mm_xor_si128(Y, _mm_shuffle_epi8(_mm_loadu_si128(data_mm + 0), BSWAP)), ctx->H[7], ctx->Hk[7], &lo, &mid, &hi);
+		gcm_mul_acc (_mm_shuffle_epi8(_mm_loadu_si128(data_mm + 1), BSWAP), ctx->H[6], ctx->Hk[6], &lo, &mid, &hi);
+		gcm_mul_acc (_mm_shuffle_epi8(_mm_loadu_si128(data_mm + 2), BSWAP), ctx->H[5], ctx->Hk[5], &lo, &mid, &hi);
+		gcm_mul_acc (_mm_shuffle_epi8(_mm_loadu_si128(data_mm + 3), BSWAP), ctx->H[4], ctx->Hk[4], &lo, &mid, &hi);
+		gcm_mul_acc (_mm_shuffle_epi8(_mm_loadu_si128(data_mm + 4), BSWAP), ctx->H[3], ctx->Hk[3], &lo, &mid, &hi);
+		gcm_mul_acc (_mm_shuffle_epi8(_mm_loadu_si128(data_mm + 5), BSWAP), ctx->H[2], ctx->Hk[2], &lo, &mid, &hi);
+		gcm_mul_acc (_mm_shuffle_epi8(_mm_loadu_si128(data_mm + 6), BSWAP), ctx->H[1], ctx->Hk[1], &lo, &mid, &hi);
+		gcm_mul_acc (_mm_shuffle_epi8(_mm_loadu_si128(data_mm + 7), BSWAP), ctx->H[0], ctx->Hk[0], &lo, &mid, &hi);
+		Y = gcm_reduce (lo, mid, hi);
+
+		data_mm += GCM_GHASH_BLOCKS;
+		len -= GCM_GHASH_BLOCKS * 16;
+	}
+
+	while (len >= 16)
+	{
+		Y = gcm_mul_h (ctx, _mm_xor_si128(Y, _mm_shuffle_epi8(_mm_loadu_si128(data_mm), BSWAP)));
+		++data_mm;
+		len -= 16;
+	}
+
+	if (len)
+	{
+		byte last[16] = {0};
+
+		memcpy (last, data_mm, len);
+		Y = gcm_mul_h (ctx, _mm_xor_si128(Y, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(last)), BSWAP)));
+	}
+
+	return Y;
+}
+
+/* pre-counter block J0 */
+static void gcm_j0(const aes_gcm_ctx* ctx, const byte* iv, uint_32t iv_len, byte* J0)
+{
+	if (iv_len == 12)
+	{
+		memcpy (J0, iv, 12);
+		J0[12] = J0[13] = J0[14] = 0;
+		J0[15] = 1;
+	}
+	else
+	{
+		__m128i Y = gcm_ghash (ctx, _mm_setzero_si128(), iv, iv_len);
+
+		// reflected length block 0^64 || [len(IV)]64
+		Y = gcm_mul_h (ctx, _mm_xor_si128(Y, _mm_set_epi64x(0, (uint64) iv_len * 8)));
+		_mm_storeu_si128((__m128i*)(J0), _mm_shuffle_epi8(Y, GCM_BSWAP_MASK));
+	}
+}
+
+/* tag from the GHASH state Y of AAD and ciphertext */
+static void gcm_final(const aes_gcm_ctx* ctx, const byte* J0, __m128i Y, uint_32t aad_len, uint_32t len, byte* tag)
+{
+	byte EJ0[16];
+
+	// reflected length block [len(A)]64 || [len(C)]64
+	Y = gcm_mul_h (ctx, _mm_xor_si128(Y, _mm_set_epi64x((uint64) aad_len * 8, (uint64) len * 8)));
+
+	aes_botan_aesni_encrypt_4x ((aes_encrypt_ctx*) &ctx->ek, J0, EJ0, 1);
+	_mm_storeu_si128((__m128i*)(tag), _mm_xor_si128(_mm_shuffle_epi8(Y, GCM_BSWAP_MASK), _mm_loadu_si128((const __m128i*)(EJ0))));
+}
+
+/* first counter block inc32(J0) */
+static void gcm_ctr0(const byte* J0, byte* ctr)
+{
+	int i;
+
+	memcpy (ctr, J0, 16);
+	for (i = 15; i >= 12 && ++ctr[i] == 0; i--);
+}
+
+/* CTR with a 32-bit counter starting at ctr */
+static void gcm_ctr(const aes_gcm_ctx* ctx, const byte* ctr, const byte* in, byte* out, uint_32t len)
+{
+	aes_ctr_state state;
+
+	aes_botan_aesni_ctr_init (&state, ctr, 32);
+	GCM_CTR_CRYPT ((aes_encrypt_ctx*) &ctx->ek, &state, in, out, len);
+}
+
+static int gcm_tag_differs(const byte* computed, const byte* tag)
+{
+	byte diff = 0;
+	int i;
+
+	// constant time comparison
+	for (i = 0; i < AES_GCM_TAG_SIZE; i++)
+		diff |= computed[i] ^ tag[i];
+
+	return diff != 0;
+}
+
+AES_RETURN aes_gcm_set_key(aes_gcm_ctx* ctx, const byte* key, int key_len)
+{
+	const __m128i BSWAP = GCM_BSWAP_MASK;
+	static const byte zero[16] = {0};
+	aes_decrypt_ctx dk;
+	byte Hb[16];
+	__m128i H, Hi;
+	int i;
+
+	if (aes_botan_aesni_set_key_var (&ctx->ek, &dk, key, key_len) != EXIT_SUCCESS)
+		return EXIT_FAILURE;
+	burn (&dk, sizeof (dk));
+
+	aes_botan_aesni_encrypt_4x (&ctx->ek, zero, Hb, 1);
+	H = Hi = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(Hb)), BSWAP);
+	burn (Hb, sizeof (Hb));
+
+	for (i = 0; i < AES_GCM_H_POWERS; i++)
+	{
+		if (i)
+		{
+			__m128i lo = _mm_clmulepi64_si128(Hi, H, 0x00);
+			__m128i hi = _mm_clmulepi64_si128(Hi, H, 0x11);
+			__m128i mid = _mm_clmulepi64_si128(_mm_xor_si128(Hi, _mm_shuffle_epi32(Hi, _MM_SHUFFLE(1,0,3,2))),
+											   _mm_xor_si128(H, _mm_shuffle_epi32(H, _MM_SHUFFLE(1,0,3,2))), 0x00);
+			Hi = gcm_reduce (lo, mid, hi);
+		}
+
+		_mm_storeu_si128((__m128i*)(ctx->H[i]), Hi);
+		_mm_storeu_si128((__m128i*)(ctx->Hk[i]), _mm_xor_si128(Hi, _mm_shuffle_epi32(Hi, _MM_SHUFFLE(1,0,3,2))));
+	}
+
+	ctx->vaes = 0;
+#if CRYPTOPP_BOOL_X64 && CRYPTOPP_BOOL_VAES_INTRINSICS_AVAILABLE
+	if (!g_x86DetectionDone)
+		DetectX86Features ();
+	ctx->vaes = HasVAES () && HasAVX512F () && HasAVX512BW () && HasVPCLMULQDQ ();
+#endif
+	return EXIT_SUCCESS;
+}
+
+void aes_gcm_seal(const aes_gcm_ctx* ctx, const byte* iv, uint_32t iv_len, const byte* aad, uint_32t aad_len,
+				  const byte* in, byte* out, uint_32t len, byte* tag)
+{
+	byte J0[16], ctr[16], ghash[16];
+	uint_32t done;
+	__m128i Y;
+
+	gcm_j0 (ctx, iv, iv_len, J0);
+	gcm_ctr0 (J0, ctr);
+	Y = gcm_ghash (ctx, _mm_setzero_si128(), aad, aad_len);
+
+	_mm_storeu_si128((__m128i*)(ghash), Y);
+	done = 0;
+#if CRYPTOPP_BOOL_X64 && CRYPTOPP_BOOL_VAES_INTRINSICS_AVAILABLE
+	if (ctx->vaes)
+		done = 16 * aes_botan_aesni_gcm_encrypt_vaes512 (ctx, ctr, ghash, in, out, len / 16);
+#endif
+	done += 16 * aes_botan_aesni_gcm_encrypt_8x (ctx, ctr, ghash, in + done, out + done, (len - done) / 16);
+	Y = _mm_loadu_si128((const __m128i*)(ghash));
+
+	if (len > done)
+	{
+		gcm_ctr (ctx, ctr, in + done, out + done, len - done);
+		Y = gcm_ghash (ctx, Y, out + done, len - done);
+	}
+
+	gcm_final (ctx, J0, Y, aad_len, len, tag);
+}
+
+AES_RETURN aes_gcm_open(const aes_gcm_ctx* ctx, const byte* iv, uint_32t iv_len, const byte* aad, uint_32t aad_len,
+						const byte* in, byte* out, uint_32t len, const byte* tag)
+{
+	byte J0[16], ctr[16], ghash[16], computed[AES_GCM_TAG_SIZE];
+	uint_32t done;
+	__m128i Y;
+
+	gcm_j0 (ctx, iv, iv_len, J0);
+	gcm_ctr0 (J0, ctr);
+	Y = gcm_ghash (ctx, _mm_setzero_si128(), aad, aad_len);
+
+	_mm_storeu_si128((__m128i*)(ghash), Y);
+	done = 0;
+#if CRYPTOPP_BOOL_X64 && CRYPTOPP_BOOL_VAES_INTRINSICS_AVAILABLE
+	if (ctx->vaes)
+		done = 16 * aes_botan_aesni_gcm_decrypt_vaes512 (ctx, ctr, ghash, in, out, len / 16);
+#endif
+	done += 16 * aes_botan_aesni_gcm_decrypt_8x (ctx, ctr, ghash, in + done, out + done, (len - done) / 16);
+	Y = _mm_loadu_si128((const __m128i*)(ghash));
+
+	if (len > done)
+	{
+		// hash before decrypting, in and out may be the same buffer
+		Y = gcm_ghash (ctx, Y, in + done, len - done);
+		gcm_ctr (ctx, ctr, in + done, out + done, len - done);
+	}
+
+	gcm_final (ctx, J0, Y, aad_len, len, computed);
+
+	if (gcm_tag_differs (computed, tag))
+	{
+		burn (out, len);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+void aes_gcm_seal_2pass(const aes_gcm_ctx* ctx, const byte* iv, uint_32t iv_len, const byte* aad, uint_32t aad_len,
+						const byte* in, byte* out, uint_32t len, byte* tag)
+{
+	byte J0[16], ctr[16];
+	__m128i Y;
+
+	gcm_j0 (ctx, iv, iv_len, J0);
+	gcm_ctr0 (J0, ctr);
+	gcm_ctr (ctx, ctr, in, out, len);
+
+	Y = gcm_ghash (ctx, _mm_setzero_si128(), aad, aad_len);
+	Y = gcm_ghash (ctx, Y, out, len);
+	gcm_final (ctx, J0, Y, aad_len, len, tag);
+}
+
+AES_RETURN aes_gcm_open_2pass(const aes_gcm_ctx* ctx, const byte* iv, uint_32t iv_len, const byte* aad, uint_32t aad_len,
+							  const byte* in, byte* out, uint_32t len, const byte* tag)
+{
+	byte J0[16], ctr[16], computed[AES_GCM_TAG_SIZE];
+	__m128i Y;
+
+	gcm_j0 (ctx, iv, iv_len, J0);
+
+	Y = gcm_ghash (ctx, _mm_setzero_si128(), aad, aad_len);
+	Y = gcm_ghash (ctx, Y, in, len);
+	gcm_final (ctx, J0, Y, aad_len, len, computed);
+
+	if (gcm_tag_differs (computed, tag))
+		return EXIT_FAILURE;
+
+	gcm_ctr0 (J0, ctr);
+	gcm_ctr (ctx, ctr, in, out, len);
+	return EXIT_SUCCESS;
+}
+
+#undef GCM_CTR_CRYPT
@@ -0,0 +1,52 @@
+/*
+ * AES-GCM (NIST SP 800-38D) on top of the AES-NI kernels.
+ *
+ * GHASH uses PCLMULQDQ with the powers H^1 .. H^16 precomputed at key setup,
+ * so eight blocks, or sixteen with VAES and VPCLMULQDQ, are multiplied with
+ * Karatsuba and reduced only once. Requires HasAESNI() && HasCLMUL().
+ */
+
+#include "Tcdefs.h"
+#include "config.h"
+#include "Aes.h"
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define AES_GCM_TAG_SIZE	16
+#define AES_GCM_H_POWERS	16
+
+typedef struct
+{
+	aes_encrypt_ctx ek;
+	byte H[AES_GCM_H_POWERS][16];	/* H^1 .. H^16, byte-reflected */
+	byte Hk[AES_GCM_H_POWERS][16];	/* high ^ low halves of H^i, for Karatsuba */
+	int vaes;						/* 16-block stitched kernel, on CPUs with VAES, AVX-512 and VPCLMULQDQ */
+} aes_gcm_ctx;
+
+/* key_len in bytes (16, 24, 32) or bits (128, 192, 256) */
+AES_RETURN aes_gcm_set_key(aes_gcm_ctx* ctx, const byte* key, int key_len);
+
+/* GHASH stitched into the AES rounds, single pass over the data */
+void aes_gcm_seal(const aes_gcm_ctx* ctx, const byte* iv, uint_32t iv_len, const byte* aad, uint_32t aad_len,
+				  const byte* in, byte* out, uint_32t len, byte* tag);
+
+/* returns EXIT_FAILURE, with out zeroed, if the tag does not match */
+AES_RETURN aes_gcm_open(const aes_gcm_ctx* ctx, const byte* iv, uint_32t iv_len, const byte* aad, uint_32t aad_len,
+						const byte* in, byte* out, uint_32t len, const byte* tag);
+
+/* CTR pass then GHASH pass, kept for comparison */
+void aes_gcm_seal_2pass(const aes_gcm_ctx* ctx, const byte* iv, uint_32t iv_len, const byte* aad, uint_32t aad_len,
+						const byte* in, byte* out, uint_32t len, byte* tag);
+
+/* returns EXIT_FAILURE, and leaves out untouched, if the tag does not match */
+AES_RETURN aes_gcm_open_2pass(const aes_gcm_ctx* ctx, const byte* iv, uint_32t iv_len, const byte* aad, uint_32t aad_len,
+							  const byte* in, byte* out, uint_32t len, const byte* tag);
+
+#ifdef __cplusplus
+}
+#endif
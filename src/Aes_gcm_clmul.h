@@ -0,0 +1,61 @@
+/*
+ * GHASH building blocks shared by Aes_gcm.c and the stitched kernels of
+ * Aes_Botan_aesni.c. Blocks and H are byte-reflected, see Aes_gcm.c.
+ */
+
+#include "cpu.h"
+
+#pragma once
+
+#define GCM_BSWAP_MASK _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15)
+
+/* Karatsuba: accumulate the unreduced product of X by H, Hk holding H_hi ^ H_lo */
+VC_INLINE void gcm_mul_acc(__m128i X, const byte* H, const byte* Hk, __m128i* lo, __m128i* mid, __m128i* hi)
+{
+	const __m128i H_mm = _mm_loadu_si128((const __m128i*)(H));
+	const __m128i Xk = _mm_xor_si128(X, _mm_shuffle_epi32(X, _MM_SHUFFLE(1,0,3,2)));
+
+	*lo = _mm_xor_si128(*lo, _mm_clmulepi64_si128(X, H_mm, 0x00));
+	*hi = _mm_xor_si128(*hi, _mm_clmulepi64_si128(X, H_mm, 0x11));
+	*mid = _mm_xor_si128(*mid, _mm_clmulepi64_si128(Xk, _mm_loadu_si128((const __m128i*)(Hk)), 0x00));
+}
+
+VC_INLINE __m128i gcm_reduce(__m128i lo, __m128i mid, __m128i hi)
+{
+	__m128i t2, t4, t5, t7, t8, t9;
+
+	mid = _mm_xor_si128(mid, _mm_xor_si128(lo, hi));
+	lo = _mm_xor_si128(lo, _mm_slli_si128(mid, 8));
+	hi = _mm_xor_si128(hi, _mm_srli_si128(mid, 8));
+
+	// shift the 256-bit product hi:lo left by one bit
+	t7 = _mm_srli_epi32(lo, 31);
+	t8 = _mm_srli_epi32(hi, 31);
+	lo = _mm_slli_epi32(lo, 1);
+	hi = _mm_slli_epi32(hi, 1);
+	t9 = _mm_srli_si128(t7, 12);
+	t8 = _mm_slli_si128(t8, 4);
+	t7 = _mm_slli_si128(t7, 4);
+	lo = _mm_or_si128(lo, t7);
+	hi = _mm_or_si128(hi, t8);
+	hi = _mm_or_si128(hi, t9);
+
+	// reduce modulo x^128 + x^7 + x^2 + x + 1
+	t7 = _mm_slli_epi32(lo, 31);
+	t8 = _mm_slli_epi32(lo, 30);
+	t9 = _mm_slli_epi32(lo, 25);
+	t7 = _mm_xor_si128(t7, t8);
+	t7 = _mm_xor_si128(t7, t9);
+	t8 = _mm_srli_si128(t7, 4);
+	t7 = _mm_slli_si128(t7, 12);
+	lo = _mm_xor_si128(lo, t7);
+
+	t2 = _mm_srli_epi32(lo, 1);
+	t4 = _mm_srli_epi32(lo, 2);
+	t5 = _mm_srli_epi32(lo, 7);
+	t2 = _mm_xor_si128(t2, t4);
+	t2 = _mm_xor_si128(t2, t5);
+	t2 = _mm_xor_si128(t2, t8);
+	lo = _mm_xor_si128(lo, t2);
+	return _mm_xor_si128(hi, lo);
+}
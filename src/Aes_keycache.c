@@ -0,0 +1,242 @@
+/*
+ * Cache of expanded AES key schedules.
+ *
+ * A lookup probes the table without locking, then pins the entry it found
+ * with an atomic increment and checks that the entry still holds the handle:
+ * the table may be rewritten under it, but an entry is only reused once its
+ * pin count is 0, and the evictor claims it by setting AES_KC_EVICTING with
+ * a compare-and-swap, which makes any later pin fail until the new schedule
+ * is in place. Deleted slots are left as tombstones so that probes of other
+ * handles still find their entries; the table is rebuilt when they pile up.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "cpu.h"
+#include "Aes_keycache.h"
+#include "Aes_Botan_aesni.h"
+#include "utils.h"
+
+#define AES_KC_EMPTY		((aes_kc_handle) 0)
+#define AES_KC_TOMBSTONE	(~(aes_kc_handle) 0)
+#define AES_KC_EVICTING		0x40000000L
+
+#if defined(_MSC_VER)
+#define AES_KC_INCREMENT(p)			InterlockedIncrement (p)
+#define AES_KC_DECREMENT(p)			InterlockedDecrement (p)
+#define AES_KC_ADD(p, v)			InterlockedExchangeAdd (p, v)
+#define AES_KC_CAS(p, v, c)			InterlockedCompareExchange (p, v, c)
+#define AES_KC_BARRIER()			_ReadWriteBarrier ()
+#else
+#define AES_KC_INCREMENT(p)			__sync_add_and_fetch (p, 1)
+#define AES_KC_DECREMENT(p)			__sync_sub_and_fetch (p, 1)
+#define AES_KC_ADD(p, v)			__sync_fetch_and_add (p, v)
+#define AES_KC_CAS(p, v, c)			__sync_val_compare_and_swap (p, c, v)
+#define AES_KC_BARRIER()			__asm__ __volatile__ ("" ::: "memory")
+#endif
+
+/* Fibonacci hashing: the high bits of the product depend on all handle bits */
+static uint_32t aes_kc_hash(const aes_kc* kc, aes_kc_handle handle)
+{
+	return (uint_32t) ((handle * LL(0x9E3779B97F4A7C15)) >> 32) & kc->mask;
+}
+
+static void aes_kc_lock(aes_kc* kc)
+{
+	while (AES_KC_CAS (&kc->lock, 1, 0) != 0)
+	{
+		while (kc->lock)
+			_mm_pause ();
+	}
+}
+
+static void aes_kc_unlock(aes_kc* kc)
+{
+	AES_KC_BARRIER ();
+	kc->lock = 0;
+}
+
+AES_RETURN aes_kc_init(aes_kc* kc, uint_32t capacity, int key_len)
+{
+	uint_32t i, size;
+
+	memset (kc, 0, sizeof (aes_kc));
+	switch (key_len)
+	{
+	case 16: case 128: case 24: case 192: case 32: case 256: break;
+	default: return EXIT_FAILURE;
+	}
+	if (capacity == 0 || capacity > 0x10000000)
+		return EXIT_FAILURE;
+
+	/* load factor at most 1/2 */
+	for (size = 2; size < 2 * capacity; size <<= 1)
+		;
+
+	kc->entries = (aes_kc_entry*) _aligned_malloc (capacity * sizeof (aes_kc_entry), 64);
+	kc->table = (aes_kc_slot*) _aligned_malloc (size * sizeof (aes_kc_slot), 64);
+	if (!kc->entries || !kc->table)
+	{
+		aes_kc_free (kc);
+		return EXIT_FAILURE;
+	}
+
+	memset (kc->entries, 0, capacity * sizeof (aes_kc_entry));
+	memset (kc->table, 0, size * sizeof (aes_kc_slot));
+	for (i = 0; i < capacity; i++)
+		kc->entries[i].pins = AES_KC_EVICTING;
+
+	kc->capacity = capacity;
+	kc->mask = size - 1;
+	kc->key_len = key_len;
+	return EXIT_SUCCESS;
+}
+
+void aes_kc_free(aes_kc* kc)
+{
+	if (kc->entries)
+	{
+		burn (kc->entries, kc->capacity * sizeof (aes_kc_entry));
+		_aligned_free (kc->entries);
+	}
+	if (kc->table)
+		_aligned_free (kc->table);
+	memset (kc, 0, sizeof (aes_kc));
+}
+
+/* pins the entry of slot s if it still holds handle */
+static aes_kc_entry* aes_kc_pin(aes_kc* kc, uint_32t s, aes_kc_handle handle)
+{
+	aes_kc_entry* e = &kc->entries[kc->table[s].entry];
+
+	if ((AES_KC_INCREMENT (&e->pins) & AES_KC_EVICTING) || e->handle != handle)
+	{
+		AES_KC_DECREMENT (&e->pins);
+		return NULL;
+	}
+	if (!e->referenced)
+		e->referenced = 1;
+	return e;
+}
+
+const aes_kc_entry* aes_kc_lookup(aes_kc* kc, aes_kc_handle handle)
+{
+	uint_32t s = aes_kc_hash (kc, handle);
+	uint_32t n;
+
+	for (n = 0; n <= kc->mask; n++, s = (s + 1) & kc->mask)
+	{
+		const aes_kc_handle h = kc->table[s].handle;
+
+		if (h == handle)
+			return aes_kc_pin (kc, s, handle);
+		if (h == AES_KC_EMPTY)
+			break;
+	}
+	return NULL;
+}
+
+void aes_kc_release(aes_kc* kc, const aes_kc_entry* entry)
+{
+	AES_KC_DECREMENT (&kc->entries[entry - kc->entries].pins);
+}
+
+/* publishes entry e, already holding its handle, in the first free or deleted slot of its probe */
+static void aes_kc_link(aes_kc* kc, aes_kc_entry* e)
+{
+	uint_32t s = aes_kc_hash (kc, e->handle);
+
+	while (kc->table[s].handle != AES_KC_EMPTY && kc->table[s].handle != AES_KC_TOMBSTONE)
+		s = (s + 1) & kc->mask;
+
+	if (kc->table[s].handle == AES_KC_TOMBSTONE)
+		kc->tombstones--;
+	kc->table[s].entry = (uint_32t) (e - kc->entries);
+	AES_KC_BARRIER ();
+	kc->table[s].handle = e->handle;
+	e->slot = s;
+}
+
+/* Clears the table and links every cached entry again. Concurrent lookups
+   may miss while this runs, but never return a wrong entry. */
+static void aes_kc_rebuild(aes_kc* kc)
+{
+	uint_32t i;
+
+	for (i = 0; i <= kc->mask; i++)
+		kc->table[i].handle = AES_KC_EMPTY;
+	kc->tombstones = 0;
+	AES_KC_BARRIER ();
+	for (i = 0; i < kc->filled; i++)
+	{
+		if (kc->entries[i].handle != AES_KC_EMPTY)
+			aes_kc_link (kc, &kc->entries[i]);
+	}
+}
+
+/* CLOCK: the first entry, from the hand on, that is neither referenced since
+   the last pass nor pinned. Returns it claimed, or NULL if all are pinned. */
+static aes_kc_entry* aes_kc_evict(aes_kc* kc)
+{
+	uint_32t n;
+
+	for (n = 0; n < 2 * kc->capacity; n++)
+	{
+		aes_kc_entry* e = &kc->entries[kc->hand];
+
+		kc->hand = (kc->hand + 1 == kc->capacity)? 0 : kc->hand + 1;
+		if (e->referenced)
+		{
+			e->referenced = 0;
+			continue;
+		}
+		if (AES_KC_CAS (&e->pins, AES_KC_EVICTING, 0) != 0)
+			continue;
+
+		kc->table[e->slot].handle = AES_KC_TOMBSTONE;
+		kc->tombstones++;
+		kc->evictions++;
+		return e;
+	}
+	return NULL;
+}
+
+const aes_kc_entry* aes_kc_insert(aes_kc* kc, aes_kc_handle handle, const byte* key)
+{
+	const aes_kc_entry* found;
+	aes_kc_entry* e;
+
+	if (handle == AES_KC_EMPTY || handle == AES_KC_TOMBSTONE)
+		return NULL;
+
+	aes_kc_lock (kc);
+
+	/* no other insertion runs, so a cached handle cannot be missed here */
+	if ((found = aes_kc_lookup (kc, handle)) != NULL)
+	{
+		aes_kc_unlock (kc);
+		return found;
+	}
+
+	if (kc->filled < kc->capacity)
+		e = &kc->entries[kc->filled++];
+	else if ((e = aes_kc_evict (kc)) == NULL)
+	{
+		aes_kc_unlock (kc);
+		return NULL;
+	}
+
+	/* claimed: pins holds AES_KC_EVICTING and nothing else */
+	e->handle = handle;
+	aes_botan_aesni_set_key_var (&e->ek.ctx, &e->dk.ctx, key, kc->key_len);
+	e->referenced = 1;
+	AES_KC_ADD (&e->pins, 1 - AES_KC_EVICTING);
+
+	if (kc->tombstones > (kc->mask + 1) / 4)
+		aes_kc_rebuild (kc);
+	else
+		aes_kc_link (kc, e);
+
+	aes_kc_unlock (kc);
+	return e;
+}
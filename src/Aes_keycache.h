@@ -0,0 +1,77 @@
+/*
+ * Cache of expanded AES key schedules, indexed by opaque key handles.
+ *
+ * The schedules live in a pool allocated once, each entry on its own cache
+ * lines, and are found through an open-addressed table. When the pool is full
+ * the CLOCK algorithm picks the entry to reuse. Lookups take no lock and may
+ * run from any number of threads; insertions are serialized by a spin lock.
+ * Requires HasAESNI().
+ */
+
+#include "Tcdefs.h"
+#include "config.h"
+#include "Aes.h"
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* any value but 0 and ~0, which mark free and deleted table slots */
+typedef uint64 aes_kc_handle;
+
+#define AES_KC_SCHEDULE_SIZE	256	/* aes_encrypt_ctx rounded up to whole cache lines */
+
+typedef struct
+{
+	union { aes_encrypt_ctx ctx; byte line[AES_KC_SCHEDULE_SIZE]; } ek;
+	union { aes_decrypt_ctx ctx; byte line[AES_KC_SCHEDULE_SIZE]; } dk;
+	volatile aes_kc_handle handle;
+	volatile long pins;			/* lookups using the entry, plus a flag while it is rewritten */
+	volatile long referenced;	/* CLOCK bit */
+	uint_32t slot;				/* table slot pointing to the entry */
+	byte pad[64 - sizeof (aes_kc_handle) - 2 * sizeof (long) - sizeof (uint_32t)];
+} aes_kc_entry;
+
+typedef struct
+{
+	volatile aes_kc_handle handle;
+	volatile uint_32t entry;
+} aes_kc_slot;
+
+typedef struct
+{
+	aes_kc_entry* entries;	/* pool, 64-byte aligned */
+	aes_kc_slot* table;
+	uint_32t capacity;		/* entries in the pool */
+	uint_32t mask;			/* table size - 1 */
+	uint_32t filled;		/* entries used at least once */
+	uint_32t tombstones;
+	uint_32t hand;			/* CLOCK hand */
+	uint_32t evictions;
+	int key_len;
+	volatile long lock;
+} aes_kc;
+
+/* Pool of capacity entries for keys of key_len bytes (16, 24, 32) or bits */
+AES_RETURN aes_kc_init(aes_kc* kc, uint_32t capacity, int key_len);
+
+/* Erases the schedules and frees the pool; no other call may be running */
+void aes_kc_free(aes_kc* kc);
+
+/* Returns the entry of handle, pinned so that it is not evicted until
+   aes_kc_release, or NULL if it is not cached. An entry being inserted or
+   evicted at the same time may be missed. */
+const aes_kc_entry* aes_kc_lookup(aes_kc* kc, aes_kc_handle handle);
+
+/* Returns the pinned entry of handle, expanding key into it if it is not
+   cached. NULL if every entry of the pool is pinned. */
+const aes_kc_entry* aes_kc_insert(aes_kc* kc, aes_kc_handle handle, const byte* key);
+
+void aes_kc_release(aes_kc* kc, const aes_kc_entry* entry);
+
+#ifdef __cplusplus
+}
+#endif
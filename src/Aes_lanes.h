@@ -0,0 +1,103 @@
+/*
+ * AES_LANES_n(M) expands M(0) .. M(n - 1), for n from 1 to 32: the kernels of
+ * Aes_Botan_aesni.c and Aes_mb.c are generated from it for any number of
+ * blocks or lanes, one register per block.
+ */
+
+#pragma once
+
+#define AES_LANES_1(M)  M(0)
+#define AES_LANES_2(M)  AES_LANES_1(M) M(1)
+#define AES_LANES_3(M)  AES_LANES_2(M) M(2)
+#define AES_LANES_4(M)  AES_LANES_3(M) M(3)
+#define AES_LANES_5(M)  AES_LANES_4(M) M(4)
+#define AES_LANES_6(M)  AES_LANES_5(M) M(5)
+#define AES_LANES_7(M)  AES_LANES_6(M) M(6)
+#define AES_LANES_8(M)  AES_LANES_7(M) M(7)
+#define AES_LANES_9(M)  AES_LANES_8(M) M(8)
+#define AES_LANES_10(M) AES_LANES_9(M) M(9)
+#define AES_LANES_11(M) AES_LANES_10(M) M(10)
+#define AES_LANES_12(M) AES_LANES_11(M) M(11)
+#define AES_LANES_13(M) AES_LANES_12(M) M(12)
+#define AES_LANES_14(M) AES_LANES_13(M) M(13)
+#define AES_LANES_15(M) AES_LANES_14(M) M(14)
+#define AES_LANES_16(M) AES_LANES_15(M) M(15)
+#define AES_LANES_17(M) AES_LANES_16(M) M(16)
+#define AES_LANES_18(M) AES_LANES_17(M) M(17)
+#define AES_LANES_19(M) AES_LANES_18(M) M(18)
+#define AES_LANES_20(M) AES_LANES_19(M) M(19)
+#define AES_LANES_21(M) AES_LANES_20(M) M(20)
+#define AES_LANES_22(M) AES_LANES_21(M) M(21)
+#define AES_LANES_23(M) AES_LANES_22(M) M(22)
+#define AES_LANES_24(M) AES_LANES_23(M) M(23)
+#define AES_LANES_25(M) AES_LANES_24(M) M(24)
+#define AES_LANES_26(M) AES_LANES_25(M) M(25)
+#define AES_LANES_27(M) AES_LANES_26(M) M(26)
+#define AES_LANES_28(M) AES_LANES_27(M) M(27)
+#define AES_LANES_29(M) AES_LANES_28(M) M(28)
+#define AES_LANES_30(M) AES_LANES_29(M) M(29)
+#define AES_LANES_31(M) AES_LANES_30(M) M(30)
+#define AES_LANES_32(M) AES_LANES_31(M) M(31)
+
+#define AES_WIDTHS(M) M(1) M(2) M(3) M(4) M(5) M(6) M(7) M(8) M(9) M(10) M(11) M(12) M(13) M(14) M(15) M(16) M(17) M(18) M(19) M(20) M(21) M(22) M(23) M(24) M(25) M(26) M(27) M(28) M(29) M(30) M(31) M(32)
+
+/* one round of lanes B0 .. Bn-1: K = KEY, then OP on every lane */
+#define AES_N_ROUND_K(n, KEY, OP) \
+	do \
+	{ \
+		K = KEY; \
+		AES_LANES_##n(OP) \
+	} while (0)
+
+/*
+ * All the rounds of lanes B0 .. Bn-1 with a constant number of rounds, so
+ * that the rounds tests fold away: K = KEY(i) for round i, K = KEYLAST for
+ * the last one, and XOROP adds round key 0 to a lane. K is whatever OP reads,
+ * one key for all the lanes or a row of per-lane keys (Aes_mb.c).
+ */
+#define AES_N_ALL_ROUNDS_K(n, KEY, KEYLAST, XOROP, OP, LASTOP) \
+	do \
+	{ \
+		K = KEY(0); \
+		AES_LANES_##n(XOROP) \
+		AES_N_ROUND_K(n, KEY(1), OP); \
+		AES_N_ROUND_K(n, KEY(2), OP); \
+		AES_N_ROUND_K(n, KEY(3), OP); \
+		AES_N_ROUND_K(n, KEY(4), OP); \
+		AES_N_ROUND_K(n, KEY(5), OP); \
+		AES_N_ROUND_K(n, KEY(6), OP); \
+		AES_N_ROUND_K(n, KEY(7), OP); \
+		AES_N_ROUND_K(n, KEY(8), OP); \
+		AES_N_ROUND_K(n, KEY(9), OP); \
+		if (rounds > 10) \
+		{ \
+			AES_N_ROUND_K(n, KEY(10), OP); \
+			AES_N_ROUND_K(n, KEY(11), OP); \
+		} \
+		if (rounds > 12) \
+		{ \
+			AES_N_ROUND_K(n, KEY(12), OP); \
+			AES_N_ROUND_K(n, KEY(13), OP); \
+		} \
+		AES_N_ROUND_K(n, KEYLAST, LASTOP); \
+	} while (0)
+
+/*
+ * Number of rounds (10, 12 or 14) stored by the key schedule of
+ * Aes_Botan_aesni.c in inf.b[0]
+ */
+#define AES_NR(ctx) ((ctx)->inf.b[0] >> 4)
+
+/*
+ * Instantiate "call" with a compile-time constant "rounds" for nr, so that
+ * the round-count checks inside the inlined kernels are folded away
+ */
+#define AES_ROUNDS_DISPATCH(nr, call) \
+	switch (nr) \
+	{ \
+	case 10: { const int rounds = 10; call; } break; \
+	case 12: { const int rounds = 12; call; } break; \
+	default: { const int rounds = 14; call; } break; \
+	}
+
+#define AES_NR_DISPATCH(ctx, call)	AES_ROUNDS_DISPATCH (AES_NR (ctx), call)
@@ -0,0 +1,386 @@
+/*
+ * Multi-buffer AES-NI.
+ *
+ * As in the Intel multi-buffer manager, the key schedule of a job is copied
+ * into a round-major lane table when it is submitted: a round of n lanes
+ * reads its n round keys from one row, through a single base pointer. An
+ * n-lane kernel runs every block up to the end of the shortest job in one
+ * call, with the lane pointers in locals and the rounds unrolled for a
+ * constant number of rounds. Jobs of different key sizes cannot share a pass
+ * and get separate lanes.
+ */
+
+#include <string.h>
+#include "cpu.h"
+#include "Aes_mb.h"
+#include "Aes_Botan_aesni.h"
+#include "Aes_lanes.h"
+
+/* bytes from one row of the lane table to the next */
+#define AES_MB_ROW (AES_MB_ROW_LANES * 16)
+
+/* row i of the lane table from rk: round key i of each lane */
+#define AES_MB_ROUND_KEYS(i)	((const __m128i*)(rk + (i) * AES_MB_ROW))
+
+/*
+* steps blocks of each of n lanes, lane j from in[j] to out[j] with its round
+* keys in column j of rk: aes_mb_encrypt_<n>lanes and aes_mb_decrypt_<n>lanes
+*/
+#define AES_MB_LANE_POINTERS(j)	const byte* in##j = in[j]; byte* out##j = out[j];
+#define AES_MB_LANE_LOAD(j)		__m128i B##j = _mm_loadu_si128((const __m128i*)(in##j + off));
+#define AES_MB_LANE_XOR(j)		B##j = _mm_xor_si128(B##j, _mm_loadu_si128(K + j));
+#define AES_MB_LANE_ENC(j)		B##j = _mm_aesenc_si128(B##j, _mm_loadu_si128(K + j));
+#define AES_MB_LANE_ENCLAST(j)	B##j = _mm_aesenclast_si128(B##j, _mm_loadu_si128(K + j));
+#define AES_MB_LANE_DEC(j)		B##j = _mm_aesdec_si128(B##j, _mm_loadu_si128(K + j));
+#define AES_MB_LANE_DECLAST(j)	B##j = _mm_aesdeclast_si128(B##j, _mm_loadu_si128(K + j));
+#define AES_MB_LANE_STORE(j)	_mm_storeu_si128((__m128i*)(out##j + off), B##j);
+
+#define AES_MB_LANE_KERNEL(dir, n, OP, LASTOP) \
+VC_INLINE void aes_mb_##dir##_##n##lanes(const byte* rk, const byte* const* in, byte* const* out, uint_32t steps, const int rounds) \
+{ \
+	const size_t end = (size_t) steps * 16; \
+	const __m128i* K; \
+	size_t off; \
+	AES_LANES_##n(AES_MB_LANE_POINTERS) \
+	for (off = 0; off < end; off += 16) \
+	{ \
+		AES_LANES_##n(AES_MB_LANE_LOAD) \
+		AES_N_ALL_ROUNDS_K(n, AES_MB_ROUND_KEYS, AES_MB_ROUND_KEYS(rounds), AES_MB_LANE_XOR, OP, LASTOP); \
+		AES_LANES_##n(AES_MB_LANE_STORE) \
+	} \
+}
+
+#define AES_MB_LANE_KERNELS(n) \
+	AES_MB_LANE_KERNEL(encrypt, n, AES_MB_LANE_ENC, AES_MB_LANE_ENCLAST) \
+	AES_MB_LANE_KERNEL(decrypt, n, AES_MB_LANE_DEC, AES_MB_LANE_DECLAST)
+
+#if CRYPTOPP_BOOL_X64
+AES_MB_LANE_KERNELS(15)
+#endif
+AES_MB_LANE_KERNELS(7)
+AES_MB_LANE_KERNELS(4)
+AES_MB_LANE_KERNELS(3)
+AES_MB_LANE_KERNELS(2)
+AES_MB_LANE_KERNELS(1)
+
+#define AES_MB_LANES_CALL(w) \
+	if (encrypt) aes_mb_encrypt_##w##lanes (rk + 16 * j, g->in + j, g->out + j, steps, rounds); else aes_mb_decrypt_##w##lanes (rk + 16 * j, g->in + j, g->out + j, steps, rounds)
+
+VC_INLINE void aes_mb_run_nr(aes_mb_lanes* g, uint_32t steps, const int rounds, const int encrypt)
+{
+	const byte* rk = &g->rk[0][0][0];
+	const uint_32t n = g->active;
+	uint_32t j = 0;
+
+#if CRYPTOPP_BOOL_X64
+	if (n == 15)
+	{
+		AES_MB_LANES_CALL (15);
+		return;
+	}
+#endif
+	for (; n - j >= 7; j += 7)
+	{
+		AES_MB_LANES_CALL (7);
+	}
+	if (n - j >= 4)
+	{
+		AES_MB_LANES_CALL (4);
+		j += 4;
+	}
+	switch (n - j)
+	{
+	case 3: AES_MB_LANES_CALL (3); break;
+	case 2: AES_MB_LANES_CALL (2); break;
+	case 1: AES_MB_LANES_CALL (1); break;
+	}
+}
+
+#undef AES_MB_LANES_CALL
+
+#if CRYPTOPP_BOOL_X64 && CRYPTOPP_BOOL_VAES_INTRINSICS_AVAILABLE
+
+#define VAES512_FUNCTION CRYPTOPP_TARGET("aes,avx2,avx512f,vaes")
+
+/*
+* Four lanes per zmm register: group q holds lanes 4q to 4q + 3 and takes the
+* round keys of a round as one 64-byte slice of its row. A step runs a whole
+* cache line, four blocks, of every lane (registers Bq_0 to Bq_3) and the
+* blocks left over run one at a time (Bq_0)
+*/
+#define AES_MB_ZMM_LANE_IN(q, k, b)	_mm_loadu_si128((const __m128i*)(in[4 * q + k] + off + 16 * b))
+#define AES_MB_ZMM_LANE_OUT(q, k, b)	(__m128i*)(out[4 * q + k] + off + 16 * b)
+
+#define AES_MB_ZMM_LOAD(q, b) \
+	__m512i B##q##_##b = _mm512_castsi128_si512(AES_MB_ZMM_LANE_IN(q, 0, b)); \
+	B##q##_##b = _mm512_inserti32x4(B##q##_##b, AES_MB_ZMM_LANE_IN(q, 1, b), 1); \
+	B##q##_##b = _mm512_inserti32x4(B##q##_##b, AES_MB_ZMM_LANE_IN(q, 2, b), 2); \
+	B##q##_##b = _mm512_inserti32x4(B##q##_##b, AES_MB_ZMM_LANE_IN(q, 3, b), 3);
+#define AES_MB_ZMM_STORE(q, b) \
+	_mm_storeu_si128(AES_MB_ZMM_LANE_OUT(q, 0, b), _mm512_castsi512_si128(B##q##_##b)); \
+	_mm_storeu_si128(AES_MB_ZMM_LANE_OUT(q, 1, b), _mm512_extracti32x4_epi32(B##q##_##b, 1)); \
+	_mm_storeu_si128(AES_MB_ZMM_LANE_OUT(q, 2, b), _mm512_extracti32x4_epi32(B##q##_##b, 2)); \
+	_mm_storeu_si128(AES_MB_ZMM_LANE_OUT(q, 3, b), _mm512_extracti32x4_epi32(B##q##_##b, 3));
+
+/* OP with the round keys of group q on its one or four registers */
+#define AES_MB_ZMM_GROUP_1(q, OP) \
+	{ \
+		const __m512i Kq = _mm512_loadu_si512(K + 64 * q); \
+		B##q##_0 = OP(B##q##_0, Kq); \
+	}
+#define AES_MB_ZMM_GROUP_4(q, OP) \
+	{ \
+		const __m512i Kq = _mm512_loadu_si512(K + 64 * q); \
+		B##q##_0 = OP(B##q##_0, Kq); \
+		B##q##_1 = OP(B##q##_1, Kq); \
+		B##q##_2 = OP(B##q##_2, Kq); \
+		B##q##_3 = OP(B##q##_3, Kq); \
+	}
+
+#define AES_MB_ZMM1_LOAD(q)		AES_MB_ZMM_LOAD(q, 0)
+#define AES_MB_ZMM1_STORE(q)	AES_MB_ZMM_STORE(q, 0)
+#define AES_MB_ZMM1_XOR(q)		AES_MB_ZMM_GROUP_1(q, _mm512_xor_si512)
+#define AES_MB_ZMM1_ENC(q)		AES_MB_ZMM_GROUP_1(q, _mm512_aesenc_epi128)
+#define AES_MB_ZMM1_ENCLAST(q)	AES_MB_ZMM_GROUP_1(q, _mm512_aesenclast_epi128)
+#define AES_MB_ZMM1_DEC(q)		AES_MB_ZMM_GROUP_1(q, _mm512_aesdec_epi128)
+#define AES_MB_ZMM1_DECLAST(q)	AES_MB_ZMM_GROUP_1(q, _mm512_aesdeclast_epi128)
+
+#define AES_MB_ZMM4_LOAD(q)		AES_MB_ZMM_LOAD(q, 0) AES_MB_ZMM_LOAD(q, 1) AES_MB_ZMM_LOAD(q, 2) AES_MB_ZMM_LOAD(q, 3)
+#define AES_MB_ZMM4_STORE(q)	AES_MB_ZMM_STORE(q, 0) AES_MB_ZMM_STORE(q, 1) AES_MB_ZMM_STORE(q, 2) AES_MB_ZMM_STORE(q, 3)
+#define AES_MB_ZMM4_XOR(q)		AES_MB_ZMM_GROUP_4(q, _mm512_xor_si512)
+#define AES_MB_ZMM4_ENC(q)		AES_MB_ZMM_GROUP_4(q, _mm512_aesenc_epi128)
+#define AES_MB_ZMM4_ENCLAST(q)	AES_MB_ZMM_GROUP_4(q, _mm512_aesenclast_epi128)
+#define AES_MB_ZMM4_DEC(q)		AES_MB_ZMM_GROUP_4(q, _mm512_aesdec_epi128)
+#define AES_MB_ZMM4_DECLAST(q)	AES_MB_ZMM_GROUP_4(q, _mm512_aesdeclast_epi128)
+
+/* row i of the lane table from rk */
+#define AES_MB_ROUND_ROW(i)		(rk + (i) * AES_MB_ROW)
+
+/*
+* steps blocks of each of the 4 * G lanes of groups 0 to G - 1:
+* aes_mb_encrypt_<G>groups and aes_mb_decrypt_<G>groups
+*/
+#define AES_MB_ZMM_KERNEL(dir, G, OP, LASTOP) \
+VAES512_FUNCTION VC_INLINE void aes_mb_##dir##_##G##groups(const byte* rk, const byte* const* in, byte* const* out, uint_32t steps, const int rounds) \
+{ \
+	const size_t end = (size_t) steps * 16, lines = (size_t) (steps & ~3u) * 16; \
+	const byte* K; \
+	size_t off; \
+	for (off = 0; off < lines; off += 64) \
+	{ \
+		AES_LANES_##G(AES_MB_ZMM4_LOAD) \
+		AES_N_ALL_ROUNDS_K(G, AES_MB_ROUND_ROW, AES_MB_ROUND_ROW(rounds), AES_MB_ZMM4_XOR, AES_MB_ZMM4_##OP, AES_MB_ZMM4_##LASTOP); \
+		AES_LANES_##G(AES_MB_ZMM4_STORE) \
+	} \
+	for (; off < end; off += 16) \
+	{ \
+		AES_LANES_##G(AES_MB_ZMM1_LOAD) \
+		AES_N_ALL_ROUNDS_K(G, AES_MB_ROUND_ROW, AES_MB_ROUND_ROW(rounds), AES_MB_ZMM1_XOR, AES_MB_ZMM1_##OP, AES_MB_ZMM1_##LASTOP); \
+		AES_LANES_##G(AES_MB_ZMM1_STORE) \
+	} \
+}
+
+#define AES_MB_ZMM_KERNELS(G) \
+	AES_MB_ZMM_KERNEL(encrypt, G, ENC, ENCLAST) \
+	AES_MB_ZMM_KERNEL(decrypt, G, DEC, DECLAST)
+
+AES_MB_ZMM_KERNELS(4)
+AES_MB_ZMM_KERNELS(3)
+AES_MB_ZMM_KERNELS(2)
+AES_MB_ZMM_KERNELS(1)
+
+#define AES_MB_GROUPS_CALL(G) \
+	if (encrypt) aes_mb_encrypt_##G##groups (rk, in, out, steps, rounds); else aes_mb_decrypt_##G##groups (rk, in, out, steps, rounds)
+
+/* lanes past the last active one, up to a whole group, repeat lane 0: same blocks and keys, so the same output */
+VAES512_FUNCTION VC_INLINE void aes_mb_vaes_nr(aes_mb_lanes* g, uint_32t steps, const int rounds, const int encrypt)
+{
+	const byte* rk = &g->rk[0][0][0];
+	const byte* in[AES_MB_ROW_LANES];
+	byte* out[AES_MB_ROW_LANES];
+	const uint_32t n = g->active;
+	uint_32t j;
+	int r;
+
+	for (j = 0; j < n; j++)
+	{
+		in[j] = g->in[j];
+		out[j] = g->out[j];
+	}
+	for (; j % 4; j++)
+	{
+		in[j] = g->in[0];
+		out[j] = g->out[0];
+		for (r = 0; r <= rounds; r++)
+			memcpy (g->rk[r][j], g->rk[r][0], 16);
+	}
+
+	switch (j / 4)
+	{
+	case 4: AES_MB_GROUPS_CALL (4); break;
+	case 3: AES_MB_GROUPS_CALL (3); break;
+	case 2: AES_MB_GROUPS_CALL (2); break;
+	default: AES_MB_GROUPS_CALL (1); break;
+	}
+	_mm256_zeroupper ();
+}
+
+static VAES512_FUNCTION void aes_mb_vaes(aes_mb_lanes* g, uint_32t steps, int nr, int encrypt)
+{
+	AES_ROUNDS_DISPATCH (nr, if (encrypt) aes_mb_vaes_nr (g, steps, rounds, 1); else aes_mb_vaes_nr (g, steps, rounds, 0));
+}
+
+#undef AES_MB_GROUPS_CALL
+
+#endif
+
+/*
+* Run lanes 0 to active - 1, all holding a job, until the shortest job is
+* done. Completed jobs move to the done stack and their lanes become idle
+*/
+static void aes_mb_run(aes_mb_mgr* mgr, aes_mb_lanes* g, int nr)
+{
+	const uint_32t n = g->active;
+	uint_32t steps = g->left[0], i;
+
+	for (i = 1; i < n; i++)
+	{
+		if (g->left[i] < steps)
+			steps = g->left[i];
+	}
+
+#if CRYPTOPP_BOOL_X64 && CRYPTOPP_BOOL_VAES_INTRINSICS_AVAILABLE
+	if (mgr->vaes)
+		aes_mb_vaes (g, steps, nr, mgr->encrypt);
+	else
+#endif
+	{
+		AES_ROUNDS_DISPATCH (nr, if (mgr->encrypt) aes_mb_run_nr (g, steps, rounds, 1); else aes_mb_run_nr (g, steps, rounds, 0));
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		g->in[i] += 16 * steps;
+		g->out[i] += 16 * steps;
+		if ((g->left[i] -= steps) != 0)
+			continue;
+
+		g->job[i]->status = AES_MB_STATUS_COMPLETED;
+		g->done[g->doneCount++] = g->job[i];
+		g->job[i] = NULL;
+		g->idle[g->idleCount++] = i;
+		g->active--;
+	}
+}
+
+/* move the jobs to lanes 0 to active - 1, for a pass over a partial set */
+static void aes_mb_compact(aes_mb_lanes* g, int rounds, uint_32t ways)
+{
+	uint_32t i, last = ways;
+	int r;
+
+	for (i = 0; i < g->active; i++)
+	{
+		if (g->job[i])
+			continue;
+
+		while (!g->job[--last])
+			;
+		for (r = 0; r <= rounds; r++)
+			memcpy (g->rk[r][i], g->rk[r][last], 16);
+		g->job[i] = g->job[last];
+		g->in[i] = g->in[last];
+		g->out[i] = g->out[last];
+		g->left[i] = g->left[last];
+		g->job[last] = NULL;
+	}
+
+	g->idleCount = 0;
+	for (i = ways; i-- > g->active; )
+		g->idle[g->idleCount++] = i;
+}
+
+AES_RETURN aes_mb_init(aes_mb_mgr* mgr, int encrypt, uint_32t ways)
+{
+	uint_32t i, j;
+
+	if (ways < 1 || ways > AES_MB_MAX_LANES)
+		return EXIT_FAILURE;
+
+	memset (mgr, 0, sizeof (aes_mb_mgr));
+	mgr->encrypt = encrypt;
+	mgr->ways = ways;
+	for (i = 0; i < 3; i++)
+	{
+		for (j = ways; j-- > 0; )
+			mgr->lanes[i].idle[mgr->lanes[i].idleCount++] = j;
+	}
+#if CRYPTOPP_BOOL_X64 && CRYPTOPP_BOOL_VAES_INTRINSICS_AVAILABLE
+	if (!g_x86DetectionDone)
+		DetectX86Features ();
+	mgr->vaes = HasVAES () && HasAVX512F ();
+#endif
+	return EXIT_SUCCESS;
+}
+
+aes_mb_job* aes_mb_submit(aes_mb_mgr* mgr, aes_mb_job* job)
+{
+	/* both context types start with the schedule and end with inf */
+	const aes_encrypt_ctx* ctx = (const aes_encrypt_ctx*)(job->ctx);
+	const int rounds = AES_NR (ctx);
+	aes_mb_lanes* g;
+	uint_32t lane;
+	int r;
+
+	if (rounds != 10 && rounds != 12 && rounds != 14)
+	{
+		job->status = AES_MB_STATUS_INVALID;
+		return job;
+	}
+	g = &mgr->lanes[(rounds - 10) / 2];
+
+	/* a schedule from aes_botan_aesni_set_decrypt_key is inverted on first use */
+	if (!mgr->encrypt)
+		aes_botan_aesni_prepare_decrypt_key ((aes_decrypt_ctx*)(job->ctx));
+
+	/* a full set runs before submit returns, so there is always an idle lane */
+	lane = g->idle[--g->idleCount];
+	for (r = 0; r <= rounds; r++)
+		memcpy (g->rk[r][lane], (const byte*)(ctx->ks) + 16 * r, 16);
+	g->job[lane] = job;
+	g->in[lane] = job->in;
+	g->out[lane] = job->out;
+	g->left[lane] = job->len / 16;
+	g->active++;
+	job->status = AES_MB_STATUS_PENDING;
+
+	if (g->active == mgr->ways)
+		aes_mb_run (mgr, g, rounds);
+
+	if (g->doneCount)
+		return g->done[--g->doneCount];
+
+	return NULL;
+}
+
+aes_mb_job* aes_mb_flush(aes_mb_mgr* mgr)
+{
+	int i;
+
+	for (i = 0; i < 3; i++)
+	{
+		aes_mb_lanes* g = &mgr->lanes[i];
+
+		if (g->doneCount)
+			return g->done[--g->doneCount];
+
+		if (!g->active)
+			continue;
+
+		aes_mb_compact (g, 10 + 2 * i, mgr->ways);
+		aes_mb_run (mgr, g, 10 + 2 * i);
+		return g->done[--g->doneCount];
+	}
+
+	return NULL;
+}
@@ -0,0 +1,85 @@
+/*
+ * Multi-buffer AES-NI, in the style of the Intel multi-buffer manager.
+ *
+ * Jobs are submitted with their own key schedule and kept in lanes, one lane
+ * per job. A pass of the AES rounds encrypts one block of every lane, each
+ * lane with its own round keys, so many short messages under different keys
+ * keep the pipeline as full as one long message under a single key.
+ * Jobs are ECB over whole blocks. Requires HasAESNI().
+ */
+
+#include "Tcdefs.h"
+#include "config.h"
+#include "Aes.h"
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#if CRYPTOPP_BOOL_X64
+#define AES_MB_MAX_LANES	15
+#define AES_MB_ROW_LANES	16	/* lanes of a key table row: four zmm registers with VAES */
+#else
+#define AES_MB_MAX_LANES	7
+#define AES_MB_ROW_LANES	AES_MB_MAX_LANES
+#endif
+
+#define AES_MB_STATUS_PENDING		0
+#define AES_MB_STATUS_COMPLETED		1
+#define AES_MB_STATUS_INVALID		2	/* the context holds no AES-128, AES-192 or AES-256 schedule */
+
+typedef struct
+{
+	void* ctx;			/* aes_encrypt_ctx or aes_decrypt_ctx, as the manager direction, kept until completion; a
+					   schedule from aes_botan_aesni_set_decrypt_key is prepared in place on submission */
+	const byte* in;
+	byte* out;
+	uint_32t len;		/* multiple of 16 */
+	int status;
+	void* user_data;
+} aes_mb_job;
+
+/* lanes of the jobs sharing a number of rounds; a lane keeps its slot until
+   its job completes, only aes_mb_flush moves lanes to run a partial set */
+typedef struct
+{
+	byte rk[15][AES_MB_ROW_LANES][16];	/* round key r of lane j at rk[r][j], copied from its schedule on submission */
+	aes_mb_job* job[AES_MB_MAX_LANES];	/* NULL for an idle lane */
+	const byte* in[AES_MB_MAX_LANES];
+	byte* out[AES_MB_MAX_LANES];
+	uint_32t left[AES_MB_MAX_LANES];
+	uint_32t idle[AES_MB_MAX_LANES];	/* stack of the idle lanes */
+	uint_32t idleCount;
+	aes_mb_job* done[AES_MB_MAX_LANES];	/* stack of the completed jobs not returned yet */
+	uint_32t doneCount;
+	uint_32t active;
+} aes_mb_lanes;
+
+typedef struct
+{
+	aes_mb_lanes lanes[3];	/* AES-128, AES-192 and AES-256 jobs */
+	int encrypt;
+	uint_32t ways;
+	int vaes;				/* four lanes per zmm register, on CPUs with VAES and AVX-512F */
+} aes_mb_mgr;
+
+/* ways is the number of lanes run together, 1 to AES_MB_MAX_LANES */
+AES_RETURN aes_mb_init(aes_mb_mgr* mgr, int encrypt, uint_32t ways);
+
+/* Queue a job. When the lanes of its key size are full they are run until a
+   job completes, which is returned; otherwise returns NULL. Jobs may complete
+   out of submission order. A job whose context has a number of rounds other
+   than 10, 12 or 14 is not queued and is returned at once, with status
+   AES_MB_STATUS_INVALID. */
+aes_mb_job* aes_mb_submit(aes_mb_mgr* mgr, aes_mb_job* job);
+
+/* Run the lanes, even partially filled, until a job completes and return it.
+   Returns NULL once all submitted jobs have been returned. */
+aes_mb_job* aes_mb_flush(aes_mb_mgr* mgr);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,458 @@
+/*
+ * Parallel ECB, CTR and XTS over a pool of threads.
+ *
+ * The caller fills the deques and the request, then sets active and wakes
+ * the workers it needs. A worker counts itself in busy before it reads
+ * active, and the caller, once every chunk is done, clears active and waits
+ * for busy to drop to 0 before it returns: a worker that wakes late, or on
+ * the permit of an earlier request, either sees active clear and goes back
+ * to sleep, or joins a request that is fully posted.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "cpu.h"
+#include "Endian.h"
+#include "Aes_dispatch.h"
+#include "Aes_parallel.h"
+
+#if defined(_MSC_VER)
+#define AES_PAR_INCREMENT(p)		InterlockedIncrement (p)
+#define AES_PAR_DECREMENT(p)		InterlockedDecrement (p)
+#define AES_PAR_CAS(p, v, c)		InterlockedCompareExchange (p, v, c)
+#define AES_PAR_CAS64(p, v, c)		((uint64) InterlockedCompareExchange64 ((volatile LONGLONG*) (p), (LONGLONG) (v), (LONGLONG) (c)))
+#define AES_PAR_BARRIER()			_ReadWriteBarrier ()
+#else
+#define AES_PAR_INCREMENT(p)		__sync_add_and_fetch (p, 1)
+#define AES_PAR_DECREMENT(p)		__sync_sub_and_fetch (p, 1)
+#define AES_PAR_CAS(p, v, c)		__sync_val_compare_and_swap (p, c, v)
+#define AES_PAR_CAS64(p, v, c)		__sync_val_compare_and_swap (p, c, v)
+#define AES_PAR_BARRIER()			__asm__ __volatile__ ("" ::: "memory")
+#endif
+
+/* orders the store to active before the load of busy */
+#define AES_PAR_FENCE()				_mm_mfence ()
+
+#define AES_PAR_RANGE(first, last)	((uint64) (first) | ((uint64) (last) << 32))
+
+#define AES_PAR_ECB_ENCRYPT		0
+#define AES_PAR_ECB_DECRYPT		1
+#define AES_PAR_CTR				2
+#define AES_PAR_XTS_ENCRYPT		3
+#define AES_PAR_XTS_DECRYPT		4
+#define AES_PAR_TOUCH			5
+
+/* chunks of blocks are multiples of both 15 and 16 blocks */
+#define AES_PAR_CHUNK_BLOCKS		240
+
+/* a request gets one more thread for each of these: waking a thread can
+   take tens of microseconds, in which a core encrypts about as much */
+#define AES_PAR_THREAD_BYTES		(256 * 1024)
+
+#if CRYPTOPP_BOOL_X64
+#define AES_PAR_CTR_CRYPT			aes_botan_aesni_ctr_crypt_15x
+#define AES_PAR_XTS_ENCRYPT_FN		aes_botan_aesni_xts_encrypt_15x
+#define AES_PAR_XTS_DECRYPT_FN		aes_botan_aesni_xts_decrypt_15x
+#else
+#define AES_PAR_CTR_CRYPT			aes_botan_aesni_ctr_crypt_7x
+#define AES_PAR_XTS_ENCRYPT_FN		aes_botan_aesni_xts_encrypt_7x
+#define AES_PAR_XTS_DECRYPT_FN		aes_botan_aesni_xts_decrypt_7x
+#endif
+
+static void aes_par_lock(aes_par_pool* pool)
+{
+	while (AES_PAR_CAS (&pool->lock, 1, 0) != 0)
+	{
+		while (pool->lock)
+			_mm_pause ();
+	}
+}
+
+static void aes_par_unlock(aes_par_pool* pool)
+{
+	AES_PAR_BARRIER ();
+	pool->lock = 0;
+}
+
+/* ctr + n, carried within the counter width as aes_botan_aesni_ctr_crypt does */
+static void aes_par_ctr_add(byte* ctr, uint64 n, int width)
+{
+	uint64 hi, lo;
+
+	memcpy (&hi, ctr, 8);
+	memcpy (&lo, ctr + 8, 8);
+	hi = BE64 (hi);
+	lo = BE64 (lo);
+
+	if (width == 32)
+		lo = (lo & 0xFFFFFFFF00000000ULL) | (uint32) (lo + n);
+	else
+	{
+		lo += n;
+		if (width == 128 && lo < n)
+			++hi;
+	}
+
+	hi = BE64 (hi);
+	lo = BE64 (lo);
+	memcpy (ctr, &hi, 8);
+	memcpy (ctr + 8, &lo, 8);
+}
+
+static void aes_par_run_chunk(const aes_par_request* r, uint_32t chunk)
+{
+	const uint64 first = (uint64) chunk * r->chunk_units;
+	const uint_32t units = (r->units - first < r->chunk_units)? (uint_32t) (r->units - first) : r->chunk_units;
+	const byte* in = r->in + (size_t) (first * r->unit_size);
+	byte* out = r->out + (size_t) (first * r->unit_size);
+	aes_ctr_state state;
+
+	switch (r->mode)
+	{
+	case AES_PAR_ECB_ENCRYPT:
+		aes_encrypt_blocks ((aes_encrypt_ctx*) r->ctx, in, out, units);
+		break;
+	case AES_PAR_ECB_DECRYPT:
+		aes_decrypt_blocks ((aes_decrypt_ctx*) r->ctx, in, out, units);
+		break;
+	case AES_PAR_CTR:
+		memcpy (state.ctr, r->ctr, 16);
+		aes_par_ctr_add (state.ctr, first, r->ctr_width);
+		state.used = 16;
+		state.width = r->ctr_width;
+		AES_PAR_CTR_CRYPT ((aes_encrypt_ctx*) r->ctx, &state, in, out, units * 16);
+		break;
+	case AES_PAR_XTS_ENCRYPT:
+		AES_PAR_XTS_ENCRYPT_FN ((const aes_xts_ctx*) r->ctx, in, out, r->start_sector + first, units, r->unit_size);
+		break;
+	case AES_PAR_XTS_DECRYPT:
+		AES_PAR_XTS_DECRYPT_FN ((const aes_xts_ctx*) r->ctx, in, out, r->start_sector + first, units, r->unit_size);
+		break;
+	case AES_PAR_TOUCH:
+		memset (out, 0, (size_t) units * 16);
+		break;
+	}
+}
+
+/* the first chunk of the deque, or the last one for a thief; -1 once it is empty */
+static long aes_par_take(aes_par_deque* deque, int steal)
+{
+	uint64 range;
+	uint_32t first, last;
+
+	do
+	{
+		range = deque->range;
+		first = (uint_32t) range;
+		last = (uint_32t) (range >> 32);
+		if (first >= last)
+			return -1;
+	}
+	while (AES_PAR_CAS64 (&deque->range, steal? AES_PAR_RANGE (first, last - 1) : AES_PAR_RANGE (first + 1, last), range) != range);
+
+	return steal? (long) (last - 1) : (long) first;
+}
+
+/* runs the deque of thread self, then steals from the others in turn; when
+   it returns, every chunk has been taken, though some may still be running */
+static void aes_par_work(aes_par_pool* pool, uint_32t self)
+{
+	const uint_32t used = pool->used;
+	uint_32t i;
+	long chunk;
+
+	for (i = 0; i < used; i++)
+	{
+		aes_par_deque* deque = &pool->deques[(self + i) % used];
+		const int steal = (i != 0 || self >= used);
+
+		while ((chunk = aes_par_take (deque, steal)) >= 0)
+		{
+			aes_par_run_chunk (&pool->request, (uint_32t) chunk);
+			AES_PAR_DECREMENT (&pool->pending);
+		}
+	}
+}
+
+static void aes_par_worker_main(void* param)
+{
+	aes_par_worker* worker = (aes_par_worker*) param;
+	aes_par_pool* pool = worker->pool;
+
+	if (worker->cpu != AES_PAR_NO_CPU)
+		PinThread (worker->cpu);
+
+	for (;;)
+	{
+		WaitSemaphore (&pool->wake);
+		if (pool->stop)
+			break;
+
+		AES_PAR_INCREMENT (&pool->busy);
+		if (pool->active)
+		{
+			AES_PAR_BARRIER ();
+			aes_par_work (pool, worker->index);
+		}
+		AES_PAR_DECREMENT (&pool->busy);
+	}
+}
+
+static void aes_par_execute(aes_par_pool* pool, aes_par_request* r)
+{
+	const uint64 bytes = r->units * r->unit_size;
+	uint64 units;
+	uint_32t used, i;
+
+	used = (bytes / AES_PAR_THREAD_BYTES < pool->threads)? (uint_32t) (bytes / AES_PAR_THREAD_BYTES) : pool->threads;
+	if (used == 0)
+		used = 1;
+
+	/* at least 4 chunks per thread, for stealing to even out the threads */
+	units = pool->chunk_bytes / r->unit_size;
+	if (used > 1 && r->units / (4 * used) < units)
+		units = r->units / (4 * used);
+	if (r->unit_size == 16)
+		units -= units % AES_PAR_CHUNK_BLOCKS;
+	if (units == 0)
+		units = (r->unit_size == 16)? AES_PAR_CHUNK_BLOCKS : 1;
+	r->chunk_units = (uint_32t) units;
+	r->chunks = (uint_32t) ((r->units + units - 1) / units);
+
+	if (used == 1)
+	{
+		for (i = 0; i < r->chunks; i++)
+			aes_par_run_chunk (r, i);
+		return;
+	}
+
+	aes_par_lock (pool);
+
+	pool->request = *r;
+	pool->used = used;
+	for (i = 0; i < used; i++)
+		pool->deques[i].range = AES_PAR_RANGE ((uint64) r->chunks * i / used, (uint64) r->chunks * (i + 1) / used);
+	pool->pending = (long) r->chunks;
+	AES_PAR_BARRIER ();
+	pool->active = 1;
+	PostSemaphore (&pool->wake, used - 1);
+
+	aes_par_work (pool, 0);
+	while (pool->pending)
+		_mm_pause ();
+
+	pool->active = 0;
+	AES_PAR_FENCE ();
+	while (pool->busy)
+		_mm_pause ();
+
+	aes_par_unlock (pool);
+}
+
+/* starts threads - 1 workers, worker i pinned to cpus[i % cpuCount] unless cpus is NULL */
+static AES_RETURN aes_par_start(aes_par_pool* pool, uint_32t threads, const uint_32t* cpus, uint_32t cpuCount, uint_32t node)
+{
+	uint_32t i;
+	size_t l2 = GetL2CacheSize ()? GetL2CacheSize () : 256 * 1024;
+
+	memset (pool, 0, sizeof (aes_par_pool));
+	pool->node = node;
+	if (threads == 0)
+		threads = cpuCount? cpuCount : 1;
+	if (threads > CPU_MAX_LOGICAL)
+		threads = CPU_MAX_LOGICAL;
+
+	/* input and output of a chunk in half the L2 */
+	pool->chunk_bytes = l2 / 4 - l2 / 4 % (AES_PAR_CHUNK_BLOCKS * 16);
+	if (pool->chunk_bytes == 0)
+		pool->chunk_bytes = AES_PAR_CHUNK_BLOCKS * 16;
+
+	if (!InitSemaphore (&pool->wake))
+		return EXIT_FAILURE;
+	pool->threads = 1;
+
+	pool->deques = (aes_par_deque*) _aligned_malloc (threads * sizeof (aes_par_deque), 64);
+	pool->workers = (aes_par_worker*) malloc (threads * sizeof (aes_par_worker));
+	if (!pool->deques || !pool->workers)
+	{
+		aes_par_free (pool);
+		return EXIT_FAILURE;
+	}
+	memset (pool->deques, 0, threads * sizeof (aes_par_deque));
+
+	for (i = 1; i < threads; i++)
+	{
+		aes_par_worker* worker = &pool->workers[i - 1];
+
+		worker->pool = pool;
+		worker->index = i;
+		worker->cpu = (cpus && cpuCount)? cpus[i % cpuCount] : AES_PAR_NO_CPU;
+		if (!StartThread (&worker->thread, aes_par_worker_main, worker))
+		{
+			aes_par_free (pool);
+			return EXIT_FAILURE;
+		}
+		pool->threads++;
+	}
+	return EXIT_SUCCESS;
+}
+
+AES_RETURN aes_par_init(aes_par_pool* pool, uint_32t threads, int pin)
+{
+	uint_32t cpus[CPU_MAX_LOGICAL];
+	const uint_32t cpuCount = GetCpuSpreadOrder (cpus, CPU_MAX_LOGICAL);
+
+	return aes_par_start (pool, threads, pin? cpus : NULL, cpuCount, AES_PAR_ANY_NODE);
+}
+
+AES_RETURN aes_par_init_node(aes_par_pool* pool, uint_32t node, uint_32t threads)
+{
+	uint_32t cpus[CPU_MAX_LOGICAL];
+	const uint_32t cpuCount = GetCpuNodeOrder (node, cpus, CPU_MAX_LOGICAL);
+
+	if (cpuCount == 0)
+	{
+		memset (pool, 0, sizeof (aes_par_pool));
+		return EXIT_FAILURE;
+	}
+	return aes_par_start (pool, threads, cpus, cpuCount, node);
+}
+
+void aes_par_free(aes_par_pool* pool)
+{
+	uint_32t i;
+
+	if (pool->threads == 0)
+		return;
+
+	pool->stop = 1;
+	PostSemaphore (&pool->wake, pool->threads - 1);
+	for (i = 1; i < pool->threads; i++)
+		JoinThread (pool->workers[i - 1].thread);
+	FreeSemaphore (&pool->wake);
+
+	if (pool->deques)
+		_aligned_free (pool->deques);
+	free (pool->workers);
+	memset (pool, 0, sizeof (aes_par_pool));
+}
+
+void aes_par_ecb_encrypt(aes_par_pool* pool, aes_encrypt_ctx* ctx, const byte* in, byte* out, uint64 blocks)
+{
+	aes_par_request r;
+
+	memset (&r, 0, sizeof (r));
+	r.mode = AES_PAR_ECB_ENCRYPT;
+	r.ctx = ctx;
+	r.in = in;
+	r.out = out;
+	r.units = blocks;
+	r.unit_size = 16;
+	if (blocks)
+		aes_par_execute (pool, &r);
+}
+
+void aes_par_ecb_decrypt(aes_par_pool* pool, aes_decrypt_ctx* ctx, const byte* in, byte* out, uint64 blocks)
+{
+	aes_par_request r;
+
+	/* the threads must not derive the decryption schedule side by side */
+	aes_botan_aesni_prepare_decrypt_key (ctx);
+
+	memset (&r, 0, sizeof (r));
+	r.mode = AES_PAR_ECB_DECRYPT;
+	r.ctx = ctx;
+	r.in = in;
+	r.out = out;
+	r.units = blocks;
+	r.unit_size = 16;
+	if (blocks)
+		aes_par_execute (pool, &r);
+}
+
+void aes_par_ctr_crypt(aes_par_pool* pool, aes_encrypt_ctx* ctx, aes_ctr_state* state, const byte* in, byte* out, uint64 len)
+{
+	aes_par_request r;
+	uint_32t head = (state->used < 16)? 16 - state->used : 0;
+	uint64 blocks;
+
+	/* the keystream left over from the previous call, then whole blocks, then the tail */
+	if (head > len)
+		head = (uint_32t) len;
+	if (head)
+	{
+		AES_PAR_CTR_CRYPT (ctx, state, in, out, head);
+		in += head;
+		out += head;
+		len -= head;
+	}
+
+	blocks = len / 16;
+	if (blocks)
+	{
+		memset (&r, 0, sizeof (r));
+		r.mode = AES_PAR_CTR;
+		r.ctx = ctx;
+		r.in = in;
+		r.out = out;
+		r.units = blocks;
+		r.unit_size = 16;
+		r.ctr_width = state->width;
+		memcpy (r.ctr, state->ctr, 16);
+		aes_par_execute (pool, &r);
+
+		aes_par_ctr_add (state->ctr, blocks, state->width);
+		in += blocks * 16;
+		out += blocks * 16;
+	}
+
+	if (len % 16)
+		AES_PAR_CTR_CRYPT (ctx, state, in, out, (uint_32t) (len % 16));
+}
+
+void aes_par_xts_encrypt(aes_par_pool* pool, const aes_xts_ctx* ctx, const byte* in, byte* out, uint64 startSector, uint64 sectorCount, uint_32t sectorSize)
+{
+	aes_par_request r;
+
+	memset (&r, 0, sizeof (r));
+	r.mode = AES_PAR_XTS_ENCRYPT;
+	r.ctx = ctx;
+	r.in = in;
+	r.out = out;
+	r.units = sectorCount;
+	r.unit_size = sectorSize;
+	r.start_sector = startSector;
+	if (sectorCount && sectorSize >= 16)
+		aes_par_execute (pool, &r);
+}
+
+void aes_par_xts_decrypt(aes_par_pool* pool, const aes_xts_ctx* ctx, const byte* in, byte* out, uint64 startSector, uint64 sectorCount, uint_32t sectorSize)
+{
+	aes_par_request r;
+
+	memset (&r, 0, sizeof (r));
+	r.mode = AES_PAR_XTS_DECRYPT;
+	r.ctx = ctx;
+	r.in = in;
+	r.out = out;
+	r.units = sectorCount;
+	r.unit_size = sectorSize;
+	r.start_sector = startSector;
+	if (sectorCount && sectorSize >= 16)
+		aes_par_execute (pool, &r);
+}
+
+void aes_par_touch(aes_par_pool* pool, byte* buffer, uint64 len)
+{
+	aes_par_request r;
+
+	memset (&r, 0, sizeof (r));
+	r.mode = AES_PAR_TOUCH;
+	r.in = buffer;
+	r.out = buffer;
+	r.units = len / 16;
+	r.unit_size = 16;
+	if (r.units)
+		aes_par_execute (pool, &r);
+	memset (buffer + len / 16 * 16, 0, (size_t) (len % 16));
+}
@@ -0,0 +1,116 @@
+/*
+ * Parallel ECB, CTR and XTS over a persistent pool of threads.
+ *
+ * A request is cut into chunks sized to stay in the L2 of a core: multiples
+ * of 240 blocks, so that both the 15-way and the 16-way loops of the kernels
+ * run without tails, or whole sectors for XTS. The chunks are dealt out to
+ * one deque per thread before the threads are woken; each thread takes
+ * chunks from the front of its own deque, then steals from the back of the
+ * others once it is empty. Taking a chunk is a single compare-and-swap: no
+ * lock is held while the data is encrypted. The calling thread works as one
+ * of the threads, and returns when every chunk is done. Small requests use
+ * fewer threads, down to the calling thread alone.
+ * Requires HasAESNI(); ECB goes through aes_encrypt_blocks and
+ * aes_decrypt_blocks, so aes_dispatch_init must have run.
+ */
+
+#include "Tcdefs.h"
+#include "config.h"
+#include "Aes.h"
+#include "Aes_Botan_aesni.h"
+#include "utils.h"
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* chunk indexes [first, last) of one thread, packed in one word so that its
+   owner and the thieves can take from either end with one compare-and-swap */
+typedef struct
+{
+	volatile uint64 range;
+	byte pad[64 - sizeof (uint64)];
+} aes_par_deque;
+
+typedef struct
+{
+	int mode;
+	const void* ctx;
+	const byte* in;
+	byte* out;
+	uint64 units;			/* blocks, or sectors for XTS */
+	uint_32t unit_size;		/* 16, or the sector size */
+	uint_32t chunk_units;
+	uint_32t chunks;
+	int ctr_width;
+	byte ctr[16];			/* counter block of the first block */
+	uint64 start_sector;
+} aes_par_request;
+
+typedef struct
+{
+	THREAD_HANDLE thread;
+	struct aes_par_pool_t* pool;
+	uint_32t index;			/* its deque; the caller has deque 0 */
+	uint_32t cpu;			/* processor it is pinned to, or AES_PAR_NO_CPU */
+} aes_par_worker;
+
+#define AES_PAR_NO_CPU		0xFFFFFFFF
+#define AES_PAR_ANY_NODE	0xFFFFFFFF
+
+typedef struct aes_par_pool_t
+{
+	aes_par_deque* deques;		/* one per thread, 64-byte aligned */
+	aes_par_worker* workers;	/* threads - 1 */
+	uint_32t threads;			/* the calling thread included */
+	uint_32t used;				/* threads the current request is dealt out to */
+	size_t chunk_bytes;			/* largest chunk */
+	uint_32t node;				/* NUMA node of the workers, or AES_PAR_ANY_NODE */
+	aes_par_request request;
+	volatile long pending;		/* chunks of the request not done */
+	volatile long busy;			/* workers looking at the request */
+	volatile long active;		/* a request is posted */
+	volatile long stop;
+	volatile long lock;			/* requests run one at a time */
+	SEMAPHORE wake;
+} aes_par_pool;
+
+/* Starts threads - 1 workers, threads 0 for one per logical processor. With
+   pin, worker i is pinned to processor i of GetCpuSpreadOrder, the first
+   being left to the caller. */
+AES_RETURN aes_par_init(aes_par_pool* pool, uint_32t threads, int pin);
+
+/* Starts threads - 1 workers pinned to the processors of NUMA node node, in
+   the order of GetCpuNodeOrder; threads 0 for one per processor of the node.
+   Requests should come from a thread of the node as well, as the calling
+   thread takes a share of the chunks. EXIT_FAILURE if the node has no processor. */
+AES_RETURN aes_par_init_node(aes_par_pool* pool, uint_32t node, uint_32t threads);
+
+/* Stops and joins the workers; no request may be running */
+void aes_par_free(aes_par_pool* pool);
+
+/* Requests may come from any thread but a worker of the pool; those of
+   several threads run one after another. in and out may be equal. */
+void aes_par_ecb_encrypt(aes_par_pool* pool, aes_encrypt_ctx* ctx, const byte* in, byte* out, uint64 blocks);
+void aes_par_ecb_decrypt(aes_par_pool* pool, aes_decrypt_ctx* ctx, const byte* in, byte* out, uint64 blocks);
+
+/* Any number of bytes, continuing the keystream of state as
+   aes_botan_aesni_ctr_crypt_15x does */
+void aes_par_ctr_crypt(aes_par_pool* pool, aes_encrypt_ctx* ctx, aes_ctr_state* state, const byte* in, byte* out, uint64 len);
+
+/* Like the XTS kernels, nothing is done when sectorSize is under 16 */
+void aes_par_xts_encrypt(aes_par_pool* pool, const aes_xts_ctx* ctx, const byte* in, byte* out, uint64 startSector, uint64 sectorCount, uint_32t sectorSize);
+void aes_par_xts_decrypt(aes_par_pool* pool, const aes_xts_ctx* ctx, const byte* in, byte* out, uint64 startSector, uint64 sectorCount, uint_32t sectorSize);
+
+/* Zeroes len bytes of buffer, dealt out to the threads as an ECB or CTR
+   request of len bytes would be. The OS places a page on the node of the
+   thread that first writes to it: on a fresh allocation, each page lands
+   on the node of the thread that will encrypt it. */
+void aes_par_touch(aes_par_pool* pool, byte* buffer, uint64 len);
+
+#ifdef __cplusplus
+}
+#endif
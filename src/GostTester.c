@@ -1,9 +1,21 @@
 #include <stdio.h>
 #include <stdlib.h>
+#if defined(_WIN32)
 #include <conio.h>
+#endif
 #include <string.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
 #include "Aes.h"
 #include "Aes_Botan_aesni.h"
+#include "Aes_dispatch.h"
+#include "Aes_gcm.h"
+#include "Aes_mb.h"
+#include "Aes_keycache.h"
+#include "Aes_parallel.h"
 #include "cpu.h"
 #include "utils.h"
 
@@ -16,17 +28,93 @@ typedef struct {
 	const char* ciphertext;
 } CIPHER_TEST;
 
+typedef struct {
+	const char* key;
+	const char* iv;
+	const char* plaintext;
+	const char* ciphertext;
+} CTR_TEST;
+
+typedef struct {
+	const char* key;
+	const char* iv;
+	const char* aad;
+	const char* plaintext;
+	const char* ciphertext;
+	const char* tag;
+} GCM_TEST;
+
+typedef struct {
+	const char* key1;
+	const char* key2;
+	uint64 sector;
+	const char* plaintext;
+	const char* ciphertext;
+} XTS_TEST;
+
 typedef void (__cdecl CipherFunction) (unsigned char* key, unsigned char* input, unsigned long inputLen, unsigned char* output, int encrypt);
+typedef void (__cdecl CtrFunction) (aes_encrypt_ctx *ctx, aes_ctr_state* state, const byte* input, byte* output, uint_32t len);
+typedef void (__cdecl CbcDecryptFunction) (aes_decrypt_ctx *ctx, byte* iv, const byte* input, byte* output, uint_32t blocks);
+typedef void (__cdecl CbcStreamsFunction) (aes_encrypt_ctx *ctx, aes_cbc_stream* streams, uint_32t count);
+typedef AES_RETURN (__cdecl KeysFunction) (aes_encrypt_ctx *ctx, const byte* keys, size_t count, int key_len);
+typedef void (__cdecl XtsFunction) (const aes_xts_ctx* ctx, const byte* input, byte* output, uint64 startSector, uint_32t sectorCount, uint_32t sectorSize);
 
+#if defined(_WIN32)
 #define RtlGenRandom SystemFunction036
 BOOLEAN NTAPI RtlGenRandom(PVOID RandomBuffer, ULONG RandomBufferLength);
+#endif
+
+#define TEST_VECTOR_LONG_LEN (63 * 16)
+#define ECB_TEST_MAX_BLOCKS 130	/* two passes of the 64-block VAES-512 loop and a tail */
+
+/* key length in bytes used by the cipher functions below */
+static int g_keySize = 32;
+
+/* random, distinct blocks through fn for every length from 1 to ECB_TEST_MAX_BLOCKS,
+   out of place then in place, against the 1-way kernel: with identical blocks a lane
+   at the wrong offset goes unnoticed. The block after the request must be left alone */
+int RunEcbLengthTest (CipherFunction fn)
+{
+	static ALIGN (64) unsigned char input[(ECB_TEST_MAX_BLOCKS + 1) * 16];
+	static ALIGN (64) unsigned char output[(ECB_TEST_MAX_BLOCKS + 1) * 16];
+	static ALIGN (64) unsigned char expected[ECB_TEST_MAX_BLOCKS * 16];
+	aes_encrypt_ctx kse;
+	aes_decrypt_ctx ksd;
+	unsigned char key[32];
+	uint_32t blocks, j;
+
+	RtlGenRandom (key, sizeof (key));
+	RtlGenRandom (input, sizeof (input));
+	aes_botan_aesni_set_key_var (&kse, &ksd, key, g_keySize);
+	aes_botan_aesni_encrypt_width (&kse, input, expected, ECB_TEST_MAX_BLOCKS, 1);
+
+	for (blocks = 1; blocks <= ECB_TEST_MAX_BLOCKS; blocks++)
+	{
+		memset (output, 0xA5, sizeof (output));
+		fn (key, input, blocks * 16, output, 1);
+		if (memcmp (output, expected, blocks * 16))
+			return 0;
+
+		fn (key, output, blocks * 16, output, 0);
+		if (memcmp (output, input, blocks * 16))
+			return 0;
+
+		for (j = blocks * 16; j < sizeof (output); j++)
+		{
+			if (output[j] != 0xA5)
+				return 0;
+		}
+	}
+
+	return 1;
+}
 
 int RunCipherTest (CipherFunction fn, CIPHER_TEST* vector, int count)
 {
-	static ALIGN (32) unsigned char input[64];
-	static ALIGN (32) unsigned char output[64];
+	static ALIGN (32) unsigned char input[TEST_VECTOR_LONG_LEN];
+	static ALIGN (32) unsigned char output[TEST_VECTOR_LONG_LEN];
 	static ALIGN (32) unsigned char key[32];
-	int i;
+	int i, j;
 	for (i = 0; i < count; i++)
 	{
 		HexStringToByteArray (vector[i].key, key);
@@ -62,137 +150,3362 @@ int RunCipherTest (CipherFunction fn, CIPHER_TEST* vector, int count)
 
 		if (memcmp (input, output, 64))
 			return 0;
+
+		/* long enough to go through the widest interleave and every tail path */
+		HexStringToByteArray (vector[i].plaintext, input);
+		HexStringToByteArray (vector[i].ciphertext, output);
+		for (j = 16; j < TEST_VECTOR_LONG_LEN; j += 16)
+		{
+			memcpy (input + j, input, 16);
+			memcpy (output + j, output, 16);
+		}
+		fn (key, input, TEST_VECTOR_LONG_LEN, input, 1);
+		if (memcmp (input, output, TEST_VECTOR_LONG_LEN))
+			return 0;
+
+		fn (key, input, TEST_VECTOR_LONG_LEN, input, 0);
+
+		HexStringToByteArray (vector[i].plaintext, output);
+		for (j = 16; j < TEST_VECTOR_LONG_LEN; j += 16)
+			memcpy (output + j, output, 16);
+
+		if (memcmp (input, output, TEST_VECTOR_LONG_LEN))
+			return 0;
 	}
 
-	return 1;
+	return RunEcbLengthTest (fn);
 }
 
-double RunCipherBenchmark (CipherFunction fn, int encrypt, int extended)
+#define CTR_TEST_LEN 64
+
+int RunCtrTest (CtrFunction fn, CTR_TEST* vector)
 {
-	#define TEST_BLOCK_LEN 52428800
-	#define TEST_BLOCK_COUNT 8
+	static ALIGN (32) unsigned char input[TEST_VECTOR_LONG_LEN];
+	static ALIGN (32) unsigned char output[TEST_VECTOR_LONG_LEN];
+	static ALIGN (32) unsigned char key[32];
+	static const uint_32t chunks[] = {1, 15, 17, 31};
+	unsigned char iv[16];
+	aes_encrypt_ctx kse;
+	aes_decrypt_ctx ksd;
+	aes_ctr_state state;
+	int i, j, keyLen = (int) strlen (vector->key) / 2;
+
+	HexStringToByteArray (vector->key, key);
+	HexStringToByteArray (vector->iv, iv);
+	aes_botan_aesni_set_key_var (&kse, &ksd, key, keyLen);
+
+	/* whole message in one call */
+	HexStringToByteArray (vector->plaintext, input);
+	HexStringToByteArray (vector->ciphertext, output);
+	aes_botan_aesni_ctr_init (&state, iv, 128);
+	fn (&kse, &state, input, input, CTR_TEST_LEN);
+	if (memcmp (input, output, CTR_TEST_LEN))
+		return 0;
+
+	/* same message split at odd byte offsets */
+	HexStringToByteArray (vector->plaintext, input);
+	aes_botan_aesni_ctr_init (&state, iv, 128);
+	for (i = 0, j = 0; i < 4; j += chunks[i++])
+		fn (&kse, &state, input + j, input + j, chunks[i]);
+	if (memcmp (input, output, CTR_TEST_LEN))
+		return 0;
+
+	/* 32-bit counter wrapping inside a wide batch, checked against ECB */
+	memset (iv + 12, 0xFF, 4);
+	iv[15] = 0xF0;
+	for (j = 0; j < TEST_VECTOR_LONG_LEN; j += 16)
+	{
+		memcpy (output + j, iv, 16);
+		for (i = 15; i >= 12 && ++iv[i] == 0; i--);
+	}
+	aes_botan_aesni_encrypt_4x (&kse, output, output, TEST_VECTOR_LONG_LEN / 16);
+
+	memset (input, 0, TEST_VECTOR_LONG_LEN);
+	HexStringToByteArray (vector->iv, iv);
+	memset (iv + 12, 0xFF, 4);
+	iv[15] = 0xF0;
+	aes_botan_aesni_ctr_init (&state, iv, 32);
+	fn (&kse, &state, input, input, TEST_VECTOR_LONG_LEN);
+	if (memcmp (input, output, TEST_VECTOR_LONG_LEN))
+		return 0;
+
+	return 1;
+}
 
-	unsigned char *input = (unsigned char*) _aligned_malloc (TEST_BLOCK_LEN, 32);
+#define CBC_TEST_LEN 64
+#define CBC_STREAM_COUNT 9
+
+int RunCbcTest (CbcDecryptFunction decFn, CbcStreamsFunction encFn, CTR_TEST* vector)
+{
+	static ALIGN (32) unsigned char input[TEST_VECTOR_LONG_LEN];
+	static ALIGN (32) unsigned char output[TEST_VECTOR_LONG_LEN];
+	static ALIGN (32) unsigned char expected[TEST_VECTOR_LONG_LEN];
 	static ALIGN (32) unsigned char key[32];
-	unsigned long i = 0;
-    double seconds;
-	unsigned long loops = extended? 20*TEST_BLOCK_COUNT : TEST_BLOCK_COUNT;
+	unsigned char iv[16], chain[16];
+	aes_cbc_stream streams[CBC_STREAM_COUNT];
+	aes_encrypt_ctx kse;
+	aes_decrypt_ctx ksd;
+	uint_32t offset;
+	int i;
+
+	HexStringToByteArray (vector->key, key);
+	HexStringToByteArray (vector->iv, iv);
+	aes_botan_aesni_set_key_var (&kse, &ksd, key, (int) strlen (vector->key) / 2);
+
+	HexStringToByteArray (vector->plaintext, input);
+	HexStringToByteArray (vector->ciphertext, expected);
+	memcpy (chain, iv, 16);
+	aes_botan_aesni_cbc_encrypt (&kse, chain, input, output, CBC_TEST_LEN / 16);
+	if (memcmp (output, expected, CBC_TEST_LEN))
+		return 0;
+
+	memcpy (chain, iv, 16);
+	decFn (&ksd, chain, output, output, CBC_TEST_LEN / 16);
+	if (memcmp (output, input, CBC_TEST_LEN))
+		return 0;
+
+	/* streams of 3 to 11 blocks, so that lanes end at different times */
+	for (i = 0; i < TEST_VECTOR_LONG_LEN; i++)
+		input[i] = (unsigned char) i;
+	for (i = 0, offset = 0; i < CBC_STREAM_COUNT; offset += 16 * streams[i++].blocks)
+	{
+		streams[i].in = input + offset;
+		streams[i].out = output + offset;
+		streams[i].blocks = i + 3;
+		memcpy (streams[i].iv, iv, 16);
+		streams[i].iv[0] ^= (byte) i;
+	}
+	encFn (&kse, streams, CBC_STREAM_COUNT);
+
+	for (i = 0, offset = 0; i < CBC_STREAM_COUNT; offset += 16 * streams[i++].blocks)
+	{
+		memcpy (chain, iv, 16);
+		chain[0] ^= (byte) i;
+		aes_botan_aesni_cbc_encrypt (&kse, chain, input + offset, expected, streams[i].blocks);
+		if (memcmp (output + offset, expected, 16 * streams[i].blocks) || memcmp (chain, streams[i].iv, 16))
+			return 0;
+
+		memcpy (chain, iv, 16);
+		chain[0] ^= (byte) i;
+		decFn (&ksd, chain, output + offset, output + offset, streams[i].blocks);
+	}
+
+	if (memcmp (output, input, TEST_VECTOR_LONG_LEN))
+		return 0;
+
+	return 1;
+}
+
+/* 3 passes of the 16-block VAES loop and one of the 8-block loop, or 7 passes
+   of the 8-block loop, then 3 blocks and a partial one */
+#define GCM_TEST_LONG_LEN (59 * 16 + 9)
+#define GCM_TEST_KERNEL_BLOCKS 48
+
+int RunGcmTest (GCM_TEST* vector, int count)
+{
+	static ALIGN (32) unsigned char key[32], iv[64], aad[256], input[256], output[256], expected[256];
+	static ALIGN (32) unsigned char longInput[GCM_TEST_LONG_LEN], longOutput[GCM_TEST_LONG_LEN], longExpected[GCM_TEST_LONG_LEN];
+	unsigned char tag[AES_GCM_TAG_SIZE], expectedTag[AES_GCM_TAG_SIZE];
+	aes_gcm_ctx ctx;
+	uint_32t ivLen = 0, aadLen = 0, len;
+	int i, j;
+
+	for (i = 0; i < count; i++)
+	{
+		HexStringToByteArray (vector[i].key, key);
+		HexStringToByteArray (vector[i].iv, iv);
+		HexStringToByteArray (vector[i].aad, aad);
+		HexStringToByteArray (vector[i].plaintext, input);
+		HexStringToByteArray (vector[i].ciphertext, expected);
+		HexStringToByteArray (vector[i].tag, expectedTag);
+		ivLen = (uint_32t) strlen (vector[i].iv) / 2;
+		aadLen = (uint_32t) strlen (vector[i].aad) / 2;
+		len = (uint_32t) strlen (vector[i].plaintext) / 2;
+
+		aes_gcm_set_key (&ctx, key, (int) strlen (vector[i].key) / 2);
+		aes_gcm_seal (&ctx, iv, ivLen, aad, aadLen, input, output, len, tag);
+		if (memcmp (output, expected, len) || memcmp (tag, expectedTag, AES_GCM_TAG_SIZE))
+			return 0;
+
+		if (aes_gcm_open (&ctx, iv, ivLen, aad, aadLen, output, output, len, tag) != EXIT_SUCCESS
+			|| memcmp (output, input, len))
+			return 0;
+
+		/* a modified tag must be rejected */
+		memcpy (output, expected, len);
+		tag[0] ^= 1;
+		if (aes_gcm_open (&ctx, iv, ivLen, aad, aadLen, output, output, len, tag) == EXIT_SUCCESS)
+			return 0;
+
+		/* two-pass implementation */
+		aes_gcm_seal_2pass (&ctx, iv, ivLen, aad, aadLen, input, output, len, tag);
+		if (memcmp (output, expected, len) || memcmp (tag, expectedTag, AES_GCM_TAG_SIZE))
+			return 0;
+
+		if (aes_gcm_open_2pass (&ctx, iv, ivLen, aad, aadLen, output, output, len, tag) != EXIT_SUCCESS
+			|| memcmp (output, input, len))
+			return 0;
+	}
+
+	/* a message long enough for the stitched kernels, under every key size and with
+	   the IV and AAD of the last vector, against the two-pass implementation */
+	for (i = 0; i < 3; i++)
+	{
+		for (j = 0; j < 32; j++)
+			key[j] = (unsigned char) (j * 3 + i);
+		for (j = 0; j < GCM_TEST_LONG_LEN; j++)
+			longInput[j] = (unsigned char) (j * 11 + i);
+
+		aes_gcm_set_key (&ctx, key, 16 + 8 * i);
+		aes_gcm_seal_2pass (&ctx, iv, ivLen, aad, aadLen, longInput, longExpected, GCM_TEST_LONG_LEN, expectedTag);
+		aes_gcm_seal (&ctx, iv, ivLen, aad, aadLen, longInput, longOutput, GCM_TEST_LONG_LEN, tag);
+		if (memcmp (longOutput, longExpected, GCM_TEST_LONG_LEN) || memcmp (tag, expectedTag, AES_GCM_TAG_SIZE))
+			return 0;
+
+		if (aes_gcm_open (&ctx, iv, ivLen, aad, aadLen, longExpected, longOutput, GCM_TEST_LONG_LEN, tag) != EXIT_SUCCESS
+			|| memcmp (longOutput, longInput, GCM_TEST_LONG_LEN))
+			return 0;
+
+		/* in place */
+		memcpy (longOutput, longInput, GCM_TEST_LONG_LEN);
+		aes_gcm_seal (&ctx, iv, ivLen, aad, aadLen, longOutput, longOutput, GCM_TEST_LONG_LEN, tag);
+		if (memcmp (longOutput, longExpected, GCM_TEST_LONG_LEN) || memcmp (tag, expectedTag, AES_GCM_TAG_SIZE))
+			return 0;
+
+		if (aes_gcm_open (&ctx, iv, ivLen, aad, aadLen, longOutput, longOutput, GCM_TEST_LONG_LEN, tag) != EXIT_SUCCESS
+			|| memcmp (longOutput, longInput, GCM_TEST_LONG_LEN))
+			return 0;
+
+		/* a modified tag, then a modified block of the stitched part, must be rejected */
+		memcpy (longOutput, longExpected, GCM_TEST_LONG_LEN);
+		tag[AES_GCM_TAG_SIZE - 1] ^= 0x80;
+		if (aes_gcm_open (&ctx, iv, ivLen, aad, aadLen, longOutput, longOutput, GCM_TEST_LONG_LEN, tag) == EXIT_SUCCESS)
+			return 0;
+
+		memcpy (longOutput, longExpected, GCM_TEST_LONG_LEN);
+		longOutput[5 * 7 * 16 + 3] ^= 1;
+		if (aes_gcm_open (&ctx, iv, ivLen, aad, aadLen, longOutput, longOutput, GCM_TEST_LONG_LEN, expectedTag) == EXIT_SUCCESS)
+			return 0;
+
+		/* aes_gcm_seal only runs the 8-block kernel on the leftover of the VAES one:
+		   both kernels over several groups, from the same counter and GHASH state */
+#if CRYPTOPP_BOOL_X64 && CRYPTOPP_BOOL_VAES_INTRINSICS_AVAILABLE
+		if (ctx.vaes)
+		{
+			unsigned char ctr[16], ghash[16], wideCtr[16], wideGhash[16];
+
+			for (j = 0; j < 16; j++)
+				ctr[j] = ghash[j] = (unsigned char) (0xF0 + j);
+			memcpy (wideCtr, ctr, 16);
+			memcpy (wideGhash, ghash, 16);
+			if (aes_botan_aesni_gcm_encrypt_8x (&ctx, ctr, ghash, longInput, longExpected, GCM_TEST_KERNEL_BLOCKS) != GCM_TEST_KERNEL_BLOCKS
+				|| aes_botan_aesni_gcm_encrypt_vaes512 (&ctx, wideCtr, wideGhash, longInput, longOutput, GCM_TEST_KERNEL_BLOCKS) != GCM_TEST_KERNEL_BLOCKS
+				|| memcmp (longOutput, longExpected, GCM_TEST_KERNEL_BLOCKS * 16) || memcmp (ctr, wideCtr, 16) || memcmp (ghash, wideGhash, 16))
+				return 0;
+
+			aes_botan_aesni_gcm_decrypt_8x (&ctx, ctr, ghash, longExpected, longExpected, GCM_TEST_KERNEL_BLOCKS);
+			aes_botan_aesni_gcm_decrypt_vaes512 (&ctx, wideCtr, wideGhash, longOutput, longOutput, GCM_TEST_KERNEL_BLOCKS);
+			if (memcmp (longOutput, longExpected, GCM_TEST_KERNEL_BLOCKS * 16) || memcmp (ctr, wideCtr, 16) || memcmp (ghash, wideGhash, 16))
+				return 0;
+		}
+#endif
+	}
+
+	return 1;
+}
+
+#define MB_TEST_JOBS 40
+#define MB_TEST_MAX_BLOCKS 12
+
+/* jobs of 0 to 11 blocks under keys of all three sizes, against the single-key kernels */
+int RunMbTest (uint_32t ways)
+{
+	static ALIGN (32) unsigned char input[MB_TEST_JOBS][MB_TEST_MAX_BLOCKS * 16];
+	static ALIGN (32) unsigned char output[MB_TEST_JOBS][MB_TEST_MAX_BLOCKS * 16];
+	static ALIGN (32) unsigned char expected[MB_TEST_MAX_BLOCKS * 16];
+	static aes_encrypt_ctx kse[MB_TEST_JOBS];
+	static aes_decrypt_ctx ksd[MB_TEST_JOBS];
+	static aes_mb_mgr mgr;
+	static aes_encrypt_ctx unset;
+	aes_mb_job jobs[MB_TEST_JOBS], invalid, *done;
+	unsigned char key[32];
+	int completed[MB_TEST_JOBS];
+	int i, j, encrypt;
+
+	for (i = 0; i < MB_TEST_JOBS; i++)
+	{
+		for (j = 0; j < 32; j++)
+			key[j] = (unsigned char) (i * 32 + j);
+		for (j = 0; j < MB_TEST_MAX_BLOCKS * 16; j++)
+			input[i][j] = (unsigned char) (i + j);
+		aes_botan_aesni_set_key_var (&kse[i], &ksd[i], key, 16 + 8 * (i % 3));
+	}
+
+	/* encrypt, then decrypt the ciphertexts in place */
+	for (encrypt = 1; encrypt >= 0; encrypt--)
+	{
+		aes_mb_init (&mgr, encrypt, ways);
+
+		/* a context without a schedule is turned down and takes no lane */
+		memset (&invalid, 0, sizeof (invalid));
+		invalid.ctx = &unset;
+		invalid.in = invalid.out = expected;
+		invalid.len = 16;
+		if (aes_mb_submit (&mgr, &invalid) != &invalid || invalid.status != AES_MB_STATUS_INVALID)
+			return 0;
+
+		for (i = 0; i < MB_TEST_JOBS; i++)
+		{
+			jobs[i].ctx = encrypt? (void*) &kse[i] : (void*) &ksd[i];
+			jobs[i].in = encrypt? input[i] : output[i];
+			jobs[i].out = output[i];
+			jobs[i].len = 16 * ((i * 7) % MB_TEST_MAX_BLOCKS);
+			jobs[i].user_data = &completed[i];
+			completed[i] = 0;
+		}
+
+		for (i = 0; i < MB_TEST_JOBS; i++)
+		{
+			if ((done = aes_mb_submit (&mgr, &jobs[i])) != NULL)
+				++*(int*) done->user_data;
+		}
+		while ((done = aes_mb_flush (&mgr)) != NULL)
+			++*(int*) done->user_data;
+
+		for (i = 0; i < MB_TEST_JOBS; i++)
+		{
+			if (completed[i] != 1 || jobs[i].status != AES_MB_STATUS_COMPLETED)
+				return 0;
+
+			if (encrypt)
+			{
+				aes_botan_aesni_encrypt_4x (&kse[i], input[i], expected, jobs[i].len / 16);
+				if (memcmp (output[i], expected, jobs[i].len))
+					return 0;
+			}
+			else if (memcmp (output[i], input[i], jobs[i].len))
+				return 0;
+		}
+	}
+
+	return 1;
+}
+
+/* jobs of msgLen bytes spread over MB_BENCH_KEYS AES-256 keys: through the multi-buffer
+   manager (mode 0), one by one on expanded keys (mode 1), or one by one through a
+   CipherFunction, which also expands the key (mode 2) */
+double RunMbBenchmark (CipherFunction fn, uint_32t ways, uint_32t msgLen, int mode)
+{
+	#define MB_BENCH_LEN 4194304
+	#define MB_BENCH_LOOPS 16
+	#define MB_BENCH_KEYS 256
+
+	unsigned char *input = (unsigned char*) _aligned_malloc (MB_BENCH_LEN, 32);
+	uint_32t jobCount = MB_BENCH_LEN / msgLen;
+	aes_mb_job *jobs = (aes_mb_job*) malloc (jobCount * sizeof (aes_mb_job));
+	aes_encrypt_ctx *kse = (aes_encrypt_ctx*) _aligned_malloc (MB_BENCH_KEYS * sizeof (aes_encrypt_ctx), 32);
+	unsigned char *keys = (unsigned char*) malloc (MB_BENCH_KEYS * 32);
+	static aes_mb_mgr mgr;
+	aes_decrypt_ctx ksd;
+	uint_32t i, j;
+	double seconds;
 	LARGE_INTEGER performanceCountStart, performanceCountEnd, performanceCountDiff, performanceCountFreq;
 
 	QueryPerformanceFrequency (&performanceCountFreq);
 
+	RtlGenRandom (input, MB_BENCH_LEN);
+	RtlGenRandom (keys, MB_BENCH_KEYS * 32);
+	for (j = 0; j < MB_BENCH_KEYS; j++)
+		aes_botan_aesni_set_key_var (&kse[j], &ksd, keys + 32 * j, 32);
+	for (j = 0; j < jobCount; j++)
+	{
+		jobs[j].ctx = &kse[j % MB_BENCH_KEYS];
+		jobs[j].in = jobs[j].out = input + j * msgLen;
+		jobs[j].len = msgLen;
+	}
+	aes_mb_init (&mgr, 1, ways);
+
 	performanceCountDiff.QuadPart = 0;
-	for (i = 0; i < loops; i++)
+	for (i = 0; i < MB_BENCH_LOOPS; i++)
 	{
-		RtlGenRandom (input, TEST_BLOCK_LEN);
-		RtlGenRandom (key, 32);
 		QueryPerformanceCounter (&performanceCountStart);
-		fn (key, input, TEST_BLOCK_LEN, input, encrypt);
+		if (mode == 0)
+		{
+			for (j = 0; j < jobCount; j++)
+				aes_mb_submit (&mgr, &jobs[j]);
+			while (aes_mb_flush (&mgr))
+				;
+		}
+		else if (mode == 1)
+		{
+			for (j = 0; j < jobCount; j++)
+			{
+#if CRYPTOPP_BOOL_X64
+				if (ways == 15)
+					aes_botan_aesni_encrypt_15x (&kse[j % MB_BENCH_KEYS], input + j * msgLen, input + j * msgLen, msgLen / 16);
+				else
+#endif
+				aes_botan_aesni_encrypt_7x (&kse[j % MB_BENCH_KEYS], input + j * msgLen, input + j * msgLen, msgLen / 16);
+			}
+		}
+		else
+		{
+			for (j = 0; j < jobCount; j++)
+				fn (keys + 32 * (j % MB_BENCH_KEYS), input + j * msgLen, msgLen, input + j * msgLen, 1);
+		}
 		QueryPerformanceCounter (&performanceCountEnd);
 		performanceCountDiff.QuadPart += performanceCountEnd.QuadPart - performanceCountStart.QuadPart;
 	}
 
+	free (keys);
+	_aligned_free (kse);
+	free (jobs);
 	_aligned_free (input);
 
 	seconds = ((double) performanceCountDiff.QuadPart) / (double) performanceCountFreq.QuadPart;
-    return  (double) TEST_BLOCK_LEN * (double) loops / (seconds * 1024.0 * 1024.0);
+	return (double) jobCount * msgLen * (double) MB_BENCH_LOOPS / (seconds * 1024.0 * 1024.0);
 }
 
-#define AES_TEST_COUNT 3
-CIPHER_TEST aes_test_vectors[AES_TEST_COUNT] = {
-	{"0000000000000000000000000000000000000000000000000000000000000000", "00000000000000000000000000000000", "dc95c078a2408989ad48a21492842087"},
-	{"8E8E8E8E8E8E8E8E8E8E8E8E8E8E8E8E8E8E8E8E8E8E8E8E8E8E8E8E8E8E8E8E", "8E8E8E8E8E8E8E8E8E8E8E8E8E8E8E8E", "2F178F9BE7246F32D6CC007060ACFA0D"},
-	{"2BD6459F82C5B300952C49104881FF482BD6459F82C5B300952C49104881FF48", "DFC295E9D04A30DB25940E4FCC64516F", "EA024714AD5C4D84EA024714AD5C4D84"}
-};
-
+#define KEYS_TEST_COUNT 37
 
-#if CRYPTOPP_BOOL_X64
-void __cdecl AesBotanAESNI15WayCipherFunction (unsigned char* key, unsigned char* input, unsigned long inputLen, unsigned char* output, int encrypt)
+/* batched and separate key schedules against aes_botan_aesni_set_key_var, for 128, 192 and 256-bit keys */
+int RunKeySetupTest ()
 {
-	aes_encrypt_ctx kse;
-	aes_decrypt_ctx ksd;
-	aes_botan_aesni_set_key(&kse, &ksd, key);
+	static ALIGN (32) unsigned char keys[KEYS_TEST_COUNT * 32];
+	static ALIGN (32) unsigned char input[4 * 16], output[4 * 16], decrypted[4 * 16];
+	static aes_encrypt_ctx kse[KEYS_TEST_COUNT], batch[KEYS_TEST_COUNT];
+	static aes_decrypt_ctx ksd[KEYS_TEST_COUNT], lazy[KEYS_TEST_COUNT];
+	KeysFunction* fns[3] = {aes_botan_aesni_set_encrypt_keys, aes_botan_aesni_set_encrypt_keys_4x, aes_botan_aesni_set_encrypt_keys_1x};
+	int i, j, k, keyLen;
 
-	if (encrypt)
-		aes_botan_aesni_encrypt_15x(&kse, input, output, inputLen/16);
-	else
-		aes_botan_aesni_decrypt_15x(&ksd, input, output, inputLen/16);
-}
-#endif
+	for (i = 0; i < (int) sizeof (keys); i++)
+		keys[i] = (unsigned char) (i * 7 + 1);
+	for (i = 0; i < (int) sizeof (input); i++)
+		input[i] = (unsigned char) i;
 
-void __cdecl AesBotanAESNI7WayCipherFunction (unsigned char* key, unsigned char* input, unsigned long inputLen, unsigned char* output, int encrypt)
-{
-	aes_encrypt_ctx kse;
-	aes_decrypt_ctx ksd;
-	aes_botan_aesni_set_key(&kse, &ksd, key);
+	for (keyLen = 16; keyLen <= 32; keyLen += 8)
+	{
+		for (i = 0; i < KEYS_TEST_COUNT; i++)
+			aes_botan_aesni_set_key_var (&kse[i], &ksd[i], keys + i * keyLen, keyLen);
 
-	if (encrypt)
-		aes_botan_aesni_encrypt_7x(&kse, input, output, inputLen/16);
-	else
-		aes_botan_aesni_decrypt_7x(&ksd, input, output, inputLen/16);
+		for (k = 0; k < 3; k++)
+		{
+			if (fns[k] (batch, keys, KEYS_TEST_COUNT, keyLen) != EXIT_SUCCESS)
+				return 0;
+			for (i = 0; i < KEYS_TEST_COUNT; i++)
+			{
+				if (batch[i].inf.b[0] != kse[i].inf.b[0] || memcmp (batch[i].ks, kse[i].ks, kse[i].inf.b[0] + 16))
+					return 0;
+			}
+		}
+
+		/* the decryption schedule is derived on first use */
+		if (aes_botan_aesni_set_decrypt_keys (lazy, keys, KEYS_TEST_COUNT, keyLen) != EXIT_SUCCESS)
+			return 0;
+		for (i = 0; i < KEYS_TEST_COUNT; i++)
+		{
+			if (i & 1)
+			{
+				if (aes_botan_aesni_set_decrypt_key (&lazy[i], keys + i * keyLen, keyLen) != EXIT_SUCCESS)
+					return 0;
+			}
+			aes_botan_aesni_encrypt_4x (&kse[i], input, output, 4);
+			for (j = 0; j < 2; j++)
+			{
+				aes_botan_aesni_decrypt_4x (&lazy[i], output, decrypted, 4);
+				if (memcmp (decrypted, input, sizeof (input)))
+					return 0;
+			}
+			if (memcmp (lazy[i].ks, ksd[i].ks, kse[i].inf.b[0] + 16))
+				return 0;
+		}
+	}
+
+	if (aes_botan_aesni_set_encrypt_keys (batch, keys, 4, 20) == EXIT_SUCCESS)
+		return 0;
+
+	return 1;
 }
 
-void __cdecl AesBotanAESNI4WayCipherFunction (unsigned char* key, unsigned char* input, unsigned long inputLen, unsigned char* output, int encrypt)
+/* keys/s: KEYS_BENCH_COUNT schedules computed in one call of fn, or one
+   aes_botan_aesni_set_key_var per key when fn is NULL */
+double RunKeySetupBenchmark (KeysFunction fn, int keyLen)
 {
-	aes_encrypt_ctx kse;
-	aes_decrypt_ctx ksd;
-	aes_botan_aesni_set_key(&kse, &ksd, key);
+	#define KEYS_BENCH_COUNT 1024
+	#define KEYS_BENCH_LOOPS 1024
 
-	if (encrypt)
-		aes_botan_aesni_encrypt_4x(&kse, input, output, inputLen/16);
-	else
-		aes_botan_aesni_decrypt_4x(&ksd, input, output, inputLen/16);
+	unsigned char *keys = (unsigned char*) malloc (KEYS_BENCH_COUNT * 32);
+	aes_encrypt_ctx *kse = (aes_encrypt_ctx*) _aligned_malloc (KEYS_BENCH_COUNT * sizeof (aes_encrypt_ctx), 32);
+	aes_decrypt_ctx *ksd = (aes_decrypt_ctx*) _aligned_malloc (KEYS_BENCH_COUNT * sizeof (aes_decrypt_ctx), 32);
+	uint_32t i, j;
+	double seconds;
+	LARGE_INTEGER performanceCountStart, performanceCountEnd, performanceCountDiff, performanceCountFreq;
+
+	QueryPerformanceFrequency (&performanceCountFreq);
+
+	RtlGenRandom (keys, KEYS_BENCH_COUNT * 32);
+
+	performanceCountDiff.QuadPart = 0;
+	for (i = 0; i < KEYS_BENCH_LOOPS; i++)
+	{
+		QueryPerformanceCounter (&performanceCountStart);
+		if (fn)
+			fn (kse, keys, KEYS_BENCH_COUNT, keyLen);
+		else
+		{
+			for (j = 0; j < KEYS_BENCH_COUNT; j++)
+				aes_botan_aesni_set_key_var (&kse[j], &ksd[j], keys + j * keyLen, keyLen);
+		}
+		QueryPerformanceCounter (&performanceCountEnd);
+		performanceCountDiff.QuadPart += performanceCountEnd.QuadPart - performanceCountStart.QuadPart;
+	}
+
+	_aligned_free (ksd);
+	_aligned_free (kse);
+	free (keys);
+
+	seconds = ((double) performanceCountDiff.QuadPart) / (double) performanceCountFreq.QuadPart;
+	return (double) KEYS_BENCH_COUNT * (double) KEYS_BENCH_LOOPS / seconds;
 }
 
-int __cdecl main (int argc, char** argv)
+/* nanoseconds per key schedule: set_encrypt_key (mode 0), set_decrypt_key
+   and the derivation of the decryption schedule (mode 1), set_key_var (mode 2) */
+double RunKeySetupTime (int keyLen, int mode)
 {
-	double p;
-	DetectX86Features ();
-#if CRYPTOPP_BOOL_X64
-	printf("\n64-bit AES-NI Benchmark by Mounir IDRASSI (mounir@idrix.fr)\nVersion 2020-12-13\n\n");
-#else
-	printf("\n32-bit AES-NI Benchmark by Mounir IDRASSI (mounir@idrix.fr)\nVersion 2020-12-13\n\n");
-#endif
+	unsigned char *keys = (unsigned char*) malloc (KEYS_BENCH_COUNT * 32);
+	static aes_encrypt_ctx kse;
+	static aes_decrypt_ctx ksd;
+	uint_32t i, j;
+	double seconds;
+	LARGE_INTEGER performanceCountStart, performanceCountEnd, performanceCountDiff, performanceCountFreq;
 
-	printf ("CPU has AES-NI extension: %s\n", g_hasAESNI? "YES" : "NO");
+	QueryPerformanceFrequency (&performanceCountFreq);
 
-	printf("\n");
-	
-	if (g_hasAESNI)
+	RtlGenRandom (keys, KEYS_BENCH_COUNT * 32);
+
+	performanceCountDiff.QuadPart = 0;
+	for (i = 0; i < KEYS_BENCH_LOOPS; i++)
 	{
-		printf("AES-NI 4-way: ");
-		if (RunCipherTest (AesBotanAESNI4WayCipherFunction, aes_test_vectors, AES_TEST_COUNT))
+		QueryPerformanceCounter (&performanceCountStart);
+		for (j = 0; j < KEYS_BENCH_COUNT; j++)
 		{
-			printf ("ok (");
-			p = RunCipherBenchmark (AesBotanAESNI4WayCipherFunction, 1, 1);
-			printf("Enc = %.2f MB/s, ", p);
-			p = RunCipherBenchmark (AesBotanAESNI4WayCipherFunction, 0, 1);
-			printf("Dec = %.2f MB/s)\n", p);
+			if (mode == 0)
+				aes_botan_aesni_set_encrypt_key (&kse, keys + j * keyLen, keyLen);
+			else if (mode == 1)
+			{
+				aes_botan_aesni_set_decrypt_key (&ksd, keys + j * keyLen, keyLen);
+				aes_botan_aesni_prepare_decrypt_key (&ksd);
+			}
+			else
+				aes_botan_aesni_set_key_var (&kse, &ksd, keys + j * keyLen, keyLen);
+		}
+		QueryPerformanceCounter (&performanceCountEnd);
+		performanceCountDiff.QuadPart += performanceCountEnd.QuadPart - performanceCountStart.QuadPart;
+	}
+
+	free (keys);
+
+	seconds = ((double) performanceCountDiff.QuadPart) / (double) performanceCountFreq.QuadPart;
+	return seconds * 1e9 / ((double) KEYS_BENCH_COUNT * (double) KEYS_BENCH_LOOPS);
+}
+
+/* ECB throughput over back-to-back messages of msgLen bytes, either all under
+   one key scheduled beforehand or each under a fresh key scheduled just before it */
+double RunKeyAgilityBenchmark (uint_32t msgLen, int keyLen, int encrypt, int rekey)
+{
+	#define AGILITY_BENCH_LEN 4194304
+	#define AGILITY_BENCH_LOOPS 8
+
+	unsigned char *input = (unsigned char*) _aligned_malloc (AGILITY_BENCH_LEN, 32);
+	unsigned char *keys = (unsigned char*) malloc (KEYS_BENCH_COUNT * 32);
+	uint_32t msgCount = AGILITY_BENCH_LEN / msgLen;
+	static aes_encrypt_ctx kse;
+	static aes_decrypt_ctx ksd;
+	uint_32t i, j;
+	double seconds;
+	LARGE_INTEGER performanceCountStart, performanceCountEnd, performanceCountDiff, performanceCountFreq;
+
+	QueryPerformanceFrequency (&performanceCountFreq);
+
+	RtlGenRandom (input, AGILITY_BENCH_LEN);
+	RtlGenRandom (keys, KEYS_BENCH_COUNT * 32);
+	aes_botan_aesni_set_key_var (&kse, &ksd, keys, keyLen);
+
+	performanceCountDiff.QuadPart = 0;
+	for (i = 0; i < AGILITY_BENCH_LOOPS; i++)
+	{
+		QueryPerformanceCounter (&performanceCountStart);
+		for (j = 0; j < msgCount; j++)
+		{
+			const unsigned char* key = keys + (j % KEYS_BENCH_COUNT) * keyLen;
+			unsigned char* msg = input + j * msgLen;
+
+			if (encrypt)
+			{
+				if (rekey)
+					aes_botan_aesni_set_encrypt_key (&kse, key, keyLen);
+#if CRYPTOPP_BOOL_X64
+				aes_botan_aesni_encrypt_15x (&kse, msg, msg, msgLen / 16);
+#else
+				aes_botan_aesni_encrypt_7x (&kse, msg, msg, msgLen / 16);
+#endif
+			}
+			else
+			{
+				if (rekey)
+					aes_botan_aesni_set_decrypt_key (&ksd, key, keyLen);
+#if CRYPTOPP_BOOL_X64
+				aes_botan_aesni_decrypt_15x (&ksd, msg, msg, msgLen / 16);
+#else
+				aes_botan_aesni_decrypt_7x (&ksd, msg, msg, msgLen / 16);
+#endif
+			}
+		}
+		QueryPerformanceCounter (&performanceCountEnd);
+		performanceCountDiff.QuadPart += performanceCountEnd.QuadPart - performanceCountStart.QuadPart;
+	}
+
+	free (keys);
+	_aligned_free (input);
+
+	seconds = ((double) performanceCountDiff.QuadPart) / (double) performanceCountFreq.QuadPart;
+	return (double) msgCount * msgLen * (double) AGILITY_BENCH_LOOPS / (seconds * 1024.0 * 1024.0);
+}
+
+#define KC_TEST_CAPACITY 16
+#define KC_TEST_HANDLES 64
+
+/* cached schedules against aes_botan_aesni_set_key_var, eviction and pinning */
+int RunKeyCacheTest ()
+{
+	static aes_kc kc;
+	static aes_encrypt_ctx kse;
+	static aes_decrypt_ctx ksd;
+	const aes_kc_entry* pinned[KC_TEST_CAPACITY];
+	const aes_kc_entry* e;
+	unsigned char key[32];
+	int i, j, cached = 0, ok = 1;
+
+	if (aes_kc_init (&kc, KC_TEST_CAPACITY, 20) == EXIT_SUCCESS || aes_kc_init (&kc, KC_TEST_CAPACITY, 32) != EXIT_SUCCESS)
+		return 0;
+
+	for (i = 0; i < 2 * KC_TEST_HANDLES && ok; i++)
+	{
+		const aes_kc_handle handle = 1 + (i % KC_TEST_HANDLES) * LL(0x100000001);
+
+		for (j = 0; j < 32; j++)
+			key[j] = (unsigned char) (i % KC_TEST_HANDLES + j);
+		aes_botan_aesni_set_key_var (&kse, &ksd, key, 32);
+
+		if ((e = aes_kc_lookup (&kc, handle)) == NULL)
+			e = aes_kc_insert (&kc, handle, key);
+		if (!e || e->handle != handle || memcmp (e->ek.ctx.ks, kse.ks, 15 * 16) || memcmp (e->dk.ctx.ks, ksd.ks, 15 * 16))
+			ok = 0;
+		else
+			aes_kc_release (&kc, e);
+	}
+
+	for (i = 0; i < KC_TEST_HANDLES; i++)
+	{
+		if ((e = aes_kc_lookup (&kc, 1 + i * LL(0x100000001))) != NULL)
+		{
+			cached++;
+			aes_kc_release (&kc, e);
+		}
+	}
+	if (cached != KC_TEST_CAPACITY)
+		ok = 0;
+
+	/* pinned entries are never evicted */
+	for (i = 0; i < KC_TEST_CAPACITY; i++)
+	{
+		key[0] = (unsigned char) i;
+		pinned[i] = aes_kc_insert (&kc, 1000 + i, key);
+		if (!pinned[i])
+			ok = 0;
+	}
+	if (ok && aes_kc_insert (&kc, 2000, key) != NULL)
+		ok = 0;
+	if (ok)
+	{
+		aes_kc_release (&kc, pinned[3]);
+		e = aes_kc_insert (&kc, 2000, key);
+		if (e != pinned[3] || (e = aes_kc_lookup (&kc, 1003)) != NULL)
+			ok = 0;
+		for (i = 0; i < KC_TEST_CAPACITY; i++)
+			aes_kc_release (&kc, pinned[i]);
+	}
+
+	aes_kc_free (&kc);
+	return ok;
+}
+
+#define KC_THREAD_COUNT 4
+#define KC_THREAD_ITERATIONS 200000
+
+/* schedules expected for the handles of the concurrent test */
+static aes_encrypt_ctx kc_test_ek[KC_TEST_HANDLES];
+static aes_decrypt_ctx kc_test_dk[KC_TEST_HANDLES];
+
+typedef struct
+{
+	aes_kc* kc;
+	uint_32t seed;
+	volatile int* start;
+	int ok;
+} KC_TEST_THREAD;
+
+static void KeyCacheTestKey (uint_32t i, unsigned char* key)
+{
+	int j;
+
+	for (j = 0; j < 32; j++)
+		key[j] = (unsigned char) (i * 7 + j);
+}
+
+/* a pinned entry must hold the schedules of its handle for as long as it is pinned */
+static int KeyCacheTestCheck (const aes_kc_entry* e, uint_32t i)
+{
+	return e->handle == 1 + i * LL(0x100000001)
+		&& !memcmp (e->ek.ctx.ks, kc_test_ek[i].ks, 15 * 16) && !memcmp (e->dk.ctx.ks, kc_test_dk[i].ks, 15 * 16);
+}
+
+/* Looks up or inserts random handles, four times as many as the cache holds,
+   so that the threads keep evicting each other's entries. Each entry stays
+   pinned until the next one is, and is checked again before its release. */
+static void KeyCacheTestThread (void* param)
+{
+	KC_TEST_THREAD* thread = (KC_TEST_THREAD*) param;
+	const aes_kc_entry* held = NULL;
+	uint_32t x = thread->seed, heldIndex = 0, n;
+	unsigned char key[32];
+
+	while (!*thread->start)
+		_mm_pause ();
+
+	for (n = 0; n < KC_THREAD_ITERATIONS && thread->ok; n++)
+	{
+		const aes_kc_entry* e;
+		uint_32t i;
+
+		/* xorshift32 */
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		i = x % KC_TEST_HANDLES;
+
+		if ((e = aes_kc_lookup (thread->kc, 1 + i * LL(0x100000001))) == NULL)
+		{
+			KeyCacheTestKey (i, key);
+			e = aes_kc_insert (thread->kc, 1 + i * LL(0x100000001), key);
+		}
+		/* at most two entries per thread are pinned, so an insertion always finds one to evict */
+		if (!e || !KeyCacheTestCheck (e, i))
+			thread->ok = 0;
+
+		if (held)
+		{
+			if (!KeyCacheTestCheck (held, heldIndex))
+				thread->ok = 0;
+			aes_kc_release (thread->kc, held);
+		}
+		held = e;
+		heldIndex = i;
+	}
+
+	if (held)
+		aes_kc_release (thread->kc, held);
+}
+
+/* lookups, insertions and evictions from KC_THREAD_COUNT threads on a cache of KC_TEST_CAPACITY entries */
+int RunKeyCacheThreadTest ()
+{
+	static aes_kc kc;
+	KC_TEST_THREAD threads[KC_THREAD_COUNT];
+	THREAD_HANDLE handles[KC_THREAD_COUNT];
+	volatile int start = 0;
+	unsigned char key[32];
+	uint_32t i, started;
+	int ok = 1;
+
+	for (i = 0; i < KC_TEST_HANDLES; i++)
+	{
+		KeyCacheTestKey (i, key);
+		aes_botan_aesni_set_key_var (&kc_test_ek[i], &kc_test_dk[i], key, 32);
+	}
+	if (aes_kc_init (&kc, KC_TEST_CAPACITY, 32) != EXIT_SUCCESS)
+		return 0;
+
+	for (started = 0; started < KC_THREAD_COUNT; started++)
+	{
+		threads[started].kc = &kc;
+		threads[started].seed = 0x9E3779B9 * (started + 1);
+		threads[started].start = &start;
+		threads[started].ok = 1;
+		if (!StartThread (&handles[started], KeyCacheTestThread, &threads[started]))
+			break;
+	}
+	start = 1;
+	for (i = 0; i < started; i++)
+	{
+		JoinThread (handles[i]);
+		ok &= threads[i].ok;
+	}
+	if (started < KC_THREAD_COUNT || kc.evictions == 0)
+		ok = 0;
+
+	/* every pin was released */
+	for (i = 0; i < kc.filled; i++)
+	{
+		if (kc.entries[i].pins != 0)
+			ok = 0;
+	}
+
+	aes_kc_free (&kc);
+	return ok;
+}
+
+/* Nanoseconds per request: a 64-byte message encrypted under the key of one of
+   tenants handles, drawn uniformly or, when skewed, 80% of the time among the
+   first fifth of them. Through a cache of capacity schedules (mode 0), or
+   expanding the key on each request (mode 1). */
+double RunKeyCacheBenchmark (uint_32t capacity, uint_32t tenants, int skewed, int mode, double* hitRate)
+{
+	#define KC_BENCH_REQUESTS 1048576
+	#define KC_BENCH_MSG_LEN 64
+
+	unsigned char *keys = (unsigned char*) malloc (tenants * 32);
+	uint_32t *requests = (uint_32t*) malloc (KC_BENCH_REQUESTS * sizeof (uint_32t));
+	static ALIGN (32) unsigned char msg[KC_BENCH_MSG_LEN];
+	static aes_kc kc;
+	static aes_encrypt_ctx kse;
+	const aes_kc_entry* e;
+	uint_32t i, hits = 0;
+	double seconds;
+	LARGE_INTEGER performanceCountStart, performanceCountEnd, performanceCountFreq;
+
+	QueryPerformanceFrequency (&performanceCountFreq);
+
+	RtlGenRandom (keys, tenants * 32);
+	RtlGenRandom (requests, KC_BENCH_REQUESTS * sizeof (uint_32t));
+	for (i = 0; i < KC_BENCH_REQUESTS; i++)
+	{
+		if (skewed && (requests[i] & 0xFF) < 205)
+			requests[i] = (requests[i] >> 8) % (tenants / 5);
+		else
+			requests[i] = (requests[i] >> 8) % tenants;
+	}
+	aes_kc_init (&kc, capacity, 32);
+
+	/* warm up the cache */
+	for (i = 0; i < KC_BENCH_REQUESTS / 4 && mode == 0; i++)
+	{
+		if ((e = aes_kc_lookup (&kc, 1 + requests[i])) == NULL)
+			e = aes_kc_insert (&kc, 1 + requests[i], keys + 32 * requests[i]);
+		aes_kc_release (&kc, e);
+	}
+
+	QueryPerformanceCounter (&performanceCountStart);
+	for (i = 0; i < KC_BENCH_REQUESTS; i++)
+	{
+		if (mode == 0)
+		{
+			if ((e = aes_kc_lookup (&kc, 1 + requests[i])) != NULL)
+				hits++;
+			else
+				e = aes_kc_insert (&kc, 1 + requests[i], keys + 32 * requests[i]);
+			aes_botan_aesni_encrypt_7x ((aes_encrypt_ctx*) &e->ek.ctx, msg, msg, KC_BENCH_MSG_LEN / 16);
+			aes_kc_release (&kc, e);
+		}
+		else
+		{
+			aes_botan_aesni_set_encrypt_key (&kse, keys + 32 * requests[i], 32);
+			aes_botan_aesni_encrypt_7x (&kse, msg, msg, KC_BENCH_MSG_LEN / 16);
+		}
+	}
+	QueryPerformanceCounter (&performanceCountEnd);
+
+	aes_kc_free (&kc);
+	free (requests);
+	free (keys);
+
+	if (hitRate)
+		*hitRate = (double) hits / KC_BENCH_REQUESTS;
+	seconds = ((double) (performanceCountEnd.QuadPart - performanceCountStart.QuadPart)) / (double) performanceCountFreq.QuadPart;
+	return seconds * 1e9 / KC_BENCH_REQUESTS;
+}
+
+/* ECB throughput of aes_botan_aesni_encrypt_width / decrypt_width over a buffer
+   that stays in the cache, so that only the kernel width makes a difference */
+double RunWidthBenchmark (uint_32t ways, int encrypt)
+{
+	#define WIDTH_BENCH_LEN 1048576
+	#define WIDTH_BENCH_LOOPS 64
+
+	unsigned char *input = (unsigned char*) _aligned_malloc (WIDTH_BENCH_LEN, 32);
+	unsigned char key[32];
+	aes_encrypt_ctx kse;
+	aes_decrypt_ctx ksd;
+	uint_32t i;
+	double seconds;
+	LARGE_INTEGER performanceCountStart, performanceCountEnd, performanceCountFreq;
+
+	QueryPerformanceFrequency (&performanceCountFreq);
+
+	RtlGenRandom (input, WIDTH_BENCH_LEN);
+	RtlGenRandom (key, 32);
+	aes_botan_aesni_set_key_var (&kse, &ksd, key, g_keySize);
+
+	QueryPerformanceCounter (&performanceCountStart);
+	for (i = 0; i < WIDTH_BENCH_LOOPS; i++)
+	{
+		if (encrypt)
+			aes_botan_aesni_encrypt_width (&kse, input, input, WIDTH_BENCH_LEN / 16, ways);
+		else
+			aes_botan_aesni_decrypt_width (&ksd, input, input, WIDTH_BENCH_LEN / 16, ways);
+	}
+	QueryPerformanceCounter (&performanceCountEnd);
+
+	_aligned_free (input);
+
+	seconds = ((double) (performanceCountEnd.QuadPart - performanceCountStart.QuadPart)) / (double) performanceCountFreq.QuadPart;
+	return (double) WIDTH_BENCH_LEN * (double) WIDTH_BENCH_LOOPS / (seconds * 1024.0 * 1024.0);
+}
+
+/* Nanoseconds per ECB request of blocks blocks, or of 1 to 16 blocks in a random
+   order when blocks is 0 so that the size branches are not all predicted. With
+   chained, each request encrypts in place the output of the previous one, which
+   measures its latency; otherwise requests are independent and overlap, which
+   measures the overhead of the code around the rounds. Best of SMALL_BENCH_RUNS
+   runs of SMALL_BENCH_REQUESTS requests, on buffers that stay in L1. */
+double RunSmallRequestBenchmark (aes_encrypt_blocks_fn fn, uint_32t blocks, int chained)
+{
+	#define SMALL_BENCH_LEN 8192
+	#define SMALL_BENCH_REQUESTS 65536
+	#define SMALL_BENCH_RUNS 8
+
+	unsigned char *input = (unsigned char*) _aligned_malloc (2 * SMALL_BENCH_LEN, 32);
+	unsigned char *output = chained? input : input + SMALL_BENCH_LEN;
+	unsigned char sizes[256];
+	unsigned char key[32];
+	aes_encrypt_ctx kse;
+	aes_decrypt_ctx ksd;
+	uint_32t i, r, offset;
+	double seconds, best = 0;
+	LARGE_INTEGER performanceCountStart, performanceCountEnd, performanceCountFreq;
+
+	QueryPerformanceFrequency (&performanceCountFreq);
+
+	RtlGenRandom (input, SMALL_BENCH_LEN);
+	RtlGenRandom (sizes, sizeof (sizes));
+	for (i = 0; i < 256; i++)
+		sizes[i] = blocks? (unsigned char) blocks : (sizes[i] & 15) + 1;
+	RtlGenRandom (key, 32);
+	aes_botan_aesni_set_key_var (&kse, &ksd, key, g_keySize);
+
+	for (r = 0; r < SMALL_BENCH_RUNS; r++)
+	{
+		offset = 0;
+		QueryPerformanceCounter (&performanceCountStart);
+		for (i = 0; i < SMALL_BENCH_REQUESTS; i++)
+		{
+			fn (&kse, input + offset, output + offset, sizes[i & 255]);
+			if (!chained)
+				offset = (offset + 256) & (SMALL_BENCH_LEN - 1);
+		}
+		QueryPerformanceCounter (&performanceCountEnd);
+
+		seconds = ((double) (performanceCountEnd.QuadPart - performanceCountStart.QuadPart)) / (double) performanceCountFreq.QuadPart;
+		if (r == 0 || seconds < best)
+			best = seconds;
+	}
+
+	_aligned_free (input);
+
+	return best * 1e9 / SMALL_BENCH_REQUESTS;
+}
+
+/* Time stamp counter, serialized: RDTSCP waits for the instructions before it
+   to complete and the LFENCE after it keeps the following ones from starting */
+static uint64 ReadSerializedTsc ()
+{
+	unsigned int aux;
+	uint64 t;
+
+	if (HasRDTSCP ())
+		t = __rdtscp (&aux);
+	else
+	{
+		_mm_lfence ();
+		t = __rdtsc ();
+	}
+	_mm_lfence ();
+	return t;
+}
+
+/* TSC ticks per second, measured against QueryPerformanceCounter at startup */
+static double g_tscFrequency = 0;
+
+/* median of 3 windows of TSC_CALIBRATION_MS, so that a preemption in one does not count */
+void CalibrateTsc ()
+{
+	#define TSC_CALIBRATION_MS 50
+
+	LARGE_INTEGER start, end, freq;
+	double hz[3], t;
+	uint64 cycles;
+	int i;
+
+	QueryPerformanceFrequency (&freq);
+	for (i = 0; i < 3; i++)
+	{
+		QueryPerformanceCounter (&start);
+		cycles = ReadSerializedTsc ();
+		do
+			QueryPerformanceCounter (&end);
+		while (end.QuadPart - start.QuadPart < freq.QuadPart * TSC_CALIBRATION_MS / 1000);
+		cycles = ReadSerializedTsc () - cycles;
+		hz[i] = (double) cycles * (double) freq.QuadPart / (double) (end.QuadPart - start.QuadPart);
+	}
+
+	if (hz[0] > hz[1]) { t = hz[0]; hz[0] = hz[1]; hz[1] = t; }
+	if (hz[1] > hz[2]) { t = hz[1]; hz[1] = hz[2]; hz[2] = t; }
+	if (hz[0] > hz[1]) { t = hz[0]; hz[0] = hz[1]; hz[1] = t; }
+	g_tscFrequency = hz[1];
+}
+
+/* TSC cycles per byte at a throughput of rate MB/s, comparable across hosts
+   whatever their clock */
+double CyclesPerByte (double rate)
+{
+	return (rate > 0)? g_tscFrequency / (rate * 1024.0 * 1024.0) : 0;
+}
+
+#define LATENCY_SAMPLES 10000
+#define LATENCY_WARMUP 1000
+
+typedef struct
+{
+	uint64 min, median, p99;
+} LATENCY_STATS;
+
+static uint64 g_tscOverhead = 0;
+static uint64 g_latencySamples[LATENCY_SAMPLES];
+
+static int __cdecl CompareCycles (const void* a, const void* b)
+{
+	const uint64 x = *(const uint64*) a, y = *(const uint64*) b;
+	return (x > y) - (x < y);
+}
+
+/* sorts the samples, less the timer overhead, into stats */
+static void GetLatencyStats (LATENCY_STATS* stats)
+{
+	int i;
+
+	for (i = 0; i < LATENCY_SAMPLES; i++)
+		g_latencySamples[i] = (g_latencySamples[i] > g_tscOverhead)? g_latencySamples[i] - g_tscOverhead : 0;
+	qsort (g_latencySamples, LATENCY_SAMPLES, sizeof (uint64), CompareCycles);
+	stats->min = g_latencySamples[0];
+	stats->median = g_latencySamples[LATENCY_SAMPLES / 2];
+	stats->p99 = g_latencySamples[LATENCY_SAMPLES - LATENCY_SAMPLES / 100];
+}
+
+/* cycles between two reads of the counter with nothing in between, the least of LATENCY_SAMPLES */
+uint64 MeasureTscOverhead ()
+{
+	uint64 t, best = (uint64) -1;
+	int i;
+
+	for (i = 0; i < LATENCY_WARMUP + LATENCY_SAMPLES; i++)
+	{
+		t = ReadSerializedTsc ();
+		t = ReadSerializedTsc () - t;
+		if (t < best)
+			best = t;
+	}
+	return best;
+}
+
+/* Cycles per ECB call of blocks blocks. Each call encrypts in place the output of
+   the previous one, so that a call cannot start before the previous one is done. */
+void RunKernelLatency (aes_encrypt_blocks_fn encFn, aes_decrypt_blocks_fn decFn, uint_32t blocks, int encrypt, LATENCY_STATS* stats)
+{
+	static ALIGN (32) unsigned char buffer[16 * 16];
+	unsigned char key[32];
+	aes_encrypt_ctx kse;
+	aes_decrypt_ctx ksd;
+	uint64 t;
+	int i;
+
+	RtlGenRandom (buffer, sizeof (buffer));
+	RtlGenRandom (key, 32);
+	aes_botan_aesni_set_key_var (&kse, &ksd, key, g_keySize);
+	aes_botan_aesni_prepare_decrypt_key (&ksd);
+
+	for (i = 0; i < LATENCY_WARMUP + LATENCY_SAMPLES; i++)
+	{
+		t = ReadSerializedTsc ();
+		if (encrypt)
+			encFn (&kse, buffer, buffer, blocks);
+		else
+			decFn (&ksd, buffer, buffer, blocks);
+		t = ReadSerializedTsc () - t;
+		if (i >= LATENCY_WARMUP)
+			g_latencySamples[i - LATENCY_WARMUP] = t;
+	}
+	GetLatencyStats (stats);
+}
+
+/* Cycles per key schedule, modes as in RunKeySetupTime; each key is taken from
+   the schedule computed before it */
+void RunKeySetupLatency (int keyLen, int mode, LATENCY_STATS* stats)
+{
+	unsigned char key[32];
+	aes_encrypt_ctx kse;
+	aes_decrypt_ctx ksd;
+	uint64 t;
+	int i;
+
+	RtlGenRandom (key, 32);
+
+	for (i = 0; i < LATENCY_WARMUP + LATENCY_SAMPLES; i++)
+	{
+		t = ReadSerializedTsc ();
+		switch (mode)
+		{
+		case 0:
+			aes_botan_aesni_set_encrypt_key (&kse, key, keyLen);
+			break;
+		case 1:
+			aes_botan_aesni_set_decrypt_key (&ksd, key, keyLen);
+			aes_botan_aesni_prepare_decrypt_key (&ksd);
+			break;
+		default:
+			aes_botan_aesni_set_key_var (&kse, &ksd, key, keyLen);
+			break;
+		}
+		t = ReadSerializedTsc () - t;
+		if (i >= LATENCY_WARMUP)
+			g_latencySamples[i - LATENCY_WARMUP] = t;
+		memcpy (key, (mode == 1)? (byte*) ksd.ks + 16 : (byte*) kse.ks + 16, keyLen);
+	}
+	GetLatencyStats (stats);
+}
+
+#define LATENCY_BURST_COUNT 5
+static const uint_32t latency_bursts[LATENCY_BURST_COUNT] = {1, 2, 4, 8, 16};
+
+/* -latency: min, median and p99 cycles per call of every kernel and key schedule */
+void RunLatencyReport ()
+{
+	static const char* keyModes[3] = {"enc", "dec", "enc+dec"};
+	const char* name;
+	aes_encrypt_blocks_fn encFn;
+	aes_decrypt_blocks_fn decFn;
+	LATENCY_STATS stats;
+	size_t n;
+	int k, i, d;
+	uint_32t b;
+
+	g_tscOverhead = MeasureTscOverhead ();
+	printf ("Latency of dependent calls in TSC cycles, min / median / p99, timer overhead (%u cycles, %s) subtracted\n\n",
+		(unsigned int) g_tscOverhead, HasRDTSCP ()? "RDTSCP" : "LFENCE + RDTSC");
+
+	for (k = 16; k <= 32; k += 8)
+	{
+		g_keySize = k;
+		printf ("AES-%d key schedule:", k * 8);
+		for (i = 0; i < 3; i++)
+		{
+			RunKeySetupLatency (k, i, &stats);
+			printf (" %s %u / %u / %u%s", keyModes[i], (unsigned int) stats.min, (unsigned int) stats.median, (unsigned int) stats.p99, (i < 2)? "," : "\n");
+		}
+
+		printf ("%-26s", "");
+		for (b = 0; b < LATENCY_BURST_COUNT; b++)
+			printf (" %9u block%s", latency_bursts[b], (latency_bursts[b] > 1)? "s" : " ");
+		printf ("\n");
+
+		/* the kernels of the dispatcher, then the entry point bound at startup */
+		for (n = 0; n <= aes_dispatch_kernel_count (); n++)
+		{
+			if (n == aes_dispatch_kernel_count ())
+			{
+				name = "Dispatched";
+				encFn = aes_encrypt_blocks;
+				decFn = aes_decrypt_blocks;
+			}
+			else if (aes_dispatch_get_kernel (n, &name, &encFn, &decFn) != EXIT_SUCCESS)
+				continue;
+
+			for (d = 1; d >= 0; d--)
+			{
+				printf ("%-22s %s", name, d? "enc" : "dec");
+				for (b = 0; b < LATENCY_BURST_COUNT; b++)
+				{
+					RunKernelLatency (encFn, decFn, latency_bursts[b], d, &stats);
+					printf (" %4u/%4u/%5u", (unsigned int) stats.min, (unsigned int) stats.median, (unsigned int) stats.p99);
+				}
+				printf ("\n");
+			}
+		}
+		printf ("\n");
+	}
+}
+
+#define SWEEP_MAX_LEN ((size_t) 1 << 30)
+#define SWEEP_MIN_BYTES (16 << 20)
+#define SWEEP_MAX_SIZES 64
+
+static int __cdecl CompareSizes (const void* a, const void* b)
+{
+	const size_t x = *(const size_t*) a, y = *(const size_t*) b;
+	return (x > y) - (x < y);
+}
+
+/* Request sizes of the sweep, sorted: powers of two from 16 bytes to maxLen,
+   the whole numbers of 512-byte sectors up to 4KB, and half of each cache level
+   and 4 times the L3, which fall well inside each level and well beyond */
+static size_t BuildSweepSizes (size_t* sizes, size_t maxLen, const size_t* caches)
+{
+	size_t count = 0, i, j, size;
+
+	for (size = 16; size <= maxLen; size <<= 1)
+		sizes[count++] = size;
+	for (size = 3 * 512; size < 4096; size += 512)
+		if (size & (size - 1))
+			sizes[count++] = size;
+	for (i = 0; i < 3; i++)
+	{
+		sizes[count++] = (caches[i] / 2) & ~(size_t) 15;
+		if (i == 2 && 4 * caches[i] <= maxLen)
+			sizes[count++] = 4 * caches[i];
+	}
+
+	qsort (sizes, count, sizeof (size_t), CompareSizes);
+	for (i = j = 0; i < count; i++)
+	{
+		if (sizes[i] && sizes[i] <= maxLen && (j == 0 || sizes[i] != sizes[j - 1]))
+			sizes[j++] = sizes[i];
+	}
+	return j;
+}
+
+static const char* FormatSize (size_t size, char* str)
+{
+	if (size >= ((size_t) 1 << 30))
+		sprintf (str, "%.4g GB", size / (1024.0 * 1024.0 * 1024.0));
+	else if (size >= (1 << 20))
+		sprintf (str, "%.4g MB", size / (1024.0 * 1024.0));
+	else if (size >= 1024)
+		sprintf (str, "%.4g KB", size / 1024.0);
+	else
+		sprintf (str, "%u B", (unsigned int) size);
+	return str;
+}
+
+/* MB/s of ECB requests of size bytes, encrypted in place at least SWEEP_MIN_BYTES
+   and twice size in total. Successive requests move through the first poolLen
+   bytes of buffer, so that none waits for the output of the previous one: hot
+   pools are read once before timing and fit in the cache, cold ones cannot. */
+double RunSweepPoint (aes_encrypt_blocks_fn fn, aes_encrypt_ctx* ctx, unsigned char* buffer, size_t poolLen, size_t size, int cold, double* cyclesPerByte)
+{
+	const size_t stride = (size + 63) & ~(size_t) 63;
+	const size_t total = (2 * size > SWEEP_MIN_BYTES)? 2 * size : SWEEP_MIN_BYTES;
+	const uint_32t blocks = (uint_32t) (size / 16);
+	size_t offset, done;
+	uint64 cycles;
+	double seconds;
+	LARGE_INTEGER performanceCountStart, performanceCountEnd, performanceCountFreq;
+
+	QueryPerformanceFrequency (&performanceCountFreq);
+
+	for (offset = 0; !cold && offset + size <= poolLen; offset += stride)
+		fn (ctx, buffer + offset, buffer + offset, blocks);
+
+	offset = 0;
+	QueryPerformanceCounter (&performanceCountStart);
+	cycles = ReadSerializedTsc ();
+	for (done = 0; done < total; done += size)
+	{
+		fn (ctx, buffer + offset, buffer + offset, blocks);
+		offset += stride;
+		if (offset + size > poolLen)
+			offset = 0;
+	}
+	cycles = ReadSerializedTsc () - cycles;
+	QueryPerformanceCounter (&performanceCountEnd);
+
+	seconds = ((double) (performanceCountEnd.QuadPart - performanceCountStart.QuadPart)) / (double) performanceCountFreq.QuadPart;
+	*cyclesPerByte = (double) cycles / (double) done;
+	return (double) done / (seconds * 1024.0 * 1024.0);
+}
+
+/* -sweep: MB/s and cycles/byte of every kernel from 16 bytes to 1GB, hot and cold */
+void RunSweepReport ()
+{
+	static const char* levels[4] = {"L1", "L2", "L3", "DRAM"};
+	size_t caches[3], sizes[SWEEP_MAX_SIZES], count, maxLen, poolLen, i, n;
+	int reported = GetL1DCacheSize () && GetL2CacheSize () && GetL3CacheSize (), level;
+	unsigned char* buffer = NULL;
+	unsigned char key[32];
+	aes_encrypt_ctx kse;
+	aes_decrypt_ctx ksd;
+	aes_encrypt_blocks_fn encFn;
+	aes_decrypt_blocks_fn decFn;
+	const char* name;
+	double hot, cold, hotCycles, coldCycles;
+	char sizeStr[32], cacheStr[3][32];
+
+	/* typical sizes when the CPU does not report its caches */
+	caches[0] = reported? GetL1DCacheSize () : 32 * 1024;
+	caches[1] = reported? GetL2CacheSize () : 256 * 1024;
+	caches[2] = reported? GetL3CacheSize () : 8 * 1024 * 1024;
+
+	/* the cold pool holds 4 times the L3; the largest size is halved until it fits in memory */
+	for (maxLen = SWEEP_MAX_LEN; maxLen >= 4 * caches[2] && !buffer; maxLen /= 2)
+		buffer = (unsigned char*) _aligned_malloc (maxLen, 4096);
+	if (!buffer)
+	{
+		printf ("Not enough memory for the sweep\n");
+		return;
+	}
+	maxLen *= 2;
+	poolLen = 4 * caches[2];
+	memset (buffer, 0x5A, maxLen);
+
+	RtlGenRandom (key, 32);
+	g_keySize = 32;
+	aes_botan_aesni_set_key_var (&kse, &ksd, key, g_keySize);
+
+	count = BuildSweepSizes (sizes, maxLen, caches);
+	printf ("Message-size sweep, AES-256 ECB in place, MB/s and TSC cycles per byte\n");
+	printf ("Caches%s: L1d %s, L2 %s, L3 %s; cold requests rotate over %s\n\n", reported? "" : " (not reported, assumed)",
+		FormatSize (caches[0], cacheStr[0]), FormatSize (caches[1], cacheStr[1]), FormatSize (caches[2], cacheStr[2]), FormatSize (poolLen, sizeStr));
+
+	/* the kernels of the dispatcher, then the entry point bound at startup */
+	for (n = 0; n <= aes_dispatch_kernel_count (); n++)
+	{
+		if (n == aes_dispatch_kernel_count ())
+		{
+			name = "Dispatched";
+			encFn = aes_encrypt_blocks;
+		}
+		else if (aes_dispatch_get_kernel (n, &name, &encFn, &decFn) != EXIT_SUCCESS)
+			continue;
+
+		printf ("%s:\n", name);
+		printf ("      size  set   hot MB/s    c/B  cold MB/s    c/B\n");
+		for (i = 0; i < count; i++)
+		{
+			for (level = 0; level < 3 && sizes[i] > caches[level]; level++)
+				;
+			/* requests smaller than half the L1d take turns in it */
+			hot = RunSweepPoint (encFn, &kse, buffer, (sizes[i] < caches[0] / 2)? caches[0] / 2 : sizes[i], sizes[i], 0, &hotCycles);
+			cold = RunSweepPoint (encFn, &kse, buffer, poolLen, sizes[i], 1, &coldCycles);
+			printf ("%10s  %-4s %10.1f %6.2f %10.1f %6.2f\n", FormatSize (sizes[i], sizeStr), levels[level], hot, hotCycles, cold, coldCycles);
+		}
+		printf ("\n");
+	}
+
+	_aligned_free (buffer);
+}
+
+#define SCALING_BYTES_PER_THREAD	((uint64) 512 << 20)
+
+/* one thread of the scaling benchmark; the alignment of ctx keeps each on cache lines of its own */
+typedef struct
+{
+	ALIGN (64) aes_encrypt_ctx ctx;
+	const unsigned char* key;
+	unsigned char* buffer;
+	size_t bufferLen;
+	uint64 bytes;
+	uint_32t cpu;
+	int pinned;
+	volatile int ready;			/* 1 once at the barrier, -1 if the buffer could not be allocated */
+	volatile int* start;
+	LARGE_INTEGER begin, end;
+} SCALING_THREAD;
+
+/* pins itself, allocates and touches its buffer from its own processor, then
+   waits at the barrier and encrypts the buffer in place until it has done its share */
+static void ScalingThread (void* param)
+{
+	SCALING_THREAD* thread = (SCALING_THREAD*) param;
+	const uint_32t blocks = (uint_32t) (thread->bufferLen / 16);
+	uint64 done;
+	uint_32t spins;
+
+	thread->pinned = PinThread (thread->cpu);
+	thread->buffer = (unsigned char*) _aligned_malloc (thread->bufferLen, 64);
+	if (!thread->buffer)
+	{
+		thread->ready = -1;
+		return;
+	}
+	memset (thread->buffer, 0x5A, thread->bufferLen);
+	aes_botan_aesni_set_encrypt_key (&thread->ctx, thread->key, 32);
+	aes_encrypt_blocks (&thread->ctx, thread->buffer, thread->buffer, blocks);
+
+	thread->ready = 1;
+	for (spins = 1; !*thread->start; spins++)
+	{
+		_mm_pause ();
+		/* more threads than processors: let the others reach the barrier */
+		if ((spins & 4095) == 0)
+			Sleep (0);
+	}
+
+	QueryPerformanceCounter (&thread->begin);
+	for (done = 0; done < thread->bytes; done += thread->bufferLen)
+		aes_encrypt_blocks (&thread->ctx, thread->buffer, thread->buffer, blocks);
+	QueryPerformanceCounter (&thread->end);
+
+	thread->bytes = done;
+	_aligned_free (thread->buffer);
+}
+
+/* Aggregate MB/s of count threads, each on its own buffer of bufferLen bytes,
+   from the first to start to the last to finish; per-thread MB/s in rates.
+   Thread i runs on processor cpus[i % cpuCount]. 0 if a thread failed. */
+double RunScalingPoint (SCALING_THREAD* threads, uint_32t count, const uint_32t* cpus, uint_32t cpuCount, const unsigned char* key, size_t bufferLen, double* rates, int* pinned)
+{
+	THREAD_HANDLE* handles = (THREAD_HANDLE*) malloc (count * sizeof (THREAD_HANDLE));
+	volatile int start = 0;
+	int64 first, last;
+	double total = 0;
+	uint_32t i, started;
+	int failed = 0;
+	LARGE_INTEGER performanceCountFreq;
+
+	if (!handles)
+		return 0;
+	QueryPerformanceFrequency (&performanceCountFreq);
+
+	for (started = 0; started < count; started++)
+	{
+		memset (&threads[started], 0, sizeof (SCALING_THREAD));
+		threads[started].key = key;
+		threads[started].bufferLen = bufferLen;
+		threads[started].bytes = (2 * (uint64) bufferLen > SCALING_BYTES_PER_THREAD)? 2 * (uint64) bufferLen : SCALING_BYTES_PER_THREAD;
+		threads[started].cpu = cpus[started % cpuCount];
+		threads[started].start = &start;
+		if (!StartThread (&handles[started], ScalingThread, &threads[started]))
+			break;
+	}
+
+	/* the barrier: every thread is pinned, has its buffer in cache or memory, and spins */
+	for (i = 0; i < started; i++)
+	{
+		while (!threads[i].ready)
+			Sleep (1);
+		failed |= threads[i].ready < 0;
+	}
+	start = 1;
+
+	for (i = 0; i < started; i++)
+		JoinThread (handles[i]);
+	free (handles);
+	if (started < count || failed)
+		return 0;
+
+	*pinned = 1;
+	first = threads[0].begin.QuadPart;
+	last = threads[0].end.QuadPart;
+	for (i = 0; i < count; i++)
+	{
+		if (threads[i].begin.QuadPart < first)
+			first = threads[i].begin.QuadPart;
+		if (threads[i].end.QuadPart > last)
+			last = threads[i].end.QuadPart;
+		rates[i] = (double) threads[i].bytes * (double) performanceCountFreq.QuadPart / ((double) (threads[i].end.QuadPart - threads[i].begin.QuadPart) * 1024.0 * 1024.0);
+		total += (double) threads[i].bytes;
+		*pinned &= threads[i].pinned;
+	}
+	return total * (double) performanceCountFreq.QuadPart / ((double) (last - first) * 1024.0 * 1024.0);
+}
+
+/* -threads [n]: aggregate and per-thread MB/s of the dispatched ECB kernel on
+   1 to n pinned threads (all the logical processors by default), with a
+   working set in each thread's L2 and with one 4 times the size of the L3s */
+void RunScalingReport (uint_32t maxThreads)
+{
+	static uint_32t cpus[CPU_MAX_LOGICAL];
+	const CPU_TOPOLOGY* topology = GetCpuTopology ();
+	SCALING_THREAD* threads;
+	uint_32t counts[32], countCount = 0, cpuCount = GetCpuSpreadOrder (cpus, CPU_MAX_LOGICAL), n, i, c;
+	size_t l2 = GetL2CacheSize ()? GetL2CacheSize () : 256 * 1024;
+	size_t l3 = GetL3CacheSize ()? GetL3CacheSize () : 8 * 1024 * 1024;
+	size_t bufferLen, memoryLen;
+	double* rates;
+	double rate, single;
+	int set, pinned;
+	unsigned char key[32];
+	char sizeStr[32];
+
+	if (cpuCount == 0)
+	{
+		cpus[0] = 0;
+		cpuCount = 1;
+	}
+	if (maxThreads == 0)
+		maxThreads = cpuCount;
+	if (maxThreads > CPU_MAX_LOGICAL)
+		maxThreads = CPU_MAX_LOGICAL;
+
+	/* powers of 2 and the maximum, with the number of cores where it falls between */
+	for (n = 1; n < maxThreads; n *= 2)
+		counts[countCount++] = n;
+	counts[countCount++] = maxThreads;
+	for (c = 0; counts[c] < topology->coreCount && c + 1 < countCount; c++)
+		;
+	if (topology->coreCount && counts[c] != topology->coreCount && topology->coreCount < maxThreads)
+	{
+		memmove (&counts[c + 1], &counts[c], (countCount - c) * sizeof (uint_32t));
+		counts[c] = topology->coreCount;
+		countCount++;
+	}
+
+	/* 4 times all the L3 instances together, so that it stays in memory at any thread count */
+	memoryLen = 4 * l3;
+	for (i = 0; i < topology->cacheCount; i++)
+	{
+		if (topology->caches[i].level == 3 && topology->caches[i].sharedBy && topology->logicalCount > topology->caches[i].sharedBy)
+			memoryLen *= (topology->logicalCount + topology->caches[i].sharedBy - 1) / topology->caches[i].sharedBy;
+	}
+	if (memoryLen > SWEEP_MAX_LEN)
+		memoryLen = SWEEP_MAX_LEN;
+
+	threads = (SCALING_THREAD*) _aligned_malloc (maxThreads * sizeof (SCALING_THREAD), 64);
+	rates = (double*) malloc (maxThreads * sizeof (double));
+	if (!threads || !rates)
+	{
+		printf ("Not enough memory for %u threads\n", maxThreads);
+		if (threads)
+			_aligned_free (threads);
+		free (rates);
+		return;
+	}
+
+	RtlGenRandom (key, 32);
+	printf ("Thread scaling, AES-256 ECB in place through %s, %u MB per thread\n", aes_dispatch_kernel_for (1, 32, (uint_32t) (l2 / 32)), (uint_32t) (SCALING_BYTES_PER_THREAD >> 20));
+	printf ("Threads are pinned one per core, package by package, then to the SMT siblings: processor");
+	for (i = 0; i < cpuCount && i < maxThreads; i++)
+		printf ("%s %u", i? "," : "", cpus[i]);
+	printf ("%s\n", (maxThreads > cpuCount)? ", then again from the first" : "");
+
+	for (set = 0; set < 2; set++)
+	{
+		if (set == 0)
+			printf ("\nWorking set: %s per thread, in its L2\n", FormatSize (l2 / 2, sizeStr));
+		else
+			printf ("\nWorking set: %s in total, shared out between the threads\n", FormatSize (memoryLen, sizeStr));
+		printf ("threads  total MB/s  efficiency  per-thread MB/s\n");
+
+		single = 0;
+		for (c = 0; c < countCount; c++)
+		{
+			n = counts[c];
+			bufferLen = (set == 0)? l2 / 2 : ((memoryLen / n) & ~(size_t) 4095);
+			if (bufferLen < 4096)
+				bufferLen = 4096;
+
+			rate = RunScalingPoint (threads, n, cpus, cpuCount, key, bufferLen, rates, &pinned);
+			if (rate == 0)
+			{
+				printf ("%7u  failed: not enough memory or threads\n", n);
+				break;
+			}
+			if (n == 1)
+				single = rate;
+
+			printf ("%7u %11.1f %10.1f%% ", n, rate, single? 100.0 * rate / (n * single) : 0.0);
+			for (i = 0; i < n; i++)
+				printf ("%s%.1f", (i && i % 8 == 0)? "\n                                " : " ", rates[i]);
+			printf ("%s\n", pinned? "" : " (not pinned)");
+		}
+	}
+
+	free (rates);
+	_aligned_free (threads);
+}
+
+#define PAR_TEST_BLOCKS		(5 * 65536 + 7)
+#define PAR_SIZE_COUNT		3
+#define PAR_MIN_BYTES		((uint64) 256 << 20)
+
+#if CRYPTOPP_BOOL_X64
+#define PAR_CTR_CRYPT		aes_botan_aesni_ctr_crypt_15x
+#define PAR_XTS_ENCRYPT		aes_botan_aesni_xts_encrypt_15x
+#else
+#define PAR_CTR_CRYPT		aes_botan_aesni_ctr_crypt_7x
+#define PAR_XTS_ENCRYPT		aes_botan_aesni_xts_encrypt_7x
+#endif
+
+static const char* par_modes[3] = {"ECB", "CTR", "XTS 4KB"};
+
+/* the engine against the kernels on one thread, with sizes that leave partial
+   chunks, CTR calls that start and end inside a block and a 32-bit counter
+   that wraps in the middle of the request */
+int RunParallelTest (aes_par_pool* pool)
+{
+	const size_t len = (size_t) PAR_TEST_BLOCKS * 16;
+	unsigned char* in = (unsigned char*) _aligned_malloc (len, 64);
+	unsigned char* ref = (unsigned char*) _aligned_malloc (len, 64);
+	unsigned char* out = (unsigned char*) _aligned_malloc (len, 64);
+	static aes_encrypt_ctx kse;
+	static aes_decrypt_ctx ksd;
+	static aes_xts_ctx xts;
+	aes_ctr_state s1, s2;
+	unsigned char key[64], iv[16];
+	int ok = 0;
+
+	if (!in || !ref || !out)
+		goto done;
+
+	RtlGenRandom (in, (ULONG) len);
+	RtlGenRandom (key, 64);
+	RtlGenRandom (iv, 12);
+	iv[12] = iv[13] = 0xFF;
+	iv[14] = 0xF0;
+	iv[15] = 0;
+	aes_botan_aesni_set_key_var (&kse, &ksd, key, 32);
+	aes_botan_aesni_xts_set_key (&xts, key, key + 32, 32);
+
+	aes_botan_aesni_encrypt_7x (&kse, in, ref, PAR_TEST_BLOCKS);
+	aes_par_ecb_encrypt (pool, &kse, in, out, PAR_TEST_BLOCKS);
+	if (memcmp (out, ref, len))
+		goto done;
+	aes_par_ecb_decrypt (pool, &ksd, out, out, PAR_TEST_BLOCKS);
+	if (memcmp (out, in, len))
+		goto done;
+
+	aes_botan_aesni_ctr_init (&s1, iv, 32);
+	aes_botan_aesni_ctr_init (&s2, iv, 32);
+	aes_botan_aesni_ctr_crypt_7x (&kse, &s1, in, ref, 5);
+	aes_botan_aesni_ctr_crypt_7x (&kse, &s1, in + 5, ref + 5, (uint_32t) len - 8);
+	aes_botan_aesni_ctr_crypt_7x (&kse, &s1, in + len - 3, ref + len - 3, 3);
+	aes_par_ctr_crypt (pool, &kse, &s2, in, out, 5);
+	aes_par_ctr_crypt (pool, &kse, &s2, in + 5, out + 5, len - 8);
+	aes_par_ctr_crypt (pool, &kse, &s2, in + len - 3, out + len - 3, 3);
+	if (memcmp (out, ref, len) || memcmp (s1.ctr, s2.ctr, 16) || s1.used != s2.used)
+		goto done;
+
+	aes_botan_aesni_xts_encrypt_7x (&xts, in, ref, 12345, (uint_32t) (len / 512), 512);
+	aes_par_xts_encrypt (pool, &xts, in, out, 12345, len / 512, 512);
+	if (memcmp (out, ref, len / 512 * 512))
+		goto done;
+	aes_par_xts_decrypt (pool, &xts, out, out, 12345, len / 512, 512);
+	ok = !memcmp (out, in, len / 512 * 512);
+
+done:
+	if (in)
+		_aligned_free (in);
+	if (ref)
+		_aligned_free (ref);
+	if (out)
+		_aligned_free (out);
+	return ok;
+}
+
+/* MB/s of mode (0: ECB, 1: CTR, 2: XTS with 4KB sectors) over len bytes in
+   place, through the engine or, without pool, on the calling thread alone */
+double RunParallelPoint (aes_par_pool* pool, int mode, const aes_encrypt_ctx* ctx, const aes_xts_ctx* xts, unsigned char* buffer, size_t len)
+{
+	const uint64 total = (2 * (uint64) len > PAR_MIN_BYTES)? 2 * (uint64) len : PAR_MIN_BYTES;
+	aes_encrypt_ctx kse = *ctx;
+	aes_ctr_state state;
+	unsigned char iv[16] = {0};
+	uint64 done;
+	double seconds;
+	LARGE_INTEGER performanceCountStart, performanceCountEnd, performanceCountFreq;
+
+	QueryPerformanceFrequency (&performanceCountFreq);
+	aes_botan_aesni_ctr_init (&state, iv, 64);
+
+	QueryPerformanceCounter (&performanceCountStart);
+	for (done = 0; done < total; done += len)
+	{
+		switch (mode)
+		{
+		case 0:
+			if (pool)
+				aes_par_ecb_encrypt (pool, &kse, buffer, buffer, len / 16);
+			else
+				aes_encrypt_blocks (&kse, buffer, buffer, (uint_32t) (len / 16));
+			break;
+		case 1:
+			if (pool)
+				aes_par_ctr_crypt (pool, &kse, &state, buffer, buffer, len);
+			else
+				PAR_CTR_CRYPT (&kse, &state, buffer, buffer, (uint_32t) len);
+			break;
+		default:
+			if (pool)
+				aes_par_xts_encrypt (pool, xts, buffer, buffer, done / 4096, len / 4096, 4096);
+			else
+				PAR_XTS_ENCRYPT (xts, buffer, buffer, done / 4096, (uint_32t) (len / 4096), 4096);
+			break;
+		}
+	}
+	QueryPerformanceCounter (&performanceCountEnd);
+
+	seconds = ((double) (performanceCountEnd.QuadPart - performanceCountStart.QuadPart)) / (double) performanceCountFreq.QuadPart;
+	return (double) done / (seconds * 1024.0 * 1024.0);
+}
+
+/* -parallel: the engine on every logical processor against the kernels on one thread, at 1MB, 64MB and 1GB */
+void RunParallelReport ()
+{
+	static const size_t sizes[PAR_SIZE_COUNT] = {(size_t) 1 << 20, (size_t) 64 << 20, (size_t) 1 << 30};
+	static aes_par_pool pool;
+	static aes_encrypt_ctx kse;
+	static aes_decrypt_ctx ksd;
+	static aes_xts_ctx xts;
+	unsigned char* buffer;
+	unsigned char key[64];
+	char sizeStr[32];
+	PAGES_INFO pages;
+	double one, par;
+	int i, mode;
+
+	if (aes_par_init (&pool, 0, 1) != EXIT_SUCCESS)
+	{
+		printf ("Parallel engine: the threads could not be started\n");
+		return;
+	}
+
+	printf ("Parallel engine on %u thread(s), chunks of at most %s: ", pool.threads, FormatSize (pool.chunk_bytes, sizeStr));
+	if (!RunParallelTest (&pool))
+	{
+		printf ("error\n");
+		aes_par_free (&pool);
+		return;
+	}
+	printf ("ok\n\n");
+
+	RtlGenRandom (key, 64);
+	aes_botan_aesni_set_key_var (&kse, &ksd, key, 32);
+	aes_botan_aesni_xts_set_key (&xts, key, key + 32, 32);
+
+	printf ("AES-256, in place        1 thread MB/s    c/B  parallel MB/s    c/B  speedup\n");
+	for (i = 0; i < PAR_SIZE_COUNT; i++)
+	{
+		buffer = (unsigned char*) AllocatePages (sizes[i], PAGES_HUGE, &pages);
+		if (!buffer)
+		{
+			printf ("%s: not enough memory\n", FormatSize (sizes[i], sizeStr));
+			continue;
+		}
+		memset (buffer, 0x5A, sizes[i]);
+
+		for (mode = 0; mode < 3; mode++)
+		{
+			one = RunParallelPoint (NULL, mode, &kse, &xts, buffer, sizes[i]);
+			par = RunParallelPoint (&pool, mode, &kse, &xts, buffer, sizes[i]);
+			printf ("%-8s %6s %20.1f %6.2f %14.1f %6.2f %7.2fx\n", par_modes[mode], FormatSize (sizes[i], sizeStr),
+				one, CyclesPerByte (one), par, CyclesPerByte (par), par / one);
+		}
+		FreePages (buffer, &pages);
+	}
+
+	aes_par_free (&pool);
+}
+
+/* -numa: ECB throughput with the threads on one node and the buffer on
+   another, for every pair of nodes, on one thread and on the whole node */
+void RunNumaReport ()
+{
+	static aes_par_pool pools[CPU_MAX_NODES];
+	static uint_32t nodes[CPU_MAX_NODES];
+	static aes_encrypt_ctx kse;
+	static aes_decrypt_ctx ksd;
+	const CPU_TOPOLOGY* topology = GetCpuTopology ();
+	size_t len = 4 * (size_t) (GetL3CacheSize ()? GetL3CacheSize () : 8 * 1024 * 1024);
+	unsigned char* buffer;
+	unsigned char key[32];
+	uint_32t nodeCount = 0, cpu, i, m, c;
+	double rates[CPU_MAX_NODES], remote;
+	char sizeStr[32];
+	THREAD_AFFINITY affinity;
+	int threads, saved;
+
+	/* the nodes, in increasing order */
+	for (i = 0; i < topology->logicalCount; i++)
+	{
+		const uint_32t node = topology->logical[i].node;
+
+		for (m = 0; m < nodeCount && nodes[m] < node; m++)
+			;
+		if ((m == nodeCount || nodes[m] != node) && nodeCount < CPU_MAX_NODES)
+		{
+			memmove (&nodes[m + 1], &nodes[m], (nodeCount - m) * sizeof (uint_32t));
+			nodes[m] = node;
+			nodeCount++;
+		}
+	}
+	if (nodeCount == 0)
+		nodes[nodeCount++] = 0;
+
+	if (len < ((size_t) 64 << 20))
+		len = (size_t) 64 << 20;
+	if (len > SWEEP_MAX_LEN)
+		len = SWEEP_MAX_LEN;
+
+	printf ("NUMA nodes:");
+	for (m = 0; m < nodeCount; m++)
+	{
+		if (aes_par_init_node (&pools[m], nodes[m], 0) != EXIT_SUCCESS)
+		{
+			printf ("\nThe threads of node %u could not be started\n", nodes[m]);
+			while (m--)
+				aes_par_free (&pools[m]);
+			return;
+		}
+		printf ("%s node %u (%u processor(s))", m? "," : "", nodes[m], pools[m].threads);
+	}
+	printf ("\n");
+	if (nodeCount == 1)
+		printf ("Only one node: every configuration is local, there is no remote penalty to measure\n");
+
+	RtlGenRandom (key, 32);
+	aes_botan_aesni_set_key_var (&kse, &ksd, key, 32);
+
+	/* the loop pins this thread to each node in turn, the benchmarks after the report run where it ran before */
+	saved = SaveThreadAffinity (&affinity);
+
+	printf ("AES-256 ECB in place over %s, MB/s with the threads on the node of the row and the buffer on that of the column\n\n", FormatSize (len, sizeStr));
+	printf ("                         ");
+	for (m = 0; m < nodeCount; m++)
+		printf ("  memory %4u", nodes[m]);
+	printf ("  remote penalty\n");
+
+	for (threads = 0; threads < 2; threads++)
+	{
+		for (c = 0; c < nodeCount; c++)
+		{
+			for (m = 0; m < nodeCount; m++)
+			{
+				buffer = (unsigned char*) _aligned_malloc (len, 4096);
+				if (!buffer)
+				{
+					printf ("Not enough memory\n");
+					for (i = 0; i < nodeCount; i++)
+						aes_par_free (&pools[i]);
+					if (saved)
+						RestoreThreadAffinity (&affinity);
+					return;
+				}
+
+				/* first touch from the threads of the memory node, then encryption from those of the row */
+				GetCpuNodeOrder (nodes[m], &cpu, 1);
+				PinThread (cpu);
+				aes_par_touch (&pools[m], buffer, len);
+				GetCpuNodeOrder (nodes[c], &cpu, 1);
+				PinThread (cpu);
+				rates[m] = RunParallelPoint (threads? &pools[c] : NULL, 0, &kse, NULL, buffer, len);
+
+				_aligned_free (buffer);
+			}
+
+			printf ("%-12s on node %-4u", threads? "all threads" : "1 thread", nodes[c]);
+			for (m = 0, remote = 0; m < nodeCount; m++)
+			{
+				printf (" %12.1f", rates[m]);
+				if (m != c)
+					remote += rates[m];
+			}
+			if (nodeCount > 1)
+				printf ("  %13.1f%%\n", 100.0 * (1.0 - remote / (nodeCount - 1) / rates[c]));
+			else
+				printf ("  %14s\n", "-");
+		}
+	}
+
+	if (saved)
+		RestoreThreadAffinity (&affinity);
+	for (m = 0; m < nodeCount; m++)
+		aes_par_free (&pools[m]);
+}
+
+#define TEST_BLOCK_LEN		52428800	/* buffer of the main benchmark */
+#define PAGES_SIZE_COUNT	2
+#define PAGES_ROUNDS		3
+
+/* page size, where it comes from, how much of the buffer is on huge pages and whether it is locked */
+static const char* FormatPages (const PAGES_INFO* pages, char* str)
+{
+	char pageStr[32], hugeStr[32];
+
+	FormatSize (pages->pageSize, pageStr);
+	if (pages->hugeBytes)
+		sprintf (str, "%s pages (%s), %s huge%s", pageStr, pages->source, FormatSize (pages->hugeBytes, hugeStr), pages->locked? ", locked" : "");
+	else
+		sprintf (str, "%s pages (%s)%s", pageStr, pages->source, pages->locked? ", locked" : "");
+	return str;
+}
+
+/* -pages: ECB and XTS in place, on one thread and through the parallel engine,
+   over buffers on huge pages and on 4KB pages, at the size of the main
+   benchmark and at 1GB. Each point is the best of PAGES_ROUNDS rounds, the two
+   kinds of pages taking turns so that clock changes hit both alike. */
+void RunPagesReport ()
+{
+	static const size_t sizes[PAGES_SIZE_COUNT] = {TEST_BLOCK_LEN, (size_t) 1 << 30};
+	static const int modes[2] = {0, 2};
+	static aes_par_pool pool;
+	static aes_encrypt_ctx kse;
+	static aes_decrypt_ctx ksd;
+	static aes_xts_ctx xts;
+	unsigned char* buffers[2];
+	PAGES_INFO pages[2];
+	unsigned char key[64];
+	char sizeStr[32], pagesStr[128];
+	double one[2][2], par[2][2], rate;
+	int i, m, p, round;
+
+	if (aes_par_init (&pool, 0, 1) != EXIT_SUCCESS)
+	{
+		printf ("Parallel engine: the threads could not be started\n");
+		return;
+	}
+
+	RtlGenRandom (key, 64);
+	aes_botan_aesni_set_key_var (&kse, &ksd, key, 32);
+	aes_botan_aesni_xts_set_key (&xts, key, key + 32, 32);
+
+	printf ("AES-256 in place on huge pages and 4KB pages, %u thread(s) for the parallel engine\n", pool.threads);
+	for (i = 0; i < PAGES_SIZE_COUNT; i++)
+	{
+		buffers[0] = (unsigned char*) AllocatePages (sizes[i], PAGES_HUGE, &pages[0]);
+		buffers[1] = (unsigned char*) AllocatePages (sizes[i], PAGES_SMALL, &pages[1]);
+		if (!buffers[0] || !buffers[1])
+		{
+			if (buffers[0])
+				FreePages (buffers[0], &pages[0]);
+			if (buffers[1])
+				FreePages (buffers[1], &pages[1]);
+			printf ("\n%s: not enough memory\n", FormatSize (sizes[i], sizeStr));
+			continue;
+		}
+
+		printf ("\n%s\n", FormatSize (sizes[i], sizeStr));
+		for (p = 0; p < 2; p++)
+		{
+			memset (buffers[p], 0x5A, sizes[i]);
+			printf ("  %s: %s\n", p? "4KB " : "huge", FormatPages (&pages[p], pagesStr));
+		}
+
+		for (m = 0; m < 2; m++)
+		{
+			for (p = 0; p < 2; p++)
+				one[m][p] = par[m][p] = 0;
+			for (round = 0; round < PAGES_ROUNDS; round++)
+			{
+				for (p = 0; p < 2; p++)
+				{
+					if ((rate = RunParallelPoint (NULL, modes[m], &kse, &xts, buffers[p], sizes[i])) > one[m][p])
+						one[m][p] = rate;
+					if ((rate = RunParallelPoint (&pool, modes[m], &kse, &xts, buffers[p], sizes[i])) > par[m][p])
+						par[m][p] = rate;
+				}
+			}
+		}
+
+		FreePages (buffers[0], &pages[0]);
+		FreePages (buffers[1], &pages[1]);
+
+		printf ("  %-8s %-5s %14s %6s %14s %6s\n", "", "pages", "1 thread MB/s", "c/B", "parallel MB/s", "c/B");
+		for (m = 0; m < 2; m++)
+		{
+			for (p = 0; p < 2; p++)
+				printf ("  %-8s %-5s %14.1f %6.2f %14.1f %6.2f\n", p? "" : par_modes[modes[m]], p? "4KB" : "huge",
+					one[m][p], CyclesPerByte (one[m][p]), par[m][p], CyclesPerByte (par[m][p]));
+			printf ("  %-8s %-5s %13.1f%% %6s %13.1f%%\n", "", "gain",
+				100.0 * (one[m][0] / one[m][1] - 1.0), "", 100.0 * (par[m][0] / par[m][1] - 1.0));
+		}
+	}
+
+	aes_par_free (&pool);
+}
+
+#define OOP_SIZE_COUNT		4
+#define OOP_ROUNDS			3
+
+#if CRYPTOPP_BOOL_X64
+#define OOP_KERNEL_NAME		"AES-NI 15-way"
+#define OOP_ENCRYPT			aes_botan_aesni_encrypt_15x
+#define OOP_DECRYPT			aes_botan_aesni_decrypt_15x
+#define OOP_ENCRYPT_NT		aes_botan_aesni_encrypt_15x_nt
+#define OOP_DECRYPT_NT		aes_botan_aesni_decrypt_15x_nt
+#else
+#define OOP_KERNEL_NAME		"AES-NI 7-way"
+#define OOP_ENCRYPT			aes_botan_aesni_encrypt_7x
+#define OOP_DECRYPT			aes_botan_aesni_decrypt_7x
+#define OOP_ENCRYPT_NT		aes_botan_aesni_encrypt_7x_nt
+#define OOP_DECRYPT_NT		aes_botan_aesni_decrypt_7x_nt
+#endif
+
+/* MB/s of ECB from in to out over len bytes, at least PAR_MIN_BYTES and
+   twice len in total, best of OOP_ROUNDS */
+double RunOutOfPlacePoint (aes_encrypt_blocks_fn encFn, aes_decrypt_blocks_fn decFn, aes_encrypt_ctx* kse, aes_decrypt_ctx* ksd,
+						   const unsigned char* in, unsigned char* out, size_t len)
+{
+	const uint64 total = (2 * (uint64) len > PAR_MIN_BYTES)? 2 * (uint64) len : PAR_MIN_BYTES;
+	LARGE_INTEGER performanceCountStart, performanceCountEnd, performanceCountFreq;
+	double seconds, best = 0;
+	uint64 done;
+	int round;
+
+	QueryPerformanceFrequency (&performanceCountFreq);
+	for (round = 0; round < OOP_ROUNDS; round++)
+	{
+		QueryPerformanceCounter (&performanceCountStart);
+		for (done = 0; done < total; done += len)
+		{
+			if (encFn)
+				encFn (kse, in, out, (uint_32t) (len / 16));
+			else
+				decFn (ksd, in, out, (uint_32t) (len / 16));
+		}
+		QueryPerformanceCounter (&performanceCountEnd);
+
+		seconds = ((double) (performanceCountEnd.QuadPart - performanceCountStart.QuadPart)) / (double) performanceCountFreq.QuadPart;
+		if ((double) done / (seconds * 1024.0 * 1024.0) > best)
+			best = (double) done / (seconds * 1024.0 * 1024.0);
+	}
+	return best;
+}
+
+/* -outofplace: ECB from one buffer to another with plain stores and with
+   streaming stores, in the last level cache and beyond it, and what the
+   dispatcher picks through aes_*_blocks_oop; each size is checked against
+   the plain kernels first.
+   The kernels are the widest the CPU has, VAES ones where supported. */
+void RunOutOfPlaceReport ()
+{
+	static aes_encrypt_ctx kse;
+	static aes_decrypt_ctx ksd;
+	const size_t llc = GetL3CacheSize ()? GetL3CacheSize () : ((size_t) 32 << 20);
+	const char* kernelName = OOP_KERNEL_NAME;
+	aes_encrypt_blocks_fn encFn = OOP_ENCRYPT, encNtFn = OOP_ENCRYPT_NT;
+	aes_decrypt_blocks_fn decFn = OOP_DECRYPT, decNtFn = OOP_DECRYPT_NT;
+	size_t sizes[OOP_SIZE_COUNT];
+	unsigned char *in, *out, *ref;
+	PAGES_INFO inPages, outPages, refPages;
+	unsigned char key[32];
+	char sizeStr[32], streamStr[32];
+	double plain, stream, dispatched;
+	int i, d;
+
+	sizes[0] = (size_t) 1 << 20;
+	sizes[1] = llc / 2;
+	sizes[2] = 2 * llc;
+	sizes[3] = (4 * llc > ((size_t) 1 << 30))? 4 * llc : (size_t) 1 << 30;
+	for (i = 0; i < OOP_SIZE_COUNT; i++)
+		sizes[i] &= ~(size_t) 4095;
+
+#if CRYPTOPP_BOOL_X64 && CRYPTOPP_BOOL_VAES_INTRINSICS_AVAILABLE
+	if (g_hasVAES && g_hasAVX512F)
+	{
+		kernelName = "VAES-512 64-way";
+		encFn = aes_botan_aesni_encrypt_vaes512;
+		decFn = aes_botan_aesni_decrypt_vaes512;
+		encNtFn = aes_botan_aesni_encrypt_vaes512_nt;
+		decNtFn = aes_botan_aesni_decrypt_vaes512_nt;
+	}
+	else if (g_hasVAES)
+	{
+		kernelName = "VAES 32-way";
+		encFn = aes_botan_aesni_encrypt_vaes256_32x;
+		decFn = aes_botan_aesni_decrypt_vaes256_32x;
+		encNtFn = aes_botan_aesni_encrypt_vaes256_32x_nt;
+		decNtFn = aes_botan_aesni_decrypt_vaes256_32x_nt;
+	}
+#endif
+
+	RtlGenRandom (key, 32);
+	aes_botan_aesni_set_key_var (&kse, &ksd, key, 32);
+
+	printf ("Kernels: %s\n", kernelName);
+	if (aes_dispatch_stream_bytes ())
+		printf ("aes_*_blocks_oop stream requests over %s\n\n", FormatSize (aes_dispatch_stream_bytes (), streamStr));
+	else
+		printf ("aes_*_blocks_oop never stream: the size of the last level cache is unknown\n\n");
+
+	printf ("AES-256, out of place      plain MB/s    c/B  streaming MB/s    c/B     gain  dispatched MB/s\n");
+	for (i = 0; i < OOP_SIZE_COUNT; i++)
+	{
+		in = (unsigned char*) AllocatePages (sizes[i], PAGES_HUGE, &inPages);
+		out = (unsigned char*) AllocatePages (sizes[i], PAGES_HUGE, &outPages);
+		ref = (unsigned char*) AllocatePages (sizes[i], PAGES_HUGE, &refPages);
+		if (!in || !out || !ref)
+		{
+			printf ("%s: not enough memory\n", FormatSize (sizes[i], sizeStr));
+			if (in)
+				FreePages (in, &inPages);
+			if (out)
+				FreePages (out, &outPages);
+			if (ref)
+				FreePages (ref, &refPages);
+			continue;
+		}
+		memset (in, 0x5A, sizes[i]);
+
+		/* the streaming kernels against the plain ones, over a count of blocks with a tail, then a single block */
+		encFn (&kse, in, ref, (uint_32t) (sizes[i] / 16) - 3);
+		encNtFn (&kse, in, out, (uint_32t) (sizes[i] / 16) - 3);
+		if (memcmp (ref, out, sizes[i] - 48))
+		{
+			printf ("%s: streaming encryption error\n", FormatSize (sizes[i], sizeStr));
+			goto next;
+		}
+		decNtFn (&ksd, ref, out, 1);
+		decNtFn (&ksd, ref + 16, out + 16, (uint_32t) (sizes[i] / 16) - 4);
+		if (memcmp (in, out, sizes[i] - 48))
+		{
+			printf ("%s: streaming decryption error\n", FormatSize (sizes[i], sizeStr));
+			goto next;
+		}
+
+		for (d = 0; d < 2; d++)
+		{
+			plain = RunOutOfPlacePoint (d? NULL : encFn, d? decFn : NULL, &kse, &ksd, in, out, sizes[i]);
+			stream = RunOutOfPlacePoint (d? NULL : encNtFn, d? decNtFn : NULL, &kse, &ksd, in, out, sizes[i]);
+			dispatched = RunOutOfPlacePoint (d? NULL : aes_encrypt_blocks_oop, d? aes_decrypt_blocks_oop : NULL, &kse, &ksd, in, out, sizes[i]);
+			printf ("%s %7s %17.1f %6.2f %15.1f %6.2f %7.1f%% %16.1f\n", d? "Dec" : "Enc", FormatSize (sizes[i], sizeStr),
+				plain, CyclesPerByte (plain), stream, CyclesPerByte (stream), 100.0 * (stream / plain - 1.0), dispatched);
+		}
+next:
+		FreePages (in, &inPages);
+		FreePages (out, &outPages);
+		FreePages (ref, &refPages);
+	}
+}
+
+/* kernels the dispatcher uses for each size class, one line per direction and key size */
+void PrintDispatchProfile ()
+{
+	static const uint_32t classBlocks[AES_DISPATCH_SIZE_CLASSES] = {1, 4, 16, 64, 256, 1024, 4096, 16384};
+	int d, k, c;
+
+	printf ("Request sizes: 16B | 64B | 256B | 1KB | 4KB | 16KB | 64KB | more\n");
+	for (d = 0; d < 2; d++)
+	{
+		for (k = 16; k <= 32; k += 8)
+		{
+			printf ("AES-%d %s: ", k * 8, d? "Dec" : "Enc");
+			for (c = 0; c < AES_DISPATCH_SIZE_CLASSES; c++)
+				printf ("%s%s", c? " | " : "", aes_dispatch_kernel_for (!d, k, classBlocks[c]));
+			printf ("\n");
+		}
+	}
+}
+
+/* caches and processor layout the rest of the benchmark sizes its work by */
+void PrintCpuTopology ()
+{
+	static const char* cacheTypes[4] = {"", "d", "i", ""};
+	const CPU_TOPOLOGY* topology = GetCpuTopology ();
+	char sizeStr[32];
+	uint_32t i;
+
+	printf ("CPU topology: %u package(s), %u NUMA node(s), %u core(s), %u thread(s) per core, %u logical processor(s)%s\n",
+		topology->packageCount, topology->nodeCount, topology->coreCount, topology->threadsPerCore, topology->logicalCount,
+		topology->osTopology? "" : " (from CPUID only)");
+	printf ("CPU caches:");
+	for (i = 0; i < topology->cacheCount; i++)
+	{
+		const CPU_CACHE_INFO* cache = &topology->caches[i];
+
+		printf ("%s L%u%s %s", i? "," : "", cache->level, cacheTypes[cache->type & 3], FormatSize (cache->size, sizeStr));
+		if (cache->sharedBy > 1)
+			printf (" (shared by %u)", cache->sharedBy);
+	}
+	printf ("%s\n", topology->cacheMismatch? " (CPUID differs, OS values used)" : "");
+}
+
+/* throughput over back-to-back messages of msgLen bytes, with a 13-byte AAD as in TLS records */
+double RunGcmBenchmark (uint_32t msgLen, int seal, int stitched)
+{
+	#define GCM_BENCH_LEN 16777216
+	#define GCM_BENCH_LOOPS 16
+
+	unsigned char *input = (unsigned char*) _aligned_malloc (GCM_BENCH_LEN, 32);
+	unsigned char *output = (unsigned char*) _aligned_malloc (GCM_BENCH_LEN, 32);
+	uint_32t msgCount = GCM_BENCH_LEN / msgLen;
+	unsigned char *tags = (unsigned char*) malloc (msgCount * AES_GCM_TAG_SIZE);
+	static ALIGN (32) unsigned char key[32];
+	unsigned char iv[12], aad[13];
+	aes_gcm_ctx ctx;
+	uint_32t i, j;
+	double seconds;
+	LARGE_INTEGER performanceCountStart, performanceCountEnd, performanceCountDiff, performanceCountFreq;
+
+	QueryPerformanceFrequency (&performanceCountFreq);
+
+	RtlGenRandom (input, GCM_BENCH_LEN);
+	RtlGenRandom (key, 32);
+	RtlGenRandom (iv, sizeof (iv));
+	RtlGenRandom (aad, sizeof (aad));
+	aes_gcm_set_key (&ctx, key, 32);
+
+	/* open needs ciphertexts with valid tags */
+	if (!seal)
+	{
+		for (j = 0; j < msgCount; j++)
+			aes_gcm_seal (&ctx, iv, sizeof (iv), aad, sizeof (aad), input + j * msgLen, input + j * msgLen, msgLen, tags + j * AES_GCM_TAG_SIZE);
+	}
+
+	performanceCountDiff.QuadPart = 0;
+	for (i = 0; i < GCM_BENCH_LOOPS; i++)
+	{
+		QueryPerformanceCounter (&performanceCountStart);
+		for (j = 0; j < msgCount; j++)
+		{
+			if (seal && stitched)
+				aes_gcm_seal (&ctx, iv, sizeof (iv), aad, sizeof (aad), input + j * msgLen, output + j * msgLen, msgLen, tags + j * AES_GCM_TAG_SIZE);
+			else if (seal)
+				aes_gcm_seal_2pass (&ctx, iv, sizeof (iv), aad, sizeof (aad), input + j * msgLen, output + j * msgLen, msgLen, tags + j * AES_GCM_TAG_SIZE);
+			else if (stitched)
+				aes_gcm_open (&ctx, iv, sizeof (iv), aad, sizeof (aad), input + j * msgLen, output + j * msgLen, msgLen, tags + j * AES_GCM_TAG_SIZE);
+			else
+				aes_gcm_open_2pass (&ctx, iv, sizeof (iv), aad, sizeof (aad), input + j * msgLen, output + j * msgLen, msgLen, tags + j * AES_GCM_TAG_SIZE);
+		}
+		QueryPerformanceCounter (&performanceCountEnd);
+		performanceCountDiff.QuadPart += performanceCountEnd.QuadPart - performanceCountStart.QuadPart;
+	}
+
+	free (tags);
+	_aligned_free (output);
+	_aligned_free (input);
+
+	seconds = ((double) performanceCountDiff.QuadPart) / (double) performanceCountFreq.QuadPart;
+	return (double) msgCount * msgLen * (double) GCM_BENCH_LOOPS / (seconds * 1024.0 * 1024.0);
+}
+
+/* multiplies the tweak by x in GF(2^128), little-endian as IEEE 1619 writes it */
+static void XtsReferenceDouble (unsigned char* T)
+{
+	const unsigned char carry = T[15] >> 7;
+	int i;
+
+	for (i = 15; i > 0; i--)
+		T[i] = (unsigned char) ((T[i] << 1) | (T[i - 1] >> 7));
+	T[0] = (unsigned char) ((T[0] << 1) ^ (carry? 0x87 : 0));
+}
+
+static void XtsReferenceBlock (const aes_xts_ctx* ctx, const unsigned char* T, const unsigned char* in, unsigned char* out, int encrypt)
+{
+	unsigned char block[16];
+	int i;
+
+	for (i = 0; i < 16; i++)
+		block[i] = in[i] ^ T[i];
+	if (encrypt)
+		aes_botan_aesni_encrypt_4x ((aes_encrypt_ctx*) &ctx->ek, block, block, 1);
+	else
+		aes_botan_aesni_decrypt_4x ((aes_decrypt_ctx*) &ctx->dk, block, block, 1);
+	for (i = 0; i < 16; i++)
+		out[i] = block[i] ^ T[i];
+}
+
+/* one data unit of size bytes, one block at a time, the reference for the wide
+   loops of the kernels; in and out must not overlap */
+static void XtsReference (const aes_xts_ctx* ctx, const unsigned char* in, unsigned char* out, uint64 sector, uint_32t size, int encrypt)
+{
+	unsigned char T[16], T2[16], last[16], block[16];
+	uint_32t blocks = size / 16, rem = size % 16, i;
+
+	memset (T, 0, 16);
+	for (i = 0; i < 8; i++)
+		T[i] = (unsigned char) (sector >> (8 * i));
+	aes_botan_aesni_encrypt_4x ((aes_encrypt_ctx*) &ctx->tk, T, T, 1);
+
+	if (rem)
+		blocks--;
+	for (i = 0; i < blocks; i++, in += 16, out += 16)
+	{
+		XtsReferenceBlock (ctx, T, in, out, encrypt);
+		XtsReferenceDouble (T);
+	}
+
+	if (rem)
+	{
+		/* the last full block goes with the next tweak, its stolen bytes with this one */
+		memcpy (T2, T, 16);
+		XtsReferenceDouble (T2);
+		XtsReferenceBlock (ctx, encrypt? T : T2, in, last, encrypt);
+		memcpy (block, in + 16, rem);
+		memcpy (block + rem, last + rem, 16 - rem);
+		memcpy (out + 16, last, rem);
+		XtsReferenceBlock (ctx, encrypt? T2 : T, block, out, encrypt);
+	}
+}
+
+/* data units that reach the 15-, 7- and 4-way loops, with and without ciphertext stealing */
+#define XTS_LONG_COUNT 5
+static const uint_32t xts_long_sizes[XTS_LONG_COUNT] = {512, 4096, 17 * 16 + 5, 31 * 16 + 9, 26 * 16 + 15};
+
+int RunXtsTest (XtsFunction encFn, XtsFunction decFn, XTS_TEST* vector, int count)
+{
+	static ALIGN (32) unsigned char key1[32], key2[32], input[3 * 4096], output[3 * 4096], expected[3 * 4096];
+	aes_xts_ctx ctx;
+	uint_32t len;
+	int i, j, k;
+
+	for (i = 0; i < count; i++)
+	{
+		HexStringToByteArray (vector[i].key1, key1);
+		HexStringToByteArray (vector[i].key2, key2);
+		HexStringToByteArray (vector[i].plaintext, input);
+		HexStringToByteArray (vector[i].ciphertext, expected);
+		len = (uint_32t) strlen (vector[i].plaintext) / 2;
+
+		aes_botan_aesni_xts_set_key (&ctx, key1, key2, (int) strlen (vector[i].key1) / 2);
+		encFn (&ctx, input, output, vector[i].sector, 1, len);
+		if (memcmp (output, expected, len))
+			return 0;
+
+		decFn (&ctx, output, output, vector[i].sector, 1, len);
+		if (memcmp (output, input, len))
+			return 0;
+
+		/* three consecutive data units in one call must match three single calls */
+		for (j = 1; j < 3; j++)
+			memcpy (input + j * len, input, len);
+		encFn (&ctx, input, output, vector[i].sector, 3, len);
+		for (j = 0; j < 3; j++)
+		{
+			encFn (&ctx, input, expected, vector[i].sector + j, 1, len);
+			if (memcmp (output + j * len, expected, len))
+				return 0;
+		}
+
+		decFn (&ctx, output, output, vector[i].sector, 3, len);
+		if (memcmp (output, input, 3 * len))
+			return 0;
+	}
+
+	/* three consecutive long data units under every key size, against the reference both ways */
+	for (k = 0; k < 3; k++)
+	{
+		for (j = 0; j < 32; j++)
+		{
+			key1[j] = (unsigned char) (j * 5 + k);
+			key2[j] = (unsigned char) (j * 9 + 0x40 + k);
+		}
+		aes_botan_aesni_xts_set_key (&ctx, key1, key2, 16 + 8 * k);
+
+		for (i = 0; i < XTS_LONG_COUNT; i++)
+		{
+			const uint64 sector = LL(0x0123456789ABCDEF) + i;
+
+			len = xts_long_sizes[i];
+			for (j = 0; j < (int) (3 * len); j++)
+				input[j] = (unsigned char) (j * 7 + i);
+
+			for (j = 0; j < 3; j++)
+				XtsReference (&ctx, input + j * len, expected + j * len, sector + j, len, 1);
+			encFn (&ctx, input, output, sector, 3, len);
+			if (memcmp (output, expected, 3 * len))
+				return 0;
+
+			for (j = 0; j < 3; j++)
+				XtsReference (&ctx, expected + j * len, output + j * len, sector + j, len, 0);
+			if (memcmp (output, input, 3 * len))
+				return 0;
+			decFn (&ctx, expected, output, sector, 3, len);
+			if (memcmp (output, input, 3 * len))
+				return 0;
+		}
+	}
+
+	return 1;
+}
+
+/* data units processed per second, over a buffer of consecutive sectors */
+double RunXtsBenchmark (XtsFunction fn, uint_32t sectorSize)
+{
+	#define XTS_BENCH_LEN 16777216
+	#define XTS_BENCH_LOOPS 16
+
+	unsigned char *input = (unsigned char*) _aligned_malloc (XTS_BENCH_LEN, 32);
+	uint_32t sectorCount = XTS_BENCH_LEN / sectorSize;
+	static ALIGN (32) unsigned char key[64];
+	aes_xts_ctx ctx;
+	uint_32t i;
+	double seconds;
+	LARGE_INTEGER performanceCountStart, performanceCountEnd, performanceCountDiff, performanceCountFreq;
+
+	QueryPerformanceFrequency (&performanceCountFreq);
+
+	RtlGenRandom (input, XTS_BENCH_LEN);
+	RtlGenRandom (key, 64);
+	aes_botan_aesni_xts_set_key (&ctx, key, key + 32, 32);
+
+	performanceCountDiff.QuadPart = 0;
+	for (i = 0; i < XTS_BENCH_LOOPS; i++)
+	{
+		QueryPerformanceCounter (&performanceCountStart);
+		fn (&ctx, input, input, (uint64) i * sectorCount, sectorCount, sectorSize);
+		QueryPerformanceCounter (&performanceCountEnd);
+		performanceCountDiff.QuadPart += performanceCountEnd.QuadPart - performanceCountStart.QuadPart;
+	}
+
+	_aligned_free (input);
+
+	seconds = ((double) performanceCountDiff.QuadPart) / (double) performanceCountFreq.QuadPart;
+	return (double) sectorCount * (double) XTS_BENCH_LOOPS / seconds;
+}
+
+double RunCipherBenchmark (CipherFunction fn, int encrypt, int extended)
+{
+	#define TEST_BLOCK_COUNT 8
+
+	PAGES_INFO pages;
+	unsigned char *input = (unsigned char*) AllocatePages (TEST_BLOCK_LEN, PAGES_HUGE, &pages);
+	static ALIGN (32) unsigned char key[32];
+	unsigned long i = 0;
+    double seconds;
+	unsigned long loops = extended? 20*TEST_BLOCK_COUNT : TEST_BLOCK_COUNT;
+	LARGE_INTEGER performanceCountStart, performanceCountEnd, performanceCountDiff, performanceCountFreq;
+
+	QueryPerformanceFrequency (&performanceCountFreq);
+
+	performanceCountDiff.QuadPart = 0;
+	for (i = 0; i < loops; i++)
+	{
+		RtlGenRandom (input, TEST_BLOCK_LEN);
+		RtlGenRandom (key, 32);
+		QueryPerformanceCounter (&performanceCountStart);
+		fn (key, input, TEST_BLOCK_LEN, input, encrypt);
+		QueryPerformanceCounter (&performanceCountEnd);
+		performanceCountDiff.QuadPart += performanceCountEnd.QuadPart - performanceCountStart.QuadPart;
+	}
+
+	FreePages (input, &pages);
+
+	seconds = ((double) performanceCountDiff.QuadPart) / (double) performanceCountFreq.QuadPart;
+    return  (double) TEST_BLOCK_LEN * (double) loops / (seconds * 1024.0 * 1024.0);
+}
+
+#define AES_TEST_COUNT 3
+CIPHER_TEST aes_test_vectors[AES_TEST_COUNT] = {
+	{"0000000000000000000000000000000000000000000000000000000000000000", "00000000000000000000000000000000", "dc95c078a2408989ad48a21492842087"},
+	{"8E8E8E8E8E8E8E8E8E8E8E8E8E8E8E8E8E8E8E8E8E8E8E8E8E8E8E8E8E8E8E8E", "8E8E8E8E8E8E8E8E8E8E8E8E8E8E8E8E", "2F178F9BE7246F32D6CC007060ACFA0D"},
+	{"2BD6459F82C5B300952C49104881FF482BD6459F82C5B300952C49104881FF48", "DFC295E9D04A30DB25940E4FCC64516F", "EA024714AD5C4D84EA024714AD5C4D84"}
+};
+
+#define AES128_TEST_COUNT 3
+CIPHER_TEST aes128_test_vectors[AES128_TEST_COUNT] = {
+	{"000102030405060708090A0B0C0D0E0F", "00112233445566778899AABBCCDDEEFF", "69C4E0D86A7B0430D8CDB78070B4C55A"},
+	{"2B7E151628AED2A6ABF7158809CF4F3C", "6BC1BEE22E409F96E93D7E117393172A", "3AD77BB40D7A3660A89ECAF32466EF97"},
+	{"2B7E151628AED2A6ABF7158809CF4F3C", "AE2D8A571E03AC9C9EB76FAC45AF8E51", "F5D3D58503B9699DE785895A96FDBAAF"}
+};
+
+#define AES192_TEST_COUNT 3
+CIPHER_TEST aes192_test_vectors[AES192_TEST_COUNT] = {
+	{"000102030405060708090A0B0C0D0E0F1011121314151617", "00112233445566778899AABBCCDDEEFF", "DDA97CA4864CDFE06EAF70A0EC0D7191"},
+	{"8E73B0F7DA0E6452C810F32B809079E562F8EAD2522C6B7B", "6BC1BEE22E409F96E93D7E117393172A", "BD334F1D6E45F25FF712A214571FA5CC"},
+	{"8E73B0F7DA0E6452C810F32B809079E562F8EAD2522C6B7B", "AE2D8A571E03AC9C9EB76FAC45AF8E51", "974104846D0AD3AD7734ECB3ECEE4EEF"}
+};
+
+/* NIST SP 800-38A F.5.1, F.5.3 and F.5.5 */
+CTR_TEST aes_ctr_test_vectors[3] = {
+	{"2B7E151628AED2A6ABF7158809CF4F3C", "F0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF",
+	 "6BC1BEE22E409F96E93D7E117393172AAE2D8A571E03AC9C9EB76FAC45AF8E5130C81C46A35CE411E5FBC1191A0A52EFF69F2445DF4F9B17AD2B417BE66C3710",
+	 "874D6191B620E3261BEF6864990DB6CE9806F66B7970FDFF8617187BB9FFFDFF5AE4DF3EDBD5D35E5B4F09020DB03EAB1E031DDA2FBE03D1792170A0F3009CEE"},
+	{"8E73B0F7DA0E6452C810F32B809079E562F8EAD2522C6B7B", "F0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF",
+	 "6BC1BEE22E409F96E93D7E117393172AAE2D8A571E03AC9C9EB76FAC45AF8E5130C81C46A35CE411E5FBC1191A0A52EFF69F2445DF4F9B17AD2B417BE66C3710",
+	 "1ABC932417521CA24F2B0459FE7E6E0B090339EC0AA6FAEFD5CCC2C6F4CE8E941E36B26BD1EBC670D1BD1D665620ABF74F78A7F6D29809585A97DAEC58C6B050"},
+	{"603DEB1015CA71BE2B73AEF0857D77811F352C073B6108D72D9810A30914DFF4", "F0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF",
+	 "6BC1BEE22E409F96E93D7E117393172AAE2D8A571E03AC9C9EB76FAC45AF8E5130C81C46A35CE411E5FBC1191A0A52EFF69F2445DF4F9B17AD2B417BE66C3710",
+	 "601EC313775789A5B7A7F504BBF3D228F443E3CA4D62B59ACA84E990CACAF5C52B0930DAA23DE94CE87017BA2D84988DDFC9C58DB67AADA613C2DD08457941A6"}
+};
+
+/* NIST SP 800-38A F.2.1, F.2.3 and F.2.5 */
+CTR_TEST aes_cbc_test_vectors[3] = {
+	{"2B7E151628AED2A6ABF7158809CF4F3C", "000102030405060708090A0B0C0D0E0F",
+	 "6BC1BEE22E409F96E93D7E117393172AAE2D8A571E03AC9C9EB76FAC45AF8E5130C81C46A35CE411E5FBC1191A0A52EFF69F2445DF4F9B17AD2B417BE66C3710",
+	 "7649ABAC8119B246CEE98E9B12E9197D5086CB9B507219EE95DB113A917678B273BED6B8E3C1743B7116E69E222295163FF1CAA1681FAC09120ECA307586E1A7"},
+	{"8E73B0F7DA0E6452C810F32B809079E562F8EAD2522C6B7B", "000102030405060708090A0B0C0D0E0F",
+	 "6BC1BEE22E409F96E93D7E117393172AAE2D8A571E03AC9C9EB76FAC45AF8E5130C81C46A35CE411E5FBC1191A0A52EFF69F2445DF4F9B17AD2B417BE66C3710",
+	 "4F021DB243BC633D7178183A9FA071E8B4D9ADA9AD7DEDF4E5E738763F69145A571B242012FB7AE07FA9BAAC3DF102E008B0E27988598881D920A9E64F5615CD"},
+	{"603DEB1015CA71BE2B73AEF0857D77811F352C073B6108D72D9810A30914DFF4", "000102030405060708090A0B0C0D0E0F",
+	 "6BC1BEE22E409F96E93D7E117393172AAE2D8A571E03AC9C9EB76FAC45AF8E5130C81C46A35CE411E5FBC1191A0A52EFF69F2445DF4F9B17AD2B417BE66C3710",
+	 "F58C4C04D6E5F1BA779EABFB5F7BFBD69CFC4E967EDB808D679F777BC6702C7D39F23369A9D9BACFA530E26304231461B2EB05E2C39BE9FCDA6C19078C6A9D1B"}
+};
+
+typedef struct {
+	int keySize;
+	CIPHER_TEST* vectors;
+	int count;
+	CTR_TEST* ctrVector;
+	CTR_TEST* cbcVector;
+} KEY_SIZE_TEST;
+
+#define KEY_SIZE_COUNT 3
+KEY_SIZE_TEST key_sizes[KEY_SIZE_COUNT] = {
+	{16, aes128_test_vectors, AES128_TEST_COUNT, &aes_ctr_test_vectors[0], &aes_cbc_test_vectors[0]},
+	{24, aes192_test_vectors, AES192_TEST_COUNT, &aes_ctr_test_vectors[1], &aes_cbc_test_vectors[1]},
+	{32, aes_test_vectors, AES_TEST_COUNT, &aes_ctr_test_vectors[2], &aes_cbc_test_vectors[2]}
+};
+
+
+#if CRYPTOPP_BOOL_X64
+void __cdecl AesBotanAESNI15WayCipherFunction (unsigned char* key, unsigned char* input, unsigned long inputLen, unsigned char* output, int encrypt)
+{
+	aes_encrypt_ctx kse;
+	aes_decrypt_ctx ksd;
+	aes_botan_aesni_set_key_var(&kse, &ksd, key, g_keySize);
+
+	if (encrypt)
+		aes_botan_aesni_encrypt_15x(&kse, input, output, inputLen/16);
+	else
+		aes_botan_aesni_decrypt_15x(&ksd, input, output, inputLen/16);
+}
+#endif
+
+void __cdecl AesBotanAESNI7WayCipherFunction (unsigned char* key, unsigned char* input, unsigned long inputLen, unsigned char* output, int encrypt)
+{
+	aes_encrypt_ctx kse;
+	aes_decrypt_ctx ksd;
+	aes_botan_aesni_set_key_var(&kse, &ksd, key, g_keySize);
+
+	if (encrypt)
+		aes_botan_aesni_encrypt_7x(&kse, input, output, inputLen/16);
+	else
+		aes_botan_aesni_decrypt_7x(&ksd, input, output, inputLen/16);
+}
+
+void __cdecl AesBotanAESNI4WayCipherFunction (unsigned char* key, unsigned char* input, unsigned long inputLen, unsigned char* output, int encrypt)
+{
+	aes_encrypt_ctx kse;
+	aes_decrypt_ctx ksd;
+	aes_botan_aesni_set_key_var(&kse, &ksd, key, g_keySize);
+
+	if (encrypt)
+		aes_botan_aesni_encrypt_4x(&kse, input, output, inputLen/16);
+	else
+		aes_botan_aesni_decrypt_4x(&ksd, input, output, inputLen/16);
+}
+
+void __cdecl AesBotanSizedCipherFunction (unsigned char* key, unsigned char* input, unsigned long inputLen, unsigned char* output, int encrypt)
+{
+	aes_encrypt_ctx kse;
+	aes_decrypt_ctx ksd;
+	aes_botan_aesni_set_key_var(&kse, &ksd, key, g_keySize);
+
+	if (encrypt)
+		aes_botan_aesni_encrypt_sized(&kse, input, output, inputLen/16);
+	else
+		aes_botan_aesni_decrypt_sized(&ksd, input, output, inputLen/16);
+}
+
+/* the streaming-store kernels, which fall back to the plain ones unless output is 16-byte aligned */
+void __cdecl AesBotanStreamingCipherFunction (unsigned char* key, unsigned char* input, unsigned long inputLen, unsigned char* output, int encrypt)
+{
+	aes_encrypt_ctx kse;
+	aes_decrypt_ctx ksd;
+	aes_botan_aesni_set_key_var(&kse, &ksd, key, g_keySize);
+
+#if CRYPTOPP_BOOL_X64
+	if (encrypt)
+		aes_botan_aesni_encrypt_15x_nt(&kse, input, output, inputLen/16);
+	else
+		aes_botan_aesni_decrypt_15x_nt(&ksd, input, output, inputLen/16);
+#else
+	if (encrypt)
+		aes_botan_aesni_encrypt_7x_nt(&kse, input, output, inputLen/16);
+	else
+		aes_botan_aesni_decrypt_7x_nt(&ksd, input, output, inputLen/16);
+#endif
+}
+
+/* request sizes, in blocks, of the small-request benchmark */
+#define SMALL_SIZE_COUNT 12
+static const uint_32t small_sizes[SMALL_SIZE_COUNT] = {1, 2, 3, 4, 5, 7, 8, 11, 14, 15, 16, 0};
+#if CRYPTOPP_BOOL_X64
+#define SMALL_WIDE_ENC aes_botan_aesni_encrypt_15x
+static const char* small_wide_name = "15-way";
+#else
+#define SMALL_WIDE_ENC aes_botan_aesni_encrypt_7x
+static const char* small_wide_name = "7-way";
+#endif
+
+static uint_32t g_ways = 7;
+
+void __cdecl AesBotanWidthCipherFunction (unsigned char* key, unsigned char* input, unsigned long inputLen, unsigned char* output, int encrypt)
+{
+	aes_encrypt_ctx kse;
+	aes_decrypt_ctx ksd;
+	aes_botan_aesni_set_key_var(&kse, &ksd, key, g_keySize);
+
+	if (encrypt)
+		aes_botan_aesni_encrypt_width(&kse, input, output, inputLen/16, g_ways);
+	else
+		aes_botan_aesni_decrypt_width(&ksd, input, output, inputLen/16, g_ways);
+}
+
+#if CRYPTOPP_BOOL_X64 && CRYPTOPP_BOOL_VAES_INTRINSICS_AVAILABLE
+void __cdecl AesBotanVAES512CipherFunction (unsigned char* key, unsigned char* input, unsigned long inputLen, unsigned char* output, int encrypt)
+{
+	aes_encrypt_ctx kse;
+	aes_decrypt_ctx ksd;
+	aes_botan_aesni_set_key_var(&kse, &ksd, key, g_keySize);
+
+	if (encrypt)
+		aes_botan_aesni_encrypt_vaes512(&kse, input, output, inputLen/16);
+	else
+		aes_botan_aesni_decrypt_vaes512(&ksd, input, output, inputLen/16);
+}
+
+/* the VAES kernels with streaming stores, for RunEcbLengthTest: the output
+   goes 0 to 3 blocks past a 64-byte boundary, depending on the length, so
+   that the blocks stored before the aligned loop are checked too */
+static void AesStreamingShifted (aes_encrypt_blocks_fn encFn, aes_decrypt_blocks_fn decFn,
+								 unsigned char* key, unsigned char* input, unsigned long inputLen, unsigned char* output, int encrypt)
+{
+	static ALIGN (64) unsigned char shifted[(ECB_TEST_MAX_BLOCKS + 3) * 16];
+	unsigned char* out = shifted + 16 * ((inputLen / 16) % 4);
+	aes_encrypt_ctx kse;
+	aes_decrypt_ctx ksd;
+	aes_botan_aesni_set_key_var(&kse, &ksd, key, g_keySize);
+
+	if (encrypt)
+		encFn(&kse, input, out, inputLen/16);
+	else
+		decFn(&ksd, input, out, inputLen/16);
+	memcpy(output, out, inputLen);
+}
+
+void __cdecl AesBotanVAES512StreamingCipherFunction (unsigned char* key, unsigned char* input, unsigned long inputLen, unsigned char* output, int encrypt)
+{
+	AesStreamingShifted (aes_botan_aesni_encrypt_vaes512_nt, aes_botan_aesni_decrypt_vaes512_nt, key, input, inputLen, output, encrypt);
+}
+
+void __cdecl AesBotanVAES16WayStreamingCipherFunction (unsigned char* key, unsigned char* input, unsigned long inputLen, unsigned char* output, int encrypt)
+{
+	AesStreamingShifted (aes_botan_aesni_encrypt_vaes256_16x_nt, aes_botan_aesni_decrypt_vaes256_16x_nt, key, input, inputLen, output, encrypt);
+}
+
+void __cdecl AesBotanVAES32WayStreamingCipherFunction (unsigned char* key, unsigned char* input, unsigned long inputLen, unsigned char* output, int encrypt)
+{
+	AesStreamingShifted (aes_botan_aesni_encrypt_vaes256_32x_nt, aes_botan_aesni_decrypt_vaes256_32x_nt, key, input, inputLen, output, encrypt);
+}
+
+void __cdecl AesBotanVAES32WayCipherFunction (unsigned char* key, unsigned char* input, unsigned long inputLen, unsigned char* output, int encrypt)
+{
+	aes_encrypt_ctx kse;
+	aes_decrypt_ctx ksd;
+	aes_botan_aesni_set_key_var(&kse, &ksd, key, g_keySize);
+
+	if (encrypt)
+		aes_botan_aesni_encrypt_vaes256_32x(&kse, input, output, inputLen/16);
+	else
+		aes_botan_aesni_decrypt_vaes256_32x(&ksd, input, output, inputLen/16);
+}
+
+void __cdecl AesBotanVAES16WayCipherFunction (unsigned char* key, unsigned char* input, unsigned long inputLen, unsigned char* output, int encrypt)
+{
+	aes_encrypt_ctx kse;
+	aes_decrypt_ctx ksd;
+	aes_botan_aesni_set_key_var(&kse, &ksd, key, g_keySize);
+
+	if (encrypt)
+		aes_botan_aesni_encrypt_vaes256_16x(&kse, input, output, inputLen/16);
+	else
+		aes_botan_aesni_decrypt_vaes256_16x(&ksd, input, output, inputLen/16);
+}
+#endif
+
+void __cdecl AesDispatchCipherFunction (unsigned char* key, unsigned char* input, unsigned long inputLen, unsigned char* output, int encrypt)
+{
+	aes_encrypt_ctx kse;
+	aes_decrypt_ctx ksd;
+	aes_botan_aesni_set_key_var(&kse, &ksd, key, g_keySize);
+
+	if (encrypt)
+		aes_encrypt_blocks(&kse, input, output, inputLen/16);
+	else
+		aes_decrypt_blocks(&ksd, input, output, inputLen/16);
+}
+
+#if CRYPTOPP_BOOL_X64
+void __cdecl AesBotanCtr15WayCipherFunction (unsigned char* key, unsigned char* input, unsigned long inputLen, unsigned char* output, int encrypt)
+{
+	static const unsigned char iv[16] = {0};
+	aes_encrypt_ctx kse;
+	aes_decrypt_ctx ksd;
+	aes_ctr_state state;
+	aes_botan_aesni_set_key_var(&kse, &ksd, key, g_keySize);
+	aes_botan_aesni_ctr_init(&state, iv, 128);
+	(void) encrypt; /* CTR is symmetric: encryption and decryption are the same operation */
+
+	aes_botan_aesni_ctr_crypt_15x(&kse, &state, input, output, inputLen);
+}
+#endif
+
+void __cdecl AesBotanCtr7WayCipherFunction (unsigned char* key, unsigned char* input, unsigned long inputLen, unsigned char* output, int encrypt)
+{
+	static const unsigned char iv[16] = {0};
+	aes_encrypt_ctx kse;
+	aes_decrypt_ctx ksd;
+	aes_ctr_state state;
+	aes_botan_aesni_set_key_var(&kse, &ksd, key, g_keySize);
+	aes_botan_aesni_ctr_init(&state, iv, 128);
+	(void) encrypt; /* CTR is symmetric: encryption and decryption are the same operation */
+
+	aes_botan_aesni_ctr_crypt_7x(&kse, &state, input, output, inputLen);
+}
+
+/* encryption splits the buffer into one CBC stream per lane */
+static void CbcCipherFunction (unsigned char* key, unsigned char* input, unsigned long inputLen, unsigned char* output, int encrypt, uint_32t ways)
+{
+	aes_encrypt_ctx kse;
+	aes_decrypt_ctx ksd;
+	aes_cbc_stream streams[15];
+	uint_32t i, blocks = inputLen / 16;
+	aes_botan_aesni_set_key_var(&kse, &ksd, key, g_keySize);
+
+	if (!encrypt)
+	{
+		unsigned char iv[16] = {0};
+#if CRYPTOPP_BOOL_X64
+		if (ways == 15)
+			aes_botan_aesni_cbc_decrypt_15x(&ksd, iv, input, output, blocks);
+		else
+#endif
+		aes_botan_aesni_cbc_decrypt_7x(&ksd, iv, input, output, blocks);
+		return;
+	}
+
+	if (ways == 1)
+	{
+		unsigned char iv[16] = {0};
+		aes_botan_aesni_cbc_encrypt(&kse, iv, input, output, blocks);
+		return;
+	}
+
+	for (i = 0; i < ways; i++)
+	{
+		streams[i].in = input + 16 * (blocks / ways) * i;
+		streams[i].out = output + 16 * (blocks / ways) * i;
+		streams[i].blocks = (i == ways - 1)? blocks - (blocks / ways) * i : blocks / ways;
+		memset (streams[i].iv, 0, 16);
+	}
+#if CRYPTOPP_BOOL_X64
+	if (ways == 15)
+		aes_botan_aesni_cbc_encrypt_streams_15x(&kse, streams, ways);
+	else
+#endif
+	aes_botan_aesni_cbc_encrypt_streams_7x(&kse, streams, ways);
+}
+
+void __cdecl AesBotanCbcCipherFunction (unsigned char* key, unsigned char* input, unsigned long inputLen, unsigned char* output, int encrypt)
+{
+	CbcCipherFunction (key, input, inputLen, output, encrypt, 1);
+}
+
+void __cdecl AesBotanCbc7WayCipherFunction (unsigned char* key, unsigned char* input, unsigned long inputLen, unsigned char* output, int encrypt)
+{
+	CbcCipherFunction (key, input, inputLen, output, encrypt, 7);
+}
+
+#if CRYPTOPP_BOOL_X64
+void __cdecl AesBotanCbc15WayCipherFunction (unsigned char* key, unsigned char* input, unsigned long inputLen, unsigned char* output, int encrypt)
+{
+	CbcCipherFunction (key, input, inputLen, output, encrypt, 15);
+}
+#endif
+
+/* test cases 4, 10, 16 and 18 of "The Galois/Counter Mode of Operation (GCM)", then
+   150 bytes of AAD and 200 of data, computed with OpenSSL: GHASH goes through its
+   8-block loop, then whole blocks one at a time, then a partial block */
+#define GCM_TEST_COUNT 5
+GCM_TEST aes_gcm_test_vectors[GCM_TEST_COUNT] = {
+	{"FEFFE9928665731C6D6A8F9467308308", "CAFEBABEFACEDBADDECAF888", "FEEDFACEDEADBEEFFEEDFACEDEADBEEFABADDAD2",
+	 "D9313225F88406E5A55909C5AFF5269A86A7A9531534F7DA2E4C303D8A318A721C3C0C95956809532FCF0E2449A6B525B16AEDF5AA0DE657BA637B39",
+	 "42831EC2217774244B7221B784D0D49CE3AA212F2C02A4E035C17E2329ACA12E21D514B25466931C7D8F6A5AAC84AA051BA30B396A0AAC973D58E091",
+	 "5BC94FBC3221A5DB94FAE95AE7121A47"},
+	{"FEFFE9928665731C6D6A8F9467308308FEFFE9928665731C", "CAFEBABEFACEDBADDECAF888", "FEEDFACEDEADBEEFFEEDFACEDEADBEEFABADDAD2",
+	 "D9313225F88406E5A55909C5AFF5269A86A7A9531534F7DA2E4C303D8A318A721C3C0C95956809532FCF0E2449A6B525B16AEDF5AA0DE657BA637B39",
+	 "3980CA0B3C00E841EB06FAC4872A2757859E1CEAA6EFD984628593B40CA1E19C7D773D00C144C525AC619D18C84A3F4718E2448B2FE324D9CCDA2710",
+	 "2519498E80F1478F37BA55BD6D27618C"},
+	{"FEFFE9928665731C6D6A8F9467308308FEFFE9928665731C6D6A8F9467308308", "CAFEBABEFACEDBADDECAF888", "FEEDFACEDEADBEEFFEEDFACEDEADBEEFABADDAD2",
+	 "D9313225F88406E5A55909C5AFF5269A86A7A9531534F7DA2E4C303D8A318A721C3C0C95956809532FCF0E2449A6B525B16AEDF5AA0DE657BA637B39",
+	 "522DC1F099567D07F47F37A32A84427D643A8CDCBFE5C0C97598A2BD2555D1AA8CB08E48590DBB3DA7B08B1056828838C5F61E6393BA7A0ABCC9F662",
+	 "76FC6ECE0F4E1768CDDF8853BB2D551B"},
+	{"FEFFE9928665731C6D6A8F9467308308FEFFE9928665731C6D6A8F9467308308",
+	 "9313225DF88406E555909C5AFF5269AA6A7A9538534F7DA1E4C303D2A318A728C3C0C95156809539FCF0E2429A6B525416AEDBF5A0DE6A57A637B39B",
+	 "FEEDFACEDEADBEEFFEEDFACEDEADBEEFABADDAD2",
+	 "D9313225F88406E5A55909C5AFF5269A86A7A9531534F7DA2E4C303D8A318A721C3C0C95956809532FCF0E2449A6B525B16AEDF5AA0DE657BA637B39",
+	 "5A8DEF2F0C9E53F1F75D7853659E2A20EEB2B22AAFDE6419A058AB4F6F746BF40FC0C3B780F244452DA3EBF1C5D82CDEA2418997200EF82E44AE7E3F",
+	 "A44A8266EE1C8EB0C8B5D4CF5AE9F19A"},
+	{"A0A3A6A9ACAFB2B5B8BBBEC1C4C7CACDD0D3D6D9DCDFE2E5E8EBEEF1F4F7FAFD", "10151A1F24292E33383D4247",
+	 "01080F161D242B323940474E555C636A71787F868D949BA2A9B0B7BEC5CCD3DAE1E8EFF6FD040B121920272E353C434A"
+	 "51585F666D747B828990979EA5ACB3BAC1C8CFD6DDE4EBF2F900070E151C232A31383F464D545B626970777E858C939A"
+	 "A1A8AFB6BDC4CBD2D9E0E7EEF5FC030A11181F262D343B424950575E656C737A81888F969DA4ABB2B9C0C7CED5DCE3EA"
+	 "F1F8FF060D14",
+	 "05121F2C394653606D7A8794A1AEBBC8D5E2EFFC091623303D4A5764717E8B98A5B2BFCCD9E6F3000D1A2734414E5B68"
+	 "75828F9CA9B6C3D0DDEAF704111E2B3845525F6C798693A0ADBAC7D4E1EEFB0815222F3C495663707D8A97A4B1BECBD8"
+	 "E5F2FF0C192633404D5A6774818E9BA8B5C2CFDCE9F603101D2A3744515E6B7885929FACB9C6D3E0EDFA0714212E3B48"
+	 "55626F7C8996A3B0BDCAD7E4F1FE0B1825323F4C596673808D9AA7B4C1CEDBE8F5020F1C293643505D6A7784919EABB8"
+	 "C5D2DFECF9061320",
+	 "E2B8C7F4508215770CF6C79BC813D2B8DDEE40BCC67CC63D06F6CEFF363B30ECB3069A4070A0BAA4A08341AC1D548616"
+	 "7A5E671BEF0118EB016D0EB7DABBB025D535CE577BB501738822ADF4790A76685C4C7DEE6827C62856307B71FEB83E54"
+	 "FF1B8A21446BAF3373163C37289AFCB113B64028857AFF5175847A0686526D6E14E75881630A744094B27E03D1017B60"
+	 "6C72877864267C475FBC806527CDD926AA76FD2BEE5C53A3EA8955B0416F8C7AE1175B5E8B85B308370003591353A7DA"
+	 "90F000A1BB3DFCB0",
+	 "12F22F301D3B8627CF683AB88A719E34"}
+};
+
+/* record sizes reported for GCM */
+#define GCM_SIZE_COUNT 4
+static const uint_32t gcm_sizes[GCM_SIZE_COUNT] = {64, 1536, 16384, 1048576};
+static const char* gcm_size_names[GCM_SIZE_COUNT] = {"64B", "1.5KB", "16KB", "1MB"};
+
+/* IEEE 1619-2007 vectors 1, 2, 15 (ciphertext stealing) and 4 (512-byte data unit) */
+#define XTS_TEST_COUNT 4
+XTS_TEST aes_xts_test_vectors[XTS_TEST_COUNT] = {
+	{"00000000000000000000000000000000", "00000000000000000000000000000000", 0,
+	 "0000000000000000000000000000000000000000000000000000000000000000",
+	 "917CF69EBD68B2EC9B9FE9A3EADDA692CD43D2F59598ED858C02C2652FBF922E"},
+	{"11111111111111111111111111111111", "22222222222222222222222222222222", 0x3333333333,
+	 "4444444444444444444444444444444444444444444444444444444444444444",
+	 "C454185E6A16936E39334038ACEF838BFB186FFF7480ADC4289382ECD6D394F0"},
+	{"FFFEFDFCFBFAF9F8F7F6F5F4F3F2F1F0", "BFBEBDBCBBBAB9B8B7B6B5B4B3B2B1B0", 0x123456789A,
+	 "000102030405060708090A0B0C0D0E0F10",
+	 "6C1625DB4671522D3D7599601DE7CA09ED"},
+	{"27182818284590452353602874713526", "31415926535897932384626433832795", 0,
+	 "000102030405060708090A0B0C0D0E0F101112131415161718191A1B1C1D1E1F202122232425262728292A2B2C2D2E2F"
+	 "303132333435363738393A3B3C3D3E3F404142434445464748494A4B4C4D4E4F505152535455565758595A5B5C5D5E5F"
+	 "606162636465666768696A6B6C6D6E6F707172737475767778797A7B7C7D7E7F808182838485868788898A8B8C8D8E8F"
+	 "909192939495969798999A9B9C9D9E9FA0A1A2A3A4A5A6A7A8A9AAABACADAEAFB0B1B2B3B4B5B6B7B8B9BABBBCBDBEBF"
+	 "C0C1C2C3C4C5C6C7C8C9CACBCCCDCECFD0D1D2D3D4D5D6D7D8D9DADBDCDDDEDFE0E1E2E3E4E5E6E7E8E9EAEBECEDEEEF"
+	 "F0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF000102030405060708090A0B0C0D0E0F101112131415161718191A1B1C1D1E1F"
+	 "202122232425262728292A2B2C2D2E2F303132333435363738393A3B3C3D3E3F404142434445464748494A4B4C4D4E4F"
+	 "505152535455565758595A5B5C5D5E5F606162636465666768696A6B6C6D6E6F707172737475767778797A7B7C7D7E7F"
+	 "808182838485868788898A8B8C8D8E8F909192939495969798999A9B9C9D9E9FA0A1A2A3A4A5A6A7A8A9AAABACADAEAF"
+	 "B0B1B2B3B4B5B6B7B8B9BABBBCBDBEBFC0C1C2C3C4C5C6C7C8C9CACBCCCDCECFD0D1D2D3D4D5D6D7D8D9DADBDCDDDEDF"
+	 "E0E1E2E3E4E5E6E7E8E9EAEBECEDEEEFF0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF",
+	 "27A7479BEFA1D476489F308CD4CFA6E2A96E4BBE3208FF25287DD3819616E89CC78CF7F5E543445F8333D8FA7F560000"
+	 "05279FA5D8B5E4AD40E736DDB4D35412328063FD2AAB53E5EA1E0A9F332500A5DF9487D07A5C92CC512C8866C7E860CE"
+	 "93FDF166A24912B422976146AE20CE846BB7DC9BA94A767AAEF20C0D61AD02655EA92DC4C4E41A8952C651D33174BE51"
+	 "A10C421110E6D81588EDE82103A252D8A750E8768DEFFFED9122810AAEB99F9172AF82B604DC4B8E51BCB08235A6F434"
+	 "1332E4CA60482A4BA1A03B3E65008FC5DA76B70BF1690DB4EAE29C5F1BADD03C5CCF2A55D705DDCD86D449511CEB7EC3"
+	 "0BF12B1FA35B913F9F747A8AFD1B130E94BFF94EFFD01A91735CA1726ACD0B197C4E5B03393697E126826FB6BBDE8ECC"
+	 "1E08298516E2C9ED03FF3C1B7860F6DE76D4CECD94C8119855EF5297CA67E9F3E7FF72B1E99785CA0A7E7720C5B36DC6"
+	 "D72CAC9574C8CBBC2F801E23E56FD344B07F22154BEBA0F08CE8891E643ED995C94D9A69C9F1B5F499027A78572AEEBD"
+	 "74D20CC39881C213EE770B1010E4BEA718846977AE119F7A023AB58CCA0AD752AFE656BB3C17256A9F6E9BF19FDD5A38"
+	 "FC82BBE872C5539EDB609EF4F79C203EBB140F2E583CB2AD15B4AA5B655016A8449277DBD477EF2C8D6C017DB738B18D"
+	 "EB4A427D1923CE3FF262735779A418F20A282DF920147BEABE421EE5319D0568"}
+};
+
+/* job sizes reported for the multi-buffer manager */
+#define MB_SIZE_COUNT 3
+static const uint_32t mb_sizes[MB_SIZE_COUNT] = {64, 256, 1536};
+
+/* message sizes of the key-agility benchmark, one fresh key per message */
+#define AGILITY_SIZE_COUNT 7
+static const uint_32t agility_sizes[AGILITY_SIZE_COUNT] = {16, 64, 256, 1024, 4096, 16384, 65536};
+static const char* agility_size_names[AGILITY_SIZE_COUNT] = {"16B", "64B", "256B", "1KB", "4KB", "16KB", "64KB"};
+
+#define KC_BENCH_CAPACITY 4096
+#define KC_TENANT_COUNT 3
+static const uint_32t kc_tenants[KC_TENANT_COUNT] = {4096, 16384, 65536};
+
+/* data unit sizes reported for XTS */
+#define XTS_SIZE_COUNT 2
+static const uint_32t xts_sizes[XTS_SIZE_COUNT] = {512, 4096};
+
+int __cdecl main (int argc, char** argv)
+{
+	double p, ecb7 = 0, ecb15 = 0;
+	int i, j, k;
+	unsigned char* buffer;
+	PAGES_INFO pages;
+	char pagesStr[128];
+	DetectX86Features ();
+	aes_dispatch_init ();
+#if CRYPTOPP_BOOL_X64
+	printf("\n64-bit AES-NI Benchmark by Mounir IDRASSI (mounir@idrix.fr)\nVersion 2020-12-13\n\n");
+#else
+	printf("\n32-bit AES-NI Benchmark by Mounir IDRASSI (mounir@idrix.fr)\nVersion 2020-12-13\n\n");
+#endif
+
+	printf ("CPU has AES-NI extension: %s\n", g_hasAESNI? "YES" : "NO");
+	printf ("CPU has PCLMULQDQ extension: %s\n", g_hasCLMUL? "YES" : "NO");
+	printf ("CPU has VAES extension: %s\n", g_hasVAES? "YES" : "NO");
+	printf ("CPU has VPCLMULQDQ extension: %s\n", g_hasVPCLMULQDQ? "YES" : "NO");
+	printf ("CPU has AVX-512 extension: %s (VL: %s, BW: %s)\n", g_hasAVX512F? "YES" : "NO", g_hasAVX512VL? "YES" : "NO", g_hasAVX512BW? "YES" : "NO");
+	PrintCpuTopology ();
+	CalibrateTsc ();
+	printf ("TSC: %.3f GHz%s\n", g_tscFrequency / 1e9, HasInvariantTSC ()? "" : " (not reported invariant, cycles/byte may drift with the clock)");
+	if ((buffer = (unsigned char*) AllocatePages (TEST_BLOCK_LEN, PAGES_HUGE, &pages)) != NULL)
+	{
+		printf ("Benchmark buffers: %s\n", FormatPages (&pages, pagesStr));
+		FreePages (buffer, &pages);
+	}
+
+	printf("\n");
+
+	/* -autotune: time the kernels on this CPU and record the fastest in the profile loaded at startup */
+	if (g_hasAESNI && argc > 1 && !_stricmp (argv[1], "-autotune"))
+	{
+		LARGE_INTEGER tuneStart, tuneEnd, tuneFreq;
+
+		QueryPerformanceFrequency (&tuneFreq);
+		QueryPerformanceCounter (&tuneStart);
+		if (aes_dispatch_autotune (AES_DISPATCH_PROFILE_FILE) == EXIT_SUCCESS)
+		{
+			QueryPerformanceCounter (&tuneEnd);
+			printf ("Autotuned in %.0f ms, profile written to %s\n", 1000.0 * (tuneEnd.QuadPart - tuneStart.QuadPart) / (double) tuneFreq.QuadPart, AES_DISPATCH_PROFILE_FILE);
+		}
+		else
+			printf ("Autotuning failed, the profile could not be written to %s\n", AES_DISPATCH_PROFILE_FILE);
+	}
+	/* -sweep: only report the throughput of the kernels from 16 bytes to 1GB */
+	if (g_hasAESNI && argc > 1 && !_stricmp (argv[1], "-sweep"))
+	{
+		RunSweepReport ();
+		return 0;
+	}
+
+	/* -threads [n]: only report how the throughput scales from 1 to n threads */
+	if (g_hasAESNI && argc > 1 && !_stricmp (argv[1], "-threads"))
+	{
+		RunScalingReport ((argc > 2)? (uint_32t) strtoul (argv[2], NULL, 10) : 0);
+		return 0;
+	}
+
+	/* -parallel: only compare the parallel engine with one thread */
+	if (g_hasAESNI && argc > 1 && !_stricmp (argv[1], "-parallel"))
+	{
+		RunParallelReport ();
+		return 0;
+	}
+
+	/* -numa: only report the cost of memory on another node */
+	if (g_hasAESNI && argc > 1 && !_stricmp (argv[1], "-numa"))
+	{
+		RunNumaReport ();
+		return 0;
+	}
+
+	/* -pages: only compare buffers on huge pages with buffers on 4KB pages */
+	if (g_hasAESNI && argc > 1 && !_stricmp (argv[1], "-pages"))
+	{
+		RunPagesReport ();
+		return 0;
+	}
+
+	/* -outofplace: only compare plain and streaming stores from one buffer to another */
+	if (g_hasAESNI && argc > 1 && !_stricmp (argv[1], "-outofplace"))
+	{
+		RunOutOfPlaceReport ();
+		return 0;
+	}
+
+	/* -latency: only report the cycles per call of the kernels */
+	if (g_hasAESNI && argc > 1 && !_stricmp (argv[1], "-latency"))
+	{
+		RunLatencyReport ();
+		return 0;
+	}
+	if (g_hasAESNI && !strcmp (aes_dispatch_kernel_name (), "autotuned"))
+	{
+		PrintDispatchProfile ();
+		printf("\n");
+	}
+	
+	if (g_hasAESNI)
+	{
+		for (k = 0; k < KEY_SIZE_COUNT; k++)
+		{
+			g_keySize = key_sizes[k].keySize;
+			printf("AES-%d\n", g_keySize * 8);
+
+			printf("AES-NI 4-way: ");
+			if (RunCipherTest (AesBotanAESNI4WayCipherFunction, key_sizes[k].vectors, key_sizes[k].count))
+			{
+				printf ("ok (");
+				p = RunCipherBenchmark (AesBotanAESNI4WayCipherFunction, 1, 1);
+				printf("Enc = %.2f MB/s, %.2f c/B, ", p, CyclesPerByte (p));
+				p = RunCipherBenchmark (AesBotanAESNI4WayCipherFunction, 0, 1);
+				printf("Dec = %.2f MB/s, %.2f c/B)\n", p, CyclesPerByte (p));
+			}
+			else
+				printf("error\n");
+
+			printf("AES-NI 7-way: ");
+			if (RunCipherTest (AesBotanAESNI7WayCipherFunction, key_sizes[k].vectors, key_sizes[k].count))
+			{
+				printf ("ok (");
+				p = ecb7 = RunCipherBenchmark (AesBotanAESNI7WayCipherFunction, 1, 1);
+				printf("Enc = %.2f MB/s, %.2f c/B, ", p, CyclesPerByte (p));
+				p = RunCipherBenchmark (AesBotanAESNI7WayCipherFunction, 0, 1);
+				printf("Dec = %.2f MB/s, %.2f c/B)\n", p, CyclesPerByte (p));
+			}
+			else
+				printf("error\n");
+
+#if CRYPTOPP_BOOL_X64
+			printf("AES-NI 15-way: ");
+			if (RunCipherTest (AesBotanAESNI15WayCipherFunction, key_sizes[k].vectors, key_sizes[k].count))
+			{
+				printf ("ok (");
+				p = ecb15 = RunCipherBenchmark (AesBotanAESNI15WayCipherFunction, 1, 1);
+				printf("Enc = %.2f MB/s, %.2f c/B, ", p, CyclesPerByte (p));
+				p = RunCipherBenchmark (AesBotanAESNI15WayCipherFunction, 0, 1);
+				printf("Dec = %.2f MB/s, %.2f c/B)\n", p, CyclesPerByte (p));
+			}
+			else
+				printf("error\n");
+#endif
+
+			/* benchmarked by -outofplace, over buffers larger than the caches */
+			printf("AES-NI streaming stores: %s\n", RunEcbLengthTest (AesBotanStreamingCipherFunction)? "ok" : "error");
+
+			printf("AES-NI size-adaptive: ");
+			if (RunCipherTest (AesBotanSizedCipherFunction, key_sizes[k].vectors, key_sizes[k].count))
+			{
+				printf ("ok (");
+				p = RunCipherBenchmark (AesBotanSizedCipherFunction, 1, 1);
+				printf("Enc = %.2f MB/s, %.2f c/B, ", p, CyclesPerByte (p));
+				p = RunCipherBenchmark (AesBotanSizedCipherFunction, 0, 1);
+				printf("Dec = %.2f MB/s, %.2f c/B)\n", p, CyclesPerByte (p));
+			}
+			else
+				printf("error\n");
+
+#if CRYPTOPP_BOOL_X64 && CRYPTOPP_BOOL_VAES_INTRINSICS_AVAILABLE
+			if (g_hasVAES)
+			{
+				printf("VAES 16-way: ");
+				if (RunCipherTest (AesBotanVAES16WayCipherFunction, key_sizes[k].vectors, key_sizes[k].count))
+				{
+					printf ("ok (");
+					p = RunCipherBenchmark (AesBotanVAES16WayCipherFunction, 1, 1);
+					printf("Enc = %.2f MB/s, %.2f c/B, ", p, CyclesPerByte (p));
+					p = RunCipherBenchmark (AesBotanVAES16WayCipherFunction, 0, 1);
+					printf("Dec = %.2f MB/s, %.2f c/B)\n", p, CyclesPerByte (p));
+				}
+				else
+					printf("error\n");
+				printf("VAES 16-way streaming stores: %s\n", RunEcbLengthTest (AesBotanVAES16WayStreamingCipherFunction)? "ok" : "error");
+
+				printf("VAES 32-way: ");
+				if (RunCipherTest (AesBotanVAES32WayCipherFunction, key_sizes[k].vectors, key_sizes[k].count))
+				{
+					printf ("ok (");
+					p = RunCipherBenchmark (AesBotanVAES32WayCipherFunction, 1, 1);
+					printf("Enc = %.2f MB/s, %.2f c/B, ", p, CyclesPerByte (p));
+					p = RunCipherBenchmark (AesBotanVAES32WayCipherFunction, 0, 1);
+					printf("Dec = %.2f MB/s, %.2f c/B)\n", p, CyclesPerByte (p));
+				}
+				else
+					printf("error\n");
+				printf("VAES 32-way streaming stores: %s\n", RunEcbLengthTest (AesBotanVAES32WayStreamingCipherFunction)? "ok" : "error");
+
+				if (g_hasAVX512F)
+				{
+					printf("VAES-512 64-way: ");
+					if (RunCipherTest (AesBotanVAES512CipherFunction, key_sizes[k].vectors, key_sizes[k].count))
+					{
+						printf ("ok (");
+						p = RunCipherBenchmark (AesBotanVAES512CipherFunction, 1, 1);
+						printf("Enc = %.2f MB/s, %.2f c/B, ", p, CyclesPerByte (p));
+						p = RunCipherBenchmark (AesBotanVAES512CipherFunction, 0, 1);
+						printf("Dec = %.2f MB/s, %.2f c/B)\n", p, CyclesPerByte (p));
+					}
+					else
+						printf("error\n");
+					printf("VAES-512 streaming stores: %s\n", RunEcbLengthTest (AesBotanVAES512StreamingCipherFunction)? "ok" : "error");
+				}
+			}
+#endif
+
+			printf("Dispatched (%s): ", aes_dispatch_kernel_name ());
+			if (RunCipherTest (AesDispatchCipherFunction, key_sizes[k].vectors, key_sizes[k].count))
+			{
+				printf ("ok (");
+				p = RunCipherBenchmark (AesDispatchCipherFunction, 1, 1);
+				printf("Enc = %.2f MB/s, %.2f c/B, ", p, CyclesPerByte (p));
+				p = RunCipherBenchmark (AesDispatchCipherFunction, 0, 1);
+				printf("Dec = %.2f MB/s, %.2f c/B)\n", p, CyclesPerByte (p));
+			}
+			else
+				printf("error\n");
+
+			/* CTR encryption and decryption are the same operation */
+			printf("CTR 7-way: ");
+			if (RunCtrTest (aes_botan_aesni_ctr_crypt_7x, key_sizes[k].ctrVector))
+			{
+				p = RunCipherBenchmark (AesBotanCtr7WayCipherFunction, 1, 1);
+				printf("ok (Enc/Dec = %.2f MB/s, %.2f c/B, %.1f%% of ECB 7-way)\n", p, CyclesPerByte (p), ecb7 > 0? 100.0 * p / ecb7 : 0.0);
+			}
+			else
+				printf("error\n");
+
+#if CRYPTOPP_BOOL_X64
+			printf("CTR 15-way: ");
+			if (RunCtrTest (aes_botan_aesni_ctr_crypt_15x, key_sizes[k].ctrVector))
+			{
+				p = RunCipherBenchmark (AesBotanCtr15WayCipherFunction, 1, 1);
+				printf("ok (Enc/Dec = %.2f MB/s, %.2f c/B, %.1f%% of ECB 15-way)\n", p, CyclesPerByte (p), ecb15 > 0? 100.0 * p / ecb15 : 0.0);
+			}
+			else
+				printf("error\n");
+#endif
+
+			/* a single CBC stream cannot be interleaved, several streams can */
+			printf("CBC 1 stream: ");
+			p = RunCipherBenchmark (AesBotanCbcCipherFunction, 1, 1);
+			printf("Enc = %.2f MB/s, %.2f c/B\n", p, CyclesPerByte (p));
+
+			printf("CBC 7-way: ");
+			if (RunCbcTest (aes_botan_aesni_cbc_decrypt_7x, aes_botan_aesni_cbc_encrypt_streams_7x, key_sizes[k].cbcVector))
+			{
+				printf ("ok (");
+				p = RunCipherBenchmark (AesBotanCbc7WayCipherFunction, 1, 1);
+				printf("Enc 7 streams = %.2f MB/s, %.2f c/B, ", p, CyclesPerByte (p));
+				p = RunCipherBenchmark (AesBotanCbc7WayCipherFunction, 0, 1);
+				printf("Dec = %.2f MB/s, %.2f c/B)\n", p, CyclesPerByte (p));
+			}
+			else
+				printf("error\n");
+
+#if CRYPTOPP_BOOL_X64
+			printf("CBC 15-way: ");
+			if (RunCbcTest (aes_botan_aesni_cbc_decrypt_15x, aes_botan_aesni_cbc_encrypt_streams_15x, key_sizes[k].cbcVector))
+			{
+				printf ("ok (");
+				p = RunCipherBenchmark (AesBotanCbc15WayCipherFunction, 1, 1);
+				printf("Enc 15 streams = %.2f MB/s, %.2f c/B, ", p, CyclesPerByte (p));
+				p = RunCipherBenchmark (AesBotanCbc15WayCipherFunction, 0, 1);
+				printf("Dec = %.2f MB/s, %.2f c/B)\n", p, CyclesPerByte (p));
+			}
+			else
+				printf("error\n");
+#endif
+			printf("\n");
+		}
+
+		/* the generated kernels, from 1 to AES_BOTAN_MAX_WAYS blocks in flight */
+		for (k = 0; k < KEY_SIZE_COUNT; k++)
+		{
+			uint_32t bestEnc = 0, bestDec = 0;
+			double bestEncRate = 0, bestDecRate = 0;
+
+			g_keySize = key_sizes[k].keySize;
+			printf("AES-%d width sweep:\n", g_keySize * 8);
+			for (g_ways = 1; g_ways <= AES_BOTAN_MAX_WAYS; g_ways++)
+			{
+				printf("%2u-way: ", g_ways);
+				if (RunCipherTest (AesBotanWidthCipherFunction, key_sizes[k].vectors, key_sizes[k].count))
+				{
+					p = RunWidthBenchmark (g_ways, 1);
+					printf("ok (Enc = %.2f MB/s, %.2f c/B, ", p, CyclesPerByte (p));
+					if (p > bestEncRate)
+					{
+						bestEncRate = p;
+						bestEnc = g_ways;
+					}
+					p = RunWidthBenchmark (g_ways, 0);
+					printf("Dec = %.2f MB/s, %.2f c/B)\n", p, CyclesPerByte (p));
+					if (p > bestDecRate)
+					{
+						bestDecRate = p;
+						bestDec = g_ways;
+					}
+				}
+				else
+					printf("error\n");
+			}
+			printf("Best width: Enc = %u-way (%.2f MB/s), Dec = %u-way (%.2f MB/s)\n\n", bestEnc, bestEncRate, bestDec, bestDecRate);
+		}
+
+		/* requests under 256 bytes: the size-adaptive path against the fixed interleaves.
+		   Decryption goes through the same code around the rounds, so is not repeated */
+		g_keySize = 32;
+		printf("AES-256 small requests, ns per encryption (%s | 4-way | size-adaptive):\n", small_wide_name);
+		for (i = 0; i < SMALL_SIZE_COUNT; i++)
+		{
+			double wide, sized;
+
+			if (small_sizes[i])
+				printf("%2u blocks: ", small_sizes[i]);
+			else
+				printf("    mixed: ");
+			for (j = 1; j >= 0; j--)
+			{
+				wide = RunSmallRequestBenchmark (SMALL_WIDE_ENC, small_sizes[i], j);
+				p = RunSmallRequestBenchmark (aes_botan_aesni_encrypt_4x, small_sizes[i], j);
+				sized = RunSmallRequestBenchmark (aes_botan_aesni_encrypt_sized, small_sizes[i], j);
+				printf("%s %.1f | %.1f | %.1f (%.2fx)%s", j? "latency" : "independent", wide, p, sized, wide / sized, j? ", " : "\n");
+			}
+		}
+		printf("\n");
+
+		if (g_hasCLMUL)
+		{
+			printf("AES-GCM: ");
+			if (RunGcmTest (aes_gcm_test_vectors, GCM_TEST_COUNT))
+			{
+				printf ("ok\n");
+				for (i = 0; i < GCM_SIZE_COUNT; i++)
+				{
+					printf ("AES-256-GCM %s: ", gcm_size_names[i]);
+					p = RunGcmBenchmark (gcm_sizes[i], 1, 1);
+					printf("Seal = %.2f MB/s, %.2f c/B ", p, CyclesPerByte (p));
+					p = RunGcmBenchmark (gcm_sizes[i], 1, 0);
+					printf("(2-pass %.2f MB/s, %.2f c/B), ", p, CyclesPerByte (p));
+					p = RunGcmBenchmark (gcm_sizes[i], 0, 1);
+					printf("Open = %.2f MB/s, %.2f c/B ", p, CyclesPerByte (p));
+					p = RunGcmBenchmark (gcm_sizes[i], 0, 0);
+					printf("(2-pass %.2f MB/s, %.2f c/B)\n", p, CyclesPerByte (p));
+				}
+			}
+			else
+				printf("error\n");
+		}
+		else
+			printf ("CPU doesn't have PCLMULQDQ: AES-GCM skipped\n");
+
+		printf("\nMulti-buffer %d lanes: ", AES_MB_MAX_LANES);
+		if (RunMbTest (AES_MB_MAX_LANES))
+		{
+			printf ("ok\n");
+			g_keySize = 32;
+			for (i = 0; i < MB_SIZE_COUNT; i++)
+			{
+				printf ("AES-256 %u-byte jobs, %d keys: ", mb_sizes[i], MB_BENCH_KEYS);
+#if CRYPTOPP_BOOL_X64
+				p = RunMbBenchmark (AesBotanAESNI15WayCipherFunction, AES_MB_MAX_LANES, mb_sizes[i], 0);
+				printf("MB = %.2f MB/s, %.2f c/B, ", p, CyclesPerByte (p));
+				p = RunMbBenchmark (AesBotanAESNI15WayCipherFunction, AES_MB_MAX_LANES, mb_sizes[i], 1);
+				printf("one by one = %.2f MB/s, %.2f c/B, ", p, CyclesPerByte (p));
+				p = RunMbBenchmark (AesBotanAESNI15WayCipherFunction, AES_MB_MAX_LANES, mb_sizes[i], 2);
+#else
+				p = RunMbBenchmark (AesBotanAESNI7WayCipherFunction, AES_MB_MAX_LANES, mb_sizes[i], 0);
+				printf("MB = %.2f MB/s, %.2f c/B, ", p, CyclesPerByte (p));
+				p = RunMbBenchmark (AesBotanAESNI7WayCipherFunction, AES_MB_MAX_LANES, mb_sizes[i], 1);
+				printf("one by one = %.2f MB/s, %.2f c/B, ", p, CyclesPerByte (p));
+				p = RunMbBenchmark (AesBotanAESNI7WayCipherFunction, AES_MB_MAX_LANES, mb_sizes[i], 2);
+#endif
+				printf("CipherFunction = %.2f MB/s, %.2f c/B\n", p, CyclesPerByte (p));
+			}
+		}
+		else
+			printf("error\n");
+
+		printf("\nBatched key schedules: ");
+		if (RunKeySetupTest ())
+		{
+			printf ("ok\n");
+			for (i = 16; i <= 32; i += 16)
+			{
+				printf ("AES-%d: ", i * 8);
+				p = RunKeySetupBenchmark (NULL, i);
+				printf("enc+dec one by one = %.2f Mkeys/s, ", p / 1e6);
+				p = RunKeySetupBenchmark (aes_botan_aesni_set_encrypt_keys_1x, i);
+				printf("enc one by one = %.2f Mkeys/s, ", p / 1e6);
+				p = RunKeySetupBenchmark (aes_botan_aesni_set_encrypt_keys_4x, i);
+				printf("4 at a time = %.2f Mkeys/s", p / 1e6);
+#if CRYPTOPP_BOOL_X64 && CRYPTOPP_BOOL_VAES_INTRINSICS_AVAILABLE
+				if (HasVAES () && HasAVX512F ())
+				{
+					p = RunKeySetupBenchmark (aes_botan_aesni_set_encrypt_keys, i);
+					printf(", VAES-512 16 at a time = %.2f Mkeys/s", p / 1e6);
+				}
+#endif
+				printf("\n");
+			}
+		}
+		else
+			printf("error\n");
+
+		printf("\nKey agility:\n");
+		for (i = 16; i <= 32; i += 16)
+		{
+			double setupTime[2], rate[2];
+
+			setupTime[0] = RunKeySetupTime (i, 0);
+			setupTime[1] = RunKeySetupTime (i, 1);
+			p = RunKeySetupTime (i, 2);
+			printf ("AES-%d key schedule: enc = %.1f ns, dec = %.1f ns, enc+dec = %.1f ns\n", i * 8, setupTime[0], setupTime[1], p);
+			for (j = 0; j < AGILITY_SIZE_COUNT; j++)
+			{
+				printf ("AES-%d %s messages: ", i * 8, agility_size_names[j]);
+				rate[0] = RunKeyAgilityBenchmark (agility_sizes[j], i, 1, 0);
+				printf("Enc = %.2f MB/s, %.2f c/B, ", rate[0], CyclesPerByte (rate[0]));
+				p = RunKeyAgilityBenchmark (agility_sizes[j], i, 1, 1);
+				printf("fresh key = %.2f MB/s, %.2f c/B, ", p, CyclesPerByte (p));
+				rate[1] = RunKeyAgilityBenchmark (agility_sizes[j], i, 0, 0);
+				printf("Dec = %.2f MB/s, %.2f c/B, ", rate[1], CyclesPerByte (rate[1]));
+				p = RunKeyAgilityBenchmark (agility_sizes[j], i, 0, 1);
+				printf("fresh key = %.2f MB/s, %.2f c/B\n", p, CyclesPerByte (p));
+			}
+			/* message size whose processing, at the 64KB rate, takes as long as the key
+			   schedule: from 10 times this size, a fresh key costs under 10% of the throughput */
+			printf ("AES-%d break-even size: enc = %.0f bytes, dec = %.0f bytes\n", i * 8,
+				setupTime[0] * 1e-9 * rate[0] * 1024.0 * 1024.0, setupTime[1] * 1e-9 * rate[1] * 1024.0 * 1024.0);
+		}
+
+		printf("\nKey cache: ");
+		if (RunKeyCacheTest () && RunKeyCacheThreadTest ())
+		{
+			printf ("ok\n");
+			p = RunKeyCacheBenchmark (KC_BENCH_CAPACITY, KC_BENCH_CAPACITY, 0, 1, NULL);
+			printf ("AES-256 set_key + %d-byte encryption = %.1f ns\n", KC_BENCH_MSG_LEN, p);
+			for (i = 0; i < KC_TENANT_COUNT; i++)
+			{
+				for (k = 0; k < 2; k++)
+				{
+					double hitRate;
+
+					p = RunKeyCacheBenchmark (KC_BENCH_CAPACITY, kc_tenants[i], k, 0, &hitRate);
+					printf ("%d entries, %u tenants%s: hit rate = %.2f%%, lookup + %d-byte encryption = %.1f ns\n",
+						KC_BENCH_CAPACITY, kc_tenants[i], k? " (80/20)" : "", 100.0 * hitRate, KC_BENCH_MSG_LEN, p);
+				}
+			}
 		}
 		else
 			printf("error\n");
 
-		printf("AES-NI 7-way: ");
-		if (RunCipherTest (AesBotanAESNI7WayCipherFunction, aes_test_vectors, AES_TEST_COUNT))
+		printf("\nAES-XTS 7-way: ");
+		if (RunXtsTest (aes_botan_aesni_xts_encrypt_7x, aes_botan_aesni_xts_decrypt_7x, aes_xts_test_vectors, XTS_TEST_COUNT))
 		{
-			printf ("ok (");
-			p = RunCipherBenchmark (AesBotanAESNI7WayCipherFunction, 1, 1);
-			printf("Enc = %.2f MB/s, ", p);
-			p = RunCipherBenchmark (AesBotanAESNI7WayCipherFunction, 0, 1);
-			printf("Dec = %.2f MB/s)\n",p);
+			printf ("ok\n");
+			for (i = 0; i < XTS_SIZE_COUNT; i++)
+			{
+				printf ("AES-256-XTS 7-way %u-byte sectors: ", xts_sizes[i]);
+				p = RunXtsBenchmark (aes_botan_aesni_xts_encrypt_7x, xts_sizes[i]);
+				printf("Enc = %.0f sectors/s (%.2f MB/s, %.2f c/B), ", p, p * xts_sizes[i] / (1024.0 * 1024.0), CyclesPerByte (p * xts_sizes[i] / (1024.0 * 1024.0)));
+				p = RunXtsBenchmark (aes_botan_aesni_xts_decrypt_7x, xts_sizes[i]);
+				printf("Dec = %.0f sectors/s (%.2f MB/s, %.2f c/B)\n", p, p * xts_sizes[i] / (1024.0 * 1024.0), CyclesPerByte (p * xts_sizes[i] / (1024.0 * 1024.0)));
+			}
 		}
 		else
 			printf("error\n");
 
 #if CRYPTOPP_BOOL_X64
-		printf("AES-NI 15-way: ");
-		if (RunCipherTest (AesBotanAESNI15WayCipherFunction, aes_test_vectors, AES_TEST_COUNT))
+		printf("AES-XTS 15-way: ");
+		if (RunXtsTest (aes_botan_aesni_xts_encrypt_15x, aes_botan_aesni_xts_decrypt_15x, aes_xts_test_vectors, XTS_TEST_COUNT))
 		{
-			printf ("ok (");
-			p = RunCipherBenchmark (AesBotanAESNI15WayCipherFunction, 1, 1);
-			printf("Enc = %.2f MB/s, ", p);
-			p = RunCipherBenchmark (AesBotanAESNI15WayCipherFunction, 0, 1);
-			printf("Dec = %.2f MB/s)\n", p);
+			printf ("ok\n");
+			for (i = 0; i < XTS_SIZE_COUNT; i++)
+			{
+				printf ("AES-256-XTS 15-way %u-byte sectors: ", xts_sizes[i]);
+				p = RunXtsBenchmark (aes_botan_aesni_xts_encrypt_15x, xts_sizes[i]);
+				printf("Enc = %.0f sectors/s (%.2f MB/s, %.2f c/B), ", p, p * xts_sizes[i] / (1024.0 * 1024.0), CyclesPerByte (p * xts_sizes[i] / (1024.0 * 1024.0)));
+				p = RunXtsBenchmark (aes_botan_aesni_xts_decrypt_15x, xts_sizes[i]);
+				printf("Dec = %.0f sectors/s (%.2f MB/s, %.2f c/B)\n", p, p * xts_sizes[i] / (1024.0 * 1024.0), CyclesPerByte (p * xts_sizes[i] / (1024.0 * 1024.0)));
+			}
 		}
 		else
 			printf("error\n");
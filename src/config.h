@@ -117,6 +117,22 @@
     #define CRYPTOPP_BOOL_AESNI_INTRINSICS_AVAILABLE 0
 #endif
 
+// VAES (and the AVX2 intrinsics it builds on) appeared in VS2019, GCC 8 and Clang 6.
+#if !defined(CRYPTOPP_DISABLE_VAES) && !defined(TC_WINDOWS_DRIVER) && !defined(_UEFI) && CRYPTOPP_BOOL_AESNI_INTRINSICS_AVAILABLE && (_MSC_VER >= 1920 || CRYPTOPP_GCC_VERSION >= 80000 || CRYPTOPP_CLANG_VERSION >= 60000 || CRYPTOPP_APPLE_CLANG_VERSION >= 100000 || defined(__VAES__))
+    #define CRYPTOPP_BOOL_VAES_INTRINSICS_AVAILABLE 1
+#else
+    #define CRYPTOPP_BOOL_VAES_INTRINSICS_AVAILABLE 0
+#endif
+
+// GCC and Clang only accept ISA extension intrinsics inside functions whose target
+// enables them, which lets a single binary carry kernels selected at runtime.
+// MSVC accepts all intrinsics everywhere.
+#if defined(__GNUC__) || defined(__clang__)
+	#define CRYPTOPP_TARGET(x) __attribute__((target(x)))
+#else
+	#define CRYPTOPP_TARGET(x)
+#endif
+
 #if CRYPTOPP_BOOL_SSE2_INTRINSICS_AVAILABLE || CRYPTOPP_BOOL_SSE2_ASM_AVAILABLE || defined(CRYPTOPP_X64_MASM_AVAILABLE)
     #define CRYPTOPP_BOOL_ALIGN16 1
 #else
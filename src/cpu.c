@@ -3,6 +3,9 @@
 #include "cpu.h"
 #include "misc.h"
 
+#include <stdio.h>
+#include <stdlib.h>
+
 #ifndef EXCEPTION_EXECUTE_HANDLER
 #define EXCEPTION_EXECUTE_HANDLER 1
 #endif
@@ -12,20 +15,28 @@
 #include <setjmp.h>
 #endif
 
+#ifndef _WIN32
+#include <strings.h>
+#define _stricmp strcasecmp
+#endif
+
 #ifdef CRYPTOPP_CPUID_AVAILABLE
 
 #if _MSC_VER >= 1600
 
-int CpuId(uint32 func, uint32 output[4])
+int CpuIdEx(uint32 func, uint32 subfunc, uint32 output[4])
 {
-	__cpuidex((int *)output, func, 0);
+	__cpuidex((int *)output, func, subfunc);
 	return 1;
 }
 
 #elif _MSC_VER >= 1400 && CRYPTOPP_BOOL_X64
 
-int CpuId(uint32 input, uint32 output[4])
+int CpuIdEx(uint32 input, uint32 subfunc, uint32 output[4])
 {
+	// no __cpuidex before VS2008 SP1
+	if (subfunc)
+		return 0;
 	__cpuid((int *)output, input);
 	return 1;
 }
@@ -69,7 +80,7 @@ static void SigIllHandlerSSE2(int p)
 #endif
 #endif
 
-int CpuId(uint32 input, uint32 output[4])
+int CpuIdEx(uint32 input, uint32 subfunc, uint32 output[4])
 {
 #ifdef CRYPTOPP_MS_STYLE_INLINE_ASSEMBLY
 #ifndef _UEFI
@@ -79,7 +90,7 @@ int CpuId(uint32 input, uint32 output[4])
 		__asm
 		{
 			mov eax, input
-            mov ecx, 0
+            mov ecx, subfunc
 			cpuid
 			mov edi, output
 			mov [edi], eax
@@ -124,7 +135,7 @@ int CpuId(uint32 input, uint32 output[4])
             "push %%ebx; cpuid; mov %%ebx, %%edi; pop %%ebx"
 #endif
             : "=a" (output[0]), "=D" (output[1]), "=c" (output[2]), "=d" (output[3])
-            : "a" (input), "c" (0)
+            : "a" (input), "c" (subfunc)
          );
 	}
 
@@ -135,6 +146,11 @@ int CpuId(uint32 input, uint32 output[4])
 
 #endif
 
+int CpuId(uint32 input, uint32 output[4])
+{
+	return CpuIdEx(input, 0, output);
+}
+
 static int TrySSE2()
 {
 #if CRYPTOPP_BOOL_X64
@@ -200,8 +216,11 @@ int g_x86DetectionDone = 0;
 int g_hasISSE = 0, g_hasSSE2 = 0, g_hasSSSE3 = 0, g_hasMMX = 0, g_hasAESNI = 0, g_hasCLMUL = 0, g_isP4 = 0;
 int g_hasAVX = 0, g_hasAVX2 = 0, g_hasBMI2 = 0, g_hasSSE42 = 0, g_hasSSE41 = 0, g_isIntel = 0, g_isAMD = 0;
 int g_hasSHA = 0;
+int g_hasVAES = 0, g_hasVPCLMULQDQ = 0, g_hasAVX512F = 0, g_hasAVX512VL = 0, g_hasAVX512BW = 0;
 int g_hasRDRAND = 0, g_hasRDSEED = 0;
+int g_hasRDTSCP = 0, g_hasInvariantTSC = 0;
 uint32 g_cacheLineSize = CRYPTOPP_L1_CACHE_LINE_SIZE;
+uint32 g_l1dCacheSize = 0, g_l2CacheSize = 0, g_l3CacheSize = 0;
 
 VC_INLINE int IsIntel(const uint32 output[4])
 {
@@ -300,11 +319,119 @@ static int Detect_MS_HyperV_AES ()
 
 #endif
 
+static CPU_TOPOLOGY g_cpuTopology;
+static int g_cpuTopologyDone = 0;
+
+// adds a cache, or replaces the one of the same level and type
+static CPU_CACHE_INFO* AddCache(uint32 level, uint32 type, uint32 size, uint32 lineSize, uint32 ways, uint32 sharedBy)
+{
+	CPU_CACHE_INFO* cache = NULL;
+	uint32 i;
+
+	for (i = 0; i < g_cpuTopology.cacheCount && !cache; i++)
+	{
+		if (g_cpuTopology.caches[i].level == level && g_cpuTopology.caches[i].type == type)
+			cache = &g_cpuTopology.caches[i];
+	}
+	if (!cache)
+	{
+		if (g_cpuTopology.cacheCount == CPU_MAX_CACHES)
+			return NULL;
+		cache = &g_cpuTopology.caches[g_cpuTopology.cacheCount++];
+	}
+
+	cache->level = level;
+	cache->type = type;
+	cache->size = size;
+	cache->lineSize = lineSize;
+	cache->ways = ways;
+	cache->sharedBy = sharedBy;
+	return cache;
+}
+
+// the deterministic cache parameters of leaf 4 (Intel) or 0x8000001D (AMD), one sub-leaf per cache
+static void DetectCaches(uint32 leaf)
+{
+	uint32 cpuid[4], i;
+
+	for (i = 0; i < 16 && CpuIdEx(leaf, i, cpuid); i++)
+	{
+		const uint32 type = cpuid[0] & 0x1f;
+		const uint32 ways = ((cpuid[1] >> 22) & 0x3ff) + 1, partitions = ((cpuid[1] >> 12) & 0x3ff) + 1;
+		const uint32 lineSize = (cpuid[1] & 0xfff) + 1, sets = cpuid[2] + 1;
+
+		if (type == 0)
+			break;
+		// the sharing count is the number of APIC IDs reserved, an upper bound
+		AddCache((cpuid[0] >> 5) & 7, type, ways * partitions * lineSize * sets, lineSize, ways, ((cpuid[0] >> 14) & 0xfff) + 1);
+	}
+}
+
+// threads per core and logical processors per package from the x2APIC topology
+// leaves 0x1F or 0xB, or from the legacy counts of leaves 1, 4 and 0x8000001E
+static void DetectCpuidTopology(uint32 maxLeaf, uint32 maxExtendedLeaf, int hasTopologyExtensions, const uint32 cpuid1[4])
+{
+	static const uint32 leaves[2] = {0x1F, 0xB};
+	uint32 cpuid[4], i, l, threads = 0, logical = 0;
+
+	for (l = 0; l < 2 && !logical; l++)
+	{
+		for (i = 0; maxLeaf >= leaves[l] && i < 8 && CpuIdEx(leaves[l], i, cpuid); i++)
+		{
+			const uint32 levelType = (cpuid[2] >> 8) & 0xff;
+
+			if (levelType == 0 || (cpuid[1] & 0xffff) == 0)
+				break;
+			if (levelType == 1)
+				threads = cpuid[1] & 0xffff;
+			// the last level counts the logical processors of the package
+			logical = cpuid[1] & 0xffff;
+		}
+	}
+
+	if (!logical)
+		logical = (cpuid1[3] & (1 << 28))? GETBYTE(cpuid1[1], 2) : 1;
+	if (!threads)
+	{
+		if (g_isAMD && hasTopologyExtensions && maxExtendedLeaf >= 0x8000001E && CpuId(0x8000001E, cpuid))
+			threads = GETBYTE(cpuid[1], 1) + 1;
+		else if (g_isIntel && maxLeaf >= 4 && CpuIdEx(4, 0, cpuid))
+			threads = logical / ((cpuid[0] >> 26) + 1);
+	}
+
+	g_cpuTopology.logicalPerPackage = logical? logical : 1;
+	g_cpuTopology.threadsPerCore = threads? threads : 1;
+}
+
+// g_l1dCacheSize, g_l2CacheSize and g_l3CacheSize from the data and unified caches
+static void SetCacheSizes()
+{
+	uint32 i;
+
+	for (i = 0; i < g_cpuTopology.cacheCount; i++)
+	{
+		const CPU_CACHE_INFO* cache = &g_cpuTopology.caches[i];
+
+		if (cache->type == CPU_CACHE_INSTRUCTION)
+			continue;
+		if (cache->level == 1)
+			g_l1dCacheSize = cache->size;
+		else if (cache->level == 2)
+			g_l2CacheSize = cache->size;
+		else if (cache->level == 3)
+			g_l3CacheSize = cache->size;
+	}
+}
+
 void DetectX86Features()
 {
 	uint32 cpuid[4] = {0}, cpuid1[4] = {0}, cpuid2[4] = {0};
+	uint32 maxLeaf = 0, maxExtendedLeaf = 0;
+	int hasTopologyExtensions = 0;
+	uint64 xcrFeatureMask = 0;
 	if (!CpuId(0, cpuid))
 		return;
+	maxLeaf = cpuid[0];
 	if (!CpuId(1, cpuid1))
 		return;
 
@@ -316,11 +443,9 @@ void DetectX86Features()
 		g_hasSSE2 = (cpuid1[2] & (1 << 27)) || TrySSE2();
 	if (g_hasSSE2 && (cpuid1[2] & (1 << 28)) && (cpuid1[2] & (1 << 27)) && (cpuid1[2] & (1 << 26))) /* CPU has AVX and OS supports XSAVE/XRSTORE */
 	{
-      uint64 xcrFeatureMask = xgetbv();
+      xcrFeatureMask = xgetbv();
       g_hasAVX = (xcrFeatureMask & 0x6) == 0x6;
 	}
-	g_hasAVX2 = g_hasAVX && (cpuid1[1] & (1 << 5));
-	g_hasBMI2 = g_hasSSE2 && (cpuid1[1] & (1 << 8));
 	g_hasSSE42 = g_hasSSE2 && (cpuid1[2] & (1 << 20));
 	g_hasSSE41 = g_hasSSE2 && (cpuid1[2] & (1 << 19));
 	g_hasSSSE3 = g_hasSSE2 && (cpuid1[2] & (1<<9));
@@ -336,6 +461,24 @@ void DetectX86Features()
 	}
 #endif
 
+	// structured extended features (leaf 7, sub-leaf 0) are vendor neutral
+	if (cpuid[0] >= 7 && CpuId(7, cpuid2))
+	{
+		g_hasRDSEED = (cpuid2[1] & (1 << 18)) != 0;
+		g_hasAVX2 = g_hasAVX && (cpuid2[1] & (1 <<  5)) != 0;
+		g_hasBMI2 = (cpuid2[1] & (1 <<  8)) != 0;
+		g_hasVAES = g_hasAVX2 && g_hasAESNI && (cpuid2[2] & (1 << 9)) != 0;
+		g_hasVPCLMULQDQ = g_hasAVX2 && g_hasCLMUL && (cpuid2[2] & (1 << 10)) != 0;
+
+		// AVX-512 also needs the OS to save the opmask and both halves of the ZMM registers (XCR0 bits 5-7)
+		if (g_hasAVX && (xcrFeatureMask & 0xE0) == 0xE0)
+		{
+			g_hasAVX512F = (cpuid2[1] & (1 << 16)) != 0;
+			g_hasAVX512BW = g_hasAVX512F && (cpuid2[1] & (1 << 30)) != 0;
+			g_hasAVX512VL = g_hasAVX512F && (cpuid2[1] & (1u << 31)) != 0;
+		}
+	}
+
 	if ((cpuid1[3] & (1 << 25)) != 0)
 		g_hasISSE = 1;
 	else
@@ -349,22 +492,26 @@ void DetectX86Features()
 		}
 	}
 
+	// extended features (leaf 0x80000001) are vendor neutral for RDTSCP
+	CpuId(0x80000000, cpuid2);
+	maxExtendedLeaf = cpuid2[0];
+	if (maxExtendedLeaf >= 0x80000001 && CpuId(0x80000001, cpuid2))
+	{
+		g_hasRDTSCP = (cpuid2[3] & (1 << 27)) != 0;
+		hasTopologyExtensions = (cpuid2[2] & (1 << 22)) != 0;
+	}
+	// the TSC ticks at the same rate in every P-state and C-state
+	if (maxExtendedLeaf >= 0x80000007 && CpuId(0x80000007, cpuid2))
+		g_hasInvariantTSC = (cpuid2[3] & (1 << 8)) != 0;
+
 	if (IsIntel(cpuid))
 	{
 		g_isIntel = 1;
 		g_isP4 = ((cpuid1[0] >> 8) & 0xf) == 0xf;
 		g_cacheLineSize = 8 * GETBYTE(cpuid1[1], 1);
 		g_hasRDRAND = (cpuid1[2] & (1 << 30)) != 0;
-
-		if (cpuid[0] >= 7)
-		{
-			if (CpuId(7, cpuid2))
-			{
-				g_hasRDSEED = (cpuid2[1] & (1 << 18)) != 0;
-				g_hasAVX2 = (cpuid2[1] & (1 <<  5)) != 0;
-				g_hasBMI2 = (cpuid2[1] & (1 <<  8)) != 0;
-			}
-		}
+		if (cpuid[0] >= 4)
+			DetectCaches(4);
 	}
 	else if (IsAMD(cpuid) || IsHygon(cpuid))
 	{
@@ -372,17 +519,22 @@ void DetectX86Features()
 		CpuId(0x80000005, cpuid);
 		g_cacheLineSize = GETBYTE(cpuid[2], 0);
 		g_hasRDRAND = (cpuid1[2] & (1 << 30)) != 0;
-
-		if (cpuid[0]  >= 7)
+		if (hasTopologyExtensions && maxExtendedLeaf >= 0x8000001D)
+			DetectCaches(0x8000001D);
+		else
 		{
-			if (CpuId(7, cpuid2))
+			// legacy descriptors: L1d in KB, L2 in KB, L3 in 512KB units; ways of L2 and L3 not decoded
+			AddCache(1, CPU_CACHE_DATA, (cpuid[2] >> 24) * 1024, GETBYTE(cpuid[2], 0), GETBYTE(cpuid[2], 2), 1);
+			if (maxExtendedLeaf >= 0x80000006 && CpuId(0x80000006, cpuid))
 			{
-				g_hasRDSEED = (cpuid2[1] & (1 << 18)) != 0;
-				g_hasAVX2 = (cpuid2[1] & (1 <<  5)) != 0;
-				g_hasBMI2 = (cpuid2[1] & (1 <<  8)) != 0;
+				AddCache(2, CPU_CACHE_UNIFIED, (cpuid[2] >> 16) * 1024, GETBYTE(cpuid[2], 0), 0, 0);
+				if (cpuid[3] >> 18)
+					AddCache(3, CPU_CACHE_UNIFIED, (cpuid[3] >> 18) * 512 * 1024, GETBYTE(cpuid[3], 0), 0, 0);
 			}
 		}
 	}
+	DetectCpuidTopology(maxLeaf, maxExtendedLeaf, hasTopologyExtensions, cpuid1);
+	SetCacheSizes();
 #if defined(_MSC_VER) && !defined(_UEFI)
 	/* Add check fur buggy RDRAND (AMD Ryzen case) even if we always use RDSEED instead of RDRAND when RDSEED available */
 	if (g_hasRDRAND)
@@ -416,4 +568,369 @@ void DetectX86Features()
 	*((volatile int*)&g_x86DetectionDone) = 1;
 }
 
+// Merges a cache the OS reports with the CPUID one of the same level and type.
+// The OS is right when they differ, hypervisors often forward host values.
+static void MergeOsCache(uint32 level, uint32 type, uint32 size, uint32 lineSize, uint32 ways, uint32 sharedBy)
+{
+	uint32 i;
+
+	for (i = 0; i < g_cpuTopology.cacheCount; i++)
+	{
+		CPU_CACHE_INFO* cache = &g_cpuTopology.caches[i];
+
+		if (cache->level == level && cache->type == type)
+		{
+			if (cache->size != size)
+				g_cpuTopology.cacheMismatch = 1;
+			cache->size = size;
+			if (lineSize)
+				cache->lineSize = lineSize;
+			if (ways)
+				cache->ways = ways;
+			cache->sharedBy = sharedBy;
+			return;
+		}
+	}
+	g_cpuTopology.cacheMismatch = 1;
+	AddCache(level, type, size, lineSize, ways, sharedBy);
+}
+
+#if defined(__linux__)
+
+static int ReadSysfs(const char* path, char* buf, int len)
+{
+	FILE* f = fopen(path, "r");
+	int ok;
+
+	if (!f)
+		return 0;
+	ok = fgets(buf, len, f) != NULL;
+	fclose(f);
+	return ok;
+}
+
+static int ReadSysfsValue(const char* path, uint32* value)
+{
+	char buf[64];
+
+	if (!ReadSysfs(path, buf, sizeof(buf)))
+		return 0;
+	*value = (uint32) strtoul(buf, NULL, 10);
+	return 1;
+}
+
+// processor numbers of a sysfs list such as "0-3,8,10-11"; returns how many there are
+static uint32 ParseCpuList(const char* list, uint32* cpus, uint32 max)
+{
+	uint32 count = 0, first, last;
+	char* end;
+
+	while (*list >= '0' && *list <= '9')
+	{
+		first = last = (uint32) strtoul(list, &end, 10);
+		if (*end == '-')
+			last = (uint32) strtoul(end + 1, &end, 10);
+		for (; first <= last; first++, count++)
+		{
+			if (cpus && count < max)
+				cpus[count] = first;
+		}
+		list = (*end == ',')? end + 1 : end;
+	}
+	return count;
+}
+
+static int DetectOsTopology()
+{
+	static uint32 cpus[CPU_MAX_LOGICAL];
+	char path[128], buf[4096], *end;
+	uint32 count, i, j, level, size, lineSize, ways;
+
+	if (!ReadSysfs("/sys/devices/system/cpu/online", buf, sizeof(buf)))
+		return 0;
+	count = ParseCpuList(buf, cpus, CPU_MAX_LOGICAL);
+	if (count > CPU_MAX_LOGICAL)
+		count = CPU_MAX_LOGICAL;
+
+	for (i = 0; i < count; i++)
+	{
+		CPU_LOGICAL_INFO* cpu = &g_cpuTopology.logical[i];
+
+		cpu->id = cpus[i];
+		sprintf(path, "/sys/devices/system/cpu/cpu%u/topology/physical_package_id", cpus[i]);
+		if (!ReadSysfsValue(path, &cpu->package))
+			return 0;
+		sprintf(path, "/sys/devices/system/cpu/cpu%u/topology/core_id", cpus[i]);
+		if (!ReadSysfsValue(path, &cpu->core))
+			return 0;
+		for (cpu->thread = 0, j = 0; j < i; j++)
+		{
+			if (g_cpuTopology.logical[j].package == cpu->package && g_cpuTopology.logical[j].core == cpu->core)
+				cpu->thread++;
+		}
+	}
+	g_cpuTopology.logicalCount = count;
+
+	// NUMA nodes, when the kernel has them
+	if (ReadSysfs("/sys/devices/system/node/online", buf, sizeof(buf)))
+	{
+		static uint32 nodes[CPU_MAX_NODES], nodeCpus[CPU_MAX_LOGICAL];
+		uint32 nodeCount = ParseCpuList(buf, nodes, CPU_MAX_NODES), n, k;
+
+		for (n = 0; n < nodeCount && n < CPU_MAX_NODES; n++)
+		{
+			sprintf(path, "/sys/devices/system/node/node%u/cpulist", nodes[n]);
+			if (!ReadSysfs(path, buf, sizeof(buf)))
+				continue;
+			k = ParseCpuList(buf, nodeCpus, CPU_MAX_LOGICAL);
+			for (j = 0; j < k && j < CPU_MAX_LOGICAL; j++)
+			{
+				for (i = 0; i < count; i++)
+				{
+					if (g_cpuTopology.logical[i].id == nodeCpus[j])
+						g_cpuTopology.logical[i].node = nodes[n];
+				}
+			}
+		}
+	}
+
+	// the caches of the first online processor
+	for (i = 0; i < 16; i++)
+	{
+		uint32 type;
+
+		sprintf(path, "/sys/devices/system/cpu/cpu%u/cache/index%u/type", cpus[0], i);
+		if (!ReadSysfs(path, buf, sizeof(buf)))
+			break;
+		type = (buf[0] == 'D')? CPU_CACHE_DATA : (buf[0] == 'I')? CPU_CACHE_INSTRUCTION : CPU_CACHE_UNIFIED;
+
+		sprintf(path, "/sys/devices/system/cpu/cpu%u/cache/index%u/level", cpus[0], i);
+		if (!ReadSysfsValue(path, &level))
+			continue;
+		sprintf(path, "/sys/devices/system/cpu/cpu%u/cache/index%u/size", cpus[0], i);
+		if (!ReadSysfs(path, buf, sizeof(buf)))
+			continue;
+		size = (uint32) strtoul(buf, &end, 10);
+		if (*end == 'K')
+			size *= 1024;
+		else if (*end == 'M')
+			size *= 1024 * 1024;
+
+		lineSize = ways = 0;
+		sprintf(path, "/sys/devices/system/cpu/cpu%u/cache/index%u/coherency_line_size", cpus[0], i);
+		ReadSysfsValue(path, &lineSize);
+		sprintf(path, "/sys/devices/system/cpu/cpu%u/cache/index%u/ways_of_associativity", cpus[0], i);
+		ReadSysfsValue(path, &ways);
+		sprintf(path, "/sys/devices/system/cpu/cpu%u/cache/index%u/shared_cpu_list", cpus[0], i);
+		if (!ReadSysfs(path, buf, sizeof(buf)))
+			buf[0] = 0;
+
+		MergeOsCache(level, type, size, lineSize, ways, ParseCpuList(buf, NULL, 0));
+	}
+	return 1;
+}
+
+#elif defined(_WIN32) && !defined(TC_WINDOWS_DRIVER) && !defined(_UEFI)
+
+static uint32 CountBits(ULONG_PTR mask)
+{
+	uint32 n = 0;
+
+	for (; mask; mask &= mask - 1)
+		n++;
+	return n;
+}
+
+// the processors of the current processor group, at most 64
+static int DetectOsTopology()
+{
+	SYSTEM_LOGICAL_PROCESSOR_INFORMATION* info;
+	DWORD len = 0, i, count;
+	uint32 package[64] = {0}, core[64] = {0}, thread[64] = {0}, node[64] = {0}, packages = 0, cores = 0, bit, n;
+	ULONG_PTR present = 0;
+
+	if (GetLogicalProcessorInformation(NULL, &len) || GetLastError() != ERROR_INSUFFICIENT_BUFFER)
+		return 0;
+	info = (SYSTEM_LOGICAL_PROCESSOR_INFORMATION*) malloc(len);
+	if (!info)
+		return 0;
+	if (!GetLogicalProcessorInformation(info, &len))
+	{
+		free(info);
+		return 0;
+	}
+	count = len / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION);
+
+	for (i = 0; i < count; i++)
+	{
+		const ULONG_PTR mask = info[i].ProcessorMask;
+
+		switch (info[i].Relationship)
+		{
+		case RelationProcessorPackage:
+			for (bit = 0; bit < 8 * sizeof(ULONG_PTR); bit++)
+			{
+				if (mask & ((ULONG_PTR) 1 << bit))
+					package[bit] = packages;
+			}
+			packages++;
+			break;
+
+		case RelationProcessorCore:
+			for (bit = 0, n = 0; bit < 8 * sizeof(ULONG_PTR); bit++)
+			{
+				if (mask & ((ULONG_PTR) 1 << bit))
+				{
+					core[bit] = cores;
+					thread[bit] = n++;
+				}
+			}
+			present |= mask;
+			cores++;
+			break;
+
+		case RelationNumaNode:
+			for (bit = 0; bit < 8 * sizeof(ULONG_PTR); bit++)
+			{
+				if (mask & ((ULONG_PTR) 1 << bit))
+					node[bit] = info[i].NumaNode.NodeNumber;
+			}
+			break;
+
+		case RelationCache:
+			if (info[i].Cache.Type != CacheTrace)
+			{
+				const uint32 type = (info[i].Cache.Type == CacheData)? CPU_CACHE_DATA : (info[i].Cache.Type == CacheInstruction)? CPU_CACHE_INSTRUCTION : CPU_CACHE_UNIFIED;
+				MergeOsCache(info[i].Cache.Level, type, info[i].Cache.Size, info[i].Cache.LineSize, info[i].Cache.Associativity, CountBits(mask));
+			}
+			break;
+
+		default:
+			break;
+		}
+	}
+	free(info);
+
+	for (bit = 0, n = 0; bit < 8 * sizeof(ULONG_PTR) && n < CPU_MAX_LOGICAL; bit++)
+	{
+		if (present & ((ULONG_PTR) 1 << bit))
+		{
+			g_cpuTopology.logical[n].id = bit;
+			g_cpuTopology.logical[n].package = package[bit];
+			g_cpuTopology.logical[n].core = core[bit];
+			g_cpuTopology.logical[n].thread = thread[bit];
+			g_cpuTopology.logical[n].node = node[bit];
+			n++;
+		}
+	}
+	g_cpuTopology.logicalCount = n;
+	return n != 0;
+}
+
+#else
+
+static int DetectOsTopology()
+{
+	return 0;
+}
+
+#endif
+
+const CPU_TOPOLOGY* GetCpuTopology()
+{
+	uint32 i, j;
+
+	if (g_cpuTopologyDone)
+		return &g_cpuTopology;
+	if (!g_x86DetectionDone)
+		DetectX86Features();
+
+	g_cpuTopology.osTopology = DetectOsTopology();
+	if (!g_cpuTopology.osTopology)
+	{
+		// one package laid out as CPUID describes it
+		g_cpuTopology.logicalCount = (g_cpuTopology.logicalPerPackage < CPU_MAX_LOGICAL)? g_cpuTopology.logicalPerPackage : CPU_MAX_LOGICAL;
+		for (i = 0; i < g_cpuTopology.logicalCount; i++)
+		{
+			g_cpuTopology.logical[i].id = i;
+			g_cpuTopology.logical[i].package = 0;
+			g_cpuTopology.logical[i].core = i / g_cpuTopology.threadsPerCore;
+			g_cpuTopology.logical[i].thread = i % g_cpuTopology.threadsPerCore;
+			g_cpuTopology.logical[i].node = 0;
+		}
+	}
+
+	// counts of what the OS runs on, rather than of what CPUID can address
+	g_cpuTopology.packageCount = g_cpuTopology.nodeCount = g_cpuTopology.coreCount = 0;
+	g_cpuTopology.threadsPerCore = 1;
+	for (i = 0; i < g_cpuTopology.logicalCount; i++)
+	{
+		const CPU_LOGICAL_INFO* cpu = &g_cpuTopology.logical[i];
+
+		if (cpu->thread == 0)
+			g_cpuTopology.coreCount++;
+		if (cpu->thread + 1 > g_cpuTopology.threadsPerCore)
+			g_cpuTopology.threadsPerCore = cpu->thread + 1;
+		for (j = 0; j < i && g_cpuTopology.logical[j].package != cpu->package; j++)
+			;
+		if (j == i)
+			g_cpuTopology.packageCount++;
+		for (j = 0; j < i && g_cpuTopology.logical[j].node != cpu->node; j++)
+			;
+		if (j == i)
+			g_cpuTopology.nodeCount++;
+	}
+	if (g_cpuTopology.osTopology && g_cpuTopology.packageCount)
+		g_cpuTopology.logicalPerPackage = g_cpuTopology.logicalCount / g_cpuTopology.packageCount;
+
+	SetCacheSizes();
+	*((volatile int*)&g_cpuTopologyDone) = 1;
+	return &g_cpuTopology;
+}
+
+// first threads of the cores, package by package, then their SMT siblings
+static int CompareSpreadOrder(const void* a, const void* b)
+{
+	const CPU_LOGICAL_INFO* x = (const CPU_LOGICAL_INFO*) a;
+	const CPU_LOGICAL_INFO* y = (const CPU_LOGICAL_INFO*) b;
+
+	if (x->thread != y->thread)
+		return (x->thread < y->thread)? -1 : 1;
+	if (x->package != y->package)
+		return (x->package < y->package)? -1 : 1;
+	if (x->core != y->core)
+		return (x->core < y->core)? -1 : 1;
+	return (x->id < y->id)? -1 : (x->id > y->id);
+}
+
+// of the processors of node, or of all of them for CPU_ANY_NODE
+static uint32 SpreadOrder(uint32 node, uint32* ids, uint32 max)
+{
+	CPU_LOGICAL_INFO order[CPU_MAX_LOGICAL];
+	const CPU_TOPOLOGY* topology = GetCpuTopology();
+	uint32 count = 0, i;
+
+	for (i = 0; i < topology->logicalCount; i++)
+	{
+		if (node == CPU_ANY_NODE || topology->logical[i].node == node)
+			order[count++] = topology->logical[i];
+	}
+	qsort(order, count, sizeof(CPU_LOGICAL_INFO), CompareSpreadOrder);
+	if (count > max)
+		count = max;
+	for (i = 0; i < count; i++)
+		ids[i] = order[i].id;
+	return count;
+}
+
+uint32 GetCpuSpreadOrder(uint32* ids, uint32 max)
+{
+	return SpreadOrder(CPU_ANY_NODE, ids, max);
+}
+
+uint32 GetCpuNodeOrder(uint32 node, uint32* ids, uint32 max)
+{
+	return SpreadOrder(node, ids, max);
+}
+
 #endif
@@ -113,6 +113,10 @@ extern __m128i _mm_aesdeclast_si128(__m128i v, __m128i rkey);
 #include <wmmintrin.h>
 #endif
 #endif
+
+#if CRYPTOPP_BOOL_VAES_INTRINSICS_AVAILABLE
+#include <immintrin.h>
+#endif
 #endif
 
 #if CRYPTOPP_BOOL_X86 || CRYPTOPP_BOOL_X32 || CRYPTOPP_BOOL_X64
@@ -129,13 +133,81 @@ extern int g_hasSSE41;
 extern int g_hasSSSE3;
 extern int g_hasAESNI;
 extern int g_hasCLMUL;
+extern int g_hasVAES;
+extern int g_hasVPCLMULQDQ;
+extern int g_hasAVX512F;
+extern int g_hasAVX512VL;
+extern int g_hasAVX512BW;
 extern int g_isP4;
 extern int g_isIntel;
 extern int g_isAMD;
 extern uint32 g_cacheLineSize;
+extern uint32 g_l1dCacheSize, g_l2CacheSize, g_l3CacheSize;	// bytes, 0 if not reported
 extern int g_hasSHA;
+extern int g_hasRDTSCP;
+extern int g_hasInvariantTSC;
 void DetectX86Features(); // must be called at the start of the program/driver
 int CpuId(uint32 func, uint32 output[4]);
+int CpuIdEx(uint32 func, uint32 subfunc, uint32 output[4]);
+
+// cache types, as CPUID leaf 4 encodes them
+#define CPU_CACHE_DATA			1
+#define CPU_CACHE_INSTRUCTION	2
+#define CPU_CACHE_UNIFIED		3
+
+#define CPU_MAX_CACHES		8
+#define CPU_MAX_LOGICAL		512
+#define CPU_MAX_NODES		64
+#define CPU_ANY_NODE		0xFFFFFFFF
+
+typedef struct
+{
+	uint32 level;		// 1 to 3
+	uint32 type;		// CPU_CACHE_DATA, CPU_CACHE_INSTRUCTION or CPU_CACHE_UNIFIED
+	uint32 size;		// bytes
+	uint32 lineSize;
+	uint32 ways;		// 0 if not reported
+	uint32 sharedBy;	// logical processors sharing one instance, 0 if not reported
+} CPU_CACHE_INFO;
+
+typedef struct
+{
+	uint32 id;			// processor number of the OS, as thread affinity takes it
+	uint32 package;		// physical package (socket)
+	uint32 core;		// core, unique within its package
+	uint32 thread;		// SMT sibling of the core, 0 for the first
+	uint32 node;		// NUMA node, 0 when the OS reports none
+} CPU_LOGICAL_INFO;
+
+typedef struct
+{
+	CPU_CACHE_INFO caches[CPU_MAX_CACHES];
+	uint32 cacheCount;
+	uint32 packageCount;
+	uint32 nodeCount;
+	uint32 coreCount;
+	uint32 threadsPerCore;
+	uint32 logicalPerPackage;
+	uint32 logicalCount;
+	CPU_LOGICAL_INFO logical[CPU_MAX_LOGICAL];	// the logical processors online, by processor number
+	int osTopology;		// logical[] comes from the OS, else it is extrapolated from CPUID for one package
+	int cacheMismatch;	// the OS reports other caches than CPUID, its values were kept
+} CPU_TOPOLOGY;
+
+// Caches and layout of the logical processors: CPUID leaves 4 or 0x8000001D and
+// 0x1F or 0xB, cross-checked against /sys/devices/system/cpu on Linux and
+// GetLogicalProcessorInformation on Windows, which also give the NUMA nodes
+// (/sys/devices/system/node on Linux). The first call detects them, and
+// updates GetL1DCacheSize() and the like with the OS values; make it at startup.
+const CPU_TOPOLOGY* GetCpuTopology();
+
+// Processor numbers in the order to spread threads over them: the first thread
+// of every core, package by package, then the SMT siblings. Returns how many
+// of the logicalCount processors were written to ids, at most max.
+uint32 GetCpuSpreadOrder(uint32* ids, uint32 max);
+
+// The same order, restricted to the processors of NUMA node node
+uint32 GetCpuNodeOrder(uint32 node, uint32* ids, uint32 max);
 
 #if CRYPTOPP_BOOL_X64
 #define HasSSE2()	1
@@ -161,12 +233,25 @@ extern int g_hasMMX;
 #define HasSSSE3() g_hasSSSE3
 #define HasAESNI() g_hasAESNI
 #define HasCLMUL() g_hasCLMUL
+#define HasVAES() g_hasVAES
+#define HasVPCLMULQDQ() g_hasVPCLMULQDQ
+#define HasAVX512F() g_hasAVX512F
+#define HasAVX512VL() g_hasAVX512VL
+#define HasAVX512BW() g_hasAVX512BW
+#define HasRDTSCP() g_hasRDTSCP
+#define HasInvariantTSC() g_hasInvariantTSC
 #define IsP4() g_isP4
 #define GetCacheLineSize() g_cacheLineSize
+#define GetL1DCacheSize() g_l1dCacheSize
+#define GetL2CacheSize() g_l2CacheSize
+#define GetL3CacheSize() g_l3CacheSize
 
 #else
 
 #define GetCacheLineSize()	CRYPTOPP_L1_CACHE_LINE_SIZE
+#define GetL1DCacheSize()	0
+#define GetL2CacheSize()	0
+#define GetL3CacheSize()	0
 
 #endif
 
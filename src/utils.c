@@ -1,3 +1,8 @@
+/* for pthread_setaffinity_np */
+#if !defined(_WIN32) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #include "utils.h"
 
 #ifdef _WIN32
@@ -62,6 +67,450 @@ void timersub(const struct timeval* tvp, const struct timeval* uvp, struct timev
   }
 }
 
+typedef struct
+{
+    THREAD_ROUTINE routine;
+    void* param;
+} THREAD_START;
+
+static DWORD WINAPI ThreadStart(LPVOID param)
+{
+    THREAD_START start = *(THREAD_START*) param;
+
+    free(param);
+    start.routine(start.param);
+    return 0;
+}
+
+int StartThread(THREAD_HANDLE* thread, THREAD_ROUTINE routine, void* param)
+{
+    THREAD_START* start = (THREAD_START*) malloc(sizeof(THREAD_START));
+
+    if (!start)
+        return 0;
+    start->routine = routine;
+    start->param = param;
+    *thread = CreateThread(NULL, 0, ThreadStart, start, 0, NULL);
+    if (!*thread)
+    {
+        free(start);
+        return 0;
+    }
+    return 1;
+}
+
+void JoinThread(THREAD_HANDLE thread)
+{
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+/* processors of the calling thread's group, which is where the topology comes from */
+int PinThread(unsigned int cpu)
+{
+    if (cpu >= 8 * sizeof(DWORD_PTR))
+        return 0;
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR) 1 << cpu) != 0;
+}
+
+/* there is no GetThreadAffinityMask: SetThreadAffinityMask returns the previous mask */
+int SaveThreadAffinity(THREAD_AFFINITY* affinity)
+{
+    DWORD_PTR processMask, systemMask;
+
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask))
+        return 0;
+    *affinity = SetThreadAffinityMask(GetCurrentThread(), processMask);
+    if (!*affinity)
+        return 0;
+    SetThreadAffinityMask(GetCurrentThread(), *affinity);
+    return 1;
+}
+
+void RestoreThreadAffinity(const THREAD_AFFINITY* affinity)
+{
+    SetThreadAffinityMask(GetCurrentThread(), *affinity);
+}
+
+int InitSemaphore(SEMAPHORE* semaphore)
+{
+    *semaphore = CreateSemaphore(NULL, 0, 0x7FFFFFFF, NULL);
+    return *semaphore != NULL;
+}
+
+void PostSemaphore(SEMAPHORE* semaphore, unsigned int count)
+{
+    if (count)
+        ReleaseSemaphore(*semaphore, (LONG) count, NULL);
+}
+
+void WaitSemaphore(SEMAPHORE* semaphore)
+{
+    WaitForSingleObject(*semaphore, INFINITE);
+}
+
+void FreeSemaphore(SEMAPHORE* semaphore)
+{
+    CloseHandle(*semaphore);
+}
+
+/* large pages need SeLockMemoryPrivilege, which an administrator grants to the account */
+static int EnableLockMemoryPrivilege(void)
+{
+    HANDLE token;
+    TOKEN_PRIVILEGES tp;
+    int ok;
+
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token))
+        return 0;
+    tp.PrivilegeCount = 1;
+    tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+    ok = LookupPrivilegeValue(NULL, SE_LOCK_MEMORY_NAME, &tp.Privileges[0].Luid)
+        && AdjustTokenPrivileges(token, FALSE, &tp, 0, NULL, NULL)
+        && GetLastError() == ERROR_SUCCESS;
+    CloseHandle(token);
+    return ok;
+}
+
+/* grows or shrinks the working set by delta bytes, for VirtualLock */
+static void AdjustWorkingSet(SIZE_T delta, int grow)
+{
+    SIZE_T minSize, maxSize;
+
+    if (GetProcessWorkingSetSize(GetCurrentProcess(), &minSize, &maxSize))
+    {
+        if (grow)
+            SetProcessWorkingSetSize(GetCurrentProcess(), minSize + delta, maxSize + delta);
+        else if (minSize > delta && maxSize > delta)
+            SetProcessWorkingSetSize(GetCurrentProcess(), minSize - delta, maxSize - delta);
+    }
+}
+
+void* AllocatePages(size_t len, int pages, PAGES_INFO* info)
+{
+    const SIZE_T largePage = GetLargePageMinimum();
+    SYSTEM_INFO si;
+    void* p;
+
+    memset(info, 0, sizeof(PAGES_INFO));
+    if (pages == PAGES_HUGE && largePage && EnableLockMemoryPrivilege())
+    {
+        info->mappedLen = (len + largePage - 1) / largePage * largePage;
+        p = VirtualAlloc(NULL, info->mappedLen, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if (p)
+        {
+            /* large pages are never paged out */
+            info->pageSize = largePage;
+            info->hugeBytes = info->mappedLen;
+            info->source = "MEM_LARGE_PAGES";
+            info->locked = 1;
+            memset(p, 0, info->mappedLen);
+            return p;
+        }
+    }
+
+    GetSystemInfo(&si);
+    info->pageSize = si.dwPageSize;
+    info->mappedLen = (len + info->pageSize - 1) / info->pageSize * info->pageSize;
+    info->source = (pages == PAGES_HUGE)? "VirtualAlloc, large pages need SeLockMemoryPrivilege" : "VirtualAlloc";
+    p = VirtualAlloc(NULL, info->mappedLen, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (!p)
+        return NULL;
+    memset(p, 0, info->mappedLen);
+
+    AdjustWorkingSet(info->mappedLen, 1);
+    info->locked = VirtualLock(p, info->mappedLen) != 0;
+    if (!info->locked)
+        AdjustWorkingSet(info->mappedLen, 0);
+    return p;
+}
+
+void FreePages(void* buffer, const PAGES_INFO* info)
+{
+    if (info->locked && !info->hugeBytes)
+    {
+        VirtualUnlock(buffer, info->mappedLen);
+        AdjustWorkingSet(info->mappedLen, 0);
+    }
+    VirtualFree(buffer, 0, MEM_RELEASE);
+}
+
+#else
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/select.h>
+
+#define HUGE_PAGE_2MB ((size_t) 2 << 20)
+#define HUGE_PAGE_1GB ((size_t) 1 << 30)
+
+int QueryPerformanceFrequency(LARGE_INTEGER* frequency)
+{
+    frequency->QuadPart = 1000000000;
+    return 1;
+}
+
+int QueryPerformanceCounter(LARGE_INTEGER* count)
+{
+    struct timespec ts;
+
+    /* not slewed by NTP, unlike CLOCK_MONOTONIC */
+    if (clock_gettime(CLOCK_MONOTONIC_RAW, &ts) != 0)
+        return 0;
+    count->QuadPart = (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+    return 1;
+}
+
+BOOLEAN RtlGenRandom(PVOID buffer, ULONG length)
+{
+    unsigned char* p = (unsigned char*) buffer;
+
+    while (length)
+    {
+        ssize_t n = getrandom(p, length, 0);
+
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return 0;
+        }
+        p += n;
+        length -= (ULONG) n;
+    }
+    return 1;
+}
+
+void* _aligned_malloc(size_t size, size_t alignment)
+{
+    void* p;
+
+    return posix_memalign(&p, alignment, size)? NULL : p;
+}
+
+/* a key was pressed, or stdin is not a terminal that could ever deliver one */
+int _kbhit(void)
+{
+    fd_set fds;
+    struct timeval tv = {0, 0};
+
+    if (!isatty(STDIN_FILENO))
+        return 1;
+    FD_ZERO(&fds);
+    FD_SET(STDIN_FILENO, &fds);
+    return select(STDIN_FILENO + 1, &fds, NULL, NULL, &tv) > 0;
+}
+
+typedef struct
+{
+    THREAD_ROUTINE routine;
+    void* param;
+} THREAD_START;
+
+static void* ThreadStart(void* param)
+{
+    THREAD_START start = *(THREAD_START*) param;
+
+    free(param);
+    start.routine(start.param);
+    return NULL;
+}
+
+int StartThread(THREAD_HANDLE* thread, THREAD_ROUTINE routine, void* param)
+{
+    THREAD_START* start = (THREAD_START*) malloc(sizeof(THREAD_START));
+
+    if (!start)
+        return 0;
+    start->routine = routine;
+    start->param = param;
+    if (pthread_create(thread, NULL, ThreadStart, start) != 0)
+    {
+        free(start);
+        return 0;
+    }
+    return 1;
+}
+
+void JoinThread(THREAD_HANDLE thread)
+{
+    pthread_join(thread, NULL);
+}
+
+int PinThread(unsigned int cpu)
+{
+#if defined(__linux__)
+    cpu_set_t set;
+
+    if (cpu >= CPU_SETSIZE)
+        return 0;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void) cpu;
+    return 0;
+#endif
+}
+
+int SaveThreadAffinity(THREAD_AFFINITY* affinity)
+{
+#if defined(__linux__)
+    if (sizeof(THREAD_AFFINITY) < sizeof(cpu_set_t))
+        return 0;
+    return pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), (cpu_set_t*) affinity) == 0;
+#else
+    (void) affinity;
+    return 0;
+#endif
+}
+
+void RestoreThreadAffinity(const THREAD_AFFINITY* affinity)
+{
+#if defined(__linux__)
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), (const cpu_set_t*) affinity);
+#else
+    (void) affinity;
+#endif
+}
+
+int InitSemaphore(SEMAPHORE* semaphore)
+{
+    return sem_init(semaphore, 0, 0) == 0;
+}
+
+void PostSemaphore(SEMAPHORE* semaphore, unsigned int count)
+{
+    while (count--)
+        sem_post(semaphore);
+}
+
+void WaitSemaphore(SEMAPHORE* semaphore)
+{
+    while (sem_wait(semaphore) != 0 && errno == EINTR)
+        ;
+}
+
+void FreeSemaphore(SEMAPHORE* semaphore)
+{
+    sem_destroy(semaphore);
+}
+
+/* bytes of the mapping holding p that are on transparent huge pages */
+static size_t TransparentHugeBytes(const void* p)
+{
+    size_t bytes = 0;
+#if defined(__linux__)
+    FILE* f = fopen("/proc/self/smaps", "r");
+    char line[256];
+    unsigned long start, end, kb;
+    int inside = 0;
+
+    if (!f)
+        return 0;
+    while (fgets(line, sizeof(line), f))
+    {
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2)
+            inside = (unsigned long) p >= start && (unsigned long) p < end;
+        else if (inside && sscanf(line, "AnonHugePages: %lu kB", &kb) == 1)
+        {
+            bytes = (size_t) kb * 1024;
+            break;
+        }
+    }
+    fclose(f);
+#else
+    (void) p;
+#endif
+    return bytes;
+}
+
+/* anonymous mapping of len bytes, or MAP_FAILED */
+static unsigned char* MapPages(size_t len, int flags)
+{
+    return (unsigned char*) mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+}
+
+void* AllocatePages(size_t len, int pages, PAGES_INFO* info)
+{
+    const size_t pageSize = (size_t) sysconf(_SC_PAGESIZE);
+    unsigned char* p = (unsigned char*) MAP_FAILED;
+    unsigned char* q;
+
+    memset(info, 0, sizeof(PAGES_INFO));
+
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_SHIFT)
+    /* explicit huge pages, only there if the administrator set some aside
+       (vm.nr_hugepages, or hugepagesz= and hugepages= at boot) */
+    if (pages == PAGES_HUGE && len >= HUGE_PAGE_1GB)
+    {
+        info->mappedLen = (len + HUGE_PAGE_1GB - 1) & ~(HUGE_PAGE_1GB - 1);
+        info->pageSize = HUGE_PAGE_1GB;
+        p = MapPages(info->mappedLen, MAP_HUGETLB | (30 << MAP_HUGE_SHIFT));
+    }
+    if (pages == PAGES_HUGE && p == MAP_FAILED)
+    {
+        info->mappedLen = (len + HUGE_PAGE_2MB - 1) & ~(HUGE_PAGE_2MB - 1);
+        info->pageSize = HUGE_PAGE_2MB;
+        p = MapPages(info->mappedLen, MAP_HUGETLB | (21 << MAP_HUGE_SHIFT));
+    }
+    if (p != MAP_FAILED)
+    {
+        info->hugeBytes = info->mappedLen;
+        info->source = "MAP_HUGETLB";
+    }
+#endif
+
+    if (pages == PAGES_HUGE && p == MAP_FAILED)
+    {
+        /* transparent huge pages: a 2MB-aligned range the kernel is asked to back with them */
+        info->mappedLen = (len + HUGE_PAGE_2MB - 1) & ~(HUGE_PAGE_2MB - 1);
+        info->pageSize = HUGE_PAGE_2MB;
+        info->source = "transparent huge pages";
+        q = MapPages(info->mappedLen + HUGE_PAGE_2MB, 0);
+        if (q == MAP_FAILED)
+            return NULL;
+        p = (unsigned char*) (((size_t) q + HUGE_PAGE_2MB - 1) & ~(HUGE_PAGE_2MB - 1));
+        if (p != q)
+            munmap(q, p - q);
+        munmap(p + info->mappedLen, q + HUGE_PAGE_2MB - p);
+#if defined(MADV_HUGEPAGE)
+        madvise(p, info->mappedLen, MADV_HUGEPAGE);
+#endif
+    }
+    else if (p == MAP_FAILED)
+    {
+        info->mappedLen = (len + pageSize - 1) & ~(pageSize - 1);
+        info->pageSize = pageSize;
+        info->source = "mmap";
+        p = MapPages(info->mappedLen, 0);
+        if (p == MAP_FAILED)
+            return NULL;
+#if defined(MADV_NOHUGEPAGE)
+        madvise(p, info->mappedLen, MADV_NOHUGEPAGE);
+#endif
+    }
+
+    memset(p, 0, info->mappedLen);
+    info->locked = mlock(p, info->mappedLen) == 0;
+    if (!info->hugeBytes && info->pageSize != pageSize)
+    {
+        /* the kernel may have backed only part of the range, or none of it */
+        info->hugeBytes = TransparentHugeBytes(p);
+        if (info->hugeBytes > info->mappedLen)
+            info->hugeBytes = info->mappedLen;
+    }
+    return p;
+}
+
+void FreePages(void* buffer, const PAGES_INFO* info)
+{
+    munmap(buffer, info->mappedLen);
+}
+
 #endif
 
 unsigned char HexCharToByte (char c)
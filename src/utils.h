@@ -57,6 +57,9 @@ void timersub(const struct timeval* tvp, const struct timeval* uvp, struct timev
 #else
 #include <err.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <time.h>
 #include <sysexits.h>
 #include <unistd.h>
 
@@ -64,6 +67,44 @@ void timersub(const struct timeval* tvp, const struct timeval* uvp, struct timev
 #include <sys/resource.h>
 #include <sys/time.h>
 #include <sys/types.h>
+
+#include <pthread.h>
+#include <semaphore.h>
+
+/* The Windows calls of the benchmark: time from CLOCK_MONOTONIC_RAW in
+   nanoseconds, random data from getrandom */
+
+#define __cdecl
+#define NTAPI
+
+typedef unsigned char BOOLEAN;
+typedef void* PVOID;
+typedef unsigned long ULONG;
+
+typedef union
+{
+    int64_t QuadPart;
+} LARGE_INTEGER;
+
+#if defined(__cplusplus)
+extern "C"
+{
+#endif
+
+int QueryPerformanceFrequency(LARGE_INTEGER* frequency);
+int QueryPerformanceCounter(LARGE_INTEGER* count);
+BOOLEAN RtlGenRandom(PVOID buffer, ULONG length);
+void* _aligned_malloc(size_t size, size_t alignment);
+int _kbhit(void);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#define _aligned_free free
+#define _stricmp strcasecmp
+#define Sleep(ms) usleep((ms) * 1000)
+
 #endif
 
 #if defined(__cplusplus)
@@ -71,6 +112,59 @@ extern "C"
 {
 #endif
 
+/* Threads of the benchmarks and of the parallel engine */
+#ifdef _WIN32
+typedef HANDLE THREAD_HANDLE;
+typedef HANDLE SEMAPHORE;
+typedef DWORD_PTR THREAD_AFFINITY;
+#else
+typedef pthread_t THREAD_HANDLE;
+typedef sem_t SEMAPHORE;
+typedef struct { unsigned long bits[1024 / (8 * sizeof (unsigned long))]; } THREAD_AFFINITY;	/* a cpu_set_t */
+#endif
+
+typedef void (*THREAD_ROUTINE) (void* param);
+
+/* Runs routine (param) on a new thread; 0 if it could not be created */
+int StartThread (THREAD_HANDLE* thread, THREAD_ROUTINE routine, void* param);
+
+/* Waits for the thread to return and releases it */
+void JoinThread (THREAD_HANDLE thread);
+
+/* Restricts the calling thread to logical processor cpu, numbered as the OS
+   numbers them (CPU_LOGICAL_INFO.id); 0 if it cannot be pinned */
+int PinThread (unsigned int cpu);
+
+/* Saves the processors the calling thread may run on, for RestoreThreadAffinity
+   to undo PinThread; 0 if they cannot be read */
+int SaveThreadAffinity (THREAD_AFFINITY* affinity);
+void RestoreThreadAffinity (const THREAD_AFFINITY* affinity);
+
+/* Counting semaphore, initially 0, for threads to sleep on; 0 if it could not be created */
+int InitSemaphore (SEMAPHORE* semaphore);
+void PostSemaphore (SEMAPHORE* semaphore, unsigned int count);
+void WaitSemaphore (SEMAPHORE* semaphore);
+void FreeSemaphore (SEMAPHORE* semaphore);
+
+/* Benchmark buffers, on pages of a chosen size */
+#define PAGES_SMALL		0	/* 4KB pages, transparent huge pages turned off for them */
+#define PAGES_HUGE		1	/* 1GB or 2MB pages where the OS has some set aside, else transparent huge pages */
+
+typedef struct
+{
+	size_t pageSize;		/* of the pages obtained */
+	size_t hugeBytes;		/* bytes on huge pages, which the OS may only grant in part */
+	size_t mappedLen;		/* len rounded up to whole pages */
+	const char* source;		/* how the pages were obtained, for reporting */
+	int locked;				/* locked in memory */
+} PAGES_INFO;
+
+/* len bytes on fresh pages, all faulted in by writing zeros and then locked
+   in memory where the OS allows it, so that no page fault nor TLB miss on a
+   page not mapped yet disturbs a measurement. NULL if it cannot be allocated. */
+void* AllocatePages (size_t len, int pages, PAGES_INFO* info);
+void FreePages (void* buffer, const PAGES_INFO* info);
+
 unsigned char HexCharToByte (char c);
 unsigned long HexStringToByteArray(const char* hexStr, unsigned char* pbData);
 